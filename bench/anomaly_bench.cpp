@@ -0,0 +1,79 @@
+// Microbenchmark: cost of the anomaly detection stage per sample, with every
+// series watched by a z-score and a quantile rule. Also checks the quantile
+// sketch against an exact answer and that an injected spike fires.
+//
+//   ./build/anomaly_bench [series] [samples]
+
+#include "anomaly.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+int main(int argc, char* argv[]) {
+    size_t series_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500;
+    size_t samples = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20000;
+
+    // Same shape as the monitor's dynamic names
+    std::vector<std::string> names;
+    for (size_t i = 0; i < series_count; i++) {
+        names.push_back("cgroup./system.slice/service-" + std::to_string(i) + ".service.cpu_percent");
+    }
+
+    AnomalyConfig config;
+    AlertRule rule;
+    parseAlertRule("cgroup.*.cpu_percent:z>6/3", rule);
+    config.rules.push_back(rule);
+    parseAlertRule("cgroup.*.cpu_percent:q>3", rule);
+    config.rules.push_back(rule);
+    config.log_path = "/dev/null";
+    AnomalyDetector detector(config);
+
+    std::mt19937_64 rng(42);
+    std::normal_distribution<double> noise(50.0, 5.0);
+    std::vector<double> values(series_count * 64);
+    for (auto& v : values) v = noise(rng);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < samples; s++) {
+        detector.beginSample(int64_t(s) * 100);
+        const double* row = &values[(s % 64) * series_count];
+        for (size_t i = 0; i < series_count; i++) {
+            // A spike on series 0 for a while in the middle of the run
+            double spike = (i == 0 && s >= samples / 2 && s < samples / 2 + 10) ? 500.0 : 0.0;
+            detector.observe(names[i], row[i] + spike);
+        }
+        detector.endSample();
+    }
+    double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    double per_sample_us = elapsed_ns / samples / 1000.0;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "series            " << series_count << " (" << detector.watchedSeries() << " watched)" << std::endl;
+    std::cout << "per series        " << elapsed_ns / (double(samples) * series_count) << " ns" << std::endl;
+    std::cout << "per sample        " << per_sample_us << " us" << std::endl;
+    std::cout << "CPU at 100ms      " << per_sample_us / 100000.0 * 100.0 << " % of one core" << std::endl;
+
+    size_t fired = 0;
+    detector.forEachEvent([&](const AlertEvent& event) {
+        if (event.firing && event.series == names[0]) fired++;
+    });
+    std::cout << "spike alerts      " << fired << (fired > 0 ? " (ok)" : " (MISSED)") << std::endl;
+
+    // P-squared against the exact p99 of a skewed stream
+    QuantileSketch sketch(0.99);
+    std::exponential_distribution<double> skewed(1.0);
+    std::vector<double> all(200000);
+    for (auto& v : all) {
+        v = skewed(rng);
+        sketch.add(v);
+    }
+    std::nth_element(all.begin(), all.begin() + all.size() * 99 / 100, all.end());
+    double exact = all[all.size() * 99 / 100];
+    std::cout << "p99 sketch/exact  " << sketch.value() << " / " << exact << std::endl;
+    return fired > 0 ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+// Load generator for the metrics HTTP server.
+//
+// Keeps N connections busy from T epoll threads, each issuing GET requests
+// back to back, then prints requests/sec and latency percentiles. By default
+// every request opens a new connection; --keep-alive 1 reuses them.
+//
+//   ./build/http_load --port 8080 --path /metrics --connections 2000 --threads 4 --seconds 10
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string path = "/metrics";
+    int connections = 100;
+    int threads = 2;
+    int seconds = 10;
+    bool keep_alive = false;
+};
+
+struct Conn {
+    int fd = -1;
+    std::string in;
+    size_t sent = 0;
+    Clock::time_point started;
+};
+
+struct ThreadResult {
+    std::vector<uint32_t> latencies_us;
+    size_t errors = 0;
+};
+
+// Returns the size of the first full response in `in` (head + Content-Length
+// body), or 0 if it hasn't all arrived yet
+size_t responseLength(const std::string& in) {
+    size_t head_end = in.find("\r\n\r\n");
+    if (head_end == std::string::npos) {
+        return 0;
+    }
+    size_t pos = in.find("Content-Length:");
+    if (pos == std::string::npos || pos > head_end) {
+        return 0;  // no length: wait for EOF
+    }
+    size_t length = head_end + 4 + std::strtoul(in.c_str() + pos + 15, nullptr, 10);
+    return in.size() >= length ? length : 0;
+}
+
+class LoadThread {
+public:
+    LoadThread(const Options& opts, int connections, std::atomic<bool>& running)
+        : opts(opts), connection_count(connections), running(running) {
+        request = "GET " + opts.path + " HTTP/1.1\r\nHost: " + opts.host + "\r\n";
+        request += opts.keep_alive ? "\r\n" : "Connection: close\r\n\r\n";
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opts.port);
+        inet_pton(AF_INET, opts.host.c_str(), &addr.sin_addr);
+        result.latencies_us.reserve(1 << 20);
+    }
+
+    void run() {
+        epoll_fd = epoll_create1(0);
+        conns.resize(connection_count);
+        for (auto& conn : conns) {
+            open(conn);
+        }
+
+        struct epoll_event events[256];
+        while (running) {
+            int n = epoll_wait(epoll_fd, events, 256, 100);
+            for (int i = 0; i < n; i++) {
+                Conn& conn = *static_cast<Conn*>(events[i].data.ptr);
+                if (events[i].events & EPOLLOUT) {
+                    onWritable(conn);
+                } else if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    onReadable(conn);
+                }
+            }
+        }
+
+        for (auto& conn : conns) {
+            if (conn.fd != -1) close(conn.fd);
+        }
+        close(epoll_fd);
+    }
+
+    ThreadResult result;
+
+private:
+    const Options& opts;
+    int connection_count;
+    std::atomic<bool>& running;
+    std::string request;
+    struct sockaddr_in addr;
+    int epoll_fd = -1;
+    std::vector<Conn> conns;
+
+    void open(Conn& conn) {
+        conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int opt = 1;
+        setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        conn.in.clear();
+        conn.sent = 0;
+        conn.started = Clock::now();
+        if (connect(conn.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+            result.errors++;
+            close(conn.fd);
+            conn.fd = -1;
+            return;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLOUT;
+        ev.data.ptr = &conn;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.fd, &ev);
+    }
+
+    void fail(Conn& conn) {
+        result.errors++;
+        reopen(conn);
+    }
+
+    void reopen(Conn& conn) {
+        close(conn.fd);
+        conn.fd = -1;
+        if (running) {
+            open(conn);
+        }
+    }
+
+    void onWritable(Conn& conn) {
+        while (conn.sent < request.size()) {
+            ssize_t n = send(conn.fd, request.data() + conn.sent, request.size() - conn.sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.sent += n;
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            }
+            fail(conn);
+            return;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &conn;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+    }
+
+    void onReadable(Conn& conn) {
+        char buffer[16384];
+        size_t length = 0;
+        for (;;) {
+            ssize_t n = read(conn.fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                conn.in.append(buffer, n);
+                if (opts.keep_alive && (length = responseLength(conn.in)) > 0) {
+                    break;  // server keeps the socket open, don't wait for EOF
+                }
+                continue;
+            }
+            length = responseLength(conn.in);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (length == 0) {
+                    return;
+                }
+            } else if (n < 0 || length == 0) {
+                fail(conn);
+                return;
+            }
+            break;
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - conn.started);
+        result.latencies_us.push_back(static_cast<uint32_t>(elapsed.count()));
+
+        size_t close_pos = conn.in.find("Connection: close");
+        if (!opts.keep_alive || close_pos < length) {
+            reopen(conn);
+            return;
+        }
+        conn.in.erase(0, length);
+        conn.sent = 0;
+        conn.started = Clock::now();
+        struct epoll_event ev;
+        ev.events = EPOLLOUT;
+        ev.data.ptr = &conn;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+        onWritable(conn);
+    }
+};
+
+uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[idx];
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        const char* value = argv[i + 1];
+        if (key == "--host") opts.host = value;
+        else if (key == "--port") opts.port = std::atoi(value);
+        else if (key == "--path") opts.path = value;
+        else if (key == "--connections") opts.connections = std::atoi(value);
+        else if (key == "--threads") opts.threads = std::atoi(value);
+        else if (key == "--seconds") opts.seconds = std::atoi(value);
+        else if (key == "--keep-alive") opts.keep_alive = std::atoi(value) != 0;
+        else {
+            std::cerr << "Unknown option " << key << std::endl;
+            return 1;
+        }
+    }
+    if (opts.threads < 1) opts.threads = 1;
+
+    std::cout << "Load: " << opts.connections << " connections, " << opts.threads << " threads, "
+              << opts.seconds << "s against http://" << opts.host << ":" << opts.port << opts.path
+              << (opts.keep_alive ? " (keep-alive)" : "") << std::endl;
+
+    std::atomic<bool> running{true};
+    std::vector<std::unique_ptr<LoadThread>> loaders;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < opts.threads; t++) {
+        int share = opts.connections / opts.threads + (t < opts.connections % opts.threads ? 1 : 0);
+        loaders.push_back(std::make_unique<LoadThread>(opts, share, running));
+    }
+
+    auto start = Clock::now();
+    for (auto& loader : loaders) {
+        threads.emplace_back(&LoadThread::run, loader.get());
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opts.seconds));
+    running = false;
+    for (auto& t : threads) {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<uint32_t> all;
+    size_t errors = 0;
+    for (auto& loader : loaders) {
+        all.insert(all.end(), loader->result.latencies_us.begin(), loader->result.latencies_us.end());
+        errors += loader->result.errors;
+    }
+    std::sort(all.begin(), all.end());
+
+    std::cout << "Requests:   " << all.size() << " (" << errors << " errors)" << std::endl;
+    std::cout << "Throughput: " << static_cast<long>(all.size() / elapsed) << " req/s" << std::endl;
+    std::cout << "Latency us: p50=" << percentile(all, 0.50) << " p99=" << percentile(all, 0.99)
+              << " p999=" << percentile(all, 0.999) << " max=" << (all.empty() ? 0 : all.back()) << std::endl;
+    return 0;
+}
@@ -0,0 +1,73 @@
+// Microbenchmark: cost of recording into the instrument.h histograms and
+// counters, single-threaded and with every thread recording into the same
+// instruments at once. Also checks the merged quantiles against known input.
+//
+//   ./build/instrument_bench [iterations] [threads]
+
+#include "instrument.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+namespace {
+
+double nsPer(std::chrono::steady_clock::duration elapsed, size_t n) {
+    return std::chrono::duration<double, std::nano>(elapsed).count() / n;
+}
+
+template <typename Fn>
+double timeLoop(size_t iterations, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        fn(i);
+    }
+    return nsPer(std::chrono::steady_clock::now() - start, iterations);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000000;
+    int threads = argc > 2 ? std::atoi(argv[2]) : 4;
+
+    LatencyHistogram& histogram = instruments().histogram("bench.record");
+    LatencyHistogram& timed = instruments().histogram("bench.scoped");
+    EventCounter& counter = instruments().counter("bench.counter");
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "ticks read        " << timeLoop(iterations, [](size_t) {
+        volatile uint64_t t = instrumentTicks();
+        (void)t;
+    }) << " ns" << std::endl;
+    std::cout << "histogram record  " << timeLoop(iterations, [&](size_t i) { histogram.record(i & 0xfffff); })
+              << " ns" << std::endl;
+    std::cout << "ScopedTimer       " << timeLoop(iterations, [&](size_t) { ScopedTimer timer(timed); })
+              << " ns" << std::endl;
+    std::cout << "counter add       " << timeLoop(iterations, [&](size_t) { counter.add(); }) << " ns" << std::endl;
+
+    // Every thread on its own shard of the same histogram
+    std::vector<std::thread> workers;
+    std::vector<double> per_thread(threads);
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            per_thread[t] = timeLoop(iterations, [&](size_t i) { histogram.record(i & 0xfffff); });
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double sum = 0;
+    for (double ns : per_thread) sum += ns;
+    std::cout << "record, " << threads << " threads " << sum / threads << " ns" << std::endl;
+
+    // Uniform 1..100000: quantiles should land within the 1.6% bucket error
+    LatencyHistogram& check = instruments().histogram("bench.check");
+    for (uint64_t v = 1; v <= 100000; v++) check.record(v);
+    HistogramSnapshot merged;
+    check.merge(merged);
+    std::cout << "uniform 1..100000: p50=" << merged.quantile(0.5) << " p99=" << merged.quantile(0.99)
+              << " p999=" << merged.quantile(0.999) << " max=" << merged.max << std::endl;
+    std::cout << "ns per tick " << std::setprecision(4) << instruments().nanosecondsPerTick() << std::endl;
+    return 0;
+}
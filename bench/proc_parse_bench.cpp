@@ -0,0 +1,191 @@
+// Microbenchmark: the old ifstream + stringstream collectors against the
+// pread-based ProcFile/ProcScanner ones now in PerformanceMonitor.
+//
+// Reports ns per call and heap allocations per call for each collector.
+//
+//   ./build/proc_parse_bench [iterations]
+
+#include "monitor.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iomanip>
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+
+}
+
+// Count every heap allocation in the process
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace legacy {
+
+// The collectors as they were before ProcFile/ProcScanner: same file I/O and
+// stream parsing, with results folded into a return value
+
+long cpuUsage() {
+    std::ifstream statFile("/proc/stat");
+    std::string line;
+    long total = 0;
+    while (std::getline(statFile, line)) {
+        std::stringstream ss(line);
+        std::string key;
+        ss >> key;
+        if (key == "cpu") {
+            long user, nice, system, idle, iowait, irq, softirq, steal;
+            ss >> user >> nice >> system >> idle >> iowait >> irq >> softirq >> steal;
+            total = user + nice + system + idle + iowait + irq + softirq + steal;
+        }
+        break;
+    }
+    return total;
+}
+
+long memoryUsage() {
+    std::ifstream memFile("/proc/meminfo");
+    long total_mem = 0, available_mem = 0;
+    std::string line;
+    while (std::getline(memFile, line)) {
+        std::stringstream ss(line);
+        std::string key;
+        ss >> key;
+        if (key == "MemTotal:") {
+            ss >> total_mem;
+        } else if (key == "MemAvailable:") {
+            ss >> available_mem;
+            break;
+        }
+    }
+    return total_mem - available_mem;
+}
+
+double loadAverage() {
+    std::ifstream loadFile("/proc/loadavg");
+    double a = 0, b = 0, c = 0;
+    loadFile >> a >> b >> c;
+    return a + b + c;
+}
+
+int processCount() {
+    std::ifstream statFile("/proc/stat");
+    std::string line;
+    int count = 0;
+    while (std::getline(statFile, line)) {
+        std::stringstream ss(line);
+        std::string key;
+        ss >> key;
+        if (key == "processes") {
+            ss >> count;
+            break;
+        }
+    }
+    return count;
+}
+
+size_t networkStats() {
+    std::ifstream netFile("/proc/net/dev");
+    std::string line;
+    std::getline(netFile, line);
+    std::getline(netFile, line);
+    size_t total = 0;
+    while (std::getline(netFile, line)) {
+        std::stringstream ss(line);
+        std::string interface;
+        ss >> interface;
+        if (interface.find("lo:") == 0) continue;
+        size_t recv_bytes;
+        ss >> recv_bytes;
+        for (int i = 0; i < 7; i++) {
+            size_t dummy;
+            ss >> dummy;
+        }
+        size_t sent_bytes;
+        ss >> sent_bytes;
+        total += recv_bytes + sent_bytes;
+    }
+    return total;
+}
+
+size_t diskStats() {
+    std::ifstream diskFile("/proc/diskstats");
+    std::string line;
+    size_t total = 0;
+    while (std::getline(diskFile, line)) {
+        std::stringstream ss(line);
+        int major, minor;
+        std::string device;
+        ss >> major >> minor >> device;
+        if (device.find("loop") == 0) continue;
+        size_t reads, reads_merged, sectors_read, time_reading;
+        size_t writes, writes_merged, sectors_written, time_writing;
+        ss >> reads >> reads_merged >> sectors_read >> time_reading
+           >> writes >> writes_merged >> sectors_written >> time_writing;
+        total += sectors_read + sectors_written;
+    }
+    return total;
+}
+
+}
+
+template <typename Fn>
+void run(const char* name, int iterations, Fn legacy_fn, void (PerformanceMonitor::*collect)(), PerformanceMonitor& monitor) {
+    using Clock = std::chrono::steady_clock;
+    volatile double sink = 0;
+
+    // warm up both paths (first ProcFile read may grow its buffer)
+    sink = sink + legacy_fn();
+    (monitor.*collect)();
+
+    size_t before = allocations.load();
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        sink = sink + legacy_fn();
+    }
+    double legacy_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    double legacy_allocs = double(allocations.load() - before) / iterations;
+
+    before = allocations.load();
+    start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        (monitor.*collect)();
+    }
+    double new_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    double new_allocs = double(allocations.load() - before) / iterations;
+
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(10) << legacy_ns << std::setw(10) << std::setprecision(1) << legacy_allocs
+              << std::setw(12) << std::setprecision(0) << new_ns << std::setw(10) << std::setprecision(1) << new_allocs
+              << std::setw(9) << std::setprecision(1) << legacy_ns / new_ns << "x" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+    PerformanceMonitor monitor;
+
+    std::cout << "iterations: " << iterations << std::endl;
+    std::cout << std::left << std::setw(22) << "collector" << std::right << std::setw(10) << "old ns"
+              << std::setw(10) << "old alloc" << std::setw(12) << "new ns" << std::setw(10) << "new alloc"
+              << std::setw(10) << "speedup" << std::endl;
+
+    run("collectCPUUsage", iterations, legacy::cpuUsage, &PerformanceMonitor::collectCPUUsage, monitor);
+    // Reads /proc/vmstat and the NUMA node files too now, not just meminfo
+    run("collectMemoryUsage", iterations, legacy::memoryUsage, &PerformanceMonitor::collectMemoryUsage, monitor);
+    run("collectLoadAverage", iterations, legacy::loadAverage, &PerformanceMonitor::collectLoadAverage, monitor);
+    run("collectProcessCount", iterations, legacy::processCount, &PerformanceMonitor::collectProcessCount, monitor);
+    run("collectNetworkStats", iterations, legacy::networkStats, &PerformanceMonitor::collectNetworkStats, monitor);
+    run("collectDiskStats", iterations, legacy::diskStats, &PerformanceMonitor::collectDiskStats, monitor);
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Load generator for the push exporter: times batch encoding on its own,
+// then pushes synthetic 21-column rows through one or more PushExporters to
+// a push_receiver (start it first) and reports what got through.
+//
+//   ./push_receiver &
+//   ./build/push_load [rows_per_sec] [seconds] [exporters] [host:port] [udp]
+
+#include "push_exporter.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+const size_t kColumns = 21;  // same width as the monitor's history rows
+
+// Metric-like values: slow random walks rounded to two decimals, a few
+// columns that rarely change
+struct RowSource {
+    std::mt19937_64 rng;
+    std::normal_distribution<double> step{0.0, 1.0};
+    double values[kColumns];
+
+    explicit RowSource(uint64_t seed) : rng(seed) {
+        for (size_t c = 0; c < kColumns; c++) values[c] = 10.0 * (c + 1);
+    }
+
+    const double* next() {
+        for (size_t c = 0; c < kColumns; c++) {
+            if (c % 4 == 3) continue;
+            values[c] = std::round(std::fabs(values[c] + step(rng)) * 100) / 100;
+        }
+        return values;
+    }
+};
+
+}
+
+int main(int argc, char* argv[]) {
+    double rate = argc > 1 ? std::atof(argv[1]) : 10000;
+    int seconds = argc > 2 ? std::atoi(argv[2]) : 10;
+    int exporters = argc > 3 ? std::atoi(argv[3]) : 1;
+    std::string target = argc > 4 ? argv[4] : "127.0.0.1:9109";
+    bool udp = argc > 5 && std::string(argv[5]) == "udp";
+
+    std::vector<std::string> columns;
+    for (size_t c = 0; c < kColumns; c++) columns.push_back("metric_" + std::to_string(c));
+
+    // Encoding alone
+    {
+        RowSource source(1);
+        MetricBatch batch;
+        batch.source = "bench";
+        batch.columns = columns;
+        const size_t rows = 600;
+        for (size_t r = 0; r < rows; r++) {
+            batch.timestamps.push_back(1700000000000 + int64_t(r) * 1000);
+            const double* row = source.next();
+            batch.values.insert(batch.values.end(), row, row + kColumns);
+        }
+        std::string out;
+        const int rounds = 200;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            out.clear();
+            encodeMetricBatch(batch, out);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "encode: " << ns / (rounds * rows) << " ns/row, " << double(out.size()) / rows << " B/row ("
+                  << (rows * (kColumns + 1) * 8.0) / out.size() << "x smaller than raw), 600-row batch "
+                  << out.size() << " B" << std::endl;
+    }
+
+    size_t colon = target.rfind(':');
+    PushConfig config;
+    config.host = target.substr(0, colon);
+    config.port = std::atoi(target.c_str() + colon + 1);
+    config.udp = udp;
+    config.flush_interval_ms = 100;
+    config.queue_capacity = std::max<size_t>(4096, size_t(rate / exporters));
+    config.memory_batches = 1024;
+
+    std::vector<std::unique_ptr<PushExporter>> pushers;
+    for (int e = 0; e < exporters; e++) {
+        config.source = "load-" + std::to_string(e);
+        pushers.push_back(std::make_unique<PushExporter>(columns, config));
+        if (!pushers.back()->start()) {
+            return 1;
+        }
+    }
+
+    std::vector<std::thread> producers;
+    auto start = std::chrono::steady_clock::now();
+    for (int e = 0; e < exporters; e++) {
+        producers.emplace_back([&, e] {
+            RowSource source(e + 2);
+            double per_thread = rate / exporters;
+            auto begin = std::chrono::steady_clock::now();
+            for (uint64_t n = 0;; n++) {
+                auto due = begin + std::chrono::nanoseconds(int64_t(n * 1e9 / per_thread));
+                if (due - begin >= std::chrono::seconds(seconds)) break;
+                std::this_thread::sleep_until(due);
+                pushers[e]->push(1700000000000 + int64_t(n), source.next());
+            }
+        });
+    }
+    for (auto& t : producers) t.join();
+    for (auto& p : pushers) p->stop();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t batches = 0, bytes = 0, dropped_rows = 0, dropped_batches = 0;
+    for (auto& p : pushers) {
+        batches += p->sentBatches();
+        bytes += p->sentBytes();
+        dropped_rows += p->droppedRows();
+        dropped_batches += p->droppedBatches();
+    }
+    uint64_t offered = uint64_t(rate * seconds);
+    std::cout << "push: " << offered << " rows offered over " << elapsed << " s by " << exporters << " exporter(s), "
+              << batches << " batches, " << std::setprecision(2) << bytes / 1e6 << " MB sent ("
+              << bytes / elapsed / 1e6 << " MB/s), " << std::setprecision(1) << double(bytes) / offered << " B/row, "
+              << dropped_rows << " rows and " << dropped_batches << " batches dropped" << std::endl;
+    return 0;
+}
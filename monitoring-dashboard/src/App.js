@@ -10,38 +10,84 @@ export default function MonitoringDashboard() {
   const [error, setError] = useState(null);
 
   useEffect(() => {
+    const applyMetrics = (data) => {
+      setMetrics(data);
+      setIsConnected(true);
+      setError(null);
+
+      // Add to history - keep the last 100 samples
+      setHistory(prev => {
+        const newHistory = [...prev, {
+          time: new Date().toLocaleTimeString(),
+          cpu: data.cpu_usage,
+          memory: data.memory_usage_kb / 1024,
+          disk_read: data.disk.bytes_read / 1024 / 1024,
+          disk_write: data.disk.bytes_written / 1024 / 1024,
+          net_recv: data.network.bytes_received / 1024 / 1024,
+          net_sent: data.network.bytes_sent / 1024 / 1024
+        }];
+        return newHistory.slice(-100);
+      });
+    };
+
     const fetchMetrics = async () => {
       try {
         const response = await fetch(`${apiUrl}/metrics`);
         if (!response.ok) throw new Error('Failed to fetch metrics');
-        
-        const data = await response.json();
-        setMetrics(data);
-        setIsConnected(true);
-        setError(null);
-
-        // Add to history - keep last 20 data points
-        setHistory(prev => {
-          const newHistory = [...prev, {
-            time: new Date().toLocaleTimeString(),
-            cpu: data.cpu_usage,
-            memory: data.memory_usage_kb / 1024,
-            disk_read: data.disk.bytes_read / 1024 / 1024,
-            disk_write: data.disk.bytes_written / 1024 / 1024,
-            net_recv: data.network.bytes_received / 1024 / 1024,
-            net_sent: data.network.bytes_sent / 1024 / 1024
-          }];
-          return newHistory.slice(-20);
-        });
+        applyMetrics(await response.json());
       } catch (err) {
         setIsConnected(false);
         setError(err.message);
       }
     };
 
-    fetchMetrics();
-    const interval = setInterval(fetchMetrics, 5000);
-    return () => clearInterval(interval);
+    // Seed the charts from the server's history so a reload doesn't start empty
+    const loadHistory = async () => {
+      try {
+        const response = await fetch(`${apiUrl}/metrics/range?from=-100&agg=last`);
+        if (!response.ok) return;
+        const range = await response.json();
+        const s = range.series;
+        setHistory(range.timestamps_ms.map((ts, i) => ({
+          time: new Date(ts).toLocaleTimeString(),
+          cpu: s.cpu_usage[i],
+          memory: s.memory_usage_kb[i] / 1024,
+          disk_read: s.disk_bytes_read[i] / 1024 / 1024,
+          disk_write: s.disk_bytes_written[i] / 1024 / 1024,
+          net_recv: s.net_bytes_received[i] / 1024 / 1024,
+          net_sent: s.net_bytes_sent[i] / 1024 / 1024
+        })).slice(-100));
+      } catch (err) {
+        // no history yet - live polling fills it in
+      }
+    };
+
+    // Live updates are pushed over SSE as each sample is published; fall
+    // back to polling if the stream can't be opened
+    let source = null;
+    let interval = null;
+    loadHistory().finally(() => {
+      if (typeof EventSource === 'undefined') {
+        fetchMetrics();
+        interval = setInterval(fetchMetrics, 5000);
+        return;
+      }
+      source = new EventSource(`${apiUrl}/metrics/stream`);
+      source.onmessage = (event) => applyMetrics(JSON.parse(event.data));
+      source.onerror = () => {
+        // EventSource reconnects by itself; surface the outage meanwhile
+        setIsConnected(false);
+        if (source.readyState === EventSource.CLOSED) {
+          source = null;
+          fetchMetrics();
+          interval = setInterval(fetchMetrics, 5000);
+        }
+      };
+    });
+    return () => {
+      if (source) source.close();
+      if (interval) clearInterval(interval);
+    };
   }, [apiUrl]);
 
   const formatBytes = (bytes) => {
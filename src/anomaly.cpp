@@ -0,0 +1,353 @@
+#include "anomaly.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Series not seen for this long are dropped (a cgroup or interface went away)
+const int64_t kExpireAfterMs = 10 * 60 * 1000;
+const uint64_t kExpireEvery = 64;  // samples between sweeps
+// Once warm, a value only moves the baseline as far as mean +- this many
+// stddevs, so the first samples of a spike don't hide the rest of it
+const double kClipScale = 3.0;
+
+// '*' matches any run of characters, everything else itself
+bool globMatch(std::string_view pattern, std::string_view text) {
+    size_t p = 0, t = 0;
+    size_t star = std::string_view::npos, resume = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            resume = t;
+        } else if (p < pattern.size() && pattern[p] == text[t]) {
+            p++;
+            t++;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            t = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
+
+}
+
+QuantileSketch::QuantileSketch(double q) : q(q) {
+    for (int i = 0; i < 5; i++) {
+        heights[i] = 0.0;
+        positions[i] = i + 1;
+    }
+    desired[0] = 1;
+    desired[1] = 1 + 2 * q;
+    desired[2] = 1 + 4 * q;
+    desired[3] = 3 + 2 * q;
+    desired[4] = 5;
+    increments[0] = 0;
+    increments[1] = q / 2;
+    increments[2] = q;
+    increments[3] = (1 + q) / 2;
+    increments[4] = 1;
+}
+
+void QuantileSketch::add(double x) {
+    if (n < 5) {
+        heights[n++] = x;
+        if (n == 5) std::sort(heights, heights + 5);
+        return;
+    }
+    n++;
+
+    int k;
+    if (x < heights[0]) {
+        heights[0] = x;
+        k = 0;
+    } else if (x >= heights[4]) {
+        heights[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= heights[k + 1]) k++;
+    }
+    for (int i = k + 1; i < 5; i++) positions[i] += 1;
+    for (int i = 0; i < 5; i++) desired[i] += increments[i];
+
+    // Move the middle markers at most one step toward where they belong,
+    // along the parabola through their neighbours when that stays ordered
+    for (int i = 1; i <= 3; i++) {
+        double d = desired[i] - positions[i];
+        if ((d >= 1 && positions[i + 1] - positions[i] > 1) || (d <= -1 && positions[i - 1] - positions[i] < -1)) {
+            int s = d > 0 ? 1 : -1;
+            double left = positions[i] - positions[i - 1];
+            double right = positions[i + 1] - positions[i];
+            double parabolic = heights[i] + s / (positions[i + 1] - positions[i - 1]) *
+                ((left + s) * (heights[i + 1] - heights[i]) / right + (right - s) * (heights[i] - heights[i - 1]) / left);
+            if (heights[i - 1] < parabolic && parabolic < heights[i + 1]) {
+                heights[i] = parabolic;
+            } else {
+                heights[i] += s * (heights[i + s] - heights[i]) / (positions[i + s] - positions[i]);
+            }
+            positions[i] += s;
+        }
+    }
+}
+
+double QuantileSketch::value() const {
+    if (n >= 5) {
+        return heights[2];
+    }
+    if (n == 0) {
+        return 0.0;
+    }
+    double sorted[5];
+    std::copy(heights, heights + n, sorted);
+    std::sort(sorted, sorted + n);
+    size_t rank = std::min<size_t>(n - 1, size_t(q * n));
+    return sorted[rank];
+}
+
+bool parseAlertRule(const std::string& text, AlertRule& out) {
+    size_t op = text.find_first_of("<>");
+    if (op == std::string::npos || op == 0) {
+        return false;
+    }
+    AlertRule rule;
+    rule.text = text;
+    rule.pattern = text.substr(0, op);
+    rule.above = text[op] == '>';
+    size_t n = rule.pattern.size();
+    if (n > 2 && rule.pattern[n - 2] == ':') {
+        char kind = rule.pattern[n - 1];
+        if (kind == 'z') rule.kind = AlertRule::Kind::ZScore;
+        else if (kind == 'q') rule.kind = AlertRule::Kind::Quantile;
+        else return false;
+        rule.pattern.resize(n - 2);
+    }
+
+    const char* begin = text.c_str() + op + 1;
+    char* end = nullptr;
+    rule.threshold = std::strtod(begin, &end);
+    if (end == begin || !std::isfinite(rule.threshold)) {
+        return false;
+    }
+    if (*end == '/') {
+        begin = end + 1;
+        long samples = std::strtol(begin, &end, 10);
+        if (end == begin || samples <= 0 || samples > 1000000) {
+            return false;
+        }
+        rule.samples = (int)samples;
+    }
+    if (*end != '\0') {
+        return false;
+    }
+    if (rule.kind == AlertRule::Kind::Quantile && rule.threshold <= 0) {
+        return false;
+    }
+    out = std::move(rule);
+    return true;
+}
+
+AnomalyDetector::AnomalyDetector(AnomalyConfig config) : config(std::move(config)) {
+    if (!this->config.log_path.empty()) {
+        int fd = open(this->config.log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            std::cerr << "Failed to open alert log " << this->config.log_path << ": " << std::strerror(errno)
+                      << "; logging alerts to stderr" << std::endl;
+        } else {
+            log_fd = fd;
+        }
+    }
+}
+
+AnomalyDetector::~AnomalyDetector() {
+    if (log_fd > 2) {
+        close(log_fd);
+    }
+}
+
+void AnomalyDetector::beginSample(int64_t timestamp_ms) {
+    now_ms = timestamp_ms;
+}
+
+AnomalyDetector::Series& AnomalyDetector::lookupSeries(std::string_view name) {
+    lookup.assign(name.data(), name.size());
+    auto it = series.find(lookup);
+    if (it != series.end()) {
+        return it->second;
+    }
+    // Rules are matched once per series, not per sample
+    it = series.emplace(lookup, Series(config.quantile)).first;
+    for (size_t r = 0; r < config.rules.size(); r++) {
+        if (globMatch(config.rules[r].pattern, lookup)) {
+            it->second.watches.push_back(Watch{r});
+        }
+    }
+    if (!it->second.watches.empty()) {
+        watched_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return it->second;
+}
+
+void AnomalyDetector::observe(std::string_view name, double value) {
+    if (!std::isfinite(value)) {
+        return;
+    }
+    Series& s = lookupSeries(name);
+    s.last_seen_ms = now_ms;
+    if (s.watches.empty()) {
+        return;
+    }
+
+    // Scored against the baseline before this value joins it. The stddev
+    // floor (1% of the mean) keeps a near-constant series from turning every
+    // small step into a huge z.
+    double stddev = std::sqrt(s.variance);
+    double scale = std::max(stddev, std::max(0.01 * std::fabs(s.mean), 1e-9));
+    double zscore = s.samples > 0 ? (value - s.mean) / scale : 0.0;
+    double quantile = s.sketch.value();
+    bool warm = s.samples >= config.warmup;
+
+    for (auto& watch : s.watches) {
+        const AlertRule& rule = config.rules[watch.rule];
+        bool breach = false;
+        if (rule.kind == AlertRule::Kind::Value) {
+            breach = rule.above ? value > rule.threshold : value < rule.threshold;
+        } else if (rule.kind == AlertRule::Kind::ZScore) {
+            breach = warm && (rule.above ? zscore > rule.threshold : zscore < rule.threshold);
+        } else if (warm && quantile > 0) {
+            double ratio = value / quantile;
+            breach = rule.above ? ratio > rule.threshold : ratio < rule.threshold;
+        }
+
+        if (breach) {
+            watch.run = watch.run > 0 ? watch.run + 1 : 1;
+            if (!watch.firing && watch.run >= rule.samples) {
+                transition(lookup, s, watch, true, value, stddev, zscore, quantile);
+            }
+        } else {
+            watch.run = watch.run < 0 ? watch.run - 1 : -1;
+            if (watch.firing && -watch.run >= rule.samples) {
+                transition(lookup, s, watch, false, value, stddev, zscore, quantile);
+            }
+        }
+    }
+
+    // EWMA mean and variance (West's incremental form). A lasting shift
+    // still gets absorbed, just over tens of samples instead of a few.
+    if (s.samples == 0) {
+        s.mean = value;
+    } else {
+        double clipped = warm ? std::clamp(value, s.mean - kClipScale * scale, s.mean + kClipScale * scale) : value;
+        double diff = clipped - s.mean;
+        double step = config.alpha * diff;
+        s.mean += step;
+        s.variance = (1 - config.alpha) * (s.variance + diff * step);
+    }
+    s.samples++;
+    s.sketch.add(value);
+}
+
+void AnomalyDetector::transition(const std::string& name, const Series& s, Watch& watch, bool firing, double value,
+                                 double stddev, double zscore, double quantile) {
+    watch.firing = firing;
+    if (firing) {
+        watch.since_ms = now_ms;
+    }
+    AlertEvent event;
+    event.firing = firing;
+    event.rule = watch.rule;
+    event.series = name;
+    event.timestamp_ms = now_ms;
+    event.since_ms = watch.since_ms;
+    event.value = value;
+    event.mean = s.mean;
+    event.stddev = stddev;
+    event.zscore = zscore;
+    event.quantile = quantile;
+    pending.push_back(std::move(event));
+}
+
+void AnomalyDetector::expire() {
+    for (auto it = series.begin(); it != series.end(); ) {
+        Series& s = it->second;
+        if (now_ms - s.last_seen_ms < kExpireAfterMs) {
+            ++it;
+            continue;
+        }
+        for (auto& watch : s.watches) {
+            if (watch.firing) {
+                transition(it->first, s, watch, false, s.mean, std::sqrt(s.variance), 0.0, s.sketch.value());
+            }
+        }
+        if (!s.watches.empty()) {
+            watched_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+        it = series.erase(it);
+    }
+}
+
+void AnomalyDetector::endSample() {
+    if (++sample_count % kExpireEvery == 0) {
+        expire();
+    }
+    if (pending.empty()) {
+        return;
+    }
+    for (const auto& event : pending) {
+        writeLog(event);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& event : pending) {
+        if (event.firing) {
+            active.push_back(event);
+        } else {
+            active.erase(std::remove_if(active.begin(), active.end(), [&](const AlertEvent& a) {
+                return a.rule == event.rule && a.series == event.series;
+            }), active.end());
+        }
+        recent.push_back(std::move(event));
+        if (recent.size() > config.recent_events) recent.pop_front();
+    }
+    active_count.store(active.size(), std::memory_order_relaxed);
+    pending.clear();
+}
+
+// "2026-01-02T03:04:05.678Z FIRING cpu_usage>90 cpu_usage value=97.10 mean=..."
+void AnomalyDetector::writeLog(const AlertEvent& event) {
+    time_t seconds = event.timestamp_ms / 1000;
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    char line[512];
+    int length = std::snprintf(line, sizeof(line), "%s.%03dZ %s %s %s value=%.2f mean=%.2f stddev=%.2f z=%.2f p%g=%.2f",
+                               stamp, (int)(event.timestamp_ms % 1000), event.firing ? "FIRING" : "RESOLVED",
+                               config.rules[event.rule].text.c_str(), event.series.c_str(), event.value, event.mean,
+                               event.stddev, event.zscore, config.quantile * 100, event.quantile);
+    if (length < 0) {
+        return;
+    }
+    length = std::min(length, (int)sizeof(line) - 32);
+    if (!event.firing) {
+        length += std::snprintf(line + length, sizeof(line) - length, " after %.1fs",
+                                (event.timestamp_ms - event.since_ms) / 1000.0);
+        length = std::min(length, (int)sizeof(line) - 1);
+    }
+    line[length++] = '\n';
+    if (write(log_fd, line, length) < 0) {
+        // Nowhere better to report it
+    }
+}
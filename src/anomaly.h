@@ -0,0 +1,144 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Streaming estimate of one quantile with the P-squared algorithm (Jain &
+// Chlamtac): five markers nudged toward their ideal positions on every value,
+// so memory and time per value are constant. Covers everything seen so far.
+class QuantileSketch {
+public:
+    explicit QuantileSketch(double q = 0.99);
+    void add(double x);
+    double value() const;
+    uint64_t count() const { return n; }
+
+private:
+    double q;
+    double heights[5];
+    double positions[5];
+    double desired[5];
+    double increments[5];
+    uint64_t n = 0;
+};
+
+// NAME[:z|:q](>|<)THRESHOLD[/SAMPLES]
+//   cpu_usage>90                 the value itself
+//   cgroup.*.cpu_percent:z>4     z-score against the series' EWMA baseline
+//   custom.orders.*:q>1.5        value over the series' long-run quantile
+// '*' in NAME matches any run of characters; /SAMPLES is how many samples in
+// a row must breach before the alert fires (and stay clear before it resolves).
+struct AlertRule {
+    enum class Kind { Value, ZScore, Quantile };
+    std::string text;                // as given
+    std::string pattern;
+    Kind kind = Kind::Value;
+    bool above = true;
+    double threshold = 0.0;
+    int samples = 1;
+};
+
+bool parseAlertRule(const std::string& text, AlertRule& out);
+
+struct AnomalyConfig {
+    std::vector<AlertRule> rules;
+    double alpha = 0.05;             // EWMA weight of each new sample
+    double quantile = 0.99;          // tracked per series, the base of :q rules
+    uint64_t warmup = 30;            // samples before :z and :q rules can fire
+    std::string log_path;            // empty: stderr
+    size_t recent_events = 200;      // fired/resolved events kept for /alerts
+};
+
+// A transition, or (in the active list) an alert that is still firing. The
+// numbers are from the sample that caused the transition.
+struct AlertEvent {
+    bool firing = true;
+    size_t rule = 0;                 // index into the config's rules
+    std::string series;
+    int64_t timestamp_ms = 0;
+    int64_t since_ms = 0;            // when it fired
+    double value = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    double zscore = 0.0;
+    double quantile = 0.0;
+};
+
+// Online anomaly detection over named series, run by the sampler after each
+// cycle. Only series some rule matches are tracked; each keeps an EWMA mean
+// and variance plus a quantile sketch, all O(1) in time and memory. Every
+// transition goes to the log and to the lists behind /alerts.
+class AnomalyDetector {
+public:
+    explicit AnomalyDetector(AnomalyConfig config);
+    ~AnomalyDetector();
+    AnomalyDetector(const AnomalyDetector&) = delete;
+    AnomalyDetector& operator=(const AnomalyDetector&) = delete;
+
+    // Sampler thread only: one beginSample, then observe every series that
+    // has a fresh value, then endSample
+    void beginSample(int64_t timestamp_ms);
+    void observe(std::string_view series, double value);
+    void endSample();
+
+    // Any thread
+    const std::vector<AlertRule>& rules() const { return config.rules; }
+    size_t activeCount() const { return active_count.load(std::memory_order_relaxed); }
+    size_t watchedSeries() const { return watched_count.load(std::memory_order_relaxed); }
+    template <typename Fn>
+    void forEachActive(Fn fn) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& event : active) fn(event);
+    }
+    // Oldest first
+    template <typename Fn>
+    void forEachEvent(Fn fn) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& event : recent) fn(event);
+    }
+
+private:
+    struct Watch {
+        size_t rule;
+        int run = 0;                 // > 0 breaching samples in a row, < 0 clear ones
+        bool firing = false;
+        int64_t since_ms = 0;
+    };
+
+    struct Series {
+        double mean = 0.0;
+        double variance = 0.0;
+        uint64_t samples = 0;
+        QuantileSketch sketch;
+        int64_t last_seen_ms = 0;
+        std::vector<Watch> watches;  // empty: matched no rule, ignored
+
+        explicit Series(double q) : sketch(q) {}
+    };
+
+    AnomalyConfig config;
+    int log_fd = 2;
+    int64_t now_ms = 0;
+    uint64_t sample_count = 0;
+    std::string lookup;              // reused key buffer
+    std::unordered_map<std::string, Series> series;
+    std::vector<AlertEvent> pending;  // transitions from the current sample
+
+    mutable std::mutex mutex;
+    std::vector<AlertEvent> active;
+    std::deque<AlertEvent> recent;
+    std::atomic<size_t> active_count{0};
+    std::atomic<size_t> watched_count{0};
+
+    Series& lookupSeries(std::string_view name);
+    void transition(const std::string& name, const Series& s, Watch& watch, bool firing, double value,
+                    double stddev, double zscore, double quantile);
+    void expire();
+    void writeLog(const AlertEvent& event);
+};
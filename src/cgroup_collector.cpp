@@ -0,0 +1,363 @@
+#include "cgroup_collector.h"
+#include <iostream>
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+bool startsWith(std::string_view s, std::string_view prefix) {
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+// "key=value" token -> value
+template <typename T>
+T valueAfterEquals(std::string_view token) {
+    T value = 0;
+    size_t eq = token.find('=');
+    if (eq != std::string_view::npos) {
+        std::from_chars(token.data() + eq + 1, token.data() + token.size(), value);
+    }
+    return value;
+}
+
+// Counters only move forward; a reset (group re-created) restarts from zero
+uint64_t forwardDelta(uint64_t now, uint64_t prev) {
+    return now >= prev ? now - prev : now;
+}
+
+double perSec(uint64_t delta, double elapsed_sec) {
+    return elapsed_sec > 0.0 ? delta / elapsed_sec : 0.0;
+}
+
+// Stalled microseconds over the interval as a percent of it
+double stallPercent(uint64_t now_us, uint64_t prev_us, double elapsed_sec) {
+    if (elapsed_sec <= 0.0) {
+        return 0.0;
+    }
+    return std::min(100.0, forwardDelta(now_us, prev_us) / (elapsed_sec * 1e4));
+}
+
+void updatePressure(ProcFile& file, PressureStats& stats, double elapsed_sec, bool& available) {
+    uint64_t prev_some = stats.some_total_us, prev_full = stats.full_total_us;
+    if (!file.read() || !parsePressure(file.contents(), stats)) {
+        return;
+    }
+    available = true;
+    stats.some_percent = stallPercent(stats.some_total_us, prev_some, elapsed_sec);
+    stats.full_percent = stallPercent(stats.full_total_us, prev_full, elapsed_sec);
+}
+
+}
+
+bool parsePressure(std::string_view text, PressureStats& out) {
+    bool found = false;
+    ProcScanner ss(text);
+    do {
+        std::string_view kind = ss.token();
+        bool some = kind == "some";
+        if (!some && kind != "full") {
+            continue;
+        }
+        double avg10 = valueAfterEquals<double>(ss.token());
+        double avg60 = valueAfterEquals<double>(ss.token());
+        double avg300 = valueAfterEquals<double>(ss.token());
+        uint64_t total = valueAfterEquals<uint64_t>(ss.token());
+        if (some) {
+            out.some_avg10 = avg10;
+            out.some_avg60 = avg60;
+            out.some_avg300 = avg300;
+            out.some_total_us = total;
+        } else {
+            out.full_avg10 = avg10;
+            out.full_avg60 = avg60;
+            out.full_avg300 = avg300;
+            out.full_total_us = total;
+        }
+        found = true;
+    } while (ss.nextLine());
+    return found;
+}
+
+void PressureCollector::collect(SystemPressure& out) {
+    auto now = std::chrono::steady_clock::now();
+    // First read has no interval; percents stay 0 until the second
+    double elapsed_sec = out.available ? std::chrono::duration<double>(now - prev_time).count() : 0.0;
+    prev_time = now;
+
+    bool available = false;
+    updatePressure(cpu, out.cpu, elapsed_sec, available);
+    updatePressure(memory, out.memory, elapsed_sec, available);
+    updatePressure(io, out.io, elapsed_sec, available);
+    out.available = available;
+}
+
+CgroupCollector::~CgroupCollector() {
+    if (inotify_fd != -1) {
+        close(inotify_fd);
+    }
+}
+
+std::string CgroupCollector::fsPath(const std::string& name) const {
+    return name == "/" ? root : root + name;
+}
+
+void CgroupCollector::initialize() {
+    initialized = true;
+    if (root.empty()) {
+        root = access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/unified";
+    }
+    while (root.size() > 1 && root.back() == '/') root.pop_back();
+    if (access((root + "/cgroup.procs").c_str(), F_OK) != 0) {
+        std::cerr << "No cgroup v2 hierarchy at " << root << "; cgroup collector disabled" << std::endl;
+        return;
+    }
+    usable = true;
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1) {
+        std::cerr << "inotify unavailable (" << std::strerror(errno)
+                  << "); new cgroups show up on the periodic rescan only" << std::endl;
+    }
+    fullScan();
+}
+
+// Reconciles the whole tree with what's on disk: new groups are added, gone
+// ones dropped, and files missing from existing groups are probed again
+void CgroupCollector::fullScan() {
+    last_scan = std::chrono::steady_clock::now();
+    scan_mark++;
+    scanDir("/");
+    for (auto it = nodes.begin(); it != nodes.end();) {
+        auto next = std::next(it);
+        if (it->second->scan_mark != scan_mark) {
+            removeNode(it);
+        }
+        it = next;
+    }
+}
+
+void CgroupCollector::scanDir(const std::string& name) {
+    auto it = nodes.find(name);
+    Node& node = it == nodes.end() ? addNode(name) : *it->second;
+    if (it != nodes.end()) {
+        openFiles(node);
+    }
+    node.scan_mark = scan_mark;
+
+    DIR* dir = opendir(fsPath(name).c_str());
+    if (!dir) {
+        return;
+    }
+    std::vector<std::string> children;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_type != DT_DIR || entry->d_name[0] == '.') {
+            continue;
+        }
+        children.push_back(name == "/" ? "/" + std::string(entry->d_name) : name + "/" + entry->d_name);
+    }
+    closedir(dir);
+    for (const auto& child : children) {
+        scanDir(child);
+    }
+}
+
+CgroupCollector::Node& CgroupCollector::addNode(const std::string& name) {
+    auto node = std::make_unique<Node>(name);
+    if (inotify_fd != -1) {
+        node->watch = inotify_add_watch(inotify_fd, fsPath(name).c_str(), kWatchMask);
+        if (node->watch != -1) {
+            by_watch[node->watch] = node.get();
+        }
+    }
+    openFiles(*node);
+    node->scan_mark = scan_mark;
+    Node& ref = *node;
+    nodes[name] = std::move(node);
+    return ref;
+}
+
+// Opens whichever stat files exist and aren't open yet. Probing with access()
+// first keeps absent controllers from costing a buffer per group.
+void CgroupCollector::openFiles(Node& node) {
+    std::string dir = fsPath(node.name);
+    auto probe = [&dir](ProcFile& file, const char* leaf, size_t capacity) {
+        if (file.isOpen()) {
+            return;
+        }
+        std::string path = dir + "/" + leaf;
+        if (access(path.c_str(), R_OK) == 0) {
+            file = ProcFile(path, capacity);
+        }
+    };
+    probe(node.cpu_stat, "cpu.stat", 512);
+    probe(node.memory_current, "memory.current", 64);
+    probe(node.memory_stat, "memory.stat", 2048);
+    probe(node.io_stat, "io.stat", 256);
+    probe(node.memory_pressure, "memory.pressure", 256);
+}
+
+void CgroupCollector::removeNode(std::map<std::string, std::unique_ptr<Node>>::iterator it) {
+    Node& node = *it->second;
+    if (node.watch != -1) {
+        inotify_rm_watch(inotify_fd, node.watch);  // already gone if the directory was removed
+        by_watch.erase(node.watch);
+    }
+    nodes.erase(it);
+}
+
+// The group and everything below it
+void CgroupCollector::removeTree(const std::string& name) {
+    auto it = nodes.find(name);
+    if (it != nodes.end()) {
+        removeNode(it);
+    }
+    std::string prefix = name + "/";
+    it = nodes.lower_bound(prefix);
+    while (it != nodes.end() && startsWith(it->first, prefix)) {
+        auto next = std::next(it);
+        removeNode(it);
+        it = next;
+    }
+}
+
+// Applies pending directory events; false if events were lost and the tree
+// needs a full rescan
+bool CgroupCollector::drainEvents() {
+    if (inotify_fd == -1) {
+        return true;
+    }
+    alignas(struct inotify_event) char buf[16384];
+    for (;;) {
+        ssize_t n = read(inotify_fd, buf, sizeof(buf));
+        if (n <= 0) {
+            return true;  // EAGAIN: nothing more queued
+        }
+        for (char* p = buf; p < buf + n;) {
+            const auto* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                return false;
+            }
+            if (event->mask & IN_IGNORED) {
+                by_watch.erase(event->wd);
+                continue;
+            }
+            auto parent = by_watch.find(event->wd);
+            if (parent == by_watch.end() || !(event->mask & IN_ISDIR) || event->len == 0) {
+                continue;
+            }
+            const std::string& parent_name = parent->second->name;
+            std::string name = parent_name == "/" ? "/" + std::string(event->name)
+                                                  : parent_name + "/" + event->name;
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                // A moved-in directory can bring a whole subtree with it
+                scanDir(name);
+            } else {
+                removeTree(name);
+            }
+        }
+    }
+}
+
+void CgroupCollector::collect(std::vector<CgroupStats>& out) {
+    if (!initialized) {
+        initialize();
+    }
+    if (!usable) {
+        out.clear();
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (!drainEvents() || now - last_scan >= rescan_interval) {
+        fullScan();
+    }
+    double elapsed_sec = std::chrono::duration<double>(now - prev_time).count();
+    prev_time = now;
+
+    // Reused in place so names and the vector keep their capacity
+    size_t count = 0;
+    for (auto& entry : nodes) {
+        if (count == out.size()) out.emplace_back();
+        readNode(*entry.second, out[count++], elapsed_sec);
+    }
+    out.resize(count);
+}
+
+void CgroupCollector::readNode(Node& node, CgroupStats& stats, double elapsed_sec) {
+    std::string name = std::move(stats.name);  // keep its capacity
+    stats = CgroupStats();
+    name.assign(node.name);
+    stats.name = std::move(name);
+
+    if (node.cpu_stat.isOpen() && node.cpu_stat.read()) {
+        ProcScanner ss(node.cpu_stat.contents());
+        do {
+            std::string_view key = ss.token();
+            if (key == "usage_usec") stats.cpu_usage_usec = ss.u64();
+            else if (key == "user_usec") stats.cpu_user_usec = ss.u64();
+            else if (key == "system_usec") stats.cpu_system_usec = ss.u64();
+            else if (key == "nr_periods") stats.cpu_periods = ss.u64();
+            else if (key == "nr_throttled") stats.cpu_throttled_periods = ss.u64();
+            else if (key == "throttled_usec") stats.cpu_throttled_usec = ss.u64();
+        } while (ss.nextLine());
+    }
+    if (node.memory_current.isOpen() && node.memory_current.read()) {
+        ProcScanner ss(node.memory_current.contents());
+        stats.memory_current = ss.u64();
+    }
+    if (node.memory_stat.isOpen() && node.memory_stat.read()) {
+        ProcScanner ss(node.memory_stat.contents());
+        do {
+            std::string_view key = ss.token();
+            if (key == "anon") stats.memory_anon = ss.u64();
+            else if (key == "file") stats.memory_file = ss.u64();
+            else if (key == "kernel") stats.memory_kernel = ss.u64();
+            else if (key == "pgmajfault") stats.major_faults = ss.u64();
+        } while (ss.nextLine());
+    }
+    if (node.io_stat.isOpen() && node.io_stat.read()) {
+        // "8:0 rbytes=N wbytes=N rios=N wios=N dbytes=N dios=N" per device
+        ProcScanner ss(node.io_stat.contents());
+        do {
+            ss.token();  // major:minor
+            for (std::string_view field = ss.token(); !field.empty(); field = ss.token()) {
+                if (startsWith(field, "rbytes=")) stats.io_read_bytes += valueAfterEquals<uint64_t>(field);
+                else if (startsWith(field, "wbytes=")) stats.io_write_bytes += valueAfterEquals<uint64_t>(field);
+            }
+        } while (ss.nextLine());
+    }
+    if (node.memory_pressure.isOpen() && node.memory_pressure.read()) {
+        parsePressure(node.memory_pressure.contents(), stats.memory_pressure);
+    }
+
+    if (node.has_prev && elapsed_sec > 0.0) {
+        uint64_t periods = forwardDelta(stats.cpu_periods, node.prev_periods);
+        stats.cpu_percent = forwardDelta(stats.cpu_usage_usec, node.prev_cpu_usec) / (elapsed_sec * 1e4);
+        stats.throttled_percent = periods > 0
+            ? 100.0 * forwardDelta(stats.cpu_throttled_periods, node.prev_throttled) / periods : 0.0;
+        stats.major_faults_per_sec = perSec(forwardDelta(stats.major_faults, node.prev_faults), elapsed_sec);
+        stats.io_read_bytes_per_sec = perSec(forwardDelta(stats.io_read_bytes, node.prev_read_bytes), elapsed_sec);
+        stats.io_write_bytes_per_sec = perSec(forwardDelta(stats.io_write_bytes, node.prev_write_bytes), elapsed_sec);
+        stats.memory_pressure.some_percent =
+            stallPercent(stats.memory_pressure.some_total_us, node.prev_some_us, elapsed_sec);
+        stats.memory_pressure.full_percent =
+            stallPercent(stats.memory_pressure.full_total_us, node.prev_full_us, elapsed_sec);
+    }
+    node.prev_cpu_usec = stats.cpu_usage_usec;
+    node.prev_periods = stats.cpu_periods;
+    node.prev_throttled = stats.cpu_throttled_periods;
+    node.prev_faults = stats.major_faults;
+    node.prev_read_bytes = stats.io_read_bytes;
+    node.prev_write_bytes = stats.io_write_bytes;
+    node.prev_some_us = stats.memory_pressure.some_total_us;
+    node.prev_full_us = stats.memory_pressure.full_total_us;
+    node.has_prev = true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include "proc_reader.h"
+#include "snapshot.h"
+
+// Parses one PSI file ("some avg10=... total=N" / "full ..."); the percent
+// fields are left alone. False if neither line was found.
+bool parsePressure(std::string_view text, PressureStats& out);
+
+// Host-wide stall information from /proc/pressure/{cpu,memory,io}
+class PressureCollector {
+public:
+    // Sampler thread only
+    void collect(SystemPressure& out);
+
+private:
+    ProcFile cpu{"/proc/pressure/cpu", 256};
+    ProcFile memory{"/proc/pressure/memory", 256};
+    ProcFile io{"/proc/pressure/io", 256};
+    std::chrono::steady_clock::time_point prev_time;
+};
+
+// Per-cgroup CPU, memory, I/O and memory pressure for every group under a
+// cgroup v2 root.
+//
+// The tree is walked once; after that, groups are added and removed from
+// inotify events on their parent directories, and each group's stat files
+// stay open and are re-read with pread. A steady-state sample is therefore a
+// handful of preads per group with no directory reads or path lookups. A
+// full reconciling walk still runs every rescan_interval (and on inotify
+// queue overflow) to pick up controllers enabled after a group was created.
+class CgroupCollector {
+public:
+    CgroupCollector() = default;
+    ~CgroupCollector();
+    CgroupCollector(const CgroupCollector&) = delete;
+    CgroupCollector& operator=(const CgroupCollector&) = delete;
+
+    // Call before the first collect. Empty picks /sys/fs/cgroup, or
+    // /sys/fs/cgroup/unified on hybrid hosts.
+    void setRoot(std::string path) { root = std::move(path); }
+    void setRescanInterval(std::chrono::seconds interval) { rescan_interval = interval; }
+
+    // Sampler thread only
+    void collect(std::vector<CgroupStats>& out);
+
+private:
+    struct Node {
+        std::string name;  // "/" or "/a/b", relative to root
+        int watch = -1;
+        // Closed when the file doesn't exist (yet)
+        ProcFile cpu_stat{std::string(), 0};
+        ProcFile memory_current{std::string(), 0};
+        ProcFile memory_stat{std::string(), 0};
+        ProcFile io_stat{std::string(), 0};
+        ProcFile memory_pressure{std::string(), 0};
+        bool has_prev = false;
+        uint64_t prev_cpu_usec = 0, prev_periods = 0, prev_throttled = 0, prev_faults = 0;
+        uint64_t prev_read_bytes = 0, prev_write_bytes = 0;
+        uint64_t prev_some_us = 0, prev_full_us = 0;
+        uint64_t scan_mark = 0;
+
+        explicit Node(std::string name) : name(std::move(name)) {}
+    };
+
+    std::string root;
+    bool initialized = false;
+    bool usable = false;
+    std::chrono::seconds rescan_interval{30};
+    std::chrono::steady_clock::time_point last_scan;
+    std::chrono::steady_clock::time_point prev_time;
+    uint64_t scan_mark = 0;
+
+    // Sorted by path, so a subtree is a contiguous range
+    std::map<std::string, std::unique_ptr<Node>> nodes;
+    std::unordered_map<int, Node*> by_watch;
+    int inotify_fd = -1;
+
+    void initialize();
+    void fullScan();
+    void scanDir(const std::string& name);
+    Node& addNode(const std::string& name);
+    void openFiles(Node& node);
+    void removeTree(const std::string& name);
+    void removeNode(std::map<std::string, std::unique_ptr<Node>>::iterator it);
+    bool drainEvents();
+    std::string fsPath(const std::string& name) const;
+    void readNode(Node& node, CgroupStats& stats, double elapsed_sec);
+};
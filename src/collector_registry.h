@@ -0,0 +1,403 @@
+#pragma once
+#include <array>
+#include <string_view>
+#include <utility>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include "snapshot.h"
+
+// Collector registry. Each collector is a type that names itself, declares
+// the host-wide scalars it produces (its schema) once, and knows how to run
+// itself on a monitor:
+//
+//   struct LoadSource {
+//       static constexpr const char* kName = "loadavg";
+//       static constexpr MetricField kSchema[] = {...};
+//       template <typename Monitor> static void collect(Monitor& m);
+//   };
+//
+// CollectorPipeline<Sources...> fixes the set at compile time. collect()
+// expands into one test-and-direct-call per source - no virtual calls or
+// function-pointer table, and the calls can be inlined. Sources whose bit
+// isn't in the mask never run, so a disabled collector costs no reads.
+//
+// The flat exports are generated from the schemas of the enabled sources:
+// history columns (/metrics/range, CSV, segments, push batches, sketches),
+// Prometheus scalars, alert series, printStats and /metrics/schema.
+// Per-entity tables (cores, interfaces, devices, groups, processes) keep
+// their hand-written renderers, since their rows are keyed by name.
+
+enum class MetricType : uint8_t { Gauge, Counter };
+
+struct MetricField {
+    const char* name;           // column and alert series name
+    MetricType type;
+    const char* unit;           // "" for plain counts
+    bool column;                // in history rows; false for Prometheus-only totals
+    const char* prometheus;     // family name, nullptr if not scraped
+    double prometheus_scale;    // to Prometheus base units (kilobytes -> bytes)
+    const char* help;
+    double (*extract)(const MetricsSnapshot& snap);
+};
+
+inline const char* metricTypeName(MetricType type) {
+    return type == MetricType::Counter ? "counter" : "gauge";
+}
+
+template <size_t N>
+constexpr size_t schemaColumns(const MetricField (&schema)[N]) {
+    size_t n = 0;
+    for (const auto& field : schema) n += field.column;
+    return n;
+}
+
+struct CpuSource {
+    static constexpr const char* kName = "cpu";
+    static constexpr MetricField kSchema[] = {
+        {"cpu_usage", MetricType::Gauge, "percent", true, "mpm_cpu_usage_percent", 1,
+         "Host CPU busy percent over the last sample interval.",
+         [](const MetricsSnapshot& s) { return s.cpu_usage; }},
+        {"procs_running", MetricType::Gauge, "", true, "mpm_procs_running", 1, "Runnable tasks.",
+         [](const MetricsSnapshot& s) { return (double)s.cpu_stats.procs_running; }},
+        {"procs_blocked", MetricType::Gauge, "", true, "mpm_procs_blocked", 1, "Tasks blocked on I/O.",
+         [](const MetricsSnapshot& s) { return (double)s.cpu_stats.procs_blocked; }},
+        {"context_switches_per_sec", MetricType::Gauge, "per_second", true, nullptr, 1, "Context switches per second.",
+         [](const MetricsSnapshot& s) { return s.cpu_stats.context_switches_per_sec; }},
+        {"interrupts_per_sec", MetricType::Gauge, "per_second", true, nullptr, 1, "Interrupts per second.",
+         [](const MetricsSnapshot& s) { return s.cpu_stats.interrupts_per_sec; }},
+        {"forks", MetricType::Counter, "", false, "mpm_forks_total", 1, "Processes created since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.process_count; }},
+        {"context_switches", MetricType::Counter, "", false, "mpm_context_switches_total", 1,
+         "Context switches since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.cpu_stats.context_switches; }},
+        {"interrupts", MetricType::Counter, "", false, "mpm_interrupts_total", 1, "Interrupts serviced since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.cpu_stats.interrupts; }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectProcStat(); }
+};
+
+struct MemorySource {
+    static constexpr const char* kName = "memory";
+    static constexpr MetricField kSchema[] = {
+        {"memory_usage_kb", MetricType::Gauge, "kilobytes", true, "mpm_memory_used_bytes", 1024,
+         "Memory in use (total - available).",
+         [](const MetricsSnapshot& s) { return (double)s.memory_usage; }},
+        {"memory_total_kb", MetricType::Gauge, "kilobytes", false, "mpm_memory_total_bytes", 1024,
+         "Total usable memory.", [](const MetricsSnapshot& s) { return (double)s.total_memory; }},
+        {"memory_free_kb", MetricType::Gauge, "kilobytes", false, "mpm_memory_free_bytes", 1024,
+         "Memory not used for anything.", [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.free_kb; }},
+        {"memory_cached_kb", MetricType::Gauge, "kilobytes", true, "mpm_memory_page_cache_bytes", 1024,
+         "Page cache (Cached + Buffers).",
+         [](const MetricsSnapshot& s) { return (double)(s.memory.meminfo.cached_kb + s.memory.meminfo.buffers_kb); }},
+        {"memory_dirty_kb", MetricType::Gauge, "kilobytes", true, "mpm_memory_dirty_bytes", 1024,
+         "Dirty page cache waiting for writeback.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.dirty_kb; }},
+        {"memory_writeback_kb", MetricType::Gauge, "kilobytes", true, "mpm_memory_writeback_bytes", 1024,
+         "Page cache being written back.", [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.writeback_kb; }},
+        {"memory_shmem_kb", MetricType::Gauge, "kilobytes", false, "mpm_memory_shmem_bytes", 1024,
+         "Shared memory and tmpfs.", [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.shmem_kb; }},
+        {"memory_slab_reclaimable_kb", MetricType::Gauge, "kilobytes", false, "mpm_memory_slab_reclaimable_bytes", 1024,
+         "Kernel slab caches that can be reclaimed.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.slab_reclaimable_kb; }},
+        {"memory_slab_unreclaimable_kb", MetricType::Gauge, "kilobytes", true, "mpm_memory_slab_unreclaimable_bytes",
+         1024, "Kernel slab memory that can't be reclaimed.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.slab_unreclaimable_kb; }},
+        {"memory_committed_kb", MetricType::Gauge, "kilobytes", false, "mpm_memory_committed_bytes", 1024,
+         "Memory promised to allocations (Committed_AS).",
+         [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.committed_as_kb; }},
+        {"swap_used_kb", MetricType::Gauge, "kilobytes", true, "mpm_swap_used_bytes", 1024, "Swap in use.",
+         [](const MetricsSnapshot& s) {
+             const MemInfo& m = s.memory.meminfo;
+             return m.swap_total_kb > m.swap_free_kb ? (double)(m.swap_total_kb - m.swap_free_kb) : 0.0;
+         }},
+        {"swap_total_kb", MetricType::Gauge, "kilobytes", false, "mpm_swap_total_bytes", 1024, "Swap space.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.swap_total_kb; }},
+        {"hugepages_total", MetricType::Gauge, "", false, "mpm_hugepages", 1, "Preallocated huge pages.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.huge_pages_total; }},
+        {"hugepages_free", MetricType::Gauge, "", false, "mpm_hugepages_free", 1, "Huge pages not yet allocated.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.meminfo.huge_pages_free; }},
+        {"major_faults_per_sec", MetricType::Gauge, "per_second", true, nullptr, 1,
+         "Page faults that had to wait for I/O, per second.",
+         [](const MetricsSnapshot& s) { return s.memory.vmstat.major_faults_per_sec; }},
+        {"swap_in_per_sec", MetricType::Gauge, "pages_per_second", true, nullptr, 1, "Pages swapped in per second.",
+         [](const MetricsSnapshot& s) { return s.memory.vmstat.swap_in_per_sec; }},
+        {"swap_out_per_sec", MetricType::Gauge, "pages_per_second", true, nullptr, 1, "Pages swapped out per second.",
+         [](const MetricsSnapshot& s) { return s.memory.vmstat.swap_out_per_sec; }},
+        {"direct_scan_per_sec", MetricType::Gauge, "pages_per_second", true, nullptr, 1,
+         "Pages scanned by allocating tasks in direct reclaim, per second.",
+         [](const MetricsSnapshot& s) { return s.memory.vmstat.pages_scanned_direct_per_sec; }},
+        {"page_faults", MetricType::Counter, "", false, "mpm_vmstat_page_faults_total", 1, "Page faults since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.vmstat.page_faults; }},
+        {"major_faults", MetricType::Counter, "", false, "mpm_vmstat_major_faults_total", 1,
+         "Major page faults since boot.", [](const MetricsSnapshot& s) { return (double)s.memory.vmstat.major_faults; }},
+        {"swap_in", MetricType::Counter, "", false, "mpm_vmstat_swap_in_pages_total", 1, "Pages swapped in since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.vmstat.swap_in; }},
+        {"swap_out", MetricType::Counter, "", false, "mpm_vmstat_swap_out_pages_total", 1,
+         "Pages swapped out since boot.", [](const MetricsSnapshot& s) { return (double)s.memory.vmstat.swap_out; }},
+        {"pages_scanned_kswapd", MetricType::Counter, "", false, "mpm_vmstat_pages_scanned_kswapd_total", 1,
+         "Pages scanned by kswapd since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.vmstat.pages_scanned_kswapd; }},
+        {"pages_scanned_direct", MetricType::Counter, "", false, "mpm_vmstat_pages_scanned_direct_total", 1,
+         "Pages scanned in direct reclaim since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.vmstat.pages_scanned_direct; }},
+        {"oom_kills", MetricType::Counter, "", false, "mpm_vmstat_oom_kills_total", 1, "OOM killer invocations since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.memory.vmstat.oom_kills; }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectMemoryUsage(); }
+};
+
+struct NetworkSource {
+    static constexpr const char* kName = "network";
+    static constexpr MetricField kSchema[] = {
+        {"net_bytes_sent", MetricType::Counter, "bytes", true, "mpm_network_transmit_bytes_total", 1,
+         "Bytes sent on all non-loopback interfaces.",
+         [](const MetricsSnapshot& s) { return (double)s.network_stats.bytes_sent; }},
+        {"net_bytes_received", MetricType::Counter, "bytes", true, "mpm_network_receive_bytes_total", 1,
+         "Bytes received on all non-loopback interfaces.",
+         [](const MetricsSnapshot& s) { return (double)s.network_stats.bytes_received; }},
+        {"net_bytes_sent_per_sec", MetricType::Gauge, "bytes_per_second", true, nullptr, 1,
+         "Bytes sent per second, all non-loopback interfaces.",
+         [](const MetricsSnapshot& s) { return s.network_stats.bytes_sent_per_sec; }},
+        {"net_bytes_received_per_sec", MetricType::Gauge, "bytes_per_second", true, nullptr, 1,
+         "Bytes received per second, all non-loopback interfaces.",
+         [](const MetricsSnapshot& s) { return s.network_stats.bytes_received_per_sec; }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectNetworkStats(); }
+};
+
+struct DiskSource {
+    static constexpr const char* kName = "disk";
+    static constexpr MetricField kSchema[] = {
+        {"disk_bytes_read", MetricType::Gauge, "bytes", true, nullptr, 1,
+         "Bytes read from whole disks since the previous sample.",
+         [](const MetricsSnapshot& s) { return (double)s.disk_stats.bytes_read; }},
+        {"disk_bytes_written", MetricType::Gauge, "bytes", true, nullptr, 1,
+         "Bytes written to whole disks since the previous sample.",
+         [](const MetricsSnapshot& s) { return (double)s.disk_stats.bytes_written; }},
+        {"disk_read_bytes_per_sec", MetricType::Gauge, "bytes_per_second", true, nullptr, 1,
+         "Bytes read per second from whole disks.",
+         [](const MetricsSnapshot& s) { return s.disk_stats.read_bytes_per_sec; }},
+        {"disk_write_bytes_per_sec", MetricType::Gauge, "bytes_per_second", true, nullptr, 1,
+         "Bytes written per second to whole disks.",
+         [](const MetricsSnapshot& s) { return s.disk_stats.write_bytes_per_sec; }},
+        {"disk_read_total", MetricType::Counter, "bytes", false, "mpm_disk_read_bytes_total", 1,
+         "Bytes read from whole disks since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.disk_stats.total_bytes_read; }},
+        {"disk_written_total", MetricType::Counter, "bytes", false, "mpm_disk_written_bytes_total", 1,
+         "Bytes written to whole disks since boot.",
+         [](const MetricsSnapshot& s) { return (double)s.disk_stats.total_bytes_written; }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectDiskStats(); }
+};
+
+struct LoadSource {
+    static constexpr const char* kName = "loadavg";
+    static constexpr MetricField kSchema[] = {
+        {"load_1min", MetricType::Gauge, "", true, "mpm_load1", 1, "1-minute load average.",
+         [](const MetricsSnapshot& s) { return s.load_average_1min; }},
+        {"load_5min", MetricType::Gauge, "", true, "mpm_load5", 1, "5-minute load average.",
+         [](const MetricsSnapshot& s) { return s.load_average_5min; }},
+        {"load_15min", MetricType::Gauge, "", true, "mpm_load15", 1, "15-minute load average.",
+         [](const MetricsSnapshot& s) { return s.load_average_15min; }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectLoadAverage(); }
+};
+
+struct SchedSource {
+    static constexpr const char* kName = "sched";
+    static constexpr MetricField kSchema[] = {
+        {"sched_run_delay_ms_per_sec", MetricType::Gauge, "ms_per_second", true, nullptr, 1,
+         "Time runnable tasks waited for a CPU per second; / 1000 is the average number waiting.",
+         [](const MetricsSnapshot& s) { return s.scheduler.run_delay_ms_per_sec; }},
+        {"sched_timeslices_per_sec", MetricType::Gauge, "per_second", true, nullptr, 1,
+         "Timeslices run per second, all CPUs.",
+         [](const MetricsSnapshot& s) { return s.scheduler.timeslices_per_sec; }},
+        {"sched_avg_delay_us", MetricType::Gauge, "microseconds", true, nullptr, 1,
+         "Average run-queue wait per timeslice over the last interval.",
+         [](const MetricsSnapshot& s) { return s.scheduler.avg_delay_us; }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectScheduler(); }
+};
+
+struct ProcessSource {
+    static constexpr const char* kName = "processes";
+    static constexpr MetricField kSchema[] = {
+        {"services_alive", MetricType::Gauge, "", false, "mpm_services_alive", 1,
+         "Tracked processes and threads that exist.",
+         [](const MetricsSnapshot& s) {
+             double alive = 0;
+             for (const auto& svc : s.services) alive += svc.alive;
+             return alive;
+         }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectProcesses(); }
+};
+
+// Ratios from the perf_event groups, next to cpu_usage: low IPC with high
+// cache MPKI is a memory-stall-bound host, high IPC a compute-bound one.
+// Zero where the PMU has no such counter.
+struct PerfSource {
+    static constexpr const char* kName = "perf";
+    static constexpr MetricField kSchema[] = {
+        {"perf_ipc", MetricType::Gauge, "", true, nullptr, 1, "Instructions per cycle, all CPUs.",
+         [](const MetricsSnapshot& s) { return s.perf.ipc; }},
+        {"perf_cache_miss_percent", MetricType::Gauge, "percent", true, nullptr, 1,
+         "Cache references that missed the last-level cache.",
+         [](const MetricsSnapshot& s) { return s.perf.cache_miss_percent; }},
+        {"perf_cache_mpki", MetricType::Gauge, "", true, nullptr, 1, "Cache misses per 1000 instructions.",
+         [](const MetricsSnapshot& s) { return s.perf.cache_mpki; }},
+        {"perf_branch_miss_percent", MetricType::Gauge, "percent", true, nullptr, 1, "Mispredicted branches.",
+         [](const MetricsSnapshot& s) { return s.perf.branch_miss_percent; }},
+        {"perf_cpu_migrations_per_sec", MetricType::Gauge, "per_second", true, nullptr, 1,
+         "Tasks moved between CPUs per second.",
+         [](const MetricsSnapshot& s) { return s.perf.cpu_migrations_per_sec; }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectPerfCounters(); }
+};
+
+struct PressureSource {
+    static constexpr const char* kName = "pressure";
+    static constexpr MetricField kSchema[] = {
+        {"psi_cpu_some_percent", MetricType::Gauge, "percent", true, nullptr, 1,
+         "Share of the last interval some task waited for CPU.",
+         [](const MetricsSnapshot& s) { return s.pressure.cpu.some_percent; }},
+        {"psi_memory_some_percent", MetricType::Gauge, "percent", true, nullptr, 1,
+         "Share of the last interval some task stalled on memory.",
+         [](const MetricsSnapshot& s) { return s.pressure.memory.some_percent; }},
+        {"psi_memory_full_percent", MetricType::Gauge, "percent", true, nullptr, 1,
+         "Share of the last interval all tasks stalled on memory.",
+         [](const MetricsSnapshot& s) { return s.pressure.memory.full_percent; }},
+        {"psi_io_some_percent", MetricType::Gauge, "percent", true, nullptr, 1,
+         "Share of the last interval some task stalled on I/O.",
+         [](const MetricsSnapshot& s) { return s.pressure.io.some_percent; }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectPressure(); }
+};
+
+struct CgroupSource {
+    static constexpr const char* kName = "cgroups";
+    static constexpr MetricField kSchema[] = {
+        {"cgroups", MetricType::Gauge, "", false, "mpm_cgroups", 1, "Groups sampled under the cgroup root.",
+         [](const MetricsSnapshot& s) { return (double)s.cgroups.size(); }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectCgroups(); }
+};
+
+struct CustomSource {
+    static constexpr const char* kName = "custom";
+    static constexpr MetricField kSchema[] = {
+        {"custom_metrics", MetricType::Gauge, "", false, "mpm_custom_metrics", 1,
+         "Metrics published over shared memory.",
+         [](const MetricsSnapshot& s) { return (double)s.custom_metrics.size(); }},
+    };
+    template <typename Monitor> static void collect(Monitor& m) { m.collectCustomMetrics(); }
+};
+
+// Order of the history columns. CSV files, segments and push batches from
+// earlier builds are read back by position, so a new column is appended
+// here and never inserted or reordered; the schemas may group fields as
+// they like. Every field with column set must be listed exactly once.
+constexpr std::string_view kColumnOrder[] = {
+    "cpu_usage", "memory_usage_kb", "net_bytes_sent", "net_bytes_received", "disk_bytes_read",
+    "disk_bytes_written", "load_1min", "load_5min", "load_15min", "procs_running", "procs_blocked",
+    "context_switches_per_sec", "interrupts_per_sec",
+    "net_bytes_sent_per_sec", "net_bytes_received_per_sec", "disk_read_bytes_per_sec",
+    "disk_write_bytes_per_sec",
+    "psi_cpu_some_percent", "psi_memory_some_percent", "psi_memory_full_percent", "psi_io_some_percent",
+    "sched_run_delay_ms_per_sec", "sched_timeslices_per_sec", "sched_avg_delay_us",
+    "memory_cached_kb", "memory_dirty_kb", "memory_writeback_kb", "memory_slab_unreclaimable_kb",
+    "swap_used_kb", "major_faults_per_sec", "swap_in_per_sec", "swap_out_per_sec", "direct_scan_per_sec",
+    "perf_ipc", "perf_cache_miss_percent", "perf_cache_mpki", "perf_branch_miss_percent",
+    "perf_cpu_migrations_per_sec",
+};
+
+struct ColumnRef {
+    uint16_t source;
+    uint16_t field;
+};
+
+template <size_t Columns>
+struct ColumnTable {
+    std::array<ColumnRef, Columns> columns{};
+    size_t found = 0;
+};
+
+// (source, field) of each kColumnOrder entry that names a column
+template <size_t Columns, size_t Count>
+constexpr ColumnTable<Columns> orderColumns(const MetricField* const (&schemas)[Count], const size_t (&sizes)[Count]) {
+    ColumnTable<Columns> table;
+    for (std::string_view name : kColumnOrder) {
+        for (size_t i = 0; i < Count; i++) {
+            for (size_t f = 0; f < sizes[i]; f++) {
+                if (schemas[i][f].column && name == schemas[i][f].name && table.found < Columns) {
+                    table.columns[table.found++] = {uint16_t(i), uint16_t(f)};
+                }
+            }
+        }
+    }
+    return table;
+}
+
+template <typename... Sources>
+class CollectorPipeline {
+public:
+    static_assert(sizeof...(Sources) <= 32, "collector masks are 32 bits");
+
+    static constexpr size_t kCount = sizeof...(Sources);
+    static constexpr uint32_t kAll = uint32_t((uint64_t(1) << kCount) - 1);
+    static constexpr const char* kNames[] = {Sources::kName...};
+    static constexpr const MetricField* kSchemas[] = {Sources::kSchema...};
+    static constexpr size_t kSchemaSizes[] = {std::size(Sources::kSchema)...};
+    // Upper bound for a history row (every source enabled)
+    static constexpr size_t kColumnCount = (schemaColumns(Sources::kSchema) + ...);
+
+    // Index by name, or -1
+    static constexpr int indexOf(std::string_view name) {
+        for (size_t i = 0; i < kCount; i++) {
+            if (name == kNames[i]) return (int)i;
+        }
+        return -1;
+    }
+
+    // Runs the sources whose bit is set, in declaration order
+    template <typename Monitor>
+    static void collect(Monitor& monitor, uint32_t mask) {
+        collectEach(monitor, mask, std::index_sequence_for<Sources...>());
+    }
+
+    // fn(field, source index) for every field of the sources in mask
+    template <typename Fn>
+    static void forEachField(uint32_t mask, Fn&& fn) {
+        for (size_t i = 0; i < kCount; i++) {
+            if (!(mask >> i & 1)) continue;
+            for (size_t f = 0; f < kSchemaSizes[i]; f++) {
+                fn(kSchemas[i][f], i);
+            }
+        }
+    }
+
+    // Same, history columns only, in kColumnOrder - the order of every history row
+    template <typename Fn>
+    static void forEachColumn(uint32_t mask, Fn&& fn) {
+        for (const ColumnRef& column : kColumns.columns) {
+            if (mask >> column.source & 1) fn(kSchemas[column.source][column.field], column.source);
+        }
+    }
+
+private:
+    static constexpr ColumnTable<kColumnCount> kColumns = orderColumns<kColumnCount>(kSchemas, kSchemaSizes);
+    static_assert(std::size(kColumnOrder) == kColumnCount && kColumns.found == kColumnCount,
+                  "every history column must be listed in kColumnOrder exactly once");
+
+    template <typename Monitor, size_t... I>
+    static void collectEach(Monitor& monitor, uint32_t mask, std::index_sequence<I...>) {
+        ((mask >> I & 1 ? Sources::template collect<Monitor>(monitor) : void()), ...);
+    }
+};
+
+// Everything the monitor can sample. Scheduler task ids, --collectors and
+// --collector-interval names and snapshot collector bits follow this order.
+using HostCollectors = CollectorPipeline<CpuSource, MemorySource, NetworkSource, DiskSource, LoadSource,
+                                         SchedSource, ProcessSource, PerfSource, PressureSource, CgroupSource,
+                                         CustomSource>;
@@ -0,0 +1,276 @@
+#include "device_collector.h"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// /proc/diskstats counts in 512-byte units whatever the device's block size
+const uint64_t kDiskstatsSectorBytes = 512;
+
+bool startsWith(std::string_view s, std::string_view prefix) {
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+// Delta of a kernel counter. One that goes backwards was reset (device
+// re-created, driver reloaded), so the delta is what it counted since.
+uint64_t counterDelta(uint64_t now, uint64_t prev) {
+    return now >= prev ? now - prev : now;
+}
+
+// Same for a counter the kernel keeps in 32 bits (io_ticks), which wraps
+uint64_t counter32Delta(uint64_t now, uint64_t prev) {
+    if (now >= prev || prev > UINT32_MAX) {
+        return counterDelta(now, prev);
+    }
+    return now + (uint64_t(1) << 32) - prev;
+}
+
+double perSec(uint64_t delta, double elapsed_sec) {
+    return elapsed_sec > 0.0 ? delta / elapsed_sec : 0.0;
+}
+
+// Small sysfs attribute as an integer; fallback if missing
+uint64_t readSysfsNumber(const std::string& path, uint64_t fallback) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return fallback;
+    }
+    char buf[32];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    close(fd);
+    uint64_t value = fallback;
+    if (n > 0) {
+        std::from_chars(buf, buf + n, value);
+    }
+    return value;
+}
+
+}
+
+uint32_t NameTable::intern(std::string_view name, uint32_t hint) {
+    if (hint < names.size() && names[hint] == name) {
+        return hint;
+    }
+    uint32_t free_id = names.size();
+    for (uint32_t id = 0; id < names.size(); id++) {
+        if (names[id] == name) return id;
+        if (names[id].empty() && free_id == names.size()) free_id = id;
+    }
+    if (free_id < names.size()) {
+        names[free_id] = name;
+        return free_id;
+    }
+    names.emplace_back(name);
+    return free_id;
+}
+
+void NetworkCollector::collect(NetworkStats& out) {
+    if (!net_dev.read()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_sec = std::chrono::duration<double>(now - prev_time).count();
+    prev_time = now;
+
+    for (auto& state : states) state.seen = false;
+    size_t count = 0;  // out.interfaces is reused in place, then trimmed
+    out.bytes_sent = out.bytes_received = 0;
+    out.bytes_sent_per_sec = out.bytes_received_per_sec = 0.0;
+
+    ProcScanner ss(net_dev.contents());
+    ss.nextLine();  // two header lines
+    uint32_t hint = 0;
+    // "  eth0: 1234 ..." - older kernels glue big counters to the colon
+    while (ss.nextLine()) {
+        std::string_view line = ss.restOfLine();
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        std::string_view name = line.substr(0, colon);
+        while (!name.empty() && name.front() == ' ') name.remove_prefix(1);
+        if (name.empty()) {
+            continue;
+        }
+
+        // rx: bytes packets errs drop fifo frame compressed multicast, then tx
+        ProcScanner fields(line.substr(colon + 1));
+        uint64_t rx_bytes = fields.u64(), rx_packets = fields.u64();
+        uint64_t rx_errors = fields.u64(), rx_dropped = fields.u64();
+        fields.skip(4);
+        uint64_t tx_bytes = fields.u64(), tx_packets = fields.u64();
+        uint64_t tx_errors = fields.u64(), tx_dropped = fields.u64();
+
+        uint32_t id = names.intern(name, hint);
+        hint = id + 1;
+        if (id >= states.size()) states.resize(id + 1);
+        State& state = states[id];
+        state.seen = true;
+
+        if (count == out.interfaces.size()) out.interfaces.emplace_back();
+        InterfaceStats& iface = out.interfaces[count++];
+        iface.name = names.name(id);
+        iface.rx_bytes = rx_bytes;
+        iface.tx_bytes = tx_bytes;
+        iface.rx_packets = rx_packets;
+        iface.tx_packets = tx_packets;
+        iface.rx_errors = rx_errors;
+        iface.tx_errors = tx_errors;
+        iface.rx_dropped = rx_dropped;
+        iface.tx_dropped = tx_dropped;
+
+        double since_prev = state.has_prev ? elapsed_sec : 0.0;
+        iface.rx_bytes_per_sec = perSec(counterDelta(rx_bytes, state.rx_bytes), since_prev);
+        iface.tx_bytes_per_sec = perSec(counterDelta(tx_bytes, state.tx_bytes), since_prev);
+        iface.rx_packets_per_sec = perSec(counterDelta(rx_packets, state.rx_packets), since_prev);
+        iface.tx_packets_per_sec = perSec(counterDelta(tx_packets, state.tx_packets), since_prev);
+        iface.errors_per_sec = perSec(counterDelta(rx_errors + tx_errors, state.errors), since_prev);
+        iface.dropped_per_sec = perSec(counterDelta(rx_dropped + tx_dropped, state.dropped), since_prev);
+
+        state.rx_bytes = rx_bytes;
+        state.tx_bytes = tx_bytes;
+        state.rx_packets = rx_packets;
+        state.tx_packets = tx_packets;
+        state.errors = rx_errors + tx_errors;
+        state.dropped = rx_dropped + tx_dropped;
+        state.has_prev = true;
+
+        if (name != "lo") {
+            out.bytes_received += rx_bytes;
+            out.bytes_sent += tx_bytes;
+            out.bytes_received_per_sec += iface.rx_bytes_per_sec;
+            out.bytes_sent_per_sec += iface.tx_bytes_per_sec;
+        }
+    }
+
+    out.interfaces.resize(count);
+
+    // Gone interfaces give up their id and start from scratch if they reappear
+    for (uint32_t id = 0; id < states.size(); id++) {
+        if (!states[id].seen && states[id].has_prev) {
+            names.release(id);
+            states[id] = State();
+        }
+    }
+}
+
+void BlockDeviceCollector::classify(std::string_view name, State& state) {
+    // Pseudo devices with nothing interesting to say
+    if (startsWith(name, "loop") || startsWith(name, "ram")) {
+        state.kind = Kind::Skip;
+        return;
+    }
+    // Only whole devices have a /sys/block entry; '/' in a name is '!' there
+    std::string dir = "/sys/block/" + std::string(name);
+    std::replace(dir.begin() + 11, dir.end(), '/', '!');
+    if (access(dir.c_str(), F_OK) != 0) {
+        state.kind = Kind::Skip;  // partition
+        return;
+    }
+    state.kind = Kind::Disk;
+    state.is_virtual = access((dir + "/device").c_str(), F_OK) != 0;
+    state.sector_size = readSysfsNumber(dir + "/queue/logical_block_size", 512);
+}
+
+void BlockDeviceCollector::collect(DiskStats& out) {
+    if (!diskstats.read()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_sec = std::chrono::duration<double>(now - prev_time).count();
+    prev_time = now;
+
+    for (auto& state : states) state.seen = false;
+    size_t count = 0;
+    out.bytes_read = out.bytes_written = 0;
+    out.total_bytes_read = out.total_bytes_written = 0;
+    out.read_bytes_per_sec = out.write_bytes_per_sec = 0.0;
+
+    ProcScanner ss(diskstats.contents());
+    uint32_t hint = 0;
+    do {
+        ss.skip(2);  // major, minor
+        std::string_view name = ss.token();
+        if (name.empty()) {
+            continue;
+        }
+        uint32_t id = names.intern(name, hint);
+        hint = id + 1;
+        if (id >= states.size()) states.resize(id + 1);
+        State& state = states[id];
+        state.seen = true;
+        if (state.kind == Kind::Unknown) {
+            classify(name, state);  // once per name
+        }
+        if (state.kind != Kind::Disk) {
+            continue;
+        }
+
+        // reads merged sectors ms, writes merged sectors ms, in_flight io_ticks
+        uint64_t reads = ss.u64();
+        ss.skip(1);
+        uint64_t sectors_read = ss.u64();
+        ss.skip(1);
+        uint64_t writes = ss.u64();
+        ss.skip(1);
+        uint64_t sectors_written = ss.u64();
+        ss.skip(2);
+        uint64_t io_ticks = ss.u64();
+
+        if (count == out.devices.size()) out.devices.emplace_back();
+        BlockDeviceStats& dev = out.devices[count++];
+        dev.name = names.name(id);
+        dev.is_virtual = state.is_virtual;
+        dev.sector_size = state.sector_size;
+        dev.reads = reads;
+        dev.writes = writes;
+        dev.read_bytes = sectors_read * kDiskstatsSectorBytes;
+        dev.write_bytes = sectors_written * kDiskstatsSectorBytes;
+        dev.io_ticks_ms = io_ticks;
+
+        uint64_t read_delta = 0, written_delta = 0;
+        if (state.has_prev) {
+            read_delta = counterDelta(sectors_read, state.sectors_read) * kDiskstatsSectorBytes;
+            written_delta = counterDelta(sectors_written, state.sectors_written) * kDiskstatsSectorBytes;
+            dev.read_iops = perSec(counterDelta(reads, state.reads), elapsed_sec);
+            dev.write_iops = perSec(counterDelta(writes, state.writes), elapsed_sec);
+            dev.read_bytes_per_sec = perSec(read_delta, elapsed_sec);
+            dev.write_bytes_per_sec = perSec(written_delta, elapsed_sec);
+            dev.busy_percent = elapsed_sec > 0.0
+                ? std::min(100.0, counter32Delta(io_ticks, state.io_ticks) / (elapsed_sec * 10.0)) : 0.0;
+        } else {
+            dev.read_iops = dev.write_iops = 0.0;
+            dev.read_bytes_per_sec = dev.write_bytes_per_sec = dev.busy_percent = 0.0;
+        }
+        state.reads = reads;
+        state.writes = writes;
+        state.sectors_read = sectors_read;
+        state.sectors_written = sectors_written;
+        state.io_ticks = io_ticks;
+        state.has_prev = true;
+
+        // Host totals count physical disks only, so dm/md stacked on top of
+        // them aren't counted twice
+        if (!state.is_virtual) {
+            out.total_bytes_read += dev.read_bytes;
+            out.total_bytes_written += dev.write_bytes;
+            out.bytes_read += read_delta;
+            out.bytes_written += written_delta;
+            out.read_bytes_per_sec += dev.read_bytes_per_sec;
+            out.write_bytes_per_sec += dev.write_bytes_per_sec;
+        }
+    } while (ss.nextLine());
+    out.devices.resize(count);
+
+    // A device that went away may come back as different hardware, so its
+    // id and classification are dropped with it
+    for (uint32_t id = 0; id < states.size(); id++) {
+        if (!states[id].seen && states[id].kind != Kind::Unknown) {
+            names.release(id);
+            states[id] = State();
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "proc_reader.h"
+#include "snapshot.h"
+
+// Device names mapped to dense ids that index per-device state. Lookups
+// start at a hint - the id the previous line of the same file resolved to,
+// plus one - since /proc lists devices in a stable order, so the steady
+// state is one compare per line and no allocation. The ids of released
+// names are handed out again, so churning names (veth, loop) stay bounded.
+class NameTable {
+public:
+    uint32_t intern(std::string_view name, uint32_t hint);
+    void release(uint32_t id) { names[id].clear(); }
+    const std::string& name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+private:
+    std::vector<std::string> names;
+};
+
+// Per-interface counters and rates from /proc/net/dev. Interfaces that
+// vanish are dropped from the table and start over if they come back.
+class NetworkCollector {
+public:
+    // Sampler thread only
+    void collect(NetworkStats& out);
+
+private:
+    struct State {
+        bool seen = false;      // present in the latest read
+        bool has_prev = false;
+        uint64_t rx_bytes = 0, tx_bytes = 0, rx_packets = 0, tx_packets = 0;
+        uint64_t errors = 0, dropped = 0;
+    };
+
+    ProcFile net_dev{"/proc/net/dev"};
+    NameTable names;
+    std::vector<State> states;  // by name id
+    std::chrono::steady_clock::time_point prev_time;
+};
+
+// Per-device I/O from /proc/diskstats. Whole devices are told apart from
+// partitions through /sys/block once per device name, not by name patterns.
+class BlockDeviceCollector {
+public:
+    // Sampler thread only
+    void collect(DiskStats& out);
+
+private:
+    enum class Kind : uint8_t { Unknown, Disk, Skip };
+
+    struct State {
+        Kind kind = Kind::Unknown;
+        bool is_virtual = false;
+        uint32_t sector_size = 512;
+        bool seen = false;
+        bool has_prev = false;
+        uint64_t reads = 0, writes = 0, sectors_read = 0, sectors_written = 0, io_ticks = 0;
+    };
+
+    ProcFile diskstats{"/proc/diskstats"};
+    NameTable names;
+    std::vector<State> states;  // by name id
+    std::chrono::steady_clock::time_point prev_time;
+
+    static void classify(std::string_view name, State& state);
+};
@@ -0,0 +1,317 @@
+#include "history_writer.h"
+#include <iostream>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+namespace {
+
+// Rows formatted per batch before the buffer is flushed early
+const size_t kBatchFlushBytes = 256 * 1024;
+// How often a log that couldn't be reopened is tried again
+const auto kReopenInterval = std::chrono::seconds(10);
+
+void appendInt(std::string& out, int64_t value) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, result.ptr - buf);
+}
+
+void appendDouble(std::string& out, double value) {
+    char buf[48];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed, 2);
+    out.append(buf, result.ptr - buf);
+}
+
+// name == base + ".YYYYmmdd-HHMMSS" with an optional "-n", as rotate() names them
+bool isRotatedName(const std::string& name, const std::string& base) {
+    static const char kPattern[] = ".dddddddd-dddddd";
+    size_t length = base.size() + sizeof(kPattern) - 1;
+    if (name.size() < length || name.compare(0, base.size(), base) != 0) {
+        return false;
+    }
+    for (size_t i = 0; kPattern[i]; i++) {
+        char c = name[base.size() + i];
+        if (kPattern[i] == 'd' ? (c < '0' || c > '9') : c != kPattern[i]) return false;
+    }
+    if (name.size() == length) {
+        return true;
+    }
+    if (name[length] != '-' || name.size() == length + 1) {
+        return false;
+    }
+    return std::all_of(name.begin() + length + 1, name.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+// Age order of two rotated names: the timestamp, then the collision number
+// as a number, so "-10" comes after "-2"
+bool rotatedBefore(const std::string& a, const std::string& b, size_t base_size) {
+    const size_t stamp = sizeof(".YYYYmmdd-HHMMSS") - 1;
+    int order = a.compare(base_size, stamp, b, base_size, stamp);
+    if (order != 0) {
+        return order < 0;
+    }
+    auto collision = [&](const std::string& name) {
+        uint64_t n = 0;
+        if (name.size() > base_size + stamp + 1) {
+            std::from_chars(name.data() + base_size + stamp + 1, name.data() + name.size(), n);
+        }
+        return n;
+    };
+    return collision(a) < collision(b);
+}
+
+}
+
+HistoryWriter::HistoryWriter(std::vector<std::string> columns, const HistoryLogConfig& config)
+    : columns(std::move(columns)), config(config),
+      capacity(config.queue_capacity ? config.queue_capacity : 1),
+      timestamps(new int64_t[capacity]),
+      rows(new double[capacity * this->columns.size()]) {
+    batch.reserve(kBatchFlushBytes + 4096);
+}
+
+HistoryWriter::~HistoryWriter() {
+    stop();
+}
+
+void HistoryWriter::appendHeader(const std::vector<std::string>& columns, std::string& out) {
+    out += "timestamp_ms";
+    for (const auto& column : columns) {
+        out += ',';
+        out += column;
+    }
+    out += '\n';
+}
+
+void HistoryWriter::appendRow(int64_t timestamp_ms, const double* values, size_t count, std::string& out) {
+    appendInt(out, timestamp_ms);
+    for (size_t i = 0; i < count; i++) {
+        out += ',';
+        appendDouble(out, values[i]);
+    }
+    out += '\n';
+}
+
+bool HistoryWriter::start() {
+    if (running) {
+        return true;
+    }
+    if (!openFile()) {
+        return false;
+    }
+    pruneRotated();
+    running = true;
+    thread = std::thread(&HistoryWriter::writerLoop, this);
+    return true;
+}
+
+void HistoryWriter::stop() {
+    if (!running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        running = false;
+    }
+    wake_cv.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+void HistoryWriter::push(int64_t timestamp_ms, const double* values) {
+    uint64_t index = head.load(std::memory_order_relaxed);
+    if (index - tail.load(std::memory_order_acquire) >= capacity) {
+        dropped.fetch_add(1, std::memory_order_relaxed);  // writer is behind, never wait for it
+        return;
+    }
+    size_t slot = index % capacity;
+    timestamps[slot] = timestamp_ms;
+    std::memcpy(&rows[slot * columns.size()], values, columns.size() * sizeof(double));
+    head.store(index + 1, std::memory_order_release);
+}
+
+void HistoryWriter::writerLoop() {
+    auto interval = std::chrono::milliseconds(config.flush_interval_ms > 0 ? config.flush_interval_ms : 1000);
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake_cv.wait_for(lock, interval, [this] { return !running; });
+        }
+        drainBatch();
+    }
+    drainBatch();  // whatever was queued before stop()
+}
+
+void HistoryWriter::drainBatch() {
+    uint64_t first = tail.load(std::memory_order_relaxed);
+    uint64_t last = head.load(std::memory_order_acquire);
+    if (first == last) {
+        return;
+    }
+    if (fd < 0) {
+        // Reopening failed after a rotation (disk full, out of fds); rows stay
+        // queued meanwhile and the producer drops once the ring fills
+        auto now = std::chrono::steady_clock::now();
+        if (now < next_reopen) {
+            return;
+        }
+        next_reopen = now + kReopenInterval;
+        if (!openFile()) {
+            return;
+        }
+    }
+
+    bool rotate_by_age = config.max_file_age_sec > 0 &&
+        std::chrono::system_clock::now() - file_opened > std::chrono::seconds(config.max_file_age_sec);
+    if (file_bytes >= config.max_file_bytes || rotate_by_age) {
+        rotate();
+        if (fd < 0) {
+            return;  // rows stay queued; producer drops once the ring fills
+        }
+    }
+
+    batch.clear();
+    for (uint64_t index = first; index < last; index++) {
+        size_t slot = index % capacity;
+        appendRow(timestamps[slot], &rows[slot * columns.size()], columns.size(), batch);
+        if (batch.size() >= kBatchFlushBytes) {
+            writeAll(batch.data(), batch.size());
+            batch.clear();
+        }
+    }
+    // Rows are formatted, hand the slots back before touching the disk again
+    tail.store(last, std::memory_order_release);
+
+    writeAll(batch.data(), batch.size());
+    // One sync per batch: a crash loses at most the rows queued since the last one
+    fdatasync(fd);
+}
+
+bool HistoryWriter::writeAll(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "History log write failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        data += written;
+        size -= written;
+        file_bytes += written;
+    }
+    return true;
+}
+
+bool HistoryWriter::openFile() {
+    fd = open(config.path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        if (!open_failed) {
+            std::cerr << "Failed to open history log " << config.path << ": " << std::strerror(errno)
+                      << (running ? "; retrying" : "") << std::endl;
+        }
+        open_failed = true;
+        return false;
+    }
+    if (open_failed) {
+        std::cerr << "History log " << config.path << " reopened" << std::endl;
+        open_failed = false;
+    }
+    struct stat st;
+    file_bytes = fstat(fd, &st) == 0 ? st.st_size : 0;
+    file_opened = std::chrono::system_clock::now();
+
+    std::string prefix;
+    appendHeader(columns, prefix);
+    if (file_bytes > 0) {
+        // A file from a run with other collectors or columns is moved aside
+        // rather than appended to under the wrong header
+        std::string first(prefix.size(), '\0');
+        ssize_t n = pread(fd, first.data(), first.size(), 0);
+        if (n != (ssize_t)first.size() || first != prefix) {
+            std::cerr << "History log " << config.path << " has other columns; rotating it" << std::endl;
+            close(fd);
+            fd = -1;
+            return moveAside() && openFile();
+        }
+        prefix.clear();
+        // A crash mid-write can leave a torn last line; start ours on a fresh one
+        char last = '\n';
+        if (pread(fd, &last, 1, file_bytes - 1) == 1 && last != '\n') {
+            prefix += '\n';
+        }
+    }
+    return writeAll(prefix.data(), prefix.size());
+}
+
+void HistoryWriter::rotate() {
+    close(fd);
+    fd = -1;
+    moveAside();
+    openFile();
+}
+
+// Renames the current file to its rotated name and applies retention
+bool HistoryWriter::moveAside() {
+    char suffix[32];
+    std::time_t now = std::time(nullptr);
+    // UTC, so names keep sorting by age across DST changes
+    struct tm utc;
+    gmtime_r(&now, &utc);
+    std::strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &utc);
+
+    std::string target = config.path + suffix;
+    struct stat st;
+    for (int n = 1; stat(target.c_str(), &st) == 0; n++) {
+        target = config.path + suffix + "-" + std::to_string(n);
+    }
+    if (rename(config.path.c_str(), target.c_str()) != 0) {
+        std::cerr << "History log rotation failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    pruneRotated();
+    return true;
+}
+
+// Keeps the newest max_files rotated files, including ones earlier runs
+// left behind.
+void HistoryWriter::pruneRotated() {
+    if (config.max_files <= 0) {
+        return;
+    }
+    size_t slash = config.path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : config.path.substr(0, slash + 1);
+    std::string base = slash == std::string::npos ? config.path : config.path.substr(slash + 1);
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) {
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(handle)) {
+        if (isRotatedName(entry->d_name, base)) names.push_back(entry->d_name);
+    }
+    closedir(handle);
+    if ((int)names.size() <= config.max_files) {
+        return;
+    }
+    std::sort(names.begin(), names.end(), [&base](const std::string& a, const std::string& b) {
+        return rotatedBefore(a, b, base.size());
+    });
+    for (size_t i = 0; i + config.max_files < names.size(); i++) {
+        std::string victim = (slash == std::string::npos ? "" : dir) + names[i];
+        if (unlink(victim.c_str()) != 0) {
+            std::cerr << "Failed to remove old history log " << victim << ": " << std::strerror(errno) << std::endl;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+struct HistoryLogConfig {
+    std::string path = "metrics_history.csv";
+    size_t max_file_bytes = 64 * 1024 * 1024;  // rotate when the file passes this
+    int max_file_age_sec = 3600;               // ...or is this old (0 = never)
+    int max_files = 24;                        // rotated files kept on disk
+    int flush_interval_ms = 1000;              // one batch (write + fdatasync) per interval
+    size_t queue_capacity = 4096;              // rows buffered between batches
+};
+
+// Durable CSV log of published samples, written off the sampling thread.
+//
+// push() copies one row into a preallocated single-producer/single-consumer
+// ring and never blocks or allocates; if the writer falls behind, rows are
+// dropped and counted. The writer thread wakes every flush interval, formats
+// everything queued into one buffer, writes it with a single write() and
+// fdatasync()s, so a crash loses at most the batch in flight.
+//
+// An existing file is appended to only if its header matches the columns;
+// otherwise it is rotated first.
+//
+// Rotated files are <path>.YYYYmmdd-HHMMSS[-n], in UTC. Retention is
+// applied to every such file in the directory, whichever run wrote it, at
+// start and after each rotation.
+class HistoryWriter {
+public:
+    HistoryWriter(std::vector<std::string> columns, const HistoryLogConfig& config);
+    ~HistoryWriter();
+
+    bool start();
+    void stop();  // flushes whatever is queued
+
+    // Producer side (sampler thread). values holds one entry per column.
+    void push(int64_t timestamp_ms, const double* values);
+
+    uint64_t droppedRows() const { return dropped.load(std::memory_order_relaxed); }
+
+    // Header line and row formatting, shared with appendToCSV
+    static void appendHeader(const std::vector<std::string>& columns, std::string& out);
+    static void appendRow(int64_t timestamp_ms, const double* values, size_t count, std::string& out);
+
+private:
+    std::vector<std::string> columns;
+    HistoryLogConfig config;
+    size_t capacity;
+    std::unique_ptr<int64_t[]> timestamps;  // capacity
+    std::unique_ptr<double[]> rows;         // capacity * columns.size()
+    std::atomic<uint64_t> head{0};          // next row the producer writes
+    std::atomic<uint64_t> tail{0};          // next row the writer reads
+    std::atomic<uint64_t> dropped{0};
+
+    int fd = -1;
+    size_t file_bytes = 0;
+    std::chrono::system_clock::time_point file_opened;
+    bool open_failed = false;                         // logged once until it opens again
+    std::chrono::steady_clock::time_point next_reopen;  // while fd is -1
+    std::string batch;
+
+    std::atomic<bool> running{false};
+    std::thread thread;
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+
+    void writerLoop();
+    void drainBatch();
+    bool openFile();
+    void rotate();
+    bool moveAside();
+    void pruneRotated();
+    bool writeAll(const char* data, size_t size);
+};
@@ -0,0 +1,700 @@
+#include "http_server.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cctype>
+#include <charconv>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+namespace {
+
+const int kMaxEvents = 256;
+const size_t kInitialReadBuffer = 4096;
+const size_t kMaxPendingOutput = 1 << 20;  // stop parsing pipelined requests past this
+
+const char kEventStreamHead[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Connection: keep-alive\r\n\r\n";
+// Subscriber socket buffer. Caps how far a client may lag before its next
+// event finds the previous one unsent and it gets dropped; without it the
+// kernel autotunes up to megabytes.
+const int kStreamSendBuffer = 32 * 1024;
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i])) return false;
+    }
+    return true;
+}
+
+// Case-insensitive search for a token in a comma separated header value
+bool hasToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+        if (equalsIgnoreCase(item, token)) return true;
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+void setEvents(int epoll_fd, int fd, uint32_t events, int op) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd, op, fd, &ev);
+}
+
+void appendError(std::string& out, const char* status, const char* message) {
+    std::string body = std::string("{\"error\":\"") + message + "\"}";
+    out += "HTTP/1.1 ";
+    out += status;
+    out += "\r\nContent-Type: application/json\r\n";
+    out += "Content-Length: " + std::to_string(body.length()) + "\r\n";
+    out += "Connection: close\r\n\r\n";
+    out += body;
+}
+
+}
+
+bool HttpRequest::param(std::string_view key, std::string_view& value) const {
+    std::string_view rest = query;
+    while (!rest.empty()) {
+        size_t amp = rest.find('&');
+        std::string_view pair = rest.substr(0, amp);
+        size_t eq = pair.find('=');
+        if (pair.substr(0, eq) == key) {
+            value = eq == std::string_view::npos ? std::string_view() : pair.substr(eq + 1);
+            return true;
+        }
+        if (amp == std::string_view::npos) break;
+        rest.remove_prefix(amp + 1);
+    }
+    return false;
+}
+
+HttpServer::HttpServer(HttpHandler handler) : handler(std::move(handler)) {
+}
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+int HttpServer::openListener() const {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (config.worker_threads > 1) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    }
+
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(config.port);
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        std::cerr << "Bind failed: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, config.backlog) < 0) {
+        std::cerr << "Listen failed: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool HttpServer::start(const HttpServerConfig& cfg) {
+    if (running) {
+        return false;
+    }
+    config = cfg;
+    if (config.worker_threads < 1) {
+        config.worker_threads = 1;
+    }
+
+    for (int i = 0; i < config.worker_threads; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->listen_fd = openListener();
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        bool ok = worker->listen_fd != -1 && worker->epoll_fd != -1 && worker->wake_fd != -1;
+        workers.push_back(std::move(worker));
+        if (!ok) {
+            for (auto& w : workers) {
+                closeWorker(*w);
+            }
+            workers.clear();
+            return false;
+        }
+        setEvents(workers.back()->epoll_fd, workers.back()->listen_fd, EPOLLIN, EPOLL_CTL_ADD);
+        setEvents(workers.back()->epoll_fd, workers.back()->wake_fd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+    running = true;
+    for (auto& worker : workers) {
+        worker->thread = std::thread(&HttpServer::workerLoop, this, std::ref(*worker));
+    }
+    return true;
+}
+
+void HttpServer::stop() {
+    if (!running) {
+        return;
+    }
+    // Deferred handlers post back to their worker, so let them finish
+    // first. running drops under the same lock defer() counts them under,
+    // so none can start once the wait begins.
+    {
+        std::unique_lock<std::mutex> lock(deferred_mutex);
+        running = false;
+        deferred_done.wait(lock, [this] { return deferred_running == 0; });
+    }
+    for (auto& worker : workers) {
+        uint64_t one = 1;
+        ssize_t ignored = write(worker->wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+        closeWorker(*worker);
+    }
+    workers.clear();
+}
+
+void HttpServer::publishEvent(std::shared_ptr<const std::string> event) {
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        latest_event = std::move(event);
+        event_sequence++;
+    }
+    // Only wake workers that have someone to send to
+    for (auto& worker : workers) {
+        if (worker->subscriber_count.load(std::memory_order_relaxed) > 0) {
+            uint64_t one = 1;
+            ssize_t ignored = write(worker->wake_fd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+}
+
+size_t HttpServer::subscriberCount() const {
+    size_t total = 0;
+    for (auto& worker : workers) {
+        total += worker->subscriber_count.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void HttpServer::closeWorker(Worker& worker) {
+    for (auto& entry : worker.connections) {
+        close(entry.first);
+    }
+    worker.connections.clear();
+    worker.idle_order.clear();
+    worker.subscribers.clear();
+    worker.subscriber_count = 0;
+    if (worker.listen_fd != -1) close(worker.listen_fd);
+    if (worker.epoll_fd != -1) close(worker.epoll_fd);
+    if (worker.wake_fd != -1) close(worker.wake_fd);
+    worker.listen_fd = worker.epoll_fd = worker.wake_fd = -1;
+}
+
+void HttpServer::workerLoop(Worker& worker) {
+    struct epoll_event events[kMaxEvents];
+    int sweep_ms = std::min(config.idle_timeout_ms, 1000);
+    auto next_sweep = std::chrono::steady_clock::now() + std::chrono::milliseconds(sweep_ms);
+
+    while (running) {
+        int n = epoll_wait(worker.epoll_fd, events, kMaxEvents, sweep_ms);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == worker.wake_fd) {
+                uint64_t count;
+                ssize_t ignored = read(worker.wake_fd, &count, sizeof(count));
+                (void)ignored;
+                if (running) {
+                    deliverEvent(worker);  // otherwise stop() woke us
+                    finishDeferred(worker);
+                }
+                continue;
+            }
+            if (fd == worker.listen_fd) {
+                acceptConnections(worker);
+                continue;
+            }
+
+            auto it = worker.connections.find(fd);
+            if (it == worker.connections.end()) {
+                continue;  // closed earlier in this batch
+            }
+            Connection& conn = *it->second;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(worker, conn);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                onReadable(worker, conn);
+            } else if (events[i].events & EPOLLOUT) {
+                onWritable(worker, conn);
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_sweep) {
+            closeIdleConnections(worker);
+            next_sweep = now + std::chrono::milliseconds(sweep_ms);
+            if (worker.listen_paused) {
+                worker.listen_paused = false;
+                setEvents(worker.epoll_fd, worker.listen_fd, EPOLLIN, EPOLL_CTL_MOD);
+            }
+        }
+    }
+}
+
+void HttpServer::acceptConnections(Worker& worker) {
+    // Level-triggered listener: drain what's queued, epoll reports the rest
+    for (int i = 0; i < kMaxEvents; i++) {
+        int fd = accept4(worker.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // The connection stays queued, so the level-triggered listener
+                // would fire again at once. Mute it until the next sweep,
+                // which may also free some fds.
+                std::cerr << "Accept failed: " << std::strerror(errno) << "; pausing accepts" << std::endl;
+                worker.listen_paused = true;
+                setEvents(worker.epoll_fd, worker.listen_fd, 0, EPOLL_CTL_MOD);
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && running) {
+                std::cerr << "Accept failed: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        auto conn = std::make_unique<Connection>();
+        conn->fd = fd;
+        conn->id = ++worker.next_conn_id;
+        conn->in.resize(std::min(kInitialReadBuffer, config.max_request_bytes));
+        conn->last_active = std::chrono::steady_clock::now();
+        conn->idle_pos = worker.idle_order.insert(worker.idle_order.end(), conn.get());
+        worker.connections[fd] = std::move(conn);
+        setEvents(worker.epoll_fd, fd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+}
+
+void HttpServer::onReadable(Worker& worker, Connection& conn) {
+    touch(worker, conn);
+
+    // Make room at the end of the buffer: slide unparsed bytes down first,
+    // grow only if a single request really needs more space
+    if (conn.in_end == conn.in.size()) {
+        if (conn.in_start > 0) {
+            std::memmove(conn.in.data(), conn.in.data() + conn.in_start, conn.in_end - conn.in_start);
+            conn.in_end -= conn.in_start;
+            conn.in_start = 0;
+        } else if (conn.in.size() < config.max_request_bytes) {
+            conn.in.resize(std::min(conn.in.size() * 2, config.max_request_bytes));
+        }
+    }
+
+    // One read per wakeup; level-triggered epoll reports whatever is left
+    if (conn.in_end < conn.in.size()) {
+        ssize_t bytes_read = read(conn.fd, conn.in.data() + conn.in_end, conn.in.size() - conn.in_end);
+        if (bytes_read > 0) {
+            conn.in_end += bytes_read;
+        } else if (bytes_read == 0) {
+            // Peer closed; anything it sent before the FIN still gets answered
+            conn.peer_closed = true;
+        } else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeConnection(worker, conn);
+            return;
+        }
+    }
+
+    if (conn.streaming) {
+        // Subscribers have nothing more to say; only watch for the close
+        conn.in_start = conn.in_end = 0;
+        if (conn.peer_closed) {
+            closeConnection(worker, conn);
+        }
+        return;
+    }
+
+    processRequests(worker, conn);
+    if (conn.out_offset < conn.out.size()) {
+        onWritable(worker, conn);
+    } else if (conn.close_after_write || conn.peer_closed) {
+        closeConnection(worker, conn);
+    }
+}
+
+// Parses and answers every complete request in the input buffer, appending
+// responses in order. Returns true if any output was queued.
+bool HttpServer::processRequests(Worker& worker, Connection& conn) {
+    bool queued = false;
+    while (!conn.close_after_write && !conn.streaming && !conn.deferred &&
+           conn.out.size() - conn.out_offset < kMaxPendingOutput) {
+        std::string_view buffered(conn.in.data() + conn.in_start, conn.in_end - conn.in_start);
+        size_t header_end = buffered.find("\r\n\r\n");
+        if (header_end == std::string_view::npos) {
+            if (buffered.size() >= config.max_request_bytes) {
+                appendError(conn.out, "431 Request Header Fields Too Large", "Request Too Large");
+                conn.close_after_write = true;
+                queued = true;
+            }
+            break;  // wait for the rest of the head
+        }
+
+        // Request line: METHOD SP PATH SP VERSION
+        std::string_view head = buffered.substr(0, header_end);
+        size_t line_end = head.find("\r\n");
+        std::string_view line = head.substr(0, line_end);
+        size_t sp1 = line.find(' ');
+        size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+        if (sp2 == std::string_view::npos) {
+            appendError(conn.out, "400 Bad Request", "Bad Request");
+            conn.close_after_write = true;
+            queued = true;
+            break;
+        }
+
+        HttpRequest request;
+        request.method = line.substr(0, sp1);
+        request.path = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        size_t question = request.path.find('?');
+        if (question != std::string_view::npos) {
+            request.query = request.path.substr(question + 1);
+            request.path = request.path.substr(0, question);
+        }
+        request.version = line.substr(sp2 + 1);
+        request.keep_alive = request.version == "HTTP/1.1";
+
+        // Headers we care about: Connection and Content-Length
+        size_t content_length = 0;
+        bool has_length = false, bad_length = false;
+        std::string_view headers = line_end == std::string_view::npos ? std::string_view() : head.substr(line_end + 2);
+        while (!headers.empty()) {
+            size_t eol = headers.find("\r\n");
+            std::string_view header = headers.substr(0, eol);
+            headers = eol == std::string_view::npos ? std::string_view() : headers.substr(eol + 2);
+
+            size_t colon = header.find(':');
+            if (colon == std::string_view::npos) continue;
+            std::string_view name = header.substr(0, colon);
+            std::string_view value = header.substr(colon + 1);
+            while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+
+            if (equalsIgnoreCase(name, "Connection")) {
+                if (hasToken(value, "close")) request.keep_alive = false;
+                else if (hasToken(value, "keep-alive")) request.keep_alive = true;
+            } else if (equalsIgnoreCase(name, "Content-Length")) {
+                while (!value.empty() && value.back() == ' ') value.remove_suffix(1);
+                size_t length = 0;
+                auto result = std::from_chars(value.data(), value.data() + value.size(), length);
+                // Repeated headers must agree
+                bad_length = bad_length || value.empty() || result.ec != std::errc() ||
+                             result.ptr != value.data() + value.size() || (has_length && length != content_length);
+                content_length = length;
+                has_length = true;
+            }
+        }
+        // A length we can't read would leave the body to be parsed as the
+        // next request
+        if (bad_length) {
+            appendError(conn.out, "400 Bad Request", "Bad Request");
+            conn.close_after_write = true;
+            queued = true;
+            break;
+        }
+
+        // Bodies are ignored but must be skipped to find the next request.
+        // Compared before adding, so a huge length can't wrap the total.
+        size_t head_bytes = header_end + 4;
+        if (head_bytes > config.max_request_bytes || content_length > config.max_request_bytes - head_bytes) {
+            appendError(conn.out, "413 Payload Too Large", "Request Too Large");
+            conn.close_after_write = true;
+            queued = true;
+            break;
+        }
+        size_t total = head_bytes + content_length;
+        if (buffered.size() < total) {
+            break;
+        }
+
+        if (!config.stream_path.empty() && request.method == "GET" && request.path == config.stream_path) {
+            conn.in_start += total;
+            subscribe(worker, conn);
+            queued = true;
+            break;
+        }
+
+        if (request.method == "GET" &&
+            std::find(config.deferred_paths.begin(), config.deferred_paths.end(), request.path) !=
+                config.deferred_paths.end()) {
+            conn.in_start += total;
+            if (!defer(worker, conn, request)) {
+                appendError(conn.out, "503 Service Unavailable", "Server Stopping");
+                conn.close_after_write = true;
+                queued = true;
+            }
+            break;
+        }
+
+        handler(request, conn.out);
+        conn.in_start += total;
+        queued = true;
+        if (!request.keep_alive) {
+            conn.close_after_write = true;
+        }
+    }
+
+    if (conn.in_start == conn.in_end) {
+        conn.in_start = conn.in_end = 0;
+    }
+    return queued;
+}
+
+// Sends data[offset, size). False if the socket filled up (EPOLLOUT is
+// armed) or the connection was closed - either way the caller stops.
+bool HttpServer::sendFrom(Worker& worker, Connection& conn, const char* data, size_t size, size_t& offset) {
+    while (offset < size) {
+        ssize_t sent = send(conn.fd, data + offset, size - offset, MSG_NOSIGNAL);
+        if (sent > 0) {
+            offset += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Socket buffer full - resume when epoll says it drained
+            if (!conn.want_write) {
+                conn.want_write = true;
+                setEvents(worker.epoll_fd, conn.fd, EPOLLOUT, EPOLL_CTL_MOD);
+            }
+            touch(worker, conn);
+            return false;
+        }
+        closeConnection(worker, conn);
+        return false;
+    }
+    return true;
+}
+
+void HttpServer::onWritable(Worker& worker, Connection& conn) {
+    for (;;) {
+        if (!sendFrom(worker, conn, conn.out.data(), conn.out.size(), conn.out_offset)) {
+            return;
+        }
+
+        // clear() keeps the capacity for the next response
+        conn.out.clear();
+        conn.out_offset = 0;
+        if (conn.close_after_write) {
+            closeConnection(worker, conn);
+            return;
+        }
+        if (conn.streaming) {
+            if (conn.event && !sendFrom(worker, conn, conn.event->data(), conn.event->size(), conn.event_offset)) {
+                return;
+            }
+            conn.event.reset();
+            conn.event_offset = 0;
+            break;
+        }
+        // Requests held back by kMaxPendingOutput can go now
+        if (!processRequests(worker, conn)) {
+            break;
+        }
+    }
+
+    if (conn.peer_closed) {
+        closeConnection(worker, conn);
+        return;
+    }
+    if (conn.want_write) {
+        conn.want_write = false;
+        setEvents(worker.epoll_fd, conn.fd, conn.deferred ? 0u : (uint32_t)EPOLLIN, EPOLL_CTL_MOD);
+    }
+}
+
+void HttpServer::subscribe(Worker& worker, Connection& conn) {
+    conn.out += kEventStreamHead;
+    conn.streaming = true;
+    setsockopt(conn.fd, SOL_SOCKET, SO_SNDBUF, &kStreamSendBuffer, sizeof(kStreamSendBuffer));
+    worker.subscribers.push_back(&conn);
+    worker.subscriber_count.fetch_add(1, std::memory_order_relaxed);
+
+    // Start with the latest event rather than waiting for the next one
+    std::lock_guard<std::mutex> lock(event_mutex);
+    conn.event = latest_event;
+    conn.event_offset = 0;
+}
+
+bool HttpServer::defer(Worker& worker, Connection& conn, const HttpRequest& request) {
+    {
+        std::lock_guard<std::mutex> lock(deferred_mutex);
+        if (!running) {
+            return false;  // stop() is tearing the workers down
+        }
+        deferred_running++;
+    }
+    conn.deferred = true;
+    if (!conn.want_write) {
+        // Stop reading until the response is back; errors and hangups still
+        // come through, anything else stays in the socket
+        setEvents(worker.epoll_fd, conn.fd, 0, EPOLL_CTL_MOD);
+    }
+    // The request's views point into conn.in, which keeps filling meanwhile
+    std::string line;
+    line.append(request.method).append(1, ' ').append(request.path).append(1, '?').append(request.query);
+    line.append(1, ' ').append(request.version);
+    std::thread([this, &worker, line = std::move(line), fd = conn.fd, id = conn.id, keep_alive = request.keep_alive] {
+        std::string_view view(line);
+        size_t sp1 = view.find(' ');
+        size_t question = view.find('?', sp1);
+        size_t sp2 = view.find(' ', question);
+        HttpRequest request;
+        request.method = view.substr(0, sp1);
+        request.path = view.substr(sp1 + 1, question - sp1 - 1);
+        request.query = view.substr(question + 1, sp2 - question - 1);
+        request.version = view.substr(sp2 + 1);
+        request.keep_alive = keep_alive;
+
+        Completion done{fd, id, keep_alive, std::string()};
+        handler(request, done.response);
+        {
+            std::lock_guard<std::mutex> lock(worker.completed_mutex);
+            worker.completed.push_back(std::move(done));
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(worker.wake_fd, &one, sizeof(one));
+        (void)ignored;
+
+        std::lock_guard<std::mutex> lock(deferred_mutex);
+        deferred_running--;
+        deferred_done.notify_all();
+    }).detach();
+    return true;
+}
+
+void HttpServer::finishDeferred(Worker& worker) {
+    std::vector<Completion> completed;
+    {
+        std::lock_guard<std::mutex> lock(worker.completed_mutex);
+        if (worker.completed.empty()) {
+            return;
+        }
+        completed.swap(worker.completed);
+    }
+    for (auto& done : completed) {
+        auto it = worker.connections.find(done.fd);
+        if (it == worker.connections.end() || it->second->id != done.conn_id) {
+            continue;  // client went away while we worked
+        }
+        Connection& conn = *it->second;
+        conn.deferred = false;
+        conn.out += done.response;
+        if (!done.keep_alive) {
+            conn.close_after_write = true;
+        }
+        if (!conn.want_write) {
+            setEvents(worker.epoll_fd, conn.fd, EPOLLIN, EPOLL_CTL_MOD);
+        }
+        touch(worker, conn);
+        processRequests(worker, conn);  // anything pipelined behind it
+        onWritable(worker, conn);
+    }
+}
+
+void HttpServer::deliverEvent(Worker& worker) {
+    std::shared_ptr<const std::string> event;
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        if (worker.delivered_sequence == event_sequence) {
+            return;
+        }
+        worker.delivered_sequence = event_sequence;
+        event = latest_event;
+    }
+
+    // Sending can only close the connection being sent to, so a copy of the
+    // list is safe to walk
+    worker.delivering = worker.subscribers;
+    for (Connection* conn : worker.delivering) {
+        if (conn->event == event) {
+            continue;  // subscribed after this event was published
+        }
+        if (conn->event || conn->out_offset < conn->out.size()) {
+            closeConnection(worker, *conn);  // still on the previous event - too slow
+            continue;
+        }
+        conn->event = event;
+        conn->event_offset = 0;
+        touch(worker, *conn);
+        onWritable(worker, *conn);
+    }
+}
+
+void HttpServer::touch(Worker& worker, Connection& conn) {
+    conn.last_active = std::chrono::steady_clock::now();
+    worker.idle_order.splice(worker.idle_order.end(), worker.idle_order, conn.idle_pos);
+}
+
+void HttpServer::closeIdleConnections(Worker& worker) {
+    auto cutoff = std::chrono::steady_clock::now() - std::chrono::milliseconds(config.idle_timeout_ms);
+    while (!worker.idle_order.empty() && worker.idle_order.front()->last_active < cutoff) {
+        Connection& conn = *worker.idle_order.front();
+        if (conn.deferred) {
+            touch(worker, conn);  // not idle, just waiting on us
+            continue;
+        }
+        closeConnection(worker, conn);
+    }
+}
+
+void HttpServer::closeConnection(Worker& worker, Connection& conn) {
+    int fd = conn.fd;
+    if (conn.streaming) {
+        auto it = std::find(worker.subscribers.begin(), worker.subscribers.end(), &conn);
+        if (it != worker.subscribers.end()) {
+            *it = worker.subscribers.back();
+            worker.subscribers.pop_back();
+        }
+        worker.subscriber_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+    epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    worker.idle_order.erase(conn.idle_pos);
+    worker.connections.erase(fd);  // destroys conn
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <functional>
+#include <chrono>
+#include <list>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+
+struct HttpRequest {
+    std::string_view method;
+    std::string_view path;    // without the query string
+    std::string_view query;   // after '?', not decoded
+    std::string_view version;
+    bool keep_alive = false;  // HTTP/1.1 default unless "Connection: close"
+
+    // Value of ?key=value in the query string; false if absent
+    bool param(std::string_view key, std::string_view& value) const;
+};
+
+// Handler appends a complete HTTP response (status line, headers, body) to out.
+// It should echo request.keep_alive in its Connection header; the server closes
+// the connection after the response when keep_alive is false.
+using HttpHandler = std::function<void(const HttpRequest& request, std::string& out)>;
+
+struct HttpServerConfig {
+    int port = 8080;
+    int backlog = 1024;
+    int worker_threads = 1;           // each worker gets its own SO_REUSEPORT listener
+    size_t max_request_bytes = 8192;  // request head larger than this is rejected
+    int idle_timeout_ms = 30000;      // keep-alive connections idle this long are closed
+    std::string stream_path;          // GET here subscribes to publishEvent() (empty = off)
+    std::vector<std::string> deferred_paths;  // handled on their own thread (slow handlers)
+};
+
+// Non-blocking epoll server. Every worker thread owns a listening socket, an
+// epoll instance and its connections, so workers never share state and the
+// kernel spreads incoming connections across them.
+//
+// Connections are HTTP/1.1 persistent by default and requests may be
+// pipelined; responses are queued in order. Each connection keeps its input
+// and output buffers for its whole lifetime, so a steady poller costs one
+// read() and one send() per request.
+//
+// A GET on config.stream_path turns the connection into a text/event-stream
+// subscriber. publishEvent() hands one pre-framed event to every worker;
+// each subscriber sends straight from that shared buffer. A subscriber still
+// sending the previous event when the next one arrives is dropped, so a slow
+// client costs nothing but its own connection.
+//
+// Requests for config.deferred_paths run the handler on a thread of their
+// own, for handlers that take seconds (e.g. a profile). The connection reads
+// no further requests until the response is handed back to its worker, and
+// the worker keeps serving everyone else meanwhile.
+class HttpServer {
+public:
+    explicit HttpServer(HttpHandler handler);
+    ~HttpServer();
+
+    bool start(const HttpServerConfig& config);
+    void stop();
+    bool isRunning() const { return running; }
+
+    // Any thread; never blocks on subscribers. event must already be framed
+    // ("data: ...\n\n") and is also the first thing new subscribers receive.
+    void publishEvent(std::shared_ptr<const std::string> event);
+    size_t subscriberCount() const;
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::vector<char> in;            // unparsed bytes live in [in_start, in_end)
+        size_t in_start = 0;
+        size_t in_end = 0;
+        std::string out;
+        size_t out_offset = 0;
+        bool want_write = false;         // EPOLLOUT armed while a response is pending
+        bool close_after_write = false;  // last queued response said Connection: close
+        bool peer_closed = false;
+        bool streaming = false;          // event-stream subscriber, no more requests
+        bool deferred = false;           // waiting on a deferred handler, no more requests yet
+        uint64_t id = 0;                 // tells a reused fd apart for deferred responses
+        std::shared_ptr<const std::string> event;  // shared event being sent after out
+        size_t event_offset = 0;
+        std::chrono::steady_clock::time_point last_active;
+        std::list<Connection*>::iterator idle_pos;
+    };
+
+    // A deferred handler's response, on its way back to the worker
+    struct Completion {
+        int fd = -1;
+        uint64_t conn_id = 0;
+        bool keep_alive = false;
+        std::string response;
+    };
+
+    struct Worker {
+        int listen_fd = -1;
+        int epoll_fd = -1;
+        int wake_fd = -1;
+        bool listen_paused = false;  // out of fds; re-armed at the next idle sweep
+        std::thread thread;
+        std::unordered_map<int, std::unique_ptr<Connection>> connections;
+        std::list<Connection*> idle_order;  // least recently active first
+        std::vector<Connection*> subscribers;
+        std::vector<Connection*> delivering;  // scratch for deliverEvent
+        std::atomic<size_t> subscriber_count{0};
+        uint64_t delivered_sequence = 0;
+        uint64_t next_conn_id = 0;
+        std::mutex completed_mutex;
+        std::vector<Completion> completed;
+    };
+
+    HttpHandler handler;
+    HttpServerConfig config;
+    std::atomic<bool> running{false};
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    mutable std::mutex event_mutex;
+    std::shared_ptr<const std::string> latest_event;
+    uint64_t event_sequence = 0;
+
+    // Deferred handlers still running; stop() waits for them
+    std::mutex deferred_mutex;
+    std::condition_variable deferred_done;
+    int deferred_running = 0;
+
+    int openListener() const;
+    void workerLoop(Worker& worker);
+    void acceptConnections(Worker& worker);
+    void onReadable(Worker& worker, Connection& conn);
+    void onWritable(Worker& worker, Connection& conn);
+    bool sendFrom(Worker& worker, Connection& conn, const char* data, size_t size, size_t& offset);
+    bool processRequests(Worker& worker, Connection& conn);
+    void subscribe(Worker& worker, Connection& conn);
+    // False once stop() has begun; the caller answers 503
+    bool defer(Worker& worker, Connection& conn, const HttpRequest& request);
+    void finishDeferred(Worker& worker);
+    void deliverEvent(Worker& worker);
+    void touch(Worker& worker, Connection& conn);
+    void closeIdleConnections(Worker& worker);
+    void closeConnection(Worker& worker, Connection& conn);
+    void closeWorker(Worker& worker);
+};
@@ -0,0 +1,317 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Embeddable hot-path instrumentation: scoped timers and counters recorded
+// into per-thread shards and merged only when exported. Header-only, so a
+// service just includes this file.
+//
+//   static LatencyHistogram& requests = instruments().histogram("web.request");
+//   {
+//       ScopedTimer timer(requests);
+//       ...handle the request...
+//   }
+//   static EventCounter& errors = instruments().counter("web.errors");
+//   errors.add();
+//
+// Registration locks and allocates; recording does neither. The first
+// kInstrumentShards live threads each own a shard and record with plain
+// relaxed load/store pairs (no locked instructions). Threads beyond that
+// share an overflow shard through atomic adds.
+
+const size_t kInstrumentShards = 16;
+
+// Raw timestamp: the TSC on x86 (constant-rate on anything recent), the vDSO
+// CLOCK_MONOTONIC in ns elsewhere. Converted to ns at export.
+inline uint64_t instrumentTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Shard slots, handed back when a thread exits so thread churn doesn't push
+// everyone onto the overflow shard
+class InstrumentSlots {
+public:
+    static InstrumentSlots& get() {
+        static InstrumentSlots slots;
+        return slots;
+    }
+
+    size_t acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_slots.empty()) {
+            size_t slot = free_slots.back();
+            free_slots.pop_back();
+            return slot;
+        }
+        return next_slot < kInstrumentShards ? next_slot++ : kInstrumentShards;
+    }
+
+    void release(size_t slot) {
+        if (slot < kInstrumentShards) {
+            std::lock_guard<std::mutex> lock(mutex);
+            free_slots.push_back(slot);
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<size_t> free_slots;
+    size_t next_slot = 0;
+};
+
+// Shard index of the calling thread; kInstrumentShards is the shared overflow
+inline size_t instrumentThreadSlot() {
+    struct Slot {
+        size_t index = InstrumentSlots::get().acquire();
+        ~Slot() { InstrumentSlots::get().release(index); }
+    };
+    thread_local Slot slot;
+    return slot.index;
+}
+
+namespace instrument_detail {
+
+// Owner-only increment: the shard has a single writer, so a load/store pair
+// is enough and readers still see whole values
+inline void bump(std::atomic<uint64_t>& value, uint64_t by, bool shared) {
+    if (shared) {
+        value.fetch_add(by, std::memory_order_relaxed);
+    } else {
+        value.store(value.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+}
+
+inline void raiseTo(std::atomic<uint64_t>& value, uint64_t candidate) {
+    uint64_t current = value.load(std::memory_order_relaxed);
+    while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+    }
+}
+
+}
+
+// HDR-style log-linear buckets: values below 64 ticks are exact, then every
+// power of two is split into 32 linear sub-buckets, so a bucket's midpoint is
+// within 1.6% of anything in it. Past 2^44 ticks (~1.5h at 3GHz) everything
+// lands in the last bucket.
+const int kHistogramSubBits = 5;
+const size_t kHistogramBuckets = 1280;
+
+inline size_t histogramBucket(uint64_t value) {
+    if (value < (uint64_t(2) << kHistogramSubBits)) {
+        return value;
+    }
+    int shift = 63 - __builtin_clzll(value) - kHistogramSubBits;
+    size_t index = (size_t(shift + 1) << kHistogramSubBits) + (value >> shift) - (size_t(1) << kHistogramSubBits);
+    return index < kHistogramBuckets ? index : kHistogramBuckets - 1;
+}
+
+// Representative value (midpoint) of a bucket
+inline uint64_t histogramBucketValue(size_t index) {
+    const size_t sub = size_t(1) << kHistogramSubBits;
+    if (index < 2 * sub) {
+        return index;
+    }
+    int shift = int(index >> kHistogramSubBits) - 1;
+    uint64_t low = uint64_t((index & (sub - 1)) + sub) << shift;
+    return low + (uint64_t(1) << shift) / 2;
+}
+
+// Merged view of a histogram, in ticks. Reusable: merge() into the same
+// object again doesn't allocate.
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    // q in [0, 1]
+    uint64_t quantile(double q) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t rank = uint64_t(q * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                uint64_t value = histogramBucketValue(i);
+                return value < max ? value : max;
+            }
+        }
+        return max;
+    }
+};
+
+class LatencyHistogram {
+public:
+    explicit LatencyHistogram(std::string name)
+        : name(std::move(name)), shards(new Shard[kInstrumentShards + 1]()) {}
+
+    void record(uint64_t ticks) {
+        size_t slot = instrumentThreadSlot();
+        bool shared = slot == kInstrumentShards;
+        Shard& shard = shards[slot];
+        instrument_detail::bump(shard.counts[histogramBucket(ticks)], 1, shared);
+        instrument_detail::bump(shard.sum, ticks, shared);
+        if (ticks > shard.max.load(std::memory_order_relaxed)) {
+            if (shared) {
+                instrument_detail::raiseTo(shard.max, ticks);
+            } else {
+                shard.max.store(ticks, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Sums every shard; concurrent records may or may not be included
+    void merge(HistogramSnapshot& out) const {
+        out.counts.assign(kHistogramBuckets, 0);
+        out.count = out.sum = out.max = 0;
+        for (size_t s = 0; s <= kInstrumentShards; s++) {
+            const Shard& shard = shards[s];
+            for (size_t i = 0; i < kHistogramBuckets; i++) {
+                uint64_t n = shard.counts[i].load(std::memory_order_relaxed);
+                out.counts[i] += n;
+                out.count += n;
+            }
+            out.sum += shard.sum.load(std::memory_order_relaxed);
+            uint64_t max = shard.max.load(std::memory_order_relaxed);
+            if (max > out.max) out.max = max;
+        }
+    }
+
+    const std::string& getName() const { return name; }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[kHistogramBuckets];
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+    };
+
+    std::string name;
+    std::unique_ptr<Shard[]> shards;  // kInstrumentShards owned + 1 shared
+};
+
+class EventCounter {
+public:
+    explicit EventCounter(std::string name) : name(std::move(name)), shards(new Shard[kInstrumentShards + 1]()) {}
+
+    void add(uint64_t n = 1) {
+        size_t slot = instrumentThreadSlot();
+        instrument_detail::bump(shards[slot].value, n, slot == kInstrumentShards);
+    }
+
+    uint64_t value() const {
+        uint64_t total = 0;
+        for (size_t s = 0; s <= kInstrumentShards; s++) {
+            total += shards[s].value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    const std::string& getName() const { return name; }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value;
+    };
+
+    std::string name;
+    std::unique_ptr<Shard[]> shards;
+};
+
+// Records the lifetime of the scope into a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram& histogram) : histogram(histogram), start(instrumentTicks()) {}
+    ~ScopedTimer() { histogram.record(instrumentTicks() - start); }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    LatencyHistogram& histogram;
+    uint64_t start;
+};
+
+// Process-wide set of instruments. Registering a name twice returns the same
+// object; instruments live until exit, so references can be cached in statics.
+class InstrumentRegistry {
+public:
+    InstrumentRegistry() : start_ticks(instrumentTicks()), start_time(std::chrono::steady_clock::now()) {}
+
+    LatencyHistogram& histogram(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& histogram : histograms) {
+            if (histogram->getName() == name) return *histogram;
+        }
+        histograms.push_back(std::make_unique<LatencyHistogram>(name));
+        return *histograms.back();
+    }
+
+    EventCounter& counter(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& counter : counters) {
+            if (counter->getName() == name) return *counter;
+        }
+        counters.push_back(std::make_unique<EventCounter>(name));
+        return *counters.back();
+    }
+
+    template <typename Fn>
+    void forEachHistogram(Fn fn) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& histogram : histograms) fn(*histogram);
+    }
+
+    template <typename Fn>
+    void forEachCounter(Fn fn) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& counter : counters) fn(*counter);
+    }
+
+    // Tick length, measured against the steady clock since the registry was
+    // created - the longer the process has run, the better the estimate
+    double nanosecondsPerTick() const {
+#if defined(__x86_64__) || defined(__i386__)
+        auto elapsed = std::chrono::steady_clock::now() - start_time;
+        if (elapsed < std::chrono::milliseconds(10)) {
+            // Too early for a stable ratio; wait the rest out once
+            while (std::chrono::steady_clock::now() - start_time < std::chrono::milliseconds(10)) {
+            }
+        }
+        uint64_t ticks = instrumentTicks() - start_ticks;
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_time).count();
+        return ticks > 0 ? ns / ticks : 1.0;
+#else
+        return 1.0;
+#endif
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+    std::vector<std::unique_ptr<EventCounter>> counters;
+    uint64_t start_ticks;
+    std::chrono::steady_clock::time_point start_time;
+};
+
+inline InstrumentRegistry& instruments() {
+    static InstrumentRegistry registry;
+    return registry;
+}
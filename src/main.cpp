@@ -2,7 +2,20 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
 #include <signal.h>
+#include <sys/resource.h>
+#include "segment.h"
+#include "sketch.h"
+#include <fstream>
+#include <sstream>
 
 PerformanceMonitor* global_monitor = nullptr;
 
@@ -10,11 +23,365 @@ void signalHandler(int signum) {
     std::cout << "\nShutting down server..." << std::endl;
     if (global_monitor) {
         global_monitor->stopHTTPServer();
+        global_monitor->stopSampler();
+        global_monitor->stopHistoryLog();
+        global_monitor->stopSegmentLog();
+        global_monitor->stopPushExport();
     }
     exit(0);
 }
 
-int main() {
+// Cgroups keep up to five files open per group and perf up to nine per
+// counted thread, on top of connections and logs; the default soft limit
+// of 1024 runs out long before the hard limit does
+void raiseFdLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// A whole number of milliseconds above zero. atoi would turn a typo or 0
+// into a 1 ms schedule that runs every collector at 1 kHz.
+bool parseInterval(std::string_view text, int& ms) {
+    int value = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || result.ec != std::errc() || result.ptr != text.data() + text.size() || value <= 0) {
+        return false;
+    }
+    ms = value;
+    return true;
+}
+
+void printUsage(const char* prog) {
+    std::cout << "Usage: " << prog << " [options]" << std::endl;
+    std::cout << "  --port N          HTTP port (default 8080)" << std::endl;
+    std::cout << "  --threads N       HTTP worker threads (default 1)" << std::endl;
+    std::cout << "  --backlog N       listen() backlog (default 1024)" << std::endl;
+    std::cout << "  --idle-timeout S  close keep-alive connections idle for S seconds (default 30)" << std::endl;
+    std::cout << "  --pid N           track process N and its threads (repeatable)" << std::endl;
+    std::cout << "  --interval MS     sampling interval (default 1000)" << std::endl;
+    std::cout << "  --collectors LIST only run these collectors, e.g. cpu,memory,loadavg (default all)" << std::endl;
+    std::cout << "  --collector-interval NAME=MS" << std::endl;
+    std::cout << "                    own interval for one collector: cpu, memory, network, disk," << std::endl;
+    std::cout << "                    loadavg, sched, processes, perf, pressure, cgroups," << std::endl;
+    std::cout << "                    custom (repeatable)" << std::endl;
+    std::cout << "  --psi-trigger RES:KIND:STALL_MS/WINDOW_MS" << std::endl;
+    std::cout << "                    event mode: sample at --interval, and every --burst-interval" << std::endl;
+    std::cout << "                    while e.g. memory:some:100/1000 keeps firing (repeatable)" << std::endl;
+    std::cout << "  --burst-interval MS  sampling interval during a burst (default 100)" << std::endl;
+    std::cout << "  --burst-window S  how long a burst lasts after the last firing (default 30)" << std::endl;
+    std::cout << "  --alert RULE      alert when a series breaches RULE (repeatable), e.g." << std::endl;
+    std::cout << "                    cpu_usage>90/3, cgroup.*.cpu_percent:z>4, device.*.busy_percent:q>1.5" << std::endl;
+    std::cout << "  --alert-log PATH  append alert transitions to PATH (default stderr)" << std::endl;
+    std::cout << "  --alert-alpha A   EWMA weight of each sample for the baselines (default 0.05)" << std::endl;
+    std::cout << "  --alert-warmup N  samples before :z and :q rules can fire (default 30)" << std::endl;
+    std::cout << "  --cgroup-root DIR cgroup v2 tree to sample (default /sys/fs/cgroup)" << std::endl;
+    std::cout << "  --history N       samples kept for /metrics/range (default 3600)" << std::endl;
+    std::cout << "  --csv PATH        append every sample to PATH (rotated hourly or at 64 MiB)" << std::endl;
+    std::cout << "  --segments DIR    write binary segments (one per day of 1s samples) into DIR" << std::endl;
+    std::cout << "  --push HOST:PORT  push every sample in batches to a receiver (see push_receiver)" << std::endl;
+    std::cout << "  --push-udp        push over UDP: no acks, no retries" << std::endl;
+    std::cout << "  --push-interval MS  one batch per MS (default 5000)" << std::endl;
+    std::cout << "  --push-spill DIR  keep unsent batches in DIR while the receiver is away" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Segment tools (no server is started):" << std::endl;
+    std::cout << "  --dump-segment PATH       print records as CSV" << std::endl;
+    std::cout << "  --summarize-segment PATH  count/min/max/mean per column, or per bucket with --step" << std::endl;
+    std::cout << "  --from S / --to S         unix seconds range for the tools above" << std::endl;
+    std::cout << "  --step S                  bucket width in seconds for --summarize-segment (means, as CSV)" << std::endl;
+    std::cout << "  --merge-sketches FILE...  merge sketches saved from /metrics/sketch?format=binary" << std::endl;
+    std::cout << "                            (e.g. one per host) and print their quantiles" << std::endl;
+}
+
+// Output for the segment tools goes through one fixed buffer
+class LineWriter {
+public:
+    ~LineWriter() { flush(); }
+    void append(std::string_view text) {
+        if (used + text.size() > sizeof(buffer)) flush();
+        std::memcpy(buffer + used, text.data(), text.size());
+        used += text.size();
+    }
+    void append(int64_t value) {
+        char buf[24];
+        auto result = std::to_chars(buf, buf + sizeof(buf), value);
+        append(std::string_view(buf, result.ptr - buf));
+    }
+    void append(double value) {
+        char buf[48];
+        auto result = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed, 2);
+        append(std::string_view(buf, result.ptr - buf));
+    }
+    void flush() {
+        fwrite(buffer, 1, used, stdout);
+        used = 0;
+    }
+
+private:
+    char buffer[64 * 1024];
+    size_t used = 0;
+};
+
+void writeSegmentHeader(const SegmentReader& segment, LineWriter& out) {
+    out.append(std::string_view("timestamp_ms"));
+    for (size_t c = 0; c < segment.columnCount(); c++) {
+        out.append(std::string_view(","));
+        out.append(segment.columnName(c));
+    }
+    out.append(std::string_view("\n"));
+}
+
+int dumpSegment(const std::string& path, int64_t from_ms, int64_t to_ms) {
+    SegmentReader segment;
+    if (!segment.open(path)) {
+        return 1;
+    }
+    LineWriter out;
+    writeSegmentHeader(segment, out);
+    for (size_t i = segment.lowerBound(from_ms); i < segment.size() && segment.timestamp(i) <= to_ms; i++) {
+        out.append(segment.timestamp(i));
+        const double* row = segment.row(i);
+        for (size_t c = 0; c < segment.columnCount(); c++) {
+            out.append(std::string_view(","));
+            out.append(row[c]);
+        }
+        out.append(std::string_view("\n"));
+    }
+    return 0;
+}
+
+int summarizeSegment(const std::string& path, int64_t from_ms, int64_t to_ms, int64_t step_ms) {
+    SegmentReader segment;
+    if (!segment.open(path)) {
+        return 1;
+    }
+    size_t first = segment.lowerBound(from_ms);
+    size_t last = first;
+    while (last < segment.size() && segment.timestamp(last) <= to_ms) last++;
+
+    LineWriter out;
+    if (step_ms > 0) {
+        // Bucketed means, one walk over the range
+        writeSegmentHeader(segment, out);
+        int64_t base = first < last ? segment.timestamp(first) : 0;
+        std::vector<double> sums(segment.columnCount());
+        for (size_t i = first; i < last; ) {
+            int64_t bucket = (segment.timestamp(i) - base) / step_ms;
+            std::fill(sums.begin(), sums.end(), 0.0);
+            size_t count = 0;
+            for (; i < last && (segment.timestamp(i) - base) / step_ms == bucket; i++, count++) {
+                const double* row = segment.row(i);
+                for (size_t c = 0; c < sums.size(); c++) sums[c] += row[c];
+            }
+            out.append(base + bucket * step_ms);
+            for (double sum : sums) {
+                out.append(std::string_view(","));
+                out.append(sum / count);
+            }
+            out.append(std::string_view("\n"));
+        }
+        return 0;
+    }
+
+    out.append(std::string_view("records "));
+    out.append((int64_t)(last - first));
+    if (first < last) {
+        out.append(std::string_view(" from_ms "));
+        out.append(segment.timestamp(first));
+        out.append(std::string_view(" to_ms "));
+        out.append(segment.timestamp(last - 1));
+    }
+    out.append(std::string_view("\ncolumn,min,max,mean,last\n"));
+    for (size_t c = 0; c < segment.columnCount() && first < last; c++) {
+        double min = segment.value(first, c), max = min, sum = 0.0;
+        for (size_t i = first; i < last; i++) {
+            double v = segment.value(i, c);
+            min = std::min(min, v);
+            max = std::max(max, v);
+            sum += v;
+        }
+        out.append(segment.columnName(c));
+        out.append(std::string_view(","));
+        out.append(min);
+        out.append(std::string_view(","));
+        out.append(max);
+        out.append(std::string_view(","));
+        out.append(sum / (last - first));
+        out.append(std::string_view(","));
+        out.append(segment.value(last - 1, c));
+        out.append(std::string_view("\n"));
+    }
+    return 0;
+}
+
+// What a downstream aggregator does with /metrics/sketch?format=binary
+int mergeSketches(const std::vector<std::string>& paths) {
+    DDSketch merged;
+    bool first = true;
+    for (const auto& path : paths) {
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream data;
+        data << file.rdbuf();
+        DDSketch sketch;
+        if (!file || !sketch.deserialize(data.str())) {
+            std::cerr << "Not a sketch: " << path << std::endl;
+            return 1;
+        }
+        if (first) {
+            merged = sketch;
+            first = false;
+        } else if (!merged.merge(sketch)) {
+            std::cerr << "Relative accuracy of " << path << " doesn't match the others" << std::endl;
+            return 1;
+        }
+    }
+    std::printf("sketches %zu count %llu min %.2f max %.2f mean %.2f\n", paths.size(),
+                (unsigned long long)merged.count(), merged.min(), merged.max(),
+                merged.count() ? merged.sum() / merged.count() : 0.0);
+    for (double q : {0.5, 0.9, 0.95, 0.99, 0.999}) {
+        std::printf("p%g %.2f\n", q * 100, merged.quantile(q));
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    HttpServerConfig server_config;
+    std::vector<int> tracked_pids;
+    size_t history_capacity = 0;
+    int interval_ms = 1000;
+    std::string collectors;
+    std::vector<std::pair<std::string, int>> collector_intervals;
+    std::string csv_path;
+    std::string segment_dir;
+    std::string cgroup_root;
+    EventModeConfig event_mode;
+    AnomalyConfig anomaly;
+    PushConfig push;
+    bool push_enabled = false;
+    std::string dump_path;
+    std::string summarize_path;
+    int64_t from_ms = std::numeric_limits<int64_t>::min();
+    int64_t to_ms = std::numeric_limits<int64_t>::max();
+    int64_t step_ms = 0;
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+            server_config.port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+            server_config.worker_threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--backlog") == 0 && has_value) {
+            server_config.backlog = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--idle-timeout") == 0 && has_value) {
+            server_config.idle_timeout_ms = std::atoi(argv[++i]) * 1000;
+        } else if (std::strcmp(argv[i], "--pid") == 0 && has_value) {
+            tracked_pids.push_back(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--interval") == 0 && has_value) {
+            if (!parseInterval(argv[++i], interval_ms)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--collectors") == 0 && has_value) {
+            collectors = argv[++i];
+        } else if (std::strcmp(argv[i], "--collector-interval") == 0 && has_value) {
+            std::string spec = argv[++i];
+            size_t eq = spec.find('=');
+            int ms = 0;
+            if (eq == std::string::npos || !parseInterval(std::string_view(spec).substr(eq + 1), ms)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            collector_intervals.emplace_back(spec.substr(0, eq), ms);
+        } else if (std::strcmp(argv[i], "--history") == 0 && has_value) {
+            history_capacity = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--csv") == 0 && has_value) {
+            csv_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--psi-trigger") == 0 && has_value) {
+            PsiTriggerSpec trigger;
+            if (!parsePsiTrigger(argv[++i], trigger)) {
+                std::cerr << "Bad --psi-trigger " << argv[i] << " (want e.g. memory:some:100/1000)" << std::endl;
+                return 1;
+            }
+            event_mode.triggers.push_back(trigger);
+        } else if (std::strcmp(argv[i], "--burst-interval") == 0 && has_value) {
+            int ms = 0;
+            if (!parseInterval(argv[++i], ms)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            event_mode.burst_interval = std::chrono::milliseconds(ms);
+        } else if (std::strcmp(argv[i], "--burst-window") == 0 && has_value) {
+            event_mode.burst_window = std::chrono::milliseconds((int64_t)(std::atof(argv[++i]) * 1000));
+        } else if (std::strcmp(argv[i], "--alert") == 0 && has_value) {
+            AlertRule rule;
+            if (!parseAlertRule(argv[++i], rule)) {
+                std::cerr << "Bad --alert " << argv[i] << " (want e.g. cpu_usage>90 or cgroup.*.cpu_percent:z>4/3)" << std::endl;
+                return 1;
+            }
+            anomaly.rules.push_back(rule);
+        } else if (std::strcmp(argv[i], "--alert-log") == 0 && has_value) {
+            anomaly.log_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--alert-alpha") == 0 && has_value) {
+            anomaly.alpha = std::atof(argv[++i]);
+            if (anomaly.alpha <= 0 || anomaly.alpha > 1) {
+                std::cerr << "--alert-alpha wants a value in (0, 1]" << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--alert-warmup") == 0 && has_value) {
+            anomaly.warmup = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--cgroup-root") == 0 && has_value) {
+            cgroup_root = argv[++i];
+        } else if (std::strcmp(argv[i], "--segments") == 0 && has_value) {
+            segment_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--push") == 0 && has_value) {
+            std::string target = argv[++i];
+            size_t colon = target.rfind(':');
+            if (colon == std::string::npos || colon == 0) {
+                std::cerr << "Bad --push " << target << " (want HOST:PORT)" << std::endl;
+                return 1;
+            }
+            push.host = target.substr(0, colon);
+            if (push.host.size() > 2 && push.host.front() == '[' && push.host.back() == ']') {
+                push.host = push.host.substr(1, push.host.size() - 2);  // [::1]:9109
+            }
+            push.port = std::atoi(target.c_str() + colon + 1);
+            push_enabled = true;
+        } else if (std::strcmp(argv[i], "--push-udp") == 0) {
+            push.udp = true;
+        } else if (std::strcmp(argv[i], "--push-interval") == 0 && has_value) {
+            if (!parseInterval(argv[++i], push.flush_interval_ms)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--push-spill") == 0 && has_value) {
+            push.spill_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--dump-segment") == 0 && has_value) {
+            dump_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--summarize-segment") == 0 && has_value) {
+            summarize_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--from") == 0 && has_value) {
+            from_ms = (int64_t)(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--to") == 0 && has_value) {
+            to_ms = (int64_t)(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--step") == 0 && has_value) {
+            step_ms = (int64_t)(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--merge-sketches") == 0 && has_value) {
+            return mergeSketches(std::vector<std::string>(argv + i + 1, argv + argc));
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!dump_path.empty()) {
+        return dumpSegment(dump_path, from_ms, to_ms);
+    }
+    if (!summarize_path.empty()) {
+        return summarizeSegment(summarize_path, from_ms, to_ms, step_ms);
+    }
+
+    raiseFdLimit();
     PerformanceMonitor monitor;
     global_monitor = &monitor;
     
@@ -24,15 +391,57 @@ int main() {
     
     std::cout << "=== Microservice Performance Monitor ===" << std::endl;
     
-    monitor.startHTTPServer(8080);
+    if (!collectors.empty() && !monitor.setCollectors(collectors)) {
+        return 1;
+    }
+    if (history_capacity > 0) {
+        monitor.setHistoryCapacity(history_capacity);
+    }
+    for (const auto& [name, ms] : collector_intervals) {
+        if (!monitor.setCollectorInterval(name, std::chrono::milliseconds(ms))) {
+            return 1;
+        }
+    }
+    monitor.setCgroupRoot(cgroup_root);
+    if (!event_mode.triggers.empty()) {
+        monitor.setEventMode(event_mode);
+    }
+    if (!anomaly.rules.empty()) {
+        monitor.setAnomalyDetection(anomaly);
+    }
+    if (!csv_path.empty()) {
+        HistoryLogConfig log_config;
+        log_config.path = csv_path;
+        if (!monitor.startHistoryLog(log_config)) {
+            return 1;
+        }
+    }
+    if (!segment_dir.empty()) {
+        SegmentConfig segment_config;
+        segment_config.dir = segment_dir;
+        if (!monitor.startSegmentLog(segment_config)) {
+            return 1;
+        }
+    }
+    if (push_enabled && !monitor.startPushExport(push)) {
+        return 1;
+    }
+    for (int pid : tracked_pids) {
+        monitor.trackProcess("pid-" + std::to_string(pid), pid, true);
+    }
+    
+    // sampler owns collection, the server only reads what it publishes
+    monitor.startSampler(std::chrono::milliseconds(interval_ms));
+    monitor.startHTTPServer(server_config);
     
-    // keep main thread alive to monitor metrics
+    // keep main thread alive while the server runs
     while (monitor.isServerRunning()) {
-        // collect metrics every 5 seconds for interal usage
-        monitor.collectAllMetrics();
-        
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+        std::this_thread::sleep_for(std::chrono::seconds(1));
     }
+    monitor.stopSampler();
+    monitor.stopHistoryLog();
+    monitor.stopSegmentLog();
+    monitor.stopPushExport();
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "memory_collector.h"
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <dirent.h>
+
+namespace {
+
+template <typename Stats>
+struct Key {
+    std::string_view name;
+    uint64_t Stats::*field;
+};
+
+// Sorted by name (byte order) for the binary search in lookup()
+constexpr Key<MemInfo> kMemInfoKeys[] = {
+    {"Active", &MemInfo::active_kb},
+    {"Active(anon)", &MemInfo::active_anon_kb},
+    {"Active(file)", &MemInfo::active_file_kb},
+    {"AnonHugePages", &MemInfo::anon_huge_pages_kb},
+    {"AnonPages", &MemInfo::anon_pages_kb},
+    {"Buffers", &MemInfo::buffers_kb},
+    {"Cached", &MemInfo::cached_kb},
+    {"CommitLimit", &MemInfo::commit_limit_kb},
+    {"Committed_AS", &MemInfo::committed_as_kb},
+    {"Dirty", &MemInfo::dirty_kb},
+    {"FilePages", &MemInfo::file_pages_kb},
+    {"HugePages_Free", &MemInfo::huge_pages_free},
+    {"HugePages_Rsvd", &MemInfo::huge_pages_reserved},
+    {"HugePages_Surp", &MemInfo::huge_pages_surplus},
+    {"HugePages_Total", &MemInfo::huge_pages_total},
+    {"Hugepagesize", &MemInfo::huge_page_size_kb},
+    {"Inactive", &MemInfo::inactive_kb},
+    {"Inactive(anon)", &MemInfo::inactive_anon_kb},
+    {"Inactive(file)", &MemInfo::inactive_file_kb},
+    {"KernelStack", &MemInfo::kernel_stack_kb},
+    {"Mapped", &MemInfo::mapped_kb},
+    {"MemAvailable", &MemInfo::available_kb},
+    {"MemFree", &MemInfo::free_kb},
+    {"MemTotal", &MemInfo::total_kb},
+    {"MemUsed", &MemInfo::used_kb},
+    {"Mlocked", &MemInfo::mlocked_kb},
+    {"PageTables", &MemInfo::page_tables_kb},
+    {"SReclaimable", &MemInfo::slab_reclaimable_kb},
+    {"SUnreclaim", &MemInfo::slab_unreclaimable_kb},
+    {"Shmem", &MemInfo::shmem_kb},
+    {"Slab", &MemInfo::slab_kb},
+    {"SwapCached", &MemInfo::swap_cached_kb},
+    {"SwapFree", &MemInfo::swap_free_kb},
+    {"SwapTotal", &MemInfo::swap_total_kb},
+    {"Unevictable", &MemInfo::unevictable_kb},
+    {"Writeback", &MemInfo::writeback_kb},
+};
+
+// Kernels before 4.8 split pgscan_* by zone; those just stay zero
+constexpr Key<VmStats> kVmStatKeys[] = {
+    {"oom_kill", &VmStats::oom_kills},
+    {"pgfault", &VmStats::page_faults},
+    {"pgmajfault", &VmStats::major_faults},
+    {"pgpgin", &VmStats::pages_paged_in},
+    {"pgpgout", &VmStats::pages_paged_out},
+    {"pgscan_direct", &VmStats::pages_scanned_direct},
+    {"pgscan_kswapd", &VmStats::pages_scanned_kswapd},
+    {"pswpin", &VmStats::swap_in},
+    {"pswpout", &VmStats::swap_out},
+};
+
+template <typename Stats, size_t N>
+constexpr bool isSorted(const Key<Stats> (&keys)[N]) {
+    for (size_t i = 1; i < N; i++) {
+        if (!(keys[i - 1].name < keys[i].name)) return false;
+    }
+    return true;
+}
+static_assert(isSorted(kMemInfoKeys), "kMemInfoKeys must stay sorted");
+static_assert(isSorted(kVmStatKeys), "kVmStatKeys must stay sorted");
+
+constexpr int8_t kUnknown = -2;  // line not seen yet
+constexpr int8_t kMiss = -1;     // line's key isn't in the table
+
+template <typename Stats, size_t N>
+int8_t lookup(const Key<Stats> (&keys)[N], std::string_view name) {
+    auto it = std::lower_bound(std::begin(keys), std::end(keys), name,
+                               [](const Key<Stats>& key, std::string_view n) { return key.name < n; });
+    return it != std::end(keys) && it->name == name ? (int8_t)(it - std::begin(keys)) : kMiss;
+}
+
+// "key value" lines (meminfo: "Key:   value kB", after skipping the
+// "Node N" prefix of node files). slots caches the table index per line.
+template <typename Stats, size_t N>
+void parseKeyed(std::string_view text, int prefix_tokens, bool colon, const Key<Stats> (&keys)[N],
+                std::vector<int8_t>& slots, Stats& out) {
+    static_assert(N < 128, "slot indexes are int8_t");
+    ProcScanner ss(text);
+    size_t line = 0;
+    do {
+        if (line >= slots.size()) {
+            slots.push_back(kUnknown);  // first pass only
+        }
+        int8_t& slot = slots[line++];
+        if (slot == kMiss) {
+            continue;
+        }
+        ss.skip(prefix_tokens);
+        std::string_view key = ss.token();
+        if (colon) {
+            if (key.empty() || key.back() != ':') {
+                slot = kMiss;
+                continue;
+            }
+            key.remove_suffix(1);
+        }
+        if (slot < 0 || keys[slot].name != key) {
+            slot = lookup(keys, key);
+            if (slot == kMiss) continue;
+        }
+        out.*keys[slot].field = ss.u64();
+    } while (ss.nextLine());
+    slots.resize(line);
+}
+
+double ratePerSec(uint64_t now, uint64_t prev, double elapsed_sec) {
+    return elapsed_sec > 0.0 && now >= prev ? (now - prev) / elapsed_sec : 0.0;
+}
+
+}
+
+MemoryCollector::MemoryCollector() {
+    const std::string root = "/sys/devices/system/node";
+    DIR* dir = opendir(root.c_str());
+    if (!dir) {
+        return;  // no NUMA in this kernel; nodes stays empty
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string_view name = entry->d_name;
+        int id = 0;
+        if (name.substr(0, 4) != "node") continue;
+        auto result = std::from_chars(name.data() + 4, name.data() + name.size(), id);
+        if (result.ec != std::errc() || result.ptr != name.data() + name.size()) continue;
+        nodes.push_back(Node{id, ProcFile(root + "/" + std::string(name) + "/meminfo", 4096), {}});
+    }
+    closedir(dir);
+    std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+}
+
+void MemoryCollector::collect(MemoryStats& out) {
+    if (meminfo.read()) {
+        out.meminfo = MemInfo{};
+        parseKeyed(meminfo.contents(), 0, true, kMemInfoKeys, meminfo_slots, out.meminfo);
+        // MemAvailable arrived in 3.14; estimate it the way free(1) used to
+        if (out.meminfo.available_kb == 0) {
+            out.meminfo.available_kb = out.meminfo.free_kb + out.meminfo.buffers_kb + out.meminfo.cached_kb;
+        }
+    }
+
+    out.nodes.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        out.nodes[i].node = nodes[i].id;
+        if (nodes[i].meminfo.read()) {
+            out.nodes[i].meminfo = MemInfo{};
+            parseKeyed(nodes[i].meminfo.contents(), 2, true, kMemInfoKeys, nodes[i].slots, out.nodes[i].meminfo);
+        }
+    }
+
+    if (!vmstat.read()) {
+        return;
+    }
+    VmStats& vm = out.vmstat;
+    parseKeyed(vmstat.contents(), 0, false, kVmStatKeys, vmstat_slots, vm);
+
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_sec = has_prev ? std::chrono::duration<double>(now - prev_time).count() : 0.0;
+    prev_time = now;
+    vm.page_faults_per_sec = ratePerSec(vm.page_faults, prev_vmstat.page_faults, elapsed_sec);
+    vm.major_faults_per_sec = ratePerSec(vm.major_faults, prev_vmstat.major_faults, elapsed_sec);
+    vm.paged_in_kb_per_sec = ratePerSec(vm.pages_paged_in, prev_vmstat.pages_paged_in, elapsed_sec);
+    vm.paged_out_kb_per_sec = ratePerSec(vm.pages_paged_out, prev_vmstat.pages_paged_out, elapsed_sec);
+    vm.swap_in_per_sec = ratePerSec(vm.swap_in, prev_vmstat.swap_in, elapsed_sec);
+    vm.swap_out_per_sec = ratePerSec(vm.swap_out, prev_vmstat.swap_out, elapsed_sec);
+    vm.pages_scanned_kswapd_per_sec =
+        ratePerSec(vm.pages_scanned_kswapd, prev_vmstat.pages_scanned_kswapd, elapsed_sec);
+    vm.pages_scanned_direct_per_sec =
+        ratePerSec(vm.pages_scanned_direct, prev_vmstat.pages_scanned_direct, elapsed_sec);
+    prev_vmstat = vm;
+    has_prev = true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "proc_reader.h"
+#include "snapshot.h"
+
+// /proc/meminfo, /proc/vmstat and /sys/devices/system/node/node*/meminfo.
+//
+// Keys are looked up in sorted compile-time tables (binary search over
+// string_views into the read buffer), and the table slot each line resolved
+// to is remembered. A running kernel never reorders these files, so after
+// the first pass a line we don't want costs one memchr and a wanted one a
+// single compare - most of vmstat's ~180 lines are never tokenized, and
+// nothing is allocated. Node files have the same keys behind a "Node N"
+// prefix and share the meminfo table.
+//
+// NUMA nodes are found once at construction; memory hotplug that adds a
+// node needs a restart to be picked up.
+class MemoryCollector {
+public:
+    MemoryCollector();
+
+    // Sampler thread only
+    void collect(MemoryStats& out);
+
+private:
+    struct Node {
+        int id = 0;
+        ProcFile meminfo;
+        std::vector<int8_t> slots;
+    };
+
+    ProcFile meminfo{"/proc/meminfo", 8192};
+    ProcFile vmstat{"/proc/vmstat", 16384};
+    std::vector<int8_t> meminfo_slots;  // per line: table index, or kMiss / kUnknown
+    std::vector<int8_t> vmstat_slots;
+    std::vector<Node> nodes;  // sorted by id
+
+    VmStats prev_vmstat;
+    bool has_prev = false;
+    std::chrono::steady_clock::time_point prev_time;
+};
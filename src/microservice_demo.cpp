@@ -17,6 +17,7 @@ void signalHandler(int signum) {
     
     if (global_monitor) {
         global_monitor->stopHTTPServer();
+        global_monitor->stopSampler();
     }
     
     exit(0);
@@ -46,7 +47,13 @@ int main() {
     // Give services time to start up
     std::this_thread::sleep_for(std::chrono::seconds(2));
     
-    // Start performance monitoring server
+    // Track each mock service (a thread of this process) individually
+    for (MockService* service : service_manager.getRunningServices()) {
+        monitor.trackThread(service->getName(), service->getPID(), service->getTID());
+    }
+    
+    // Start the background sampler and the performance monitoring server
+    monitor.startSampler(std::chrono::seconds(1));
     monitor.startHTTPServer(9090); // Different port to avoid conflicts
     
     std::cout << "\n=== Demo Running ===" << std::endl;
@@ -63,9 +70,7 @@ int main() {
     // Main monitoring loop
     int cycle = 0;
     while (monitor.isServerRunning()) {
-        // Collect and display metrics every 10 seconds
-        monitor.collectAllMetrics();
-        
+        // Display the latest published sample every 20 seconds
         cycle++;
         if (cycle % 2 == 0) { // Every 20 seconds
             std::cout << "\n--- Cycle " << cycle << " ---" << std::endl;
@@ -75,6 +80,7 @@ int main() {
         
         std::this_thread::sleep_for(std::chrono::seconds(10));
     }
+    monitor.stopSampler();
     
     return 0;
 }
\ No newline at end of file
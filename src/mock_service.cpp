@@ -1,9 +1,11 @@
 #include "mock_service.h"
+#include "instrument.h"
 #include <iostream>
 #include <chrono>
 #include <thread>
 #include <fstream>
 #include <unistd.h>
+#include <sys/syscall.h>
 #include <cmath>
 
 MockService::MockService(const std::string& name, ServiceType type, int port) 
@@ -32,7 +34,13 @@ void MockService::stop() {
     std::cout << "Stopped " << service_name << std::endl;
 }
 
+int MockService::getPID() const {
+    // Services are threads of this process
+    return getpid();
+}
+
 void MockService::serviceLoop() {
+    thread_id = static_cast<int>(syscall(SYS_gettid));
     while (running) {
         switch (service_type) {
             case ServiceType::WEB_SERVER:
@@ -61,9 +69,13 @@ void MockService::simulateWebServer() {
     std::uniform_int_distribution<> request_dist(1, 10);
     int requests = request_dist(rng);
     
+    static LatencyHistogram& request_latency = instruments().histogram("web.request");
     for (int i = 0; i < requests && running; i++) {
         // Each request uses some CPU
-        consumeCPU(50); // 50ms of CPU work
+        {
+            ScopedTimer timer(request_latency);
+            consumeCPU(50); // 50ms of CPU work
+        }
         
         // Random sleep between requests
         std::uniform_int_distribution<> sleep_dist(10, 100);
@@ -75,6 +87,8 @@ void MockService::simulateDatabase() {
     // Simulate database operations - memory intensive with disk I/O
     std::uniform_int_distribution<> operation_dist(1, 3);
     int operation = operation_dist(rng);
+    static LatencyHistogram& query_latency = instruments().histogram("database.query");
+    ScopedTimer timer(query_latency);
     
     switch (operation) {
         case 1: // Read operation
@@ -98,10 +112,14 @@ void MockService::simulateAPIGateway() {
     std::uniform_int_distribution<> request_dist(5, 20);
     int requests = request_dist(rng);
     
+    static LatencyHistogram& route_latency = instruments().histogram("api.route");
     for (int i = 0; i < requests && running; i++) {
         // Route request - some CPU + network
-        consumeCPU(20);
-        simulateNetworkActivity();
+        {
+            ScopedTimer timer(route_latency);
+            consumeCPU(20);
+            simulateNetworkActivity();
+        }
         
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
@@ -112,12 +130,18 @@ void MockService::simulateCacheService() {
     std::uniform_int_distribution<> operation_dist(1, 4);
     int operation = operation_dist(rng);
     
+    static LatencyHistogram& lookup_latency = instruments().histogram("cache.lookup");
+    static EventCounter& misses = instruments().counter("cache.miss");
+    static EventCounter& hits = instruments().counter("cache.hit");
+    ScopedTimer timer(lookup_latency);
     if (operation == 1) {
         // Cache miss - need to populate
+        misses.add();
         consumeCPU(100);
         consumeMemory(2 * 1024 * 1024, 5); // 2MB for 5 seconds
     } else {
         // Cache hit - just memory access
+        hits.add();
         consumeCPU(10);
     }
 }
@@ -127,8 +151,10 @@ void MockService::simulateWorkerService() {
     std::uniform_int_distribution<> job_dist(0, 5);
     int jobs = job_dist(rng);
     
+    static LatencyHistogram& job_latency = instruments().histogram("worker.job");
     for (int i = 0; i < jobs && running; i++) {
         // Process a job
+        ScopedTimer timer(job_latency);
         std::uniform_int_distribution<> work_dist(100, 500);
         consumeCPU(work_dist(rng));
         
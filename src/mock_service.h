@@ -4,6 +4,7 @@
 #include <atomic>
 #include <vector>
 #include <random>
+#include <memory>
 
 enum class ServiceType {
     WEB_SERVER,     // High CPU, moderate memory
@@ -26,13 +27,15 @@ public:
     std::string getName() const { return service_name; }
     ServiceType getType() const { return service_type; }
     int getPort() const { return service_port; }
-    int getPID() const { return getPID(); }
+    int getPID() const;
+    int getTID() const { return thread_id; }  // 0 until the service thread has started
     
 private:
     std::string service_name;
     ServiceType service_type;
     int service_port;
     std::atomic<bool> running{false};
+    std::atomic<int> thread_id{0};
     std::thread service_thread;
     std::mt19937 rng;
     
@@ -1,264 +1,760 @@
 #include "monitor.h"
+#include "prometheus.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <sstream>
 #include <iomanip>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <unistd.h>
 #include <cstring>
+#include <cstdio>
+#include <charconv>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
 
 
-void PerformanceMonitor::collectCPUUsage(){
-    std::ifstream statFile("/proc/stat");
-    if(!statFile.is_open()){
-        // add throw later, return for now
-        return;
+namespace {
+
+bool startsWith(std::string_view s, std::string_view prefix) {
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+// Names from outside the monitor can hold anything: cgroup directories
+// (systemd escapes with backslashes) and comm, which any thread can set
+void appendJSONString(std::ostream& json, std::string_view value) {
+    json << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            json << '\\' << c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+            json << buf;
+        } else {
+            json << c;
+        }
     }
-    std::string line;
-    while(std::getline(statFile, line)){
-        std::stringstream ss(line);
-        std::string key;
-        ss >> key; // reading first word from stream into key
-        if(key == "cpu"){
-            // read all the CPU values from stream and store
-            long user, nice, system, idle, iowait, irq, softirq, steal;
-            ss >> user >> nice >> system >> idle >> iowait>> irq >> softirq >> steal;
-
-            // calc totals
-            long total_idle = idle + iowait;
-            long total_active = user + nice + system + irq + softirq + steal;
-            long total_time = total_idle + total_active;
-            // first read check
-            if(first_cpu_read){
-                prev_total_time = total_time;
-                prev_active_time = total_active;
-                first_cpu_read = false;
-                cpu_usage = 0.0;
-            }
-            else{
-                // calc based on difference from last read
-                long diff_total = total_time - prev_total_time;
-                long diff_active = total_active - prev_active_time;
+    json << '"';
+}
 
-                if(diff_total > 0){
-                    cpu_usage = (double)diff_active / diff_total * 100.0;
-                }
+void appendPressureJSON(std::ostream& json, const PressureStats& p) {
+    json << "{\"some_avg10\": " << p.some_avg10 << ", \"some_avg60\": " << p.some_avg60
+         << ", \"some_avg300\": " << p.some_avg300 << ", \"some_total_us\": " << p.some_total_us
+         << ", \"some_percent\": " << p.some_percent
+         << ", \"full_avg10\": " << p.full_avg10 << ", \"full_avg60\": " << p.full_avg60
+         << ", \"full_avg300\": " << p.full_avg300 << ", \"full_total_us\": " << p.full_total_us
+         << ", \"full_percent\": " << p.full_percent << "}";
+}
 
-                prev_total_time = total_time;
-                prev_active_time = total_active;
-            }
+void appendPerfJSON(std::ostream& json, const PerfCounters& p) {
+    json << "{\"available\": " << (p.available ? "true" : "false")
+         << ", \"hardware\": " << (p.hardware ? "true" : "false")
+         << ", \"ipc\": " << p.ipc << ", \"cache_miss_percent\": " << p.cache_miss_percent
+         << ", \"cache_mpki\": " << p.cache_mpki << ", \"branch_miss_percent\": " << p.branch_miss_percent
+         << ", \"cycles_per_sec\": " << p.cycles_per_sec
+         << ", \"context_switches_per_sec\": " << p.context_switches_per_sec
+         << ", \"cpu_migrations_per_sec\": " << p.cpu_migrations_per_sec
+         << ", \"page_faults_per_sec\": " << p.page_faults_per_sec
+         << ", \"cycles\": " << p.cycles << ", \"instructions\": " << p.instructions
+         << ", \"cache_references\": " << p.cache_references << ", \"cache_misses\": " << p.cache_misses
+         << ", \"branches\": " << p.branches << ", \"branch_misses\": " << p.branch_misses
+         << ", \"context_switches\": " << p.context_switches << ", \"cpu_migrations\": " << p.cpu_migrations
+         << ", \"page_faults\": " << p.page_faults << "}";
+}
 
-        } 
-        break;
+void appendMemInfoJSON(std::ostream& json, const MemInfo& m) {
+    json << "{\"total_kb\": " << m.total_kb << ", \"free_kb\": " << m.free_kb
+         << ", \"available_kb\": " << m.available_kb << ", \"used_kb\": " << m.used_kb
+         << ", \"buffers_kb\": " << m.buffers_kb << ", \"cached_kb\": " << m.cached_kb
+         << ", \"file_pages_kb\": " << m.file_pages_kb << ", \"swap_cached_kb\": " << m.swap_cached_kb
+         << ", \"active_anon_kb\": " << m.active_anon_kb << ", \"inactive_anon_kb\": " << m.inactive_anon_kb
+         << ", \"active_file_kb\": " << m.active_file_kb << ", \"inactive_file_kb\": " << m.inactive_file_kb
+         << ", \"unevictable_kb\": " << m.unevictable_kb << ", \"mlocked_kb\": " << m.mlocked_kb
+         << ", \"swap_total_kb\": " << m.swap_total_kb << ", \"swap_free_kb\": " << m.swap_free_kb
+         << ", \"dirty_kb\": " << m.dirty_kb << ", \"writeback_kb\": " << m.writeback_kb
+         << ", \"anon_pages_kb\": " << m.anon_pages_kb << ", \"mapped_kb\": " << m.mapped_kb
+         << ", \"shmem_kb\": " << m.shmem_kb << ", \"slab_kb\": " << m.slab_kb
+         << ", \"slab_reclaimable_kb\": " << m.slab_reclaimable_kb
+         << ", \"slab_unreclaimable_kb\": " << m.slab_unreclaimable_kb
+         << ", \"kernel_stack_kb\": " << m.kernel_stack_kb << ", \"page_tables_kb\": " << m.page_tables_kb
+         << ", \"commit_limit_kb\": " << m.commit_limit_kb << ", \"committed_as_kb\": " << m.committed_as_kb
+         << ", \"anon_huge_pages_kb\": " << m.anon_huge_pages_kb
+         << ", \"huge_pages_total\": " << m.huge_pages_total << ", \"huge_pages_free\": " << m.huge_pages_free
+         << ", \"huge_pages_reserved\": " << m.huge_pages_reserved
+         << ", \"huge_pages_surplus\": " << m.huge_pages_surplus
+         << ", \"huge_page_size_kb\": " << m.huge_page_size_kb << "}";
+}
+
+// History columns: the column fields of the enabled collectors' schemas
+std::vector<std::string> historyMetricNames(uint32_t collectors) {
+    std::vector<std::string> names;
+    HostCollectors::forEachColumn(collectors, [&names](const MetricField& field, size_t) {
+        names.push_back(field.name);
+    });
+    return names;
+}
+
+// row needs room for HostCollectors::kColumnCount values; returns how many
+// were written
+size_t historyRow(const MetricsSnapshot& snap, double* row) {
+    size_t n = 0;
+    HostCollectors::forEachColumn(snap.collectors, [&](const MetricField& field, size_t) {
+        row[n++] = field.extract(snap);
+    });
+    return n;
+}
+
+bool collectorRan(uint32_t collectors, std::string_view name) {
+    return (collectors >> HostCollectors::indexOf(name)) & 1;
+}
+
+// Default history: one hour at the default 1s sampling interval
+const size_t kDefaultHistoryCapacity = 3600;
+
+int64_t toUnixMillis(std::chrono::system_clock::time_point tp) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
+}
+
+void appendBase64(std::ostream& out, std::string_view data) {
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i = 0;
+    for (; i + 2 < data.size(); i += 3) {
+        uint32_t n = uint32_t(uint8_t(data[i])) << 16 | uint32_t(uint8_t(data[i + 1])) << 8 | uint8_t(data[i + 2]);
+        out << kAlphabet[n >> 18] << kAlphabet[(n >> 12) & 63] << kAlphabet[(n >> 6) & 63] << kAlphabet[n & 63];
+    }
+    if (i + 1 == data.size()) {
+        uint32_t n = uint32_t(uint8_t(data[i])) << 16;
+        out << kAlphabet[n >> 18] << kAlphabet[(n >> 12) & 63] << "==";
+    } else if (i + 2 == data.size()) {
+        uint32_t n = uint32_t(uint8_t(data[i])) << 16 | uint32_t(uint8_t(data[i + 1])) << 8;
+        out << kAlphabet[n >> 18] << kAlphabet[(n >> 12) & 63] << kAlphabet[(n >> 6) & 63] << '=';
     }
 }
 
-void PerformanceMonitor::collectMemoryUsage(){
-    std::ifstream memFile("/proc/meminfo");
-    if(!memFile.is_open()){
-        // add throw later
-        return;
+// Seconds as given in a query ("1700000000", "2.5", "-300")
+bool parseSeconds(std::string_view text, double& seconds) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), seconds);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+}
+
+PerformanceMonitor::PerformanceMonitor()
+    : sketches(std::make_unique<WindowedSketches>(historyMetricNames(HostCollectors::kAll))),
+      collector_intervals(HostCollectors::kCount) {
+    sample.collectors = HostCollectors::kAll;
+    setHistoryCapacity(kDefaultHistoryCapacity);
+}
+
+bool PerformanceMonitor::setCollectors(const std::string& list) {
+    if (sampler_running || history_log || segment_log || push_exporter) {
+        std::cerr << "Collectors must be chosen before the sampler and the history outputs start" << std::endl;
+        return false;
     }
-    long total_mem, available_mem;
-    std::string line;
-    while(std::getline(memFile, line)){
-        std::stringstream ss(line);
-        std::string key;
-        ss >> key;
-        if(key == "MemTotal:"){
-            ss >> total_mem;
-        }
-        else if(key == "MemAvailable:"){
-            ss >> available_mem;
-            break;
+    uint32_t collectors = 0;
+    std::string_view names = list;
+    while (!names.empty()) {
+        size_t comma = names.find(',');
+        std::string_view name = names.substr(0, comma);
+        int index = HostCollectors::indexOf(name);
+        if (index < 0) {
+            std::cerr << "Unknown collector: " << name << std::endl;
+            return false;
         }
+        collectors |= 1u << index;
+        names = comma == std::string_view::npos ? std::string_view() : names.substr(comma + 1);
+    }
+    if (collectors == 0) {
+        std::cerr << "No collectors enabled" << std::endl;
+        return false;
     }
-    memory_usage = total_mem - available_mem;
+    sample.collectors = collectors;
+    // History columns follow the enabled schemas
+    sketches = std::make_unique<WindowedSketches>(historyMetricNames(collectors));
+    setHistoryCapacity(history->capacity());
+    return true;
 }
 
-void PerformanceMonitor::collectLoadAverage(){
-    std::ifstream loadFile("/proc/loadavg");
-    if(!loadFile.is_open()){
+bool PerformanceMonitor::setCollectorInterval(const std::string& name, std::chrono::milliseconds interval) {
+    if (sampler_running) {
+        std::cerr << "Collector intervals can only be changed before the sampler starts" << std::endl;
+        return false;
+    }
+    int index = HostCollectors::indexOf(name);
+    if (index < 0) {
+        std::cerr << "Unknown collector: " << name << std::endl;
+        return false;
+    }
+    collector_intervals[index] = interval;
+    return true;
+}
+
+void PerformanceMonitor::setHistoryCapacity(size_t samples) {
+    if (sampler_running) {
+        std::cerr << "History capacity can only be changed before the sampler starts" << std::endl;
         return;
     }
-    loadFile >> load_average_1min >> load_average_5min >> load_average_15min;
+    history = std::make_unique<TimeSeriesStore>(historyMetricNames(sample.collectors), samples);
 }
 
+bool PerformanceMonitor::startHistoryLog(const HistoryLogConfig& config) {
+    if (sampler_running) {
+        std::cerr << "History log must be started before the sampler" << std::endl;
+        return false;
+    }
+    auto writer = std::make_unique<HistoryWriter>(historyMetricNames(sample.collectors), config);
+    if (!writer->start()) {
+        return false;
+    }
+    history_log = std::move(writer);
+    return true;
+}
 
-void PerformanceMonitor::collectProcessCount(){
-    std::ifstream statFile("/proc/stat");
-    if(!statFile.is_open()){
+void PerformanceMonitor::stopHistoryLog() {
+    if (sampler_running) {
+        std::cerr << "History log must be stopped after the sampler" << std::endl;
         return;
     }
-    std::string line;
-    while(std::getline(statFile, line)){
-        std::stringstream ss(line);
-        std::string key;
-        ss >> key;
-
-        if(key == "processes"){
-            ss >> process_count;
-            break;
+    if (history_log) {
+        history_log->stop();
+        if (history_log->droppedRows() > 0) {
+            std::cerr << "History log dropped " << history_log->droppedRows() << " rows" << std::endl;
         }
+        history_log.reset();
     }
 }
 
-void PerformanceMonitor::collectNetworkStats(){
-    std::ifstream netFile("/proc/net/dev");
-    if(!netFile.is_open()){
+bool PerformanceMonitor::startSegmentLog(const SegmentConfig& config) {
+    if (sampler_running) {
+        std::cerr << "Segment log must be started before the sampler" << std::endl;
+        return false;
+    }
+    auto writer = std::make_unique<SegmentWriter>(historyMetricNames(sample.collectors), config);
+    if (!writer->prepare()) {
+        return false;
+    }
+    segment_log = std::move(writer);
+    return true;
+}
+
+void PerformanceMonitor::stopSegmentLog() {
+    if (sampler_running) {
+        std::cerr << "Segment log must be stopped after the sampler" << std::endl;
         return;
     }
+    segment_log.reset();
+}
 
-    std::string line;
-    std::getline(netFile, line); //header1
-    std::getline(netFile, line); // header2
-    size_t total_recv = 0, total_sent = 0;
-    
-    while(std::getline(netFile, line)){
-        std::stringstream ss(line);
-        std::string interface;
-        ss >> interface;
+bool PerformanceMonitor::startPushExport(const PushConfig& config) {
+    if (sampler_running) {
+        std::cerr << "Push export must be started before the sampler" << std::endl;
+        return false;
+    }
+    auto exporter = std::make_unique<PushExporter>(historyMetricNames(sample.collectors), config);
+    if (!exporter->start()) {
+        return false;
+    }
+    push_exporter = std::move(exporter);
+    return true;
+}
 
-        if(interface.find("lo:") == 0){
-            continue;
+void PerformanceMonitor::stopPushExport() {
+    if (sampler_running) {
+        std::cerr << "Push export must be stopped after the sampler" << std::endl;
+        return;
+    }
+    if (push_exporter) {
+        push_exporter->stop();
+        if (push_exporter->droppedRows() > 0 || push_exporter->droppedBatches() > 0) {
+            std::cerr << "Push export dropped " << push_exporter->droppedRows() << " rows and "
+                      << push_exporter->droppedBatches() << " batches" << std::endl;
         }
+        push_exporter.reset();
+    }
+}
 
-        size_t recv_bytes;
-        ss >> recv_bytes;
-
-        for(int i = 0; i < 7; i++){
-            size_t dummy;
-            ss >> dummy;
-        }
-        size_t sent_bytes;
-        ss >> sent_bytes;
+void CpuCounters::resize(size_t n){
+    user.resize(n);
+    system.resize(n);
+    iowait.resize(n);
+    active.resize(n);
+    total.resize(n);
+}
 
-        total_recv += recv_bytes;
-        total_sent += sent_bytes;
-    }
-    network_stats.bytes_received = total_recv;
-    network_stats.bytes_sent = total_sent;
+void PerformanceMonitor::collectCPUUsage(){
+    collectProcStat();
 }
 
-void PerformanceMonitor::collectDiskStats(){
-    std::ifstream diskFile("/proc/diskstats");
-    if(!diskFile.is_open()){
+void PerformanceMonitor::collectProcStat(){
+    if(!proc_stat.read()){
+        // add throw later, return for now
         return;
     }
-    
-    std::string line;
-    size_t current_sectors_read = 0, current_sectors_written = 0;
-    
-    while(std::getline(diskFile, line)){
-        std::stringstream ss(line);
-        int major, minor;
-        std::string device;
-        ss >> major >> minor >> device;
-        
-        // Check if this is a main disk device (not a partition)
-        bool is_main_device = false;
-        
-        // NVMe devices: nvme0n1, nvme1n1 (not nvme0n1p1, nvme1n1p2)
-        if(device.find("nvme") == 0 && device.find("p") == std::string::npos) {
-            is_main_device = true;
-        }
-        // SATA/SSD devices: sda, sdb, sdc (not sda1, sdb2)
-        else if(device.find("sd") == 0 && device.length() == 3) {
-            is_main_device = true;
+    auto now = std::chrono::steady_clock::now();
+    CpuStats& stats = sample.cpu_stats;
+    bool seen_cpu = false;
+
+    // Start from last cycle's counters so a CPU missing from this read
+    // (went offline) shows a zero delta instead of garbage
+    cpu_now = cpu_prev;
+
+    ProcScanner ss(proc_stat.contents());
+    do {
+        std::string_view key = ss.token(); // reading first word into key
+        if(startsWith(key, "cpu")){
+            // "cpu" is the aggregate, "cpuN" goes to slot N + 1
+            size_t slot = 0;
+            if(key.size() > 3){
+                std::from_chars(key.data() + 3, key.data() + key.size(), slot);
+                slot++;
+            }
+            if(slot >= cpu_now.size()){
+                // first sample or CPUs came online - the only time this allocates
+                cpu_now.resize(slot + 1);
+                cpu_prev.resize(slot + 1);
+            }
+            seen_cpu = true;
+
+            uint64_t user = ss.u64(), nice = ss.u64(), system = ss.u64(), idle = ss.u64();
+            uint64_t iowait = ss.u64(), irq = ss.u64(), softirq = ss.u64(), steal = ss.u64();
+
+            cpu_now.user[slot] = user + nice;
+            cpu_now.system[slot] = system + irq + softirq;
+            cpu_now.iowait[slot] = iowait;
+            cpu_now.active[slot] = user + nice + system + irq + softirq + steal;
+            cpu_now.total[slot] = cpu_now.active[slot] + idle + iowait;
         }
-        // Virtual/IDE devices: hda, hdb (not hda1, hdb2)
-        else if(device.find("hd") == 0 && device.length() == 3) {
-            is_main_device = true;
+        else if(key == "ctxt"){
+            stats.context_switches = ss.u64();
         }
-        // MMC/eMMC storage: mmcblk0, mmcblk1 (not mmcblk0p1)
-        else if(device.find("mmcblk") == 0 && device.find("p") == std::string::npos) {
-            is_main_device = true;
+        else if(key == "intr"){
+            stats.interrupts = ss.u64(); // first column is the total, skip the per-IRQ ones
         }
-        // VM devices: vda, vdb, xvda, xvdb (not vda1, xvda2)
-        else if((device.find("vd") == 0 || device.find("xvd") == 0) && 
-                device.length() >= 3 && std::isalpha(device.back())) {
-            is_main_device = true;
+        else if(key == "processes"){
+            sample.process_count = ss.i64();
         }
-        
-        // Skip virtual/loop devices
-        if(device.find("loop") == 0 || device.find("ram") == 0 || 
-           device.find("dm-") == 0 || device.find("zram") == 0) {
-            is_main_device = false;
+        else if(key == "procs_running"){
+            stats.procs_running = ss.i64();
         }
-        
-        if(is_main_device) {
-            size_t reads, reads_merged, sectors_read, time_reading;
-            size_t writes, writes_merged, sectors_written, time_writing;
-            
-            ss >> reads >> reads_merged >> sectors_read >> time_reading
-               >> writes >> writes_merged >> sectors_written >> time_writing;
-            
-            // Sum up all real disk devices
-            current_sectors_read += sectors_read;
-            current_sectors_written += sectors_written;
+        else if(key == "procs_blocked"){
+            stats.procs_blocked = ss.i64();
         }
+    } while(ss.nextLine());
+
+    if(!seen_cpu){
+        return;
     }
-    
-    if(first_disk_read) {
-        // First reading - just store baseline
-        prev_sectors_read = current_sectors_read;
-        prev_sectors_written = current_sectors_written;
-        first_disk_read = false;
-        disk_stats.bytes_read = 0;
-        disk_stats.bytes_written = 0;
+
+    double elapsed_sec = std::chrono::duration<double>(now - prev_stat_time).count();
+    if(first_cpu_read){
+        first_cpu_read = false;
+        elapsed_sec = 0.0;
+    }
+    computeCpuUsage(elapsed_sec);
+
+    prev_context_switches = stats.context_switches;
+    prev_interrupts = stats.interrupts;
+    prev_stat_time = now;
+    std::swap(cpu_now, cpu_prev);
+}
+
+// Turns cpu_now - cpu_prev into percentages. The loop body has no branches
+// and walks each column linearly, so the compiler can vectorize it.
+void PerformanceMonitor::computeCpuUsage(double elapsed_sec){
+    CpuStats& stats = sample.cpu_stats;
+    size_t n = cpu_now.size();
+    size_t cores = n - 1;
+    stats.core_usage.resize(cores);
+    stats.core_user.resize(cores);
+    stats.core_system.resize(cores);
+    stats.core_iowait.resize(cores);
+
+    const uint64_t* user = cpu_now.user.data();
+    const uint64_t* system = cpu_now.system.data();
+    const uint64_t* iowait = cpu_now.iowait.data();
+    const uint64_t* active = cpu_now.active.data();
+    const uint64_t* total = cpu_now.total.data();
+    const uint64_t* prev_user = cpu_prev.user.data();
+    const uint64_t* prev_system = cpu_prev.system.data();
+    const uint64_t* prev_iowait = cpu_prev.iowait.data();
+    const uint64_t* prev_active = cpu_prev.active.data();
+    const uint64_t* prev_total = cpu_prev.total.data();
+
+    // percent per jiffy; no baseline yet (first read or freshly onlined CPU) reports 0%
+    auto scaleFor = [&](size_t i){
+        double valid = prev_total[i] != 0 ? 100.0 : 0.0;
+        double diff_total = double(total[i] - prev_total[i]);
+        return valid / (diff_total > 0.0 ? diff_total : 1.0);
+    };
+
+    // slot 0 is the aggregate line
+    sample.cpu_usage = double(active[0] - prev_active[0]) * scaleFor(0);
+
+    double* usage_out = stats.core_usage.data();
+    double* user_out = stats.core_user.data();
+    double* system_out = stats.core_system.data();
+    double* iowait_out = stats.core_iowait.data();
+    for(size_t i = 1; i < n; i++){
+        double scale = scaleFor(i);
+        usage_out[i - 1] = double(active[i] - prev_active[i]) * scale;
+        user_out[i - 1] = double(user[i] - prev_user[i]) * scale;
+        system_out[i - 1] = double(system[i] - prev_system[i]) * scale;
+        iowait_out[i - 1] = double(iowait[i] - prev_iowait[i]) * scale;
+    }
+
+    if(elapsed_sec > 0.0){
+        stats.context_switches_per_sec = (stats.context_switches - prev_context_switches) / elapsed_sec;
+        stats.interrupts_per_sec = (stats.interrupts - prev_interrupts) / elapsed_sec;
     } else {
-        // Calculate difference since last reading
-        size_t diff_read = current_sectors_read - prev_sectors_read;
-        size_t diff_written = current_sectors_written - prev_sectors_written;
-        
-        // Convert sectors to bytes (512 bytes per sector)
-        disk_stats.bytes_read = diff_read * 512;
-        disk_stats.bytes_written = diff_written * 512;
-        
-        // Store current values for next time
-        prev_sectors_read = current_sectors_read;
-        prev_sectors_written = current_sectors_written;
+        stats.context_switches_per_sec = 0.0;
+        stats.interrupts_per_sec = 0.0;
     }
 }
 
+void PerformanceMonitor::collectMemoryUsage(){
+    memory_collector.collect(sample.memory);
+    const MemInfo& info = sample.memory.meminfo;
+    sample.total_memory = info.total_kb;
+    sample.memory_usage = info.total_kb > info.available_kb ? info.total_kb - info.available_kb : 0;
+}
+
+void PerformanceMonitor::collectLoadAverage(){
+    if(!proc_loadavg.read()){
+        return;
+    }
+    ProcScanner ss(proc_loadavg.contents());
+    sample.load_average_1min = ss.f64();
+    sample.load_average_5min = ss.f64();
+    sample.load_average_15min = ss.f64();
+}
+
+void PerformanceMonitor::collectScheduler(){
+    sched_collector.collect(sample.scheduler);
+}
+
+
+void PerformanceMonitor::collectProcessCount(){
+    collectProcStat();
+}
+
+void PerformanceMonitor::collectNetworkStats(){
+    network_collector.collect(sample.network_stats);
+}
+
+void PerformanceMonitor::collectDiskStats(){
+    block_collector.collect(sample.disk_stats);
+}
+
+void PerformanceMonitor::collectProcesses(){
+    process_collector.collect(sample.services);
+}
+
+void PerformanceMonitor::collectPerfCounters(){
+    perf_collector.collect(sample.perf, sample.services);
+}
+
+void PerformanceMonitor::collectPressure(){
+    pressure_collector.collect(sample.pressure);
+}
+
+void PerformanceMonitor::collectCgroups(){
+    cgroup_collector.collect(sample.cgroups);
+}
+
+void PerformanceMonitor::collectCustomMetrics(){
+    shm_collector.collect(sample.custom_metrics);
+}
+
+void PerformanceMonitor::setCgroupRoot(const std::string& path){
+    cgroup_collector.setRoot(path);
+}
+
+void PerformanceMonitor::trackProcess(const std::string& name, int pid, bool include_threads){
+    process_collector.trackProcess(name, pid, include_threads);
+}
+
+void PerformanceMonitor::trackThread(const std::string& name, int pid, int tid){
+    process_collector.trackThread(name, pid, tid);
+}
+
+void PerformanceMonitor::untrack(int pid, int tid){
+    process_collector.untrack(pid, tid);
+}
+
+// One line per enabled collector with its schema's values, then the
+// busiest core and the tracked services
 void PerformanceMonitor::printStats() const {
+    auto snap = publisher.acquire();
     std::cout << "=== Performance Stats ===" << std::endl;
-    std::cout << "CPU: " << cpu_usage << "%" << std::endl;
-    std::cout << "Memory: " << memory_usage << " KB" << std::endl;
-    std::cout << "Processes: " << process_count << std::endl;
-    std::cout << "Load: " << load_average_1min << " " << load_average_5min << " " << load_average_15min << std::endl;
-    std::cout << "Network - Sent: " << network_stats.bytes_sent << " bytes, Received: " << network_stats.bytes_received << " bytes" << std::endl;
-    std::cout << "Disk - Read: " << disk_stats.bytes_read << " bytes, Written: " << disk_stats.bytes_written << " bytes" << std::endl;
+    if (!snap) {
+        std::cout << "(no sample yet)" << std::endl << std::endl;
+        return;
+    }
+    size_t current = HostCollectors::kCount;
+    HostCollectors::forEachField(snap->collectors, [&](const MetricField& field, size_t source) {
+        if (source != current) {
+            std::cout << (current == HostCollectors::kCount ? "" : "\n") << HostCollectors::kNames[source] << ":";
+            current = source;
+        }
+        std::cout << " " << field.name << "=" << field.extract(*snap) << (*field.unit ? " " : "") << field.unit;
+    });
+    std::cout << std::endl;
+    const CpuStats& cpu = snap->cpu_stats;
+    if (!cpu.core_usage.empty()) {
+        auto busiest = std::max_element(cpu.core_usage.begin(), cpu.core_usage.end());
+        std::cout << "Busiest core: cpu" << (busiest - cpu.core_usage.begin()) << " at " << *busiest << "%" << std::endl;
+    }
+    for (const auto& svc : snap->services) {
+        std::cout << "  " << svc.name << " [" << svc.pid << (svc.tid ? "/" + std::to_string(svc.tid) : "") << "] ";
+        if (!svc.alive) {
+            std::cout << "gone" << std::endl;
+            continue;
+        }
+        std::cout << "CPU " << svc.cpu_percent << "%, RSS " << svc.rss_kb << " KB, ctxt/s "
+                  << svc.voluntary_ctxt_switches_per_sec << "/" << svc.nonvoluntary_ctxt_switches_per_sec << std::endl;
+    }
     std::cout << std::endl;
 }
 
 
 std::string PerformanceMonitor::toJSON() const {
+    auto snap = publisher.acquire();
+    if (!snap) {
+        return "{}";
+    }
+    return snap->json;
+}
+
+void PerformanceMonitor::renderJSON(const MetricsSnapshot& snap, std::string& out) const {
     std::stringstream json;
     json << std::fixed << std::setprecision(2);
     
     json << "{\n";
-    json << "  \"cpu_usage\": " << cpu_usage << ",\n";
-    json << "  \"memory_usage_kb\": " << memory_usage << ",\n";
+    json << "  \"monotonic_ns\": " << snap.monotonic_ns << ",\n";
+    json << "  \"sampling\": {\"burst\": " << (snap.burst ? "true" : "false")
+         << ", \"psi_events\": " << snap.psi_events << "},\n";
+    json << "  \"alerts_active\": " << snap.alerts_active << ",\n";
+    json << "  \"collectors\": [";
+    for (size_t i = 0, n = 0; i < HostCollectors::kCount; i++) {
+        if (snap.collectors >> i & 1) json << (n++ ? ", " : "") << '"' << HostCollectors::kNames[i] << '"';
+    }
+    json << "],\n";
+    json << "  \"cpu_usage\": " << snap.cpu_usage << ",\n";
+    json << "  \"perf\": ";
+    appendPerfJSON(json, snap.perf);
+    json << ",\n";
+    
+    const CpuStats& cpu = snap.cpu_stats;
+    auto writeColumn = [&json](const char* name, const std::vector<double>& values, bool last){
+        json << "      \"" << name << "\": [";
+        for (size_t i = 0; i < values.size(); i++) {
+            json << (i ? ", " : "") << values[i];
+        }
+        json << "]" << (last ? "\n" : ",\n");
+    };
+    json << "  \"cpu\": {\n";
+    json << "    \"procs_running\": " << cpu.procs_running << ",\n";
+    json << "    \"procs_blocked\": " << cpu.procs_blocked << ",\n";
+    json << "    \"context_switches\": " << cpu.context_switches << ",\n";
+    json << "    \"context_switches_per_sec\": " << cpu.context_switches_per_sec << ",\n";
+    json << "    \"interrupts\": " << cpu.interrupts << ",\n";
+    json << "    \"interrupts_per_sec\": " << cpu.interrupts_per_sec << ",\n";
+    json << "    \"cores\": {\n";
+    writeColumn("usage", cpu.core_usage, false);
+    writeColumn("user", cpu.core_user, false);
+    writeColumn("system", cpu.core_system, false);
+    writeColumn("iowait", cpu.core_iowait, true);
+    json << "    }\n";
+    json << "  },\n";
+    json << "  \"memory_usage_kb\": " << snap.memory_usage << ",\n";
+    const MemoryStats& mem = snap.memory;
+    const VmStats& vm = mem.vmstat;
+    json << "  \"memory\": {\n";
+    json << "    \"meminfo\": ";
+    appendMemInfoJSON(json, mem.meminfo);
+    json << ",\n    \"vmstat\": {\"page_faults\": " << vm.page_faults << ", \"major_faults\": " << vm.major_faults
+         << ", \"pages_paged_in\": " << vm.pages_paged_in << ", \"pages_paged_out\": " << vm.pages_paged_out
+         << ", \"swap_in\": " << vm.swap_in << ", \"swap_out\": " << vm.swap_out
+         << ", \"pages_scanned_kswapd\": " << vm.pages_scanned_kswapd
+         << ", \"pages_scanned_direct\": " << vm.pages_scanned_direct << ", \"oom_kills\": " << vm.oom_kills
+         << ", \"page_faults_per_sec\": " << vm.page_faults_per_sec
+         << ", \"major_faults_per_sec\": " << vm.major_faults_per_sec
+         << ", \"paged_in_kb_per_sec\": " << vm.paged_in_kb_per_sec
+         << ", \"paged_out_kb_per_sec\": " << vm.paged_out_kb_per_sec
+         << ", \"swap_in_per_sec\": " << vm.swap_in_per_sec << ", \"swap_out_per_sec\": " << vm.swap_out_per_sec
+         << ", \"pages_scanned_kswapd_per_sec\": " << vm.pages_scanned_kswapd_per_sec
+         << ", \"pages_scanned_direct_per_sec\": " << vm.pages_scanned_direct_per_sec << "},\n";
+    json << "    \"numa_nodes\": [";
+    for (size_t i = 0; i < mem.nodes.size(); i++) {
+        json << (i ? ",\n" : "\n") << "      {\"node\": " << mem.nodes[i].node << ", \"meminfo\": ";
+        appendMemInfoJSON(json, mem.nodes[i].meminfo);
+        json << "}";
+    }
+    json << (mem.nodes.empty() ? "]\n" : "\n    ]\n");
+    json << "  },\n";
+    const NetworkStats& net = snap.network_stats;
     json << "  \"network\": {\n";
-    json << "    \"bytes_sent\": " << network_stats.bytes_sent << ",\n";
-    json << "    \"bytes_received\": " << network_stats.bytes_received << "\n";
+    json << "    \"bytes_sent\": " << net.bytes_sent << ",\n";
+    json << "    \"bytes_received\": " << net.bytes_received << ",\n";
+    json << "    \"bytes_sent_per_sec\": " << net.bytes_sent_per_sec << ",\n";
+    json << "    \"bytes_received_per_sec\": " << net.bytes_received_per_sec << ",\n";
+    json << "    \"interfaces\": [";
+    for (size_t i = 0; i < net.interfaces.size(); i++) {
+        const InterfaceStats& iface = net.interfaces[i];
+        json << (i ? ",\n" : "\n");
+        json << "      {\"name\": ";
+        appendJSONString(json, iface.name);
+        json << ", \"rx_bytes\": " << iface.rx_bytes << ", \"tx_bytes\": " << iface.tx_bytes << ", "
+             << "\"rx_bytes_per_sec\": " << iface.rx_bytes_per_sec << ", \"tx_bytes_per_sec\": " << iface.tx_bytes_per_sec << ", "
+             << "\"rx_packets_per_sec\": " << iface.rx_packets_per_sec << ", \"tx_packets_per_sec\": " << iface.tx_packets_per_sec << ", "
+             << "\"rx_errors\": " << iface.rx_errors << ", \"tx_errors\": " << iface.tx_errors << ", "
+             << "\"rx_dropped\": " << iface.rx_dropped << ", \"tx_dropped\": " << iface.tx_dropped << ", "
+             << "\"errors_per_sec\": " << iface.errors_per_sec << ", \"dropped_per_sec\": " << iface.dropped_per_sec << "}";
+    }
+    json << (net.interfaces.empty() ? "]\n" : "\n    ]\n");
     json << "  },\n";
+    const DiskStats& disk = snap.disk_stats;
     json << "  \"disk\": {\n";
-    json << "    \"bytes_read\": " << disk_stats.bytes_read << ",\n";
-    json << "    \"bytes_written\": " << disk_stats.bytes_written << "\n";
+    json << "    \"bytes_read\": " << disk.bytes_read << ",\n";
+    json << "    \"bytes_written\": " << disk.bytes_written << ",\n";
+    json << "    \"read_bytes_per_sec\": " << disk.read_bytes_per_sec << ",\n";
+    json << "    \"write_bytes_per_sec\": " << disk.write_bytes_per_sec << ",\n";
+    json << "    \"devices\": [";
+    for (size_t i = 0; i < disk.devices.size(); i++) {
+        const BlockDeviceStats& dev = disk.devices[i];
+        json << (i ? ",\n" : "\n");
+        json << "      {\"name\": ";
+        appendJSONString(json, dev.name);
+        json << ", \"virtual\": " << (dev.is_virtual ? "true" : "false") << ", \"sector_size\": " << dev.sector_size << ", "
+             << "\"read_iops\": " << dev.read_iops << ", \"write_iops\": " << dev.write_iops << ", "
+             << "\"read_bytes_per_sec\": " << dev.read_bytes_per_sec << ", \"write_bytes_per_sec\": " << dev.write_bytes_per_sec << ", "
+             << "\"busy_percent\": " << dev.busy_percent << "}";
+    }
+    json << (disk.devices.empty() ? "]\n" : "\n    ]\n");
     json << "  },\n";
-    json << "  \"processes\": " << process_count << ",\n";
+    json << "  \"processes\": " << snap.process_count << ",\n";
     json << "  \"load_average\": {\n";
-    json << "    \"1min\": " << load_average_1min << ",\n";
-    json << "    \"5min\": " << load_average_5min << ",\n";
-    json << "    \"15min\": " << load_average_15min << "\n";
-    json << "  }\n";
+    json << "    \"1min\": " << snap.load_average_1min << ",\n";
+    json << "    \"5min\": " << snap.load_average_5min << ",\n";
+    json << "    \"15min\": " << snap.load_average_15min << "\n";
+    json << "  },\n";
+    const SchedStats& sched = snap.scheduler;
+    json << "  \"scheduler\": {\n";
+    json << "    \"available\": " << (sched.available ? "true" : "false") << ",\n";
+    json << "    \"run_delay_ns\": " << sched.run_delay_ns << ",\n";
+    json << "    \"timeslices\": " << sched.timeslices << ",\n";
+    json << "    \"run_delay_ms_per_sec\": " << sched.run_delay_ms_per_sec << ",\n";
+    json << "    \"timeslices_per_sec\": " << sched.timeslices_per_sec << ",\n";
+    json << "    \"avg_delay_us\": " << sched.avg_delay_us << ",\n";
+    json << "    \"cpus\": {\n";
+    writeColumn("run_delay_ms_per_sec", sched.cpu_run_delay_ms_per_sec, false);
+    writeColumn("timeslices_per_sec", sched.cpu_timeslices_per_sec, false);
+    writeColumn("avg_delay_us", sched.cpu_avg_delay_us, true);
+    json << "    }\n";
+    json << "  },\n";
+    json << "  \"services\": [";
+    for (size_t i = 0; i < snap.services.size(); i++) {
+        const ProcessStats& svc = snap.services[i];
+        json << (i ? "," : "") << "\n    {\n";
+        json << "      \"name\": ";
+        appendJSONString(json, svc.name);
+        json << ",\n";
+        json << "      \"pid\": " << svc.pid << ",\n";
+        json << "      \"tid\": " << svc.tid << ",\n";
+        json << "      \"alive\": " << (svc.alive ? "true" : "false") << ",\n";
+        json << "      \"state\": \"" << svc.state << "\",\n";
+        json << "      \"num_threads\": " << svc.num_threads << ",\n";
+        json << "      \"cpu_percent\": " << svc.cpu_percent << ",\n";
+        json << "      \"rss_kb\": " << svc.rss_kb << ",\n";
+        json << "      \"virt_kb\": " << svc.virt_kb << ",\n";
+        json << "      \"voluntary_ctxt_switches\": " << svc.voluntary_ctxt_switches << ",\n";
+        json << "      \"nonvoluntary_ctxt_switches\": " << svc.nonvoluntary_ctxt_switches << ",\n";
+        json << "      \"voluntary_ctxt_switches_per_sec\": " << svc.voluntary_ctxt_switches_per_sec << ",\n";
+        json << "      \"nonvoluntary_ctxt_switches_per_sec\": " << svc.nonvoluntary_ctxt_switches_per_sec << ",\n";
+        json << "      \"read_bytes\": " << svc.read_bytes << ",\n";
+        json << "      \"write_bytes\": " << svc.write_bytes << ",\n";
+        json << "      \"read_bytes_per_sec\": " << svc.read_bytes_per_sec << ",\n";
+        json << "      \"write_bytes_per_sec\": " << svc.write_bytes_per_sec << ",\n";
+        json << "      \"run_delay_ns\": " << svc.run_delay_ns << ",\n";
+        json << "      \"timeslices\": " << svc.timeslices << ",\n";
+        json << "      \"run_delay_ms_per_sec\": " << svc.run_delay_ms_per_sec << ",\n";
+        json << "      \"timeslices_per_sec\": " << svc.timeslices_per_sec << ",\n";
+        json << "      \"avg_delay_us\": " << svc.avg_delay_us << ",\n";
+        json << "      \"perf\": ";
+        appendPerfJSON(json, svc.perf);
+        json << ",\n";
+        json << "      \"threads\": [";
+        for (size_t t = 0; t < svc.threads.size(); t++) {
+            const ThreadStats& thread = svc.threads[t];
+            // comm is whatever the thread set with PR_SET_NAME
+            json << (t ? ", " : "") << "{\"tid\": " << thread.tid << ", \"name\": ";
+            appendJSONString(json, thread.name);
+            json << ", \"state\": \"" << thread.state << "\", \"cpu_percent\": " << thread.cpu_percent
+                 << ", \"voluntary_ctxt_switches\": " << thread.voluntary_ctxt_switches
+                 << ", \"nonvoluntary_ctxt_switches\": " << thread.nonvoluntary_ctxt_switches
+                 << ", \"run_delay_ms_per_sec\": " << thread.run_delay_ms_per_sec
+                 << ", \"avg_delay_us\": " << thread.avg_delay_us << "}";
+        }
+        json << "]\n";
+        json << "    }";
+    }
+    json << (snap.services.empty() ? "],\n" : "\n  ],\n");
+    json << "  \"pressure\": {\n";
+    json << "    \"available\": " << (snap.pressure.available ? "true" : "false") << ",\n";
+    json << "    \"cpu\": ";
+    appendPressureJSON(json, snap.pressure.cpu);
+    json << ",\n    \"memory\": ";
+    appendPressureJSON(json, snap.pressure.memory);
+    json << ",\n    \"io\": ";
+    appendPressureJSON(json, snap.pressure.io);
+    json << "\n  },\n";
+    json << "  \"cgroups\": [";
+    for (size_t i = 0; i < snap.cgroups.size(); i++) {
+        const CgroupStats& group = snap.cgroups[i];
+        json << (i ? ",\n" : "\n") << "    {\"name\": ";
+        appendJSONString(json, group.name);
+        json << ", \"cpu_percent\": " << group.cpu_percent
+             << ", \"cpu_usage_usec\": " << group.cpu_usage_usec
+             << ", \"cpu_periods\": " << group.cpu_periods
+             << ", \"cpu_throttled_periods\": " << group.cpu_throttled_periods
+             << ", \"cpu_throttled_usec\": " << group.cpu_throttled_usec
+             << ", \"throttled_percent\": " << group.throttled_percent
+             << ", \"memory_current\": " << group.memory_current
+             << ", \"memory_anon\": " << group.memory_anon
+             << ", \"memory_file\": " << group.memory_file
+             << ", \"memory_kernel\": " << group.memory_kernel
+             << ", \"major_faults_per_sec\": " << group.major_faults_per_sec
+             << ", \"io_read_bytes_per_sec\": " << group.io_read_bytes_per_sec
+             << ", \"io_write_bytes_per_sec\": " << group.io_write_bytes_per_sec
+             << ", \"memory_pressure\": ";
+        appendPressureJSON(json, group.memory_pressure);
+        json << "}";
+    }
+    json << (snap.cgroups.empty() ? "],\n" : "\n  ],\n");
+    json << "  \"custom_metrics\": [";
+    for (size_t i = 0; i < snap.custom_metrics.size(); i++) {
+        const CustomMetric& metric = snap.custom_metrics[i];
+        json << (i ? ",\n" : "\n") << "    {\"service\": ";
+        appendJSONString(json, metric.service);
+        json << ", \"pid\": " << metric.pid << ", \"name\": ";
+        appendJSONString(json, metric.name);
+        json << ", \"kind\": \""
+             << (metric.kind == 'h' ? "histogram" : metric.kind == 'g' ? "gauge" : "counter") << "\"";
+        if (metric.kind == 'h') {
+            json << ", \"count\": " << metric.count << ", \"mean\": " << metric.mean
+                 << ", \"p50\": " << metric.p50 << ", \"p90\": " << metric.p90 << ", \"p99\": " << metric.p99
+                 << ", \"p999\": " << metric.p999 << ", \"max\": " << metric.max << "}";
+        } else {
+            json << ", \"value\": " << metric.value << "}";
+        }
+    }
+    json << (snap.custom_metrics.empty() ? "]\n" : "\n  ]\n");
     json << "}";
     
-    return json.str();
+    out = json.str();
 }
 
 void PerformanceMonitor::saveToFile(const std::string& filename) const {
@@ -268,168 +764,732 @@ void PerformanceMonitor::saveToFile(const std::string& filename) const {
     }
 }
 
+void PerformanceMonitor::appendToCSV(const std::string& filename) const {
+    auto snap = publisher.acquire();
+    if (!snap) {
+        return;
+    }
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open " << filename << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+    std::string text;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size == 0) {
+        HistoryWriter::appendHeader(historyMetricNames(snap->collectors), text);
+    }
+    double row[HostCollectors::kColumnCount];
+    size_t columns = historyRow(*snap, row);
+    HistoryWriter::appendRow(toUnixMillis(snap->timestamp), row, columns, text);
+    // O_APPEND + one write keeps concurrent appenders from interleaving rows
+    if (write(fd, text.data(), text.size()) != (ssize_t)text.size()) {
+        std::cerr << "Failed to append to " << filename << std::endl;
+    }
+    close(fd);
+}
+
 void PerformanceMonitor::collectAllMetrics() {
-    collectCPUUsage();
-    collectMemoryUsage();
-    collectNetworkStats();
-    collectDiskStats();
-    collectProcessCount();
-    collectLoadAverage();
+    sample.timestamp = std::chrono::system_clock::now();
+    sample.monotonic_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    HostCollectors::collect(*this, sample.collectors);
+    detectAnomalies(sample.collectors);
+    publishSample();
+}
+
+// Series are the schema's gauges, named like their /metrics/range columns,
+// plus "<kind>.<name>.<field>" for per-core, per-device and per-group values.
+// Only collectors that ran feed the detector: re-observing a stale value
+// would flatten the baselines.
+void PerformanceMonitor::detectAnomalies(uint32_t collectors) {
+    if (!anomaly_detector) {
+        return;
+    }
+    AnomalyDetector& detector = *anomaly_detector;
+    std::string& key = anomaly_key;
+    auto ran = [collectors](const char* name) { return collectorRan(collectors, name); };
+    auto observe = [&](const char* kind, std::string_view name, const char* field, double value) {
+        key.assign(kind).append(1, '.').append(name).append(1, '.').append(field);
+        detector.observe(key, value);
+    };
+
+    detector.beginSample(toUnixMillis(sample.timestamp));
+    HostCollectors::forEachColumn(collectors, [&](const MetricField& field, size_t) {
+        if (field.type == MetricType::Gauge) detector.observe(field.name, field.extract(sample));
+    });
+    if (ran("cpu")) {
+        const CpuStats& cpu = sample.cpu_stats;
+        char id[24];
+        for (size_t i = 0; i < cpu.core_usage.size(); i++) {
+            auto result = std::to_chars(id, id + sizeof(id), i);
+            observe("core", std::string_view(id, result.ptr - id), "usage", cpu.core_usage[i]);
+            observe("core", std::string_view(id, result.ptr - id), "iowait", cpu.core_iowait[i]);
+        }
+    }
+    if (ran("sched")) {
+        const SchedStats& sched = sample.scheduler;
+        char id[24];
+        for (size_t i = 0; i < sched.cpu_run_delay_ms_per_sec.size(); i++) {
+            auto result = std::to_chars(id, id + sizeof(id), i);
+            observe("core", std::string_view(id, result.ptr - id), "run_delay_ms_per_sec",
+                    sched.cpu_run_delay_ms_per_sec[i]);
+        }
+    }
+    if (ran("network")) {
+        for (const auto& iface : sample.network_stats.interfaces) {
+            observe("interface", iface.name, "rx_bytes_per_sec", iface.rx_bytes_per_sec);
+            observe("interface", iface.name, "tx_bytes_per_sec", iface.tx_bytes_per_sec);
+            observe("interface", iface.name, "errors_per_sec", iface.errors_per_sec);
+            observe("interface", iface.name, "dropped_per_sec", iface.dropped_per_sec);
+        }
+    }
+    if (ran("disk")) {
+        for (const auto& device : sample.disk_stats.devices) {
+            observe("device", device.name, "read_iops", device.read_iops);
+            observe("device", device.name, "write_iops", device.write_iops);
+            observe("device", device.name, "read_bytes_per_sec", device.read_bytes_per_sec);
+            observe("device", device.name, "write_bytes_per_sec", device.write_bytes_per_sec);
+            observe("device", device.name, "busy_percent", device.busy_percent);
+        }
+    }
+    if (ran("processes")) {
+        for (const auto& process : sample.services) {
+            if (!process.alive) continue;
+            observe("process", process.name, "cpu_percent", process.cpu_percent);
+            observe("process", process.name, "rss_kb", (double)process.rss_kb);
+            observe("process", process.name, "run_delay_ms_per_sec", process.run_delay_ms_per_sec);
+        }
+    }
+    if (ran("perf")) {
+        for (const auto& process : sample.services) {
+            if (!process.perf.hardware) continue;
+            observe("process", process.name, "ipc", process.perf.ipc);
+            observe("process", process.name, "cache_mpki", process.perf.cache_mpki);
+        }
+    }
+    if (ran("cgroups")) {
+        for (const auto& group : sample.cgroups) {
+            observe("cgroup", group.name, "cpu_percent", group.cpu_percent);
+            observe("cgroup", group.name, "throttled_percent", group.throttled_percent);
+            observe("cgroup", group.name, "memory_current", (double)group.memory_current);
+            observe("cgroup", group.name, "memory_some_percent", group.memory_pressure.some_percent);
+        }
+    }
+    if (ran("custom")) {
+        // Gauges as they are, histograms by their p99; counters only ever grow
+        for (const auto& metric : sample.custom_metrics) {
+            if (metric.kind == 'c') continue;
+            key.assign("custom.").append(metric.service).append(1, '.').append(metric.name);
+            if (metric.kind == 'h') key.append(".p99");
+            detector.observe(key, metric.kind == 'h' ? metric.p99 : metric.value);
+        }
+    }
+    detector.endSample();
+    sample.alerts_active = detector.activeCount();
+}
+
+void PerformanceMonitor::publishSample() {
+    MetricsSnapshot& slot = publisher.beginWrite();
+    slot = sample;
+    renderJSON(slot, slot.json);
+    publisher.publish();
+
+    double row[HostCollectors::kColumnCount];
+    historyRow(sample, row);
+    int64_t timestamp_ms = toUnixMillis(sample.timestamp);
+    history->append(sample.monotonic_ns / 1000000, row);
+    sketches->add(timestamp_ms, row);
+    if (history_log) {
+        history_log->push(timestamp_ms, row);
+    }
+    if (segment_log) {
+        segment_log->append(timestamp_ms, row);
+    }
+    if (push_exporter) {
+        push_exporter->push(timestamp_ms, row);
+    }
+
+    // One framed event per sample, shared by every /metrics/stream subscriber
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    if (stream_server) {
+        stream_server->publishEvent(std::make_shared<const std::string>(renderEvent(slot)));
+    }
+}
+
+// SSE frame: "id: <generation>" then the JSON with every line prefixed by
+// "data: " - EventSource joins them back with newlines
+std::string PerformanceMonitor::renderEvent(const MetricsSnapshot& snap) const {
+    std::string event;
+    event.reserve(snap.json.size() + snap.json.size() / 8 + 64);
+    event += "id: ";
+    event += std::to_string(snap.generation);
+    event += "\ndata: ";
+    std::string_view json = snap.json;
+    while (!json.empty() && json.back() == '\n') json.remove_suffix(1);
+    for (char c : json) {
+        event += c;
+        if (c == '\n') event += "data: ";
+    }
+    event += "\n\n";
+    return event;
+}
+
+
+// sampler thread funcs
+bool PerformanceMonitor::setEventMode(const EventModeConfig& config) {
+    if (sampler_running) {
+        return false;
+    }
+    psi_triggers.clear();
+    for (const auto& spec : config.triggers) {
+        PsiTrigger trigger;
+        if (trigger.open(spec)) {
+            psi_triggers.push_back(std::move(trigger));
+        }
+    }
+    if (psi_triggers.empty()) {
+        std::cerr << "No PSI trigger could be registered; staying on fixed-interval sampling" << std::endl;
+        return false;
+    }
+    event_mode = config;
+    return true;
+}
+
+bool PerformanceMonitor::setAnomalyDetection(const AnomalyConfig& config) {
+    if (sampler_running || config.rules.empty()) {
+        return false;
+    }
+    anomaly_detector = std::make_unique<AnomalyDetector>(config);
+    return true;
+}
+
+void PerformanceMonitor::startSampler(std::chrono::milliseconds interval) {
+    if (sampler_running) {
+        return;
+    }
+    scheduler = std::make_unique<SampleScheduler>();
+    if (!scheduler->isOpen()) {
+        scheduler.reset();
+        return;
+    }
+    // Disabled collectors get no task, so they never wake the sampler
+    task_collectors.clear();
+    for (size_t i = 0; i < HostCollectors::kCount; i++) {
+        if (!(sample.collectors >> i & 1)) continue;
+        auto every = collector_intervals[i].count() > 0 ? collector_intervals[i] : interval;
+        scheduler->add(every);
+        task_collectors.push_back(i);
+    }
+    for (const auto& trigger : psi_triggers) {
+        scheduler->watch(trigger.getFd(), EPOLLPRI);
+    }
+    sampler_running = true;
+    sampler_thread = std::thread(&PerformanceMonitor::samplerLoop, this);
+}
+
+void PerformanceMonitor::stopSampler() {
+    if (!sampler_running) {
+        return;
+    }
+    scheduler->stop();
+    if (sampler_thread.joinable()) {
+        sampler_thread.join();
+    }
+    scheduler.reset();
+    sampler_running = false;
+}
+
+bool PerformanceMonitor::isSamplerRunning() const {
+    return sampler_running;
+}
+
+// One wakeup per group of collectors that are due together; collectors that
+// aren't due keep their previous values in the published sample
+void PerformanceMonitor::samplerLoop() {
+    std::vector<size_t> due;
+    SampleScheduler::Clock::time_point now;
+    SampleScheduler::Clock::time_point burst_until;
+    LatencyHistogram& cycle_latency = instruments().histogram("monitor.sample");
+    while (scheduler->wait(due, now)) {
+        // Each firing (re)starts the burst window; the kernel reports a
+        // trigger at most once per its own window while the stall lasts
+        if (!scheduler->fired().empty()) {
+            sample.psi_events += scheduler->fired().size();
+            if (!scheduler->inBurst()) {
+                scheduler->beginBurst(event_mode.burst_interval);
+            }
+            burst_until = now + event_mode.burst_window;
+        } else if (scheduler->inBurst() && now >= burst_until) {
+            scheduler->endBurst();
+        }
+        sample.burst = scheduler->inBurst();
+        if (due.empty()) {
+            continue;
+        }
+        sample.timestamp = std::chrono::system_clock::now();
+        sample.monotonic_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+        ScopedTimer timer(cycle_latency);
+        uint32_t ran = 0;
+        for (size_t id : due) {
+            ran |= 1u << task_collectors[id];
+        }
+        HostCollectors::collect(*this, ran);
+        detectAnomalies(ran);
+        publishSample();
+    }
 }
 
 
 // http server implementation funcs 
 void PerformanceMonitor::startHTTPServer(int port) {
-    if (server_running) {
+    HttpServerConfig config;
+    config.port = port;
+    startHTTPServer(config);
+}
+
+void PerformanceMonitor::startHTTPServer(const HttpServerConfig& server_config) {
+    if (http_server && http_server->isRunning()) {
         std::cout << "Server already running!" << std::endl;
         return;
     }
+    HttpServerConfig config = server_config;
+    if (config.stream_path.empty()) {
+        config.stream_path = "/metrics/stream";
+    }
+    // Blocks for the whole profile, so it runs off the event loop
+    config.deferred_paths.push_back("/profile");
+    profile_cancel = false;
     
-    server_running = true;
-    server_thread = std::thread(&PerformanceMonitor::serverLoop, this, port);
+    http_server = std::make_unique<HttpServer>(
+        [this](const HttpRequest& request, std::string& out) { handleRequest(request, out); });
+    if (!http_server->start(config)) {
+        std::cerr << "Failed to start HTTP server on port " << config.port << std::endl;
+        http_server.reset();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        stream_server = http_server.get();
+    }
     
-    std::cout << "HTTP Server started on port " << port << std::endl;
-    std::cout << "Try: curl http://localhost:" << port << "/metrics" << std::endl;
+    std::cout << "HTTP Server started on port " << config.port
+              << " (" << config.worker_threads << " worker thread"
+              << (config.worker_threads == 1 ? "" : "s") << ")" << std::endl;
+    std::cout << "Try: curl http://localhost:" << config.port << "/metrics" << std::endl;
 }
 
 void PerformanceMonitor::stopHTTPServer() {
-    if (!server_running) {
+    if (!http_server || !http_server->isRunning()) {
         return;
     }
     
-    server_running = false;
-    
-    if (server_socket != -1) {
-        close(server_socket);
-        server_socket = -1;
-    }
-    
-    if (server_thread.joinable()) {
-        server_thread.join();
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        stream_server = nullptr;
     }
-    
+    profile_cancel = true;  // stop() waits for a running profile
+    http_server->stop();
     std::cout << "HTTP Server stopped" << std::endl;
 }
 
 bool PerformanceMonitor::isServerRunning() const {
-    return server_running;
+    return http_server && http_server->isRunning();
+}
+
+// Called concurrently from every server worker thread - only touches the
+// published snapshot
+void PerformanceMonitor::handleRequest(const HttpRequest& request, std::string& out) const {
+#ifdef DEBUG
+    std::cout << "Request: " << request.method << " " << request.path << " " << request.version << std::endl;
+#endif
+    static LatencyHistogram& handler_latency = instruments().histogram("monitor.http.request");
+    ScopedTimer timer(handler_latency);
+    
+    if (request.method == "GET") {
+        if (request.path == "/metrics" || request.path == "/") {
+            // Serve whatever the sampler published last - no /proc reads here
+            auto snap = publisher.acquire();
+            if (snap) {
+                buildHTTPResponse(out, request, snap->json);
+            } else {
+                buildHTTPResponse(out, request, "{\"error\":\"No sample yet\"}", "application/json", "503 Service Unavailable");
+            }
+        } else if (request.path == "/metrics/range") {
+            handleRangeQuery(request, out);
+        } else if (request.path == "/metrics/sketch") {
+            handleSketchQuery(request, out);
+        } else if (request.path == "/metrics/latency") {
+            handleLatency(request, out);
+        } else if (request.path == "/alerts") {
+            handleAlerts(request, out);
+        } else if (request.path == "/metrics/schema") {
+            handleSchema(request, out);
+        } else if (request.path == "/metrics/prometheus") {
+            handlePrometheus(request, out);
+        } else if (request.path == "/profile") {
+            handleProfile(request, out);
+        } else if (request.path == "/health") {
+            // Simple health check
+            buildHTTPResponse(out, request, "{\"status\":\"ok\"}");
+        } else {
+            buildHTTPResponse(out, request, "{\"error\":\"Not Found\"}", "application/json", "404 Not Found");
+        }
+    } else {
+        buildHTTPResponse(out, request, "{\"error\":\"Method Not Allowed\"}", "application/json", "405 Method Not Allowed");
+    }
 }
 
-void PerformanceMonitor::serverLoop(int port) {
-    // Create socket
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket == -1) {
-        std::cerr << "Failed to create socket" << std::endl;
-        server_running = false;
+// GET /metrics/prometheus. Rendered lazily - scrapes are far rarer than
+// samples - and cached per worker thread by snapshot generation, so repeat
+// scrapes of the same sample are a copy and workers never contend.
+void PerformanceMonitor::handlePrometheus(const HttpRequest& request, std::string& out) const {
+    struct Cache {
+        uint64_t generation = 0;
+        std::string body;
+    };
+    thread_local Cache cache;
+
+    auto snap = publisher.acquire();
+    if (!snap) {
+        buildHTTPResponse(out, request, "# no sample yet\n", kPrometheusContentType, "503 Service Unavailable");
         return;
     }
-    
-    // Set socket options
-    int opt = 1;
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    
-    // Bind socket
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
-    
-    if (bind(server_socket, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        std::cerr << "Bind failed" << std::endl;
-        close(server_socket);
-        server_running = false;
+    if (cache.generation != snap->generation || cache.body.empty()) {
+        cache.body.clear();  // keeps capacity
+        renderPrometheus(*snap, cache.body);
+        cache.generation = snap->generation;
+    }
+    // Instruments aren't tied to a sample, so they're merged on every scrape
+    thread_local std::string body;
+    body.assign(cache.body);
+    renderInstruments(instruments(), body);
+    buildHTTPResponse(out, request, body, kPrometheusContentType);
+}
+
+// GET /profile?seconds=&pid=&hz=&format=
+//   seconds  how long to sample, 1-120 (default 10)
+//   pid      profile one process and its threads (default: system-wide)
+//   hz       samples per second per CPU or thread, 1-1000 (default 99)
+//   format   folded (default) for flamegraph.pl, or flat
+// Runs on its own thread (a deferred path), one profile at a time.
+void PerformanceMonitor::handleProfile(const HttpRequest& request, std::string& out) const {
+    ProfileOptions options;
+    std::string_view value;
+    bool ok = true;
+    auto parseInt = [&](const char* name, int& field, int min, int max) {
+        if (!request.param(name, value)) return;
+        auto result = std::from_chars(value.data(), value.data() + value.size(), field);
+        ok = ok && result.ec == std::errc() && result.ptr == value.data() + value.size() && field >= min && field <= max;
+    };
+    parseInt("seconds", options.seconds, 1, 120);
+    parseInt("pid", options.pid, 1, 1 << 30);
+    parseInt("hz", options.frequency, 1, 1000);
+    bool flat = false;
+    if (request.param("format", value)) {
+        if (value == "flat") flat = true;
+        else if (value != "folded") ok = false;
+    }
+    if (!ok) {
+        buildHTTPResponse(out, request, "{\"error\":\"Bad profile query\"}", "application/json", "400 Bad Request");
         return;
     }
-    
-    // Listen for connections
-    if (listen(server_socket, 3) < 0) {
-        std::cerr << "Listen failed" << std::endl;
-        close(server_socket);
-        server_running = false;
+
+    std::unique_lock<std::mutex> lock(profile_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        buildHTTPResponse(out, request, "{\"error\":\"A profile is already running\"}", "application/json",
+                          "409 Conflict");
         return;
     }
-    
-    // Accept connections
-    while (server_running) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
-        if (client_socket < 0) {
-            if (server_running) {  // Only log error if we're still supposed to be running
-                std::cerr << "Accept failed" << std::endl;
+    SamplingProfiler profiler;
+    std::string error;
+    if (!profiler.run(options, profile_cancel, error)) {
+        std::stringstream json;
+        json << "{\"error\":";
+        appendJSONString(json, error);
+        json << "}";
+        buildHTTPResponse(out, request, json.str(), "application/json", "500 Internal Server Error");
+        return;
+    }
+    std::string body;
+    if (flat) profiler.renderFlat(body);
+    else profiler.renderFolded(body);
+    buildHTTPResponse(out, request, body, "text/plain; charset=utf-8");
+}
+
+// GET /metrics/latency: every registered ScopedTimer histogram (quantiles
+// in microseconds) and counter, merged across threads now
+void PerformanceMonitor::handleLatency(const HttpRequest& request, std::string& out) const {
+    const InstrumentRegistry& registry = instruments();
+    double us_per_tick = registry.nanosecondsPerTick() / 1000.0;
+    std::stringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\n  \"histograms\": [";
+    bool first = true;
+    HistogramSnapshot merged;
+    registry.forEachHistogram([&](const LatencyHistogram& histogram) {
+        histogram.merge(merged);
+        json << (first ? "\n" : ",\n") << "    {\"name\": ";
+        appendJSONString(json, histogram.getName());
+        json << ", \"count\": " << merged.count
+             << ", \"mean_us\": " << (merged.count ? merged.sum * us_per_tick / merged.count : 0.0)
+             << ", \"p50_us\": " << merged.quantile(0.5) * us_per_tick
+             << ", \"p90_us\": " << merged.quantile(0.9) * us_per_tick
+             << ", \"p99_us\": " << merged.quantile(0.99) * us_per_tick
+             << ", \"p999_us\": " << merged.quantile(0.999) * us_per_tick
+             << ", \"max_us\": " << merged.max * us_per_tick << "}";
+        first = false;
+    });
+    json << (first ? "],\n" : "\n  ],\n") << "  \"counters\": [";
+    first = true;
+    registry.forEachCounter([&](const EventCounter& counter) {
+        json << (first ? "\n" : ",\n") << "    {\"name\": ";
+        appendJSONString(json, counter.getName());
+        json << ", \"value\": " << counter.value() << "}";
+        first = false;
+    });
+    json << (first ? "]\n" : "\n  ]\n") << "}\n";
+    buildHTTPResponse(out, request, json.str());
+}
+
+// GET /alerts: the rules, alerts firing now and the latest transitions.
+// Everything here only changes on a transition, so it's read under the
+// detector's lock rather than from the snapshot.
+void PerformanceMonitor::handleAlerts(const HttpRequest& request, std::string& out) const {
+    std::stringstream json;
+    json << std::fixed << std::setprecision(2);
+    json << "{\n  \"enabled\": " << (anomaly_detector ? "true" : "false") << ",\n  \"rules\": [";
+    if (!anomaly_detector) {
+        json << "],\n  \"watched_series\": 0,\n  \"active\": [],\n  \"recent\": []\n}\n";
+        buildHTTPResponse(out, request, json.str());
+        return;
+    }
+    const AnomalyDetector& detector = *anomaly_detector;
+    const auto& rules = detector.rules();
+    for (size_t i = 0; i < rules.size(); i++) {
+        json << (i ? ", " : "");
+        appendJSONString(json, rules[i].text);
+    }
+    json << "],\n  \"watched_series\": " << detector.watchedSeries() << ",\n";
+    auto writeEvent = [&](const AlertEvent& event, bool with_state) {
+        json << "    {";
+        if (with_state) json << "\"state\": \"" << (event.firing ? "firing" : "resolved") << "\", ";
+        json << "\"rule\": ";
+        appendJSONString(json, rules[event.rule].text);
+        json << ", \"series\": ";
+        appendJSONString(json, event.series);
+        json << ", \"timestamp_ms\": " << event.timestamp_ms << ", \"since_ms\": " << event.since_ms
+             << ", \"value\": " << event.value << ", \"mean\": " << event.mean << ", \"stddev\": " << event.stddev
+             << ", \"zscore\": " << event.zscore << ", \"quantile\": " << event.quantile << "}";
+    };
+    bool first = true;
+    json << "  \"active\": [";
+    detector.forEachActive([&](const AlertEvent& event) {
+        json << (first ? "\n" : ",\n");
+        writeEvent(event, false);
+        first = false;
+    });
+    json << (first ? "],\n" : "\n  ],\n") << "  \"recent\": [";
+    first = true;
+    detector.forEachEvent([&](const AlertEvent& event) {
+        json << (first ? "\n" : ",\n");
+        writeEvent(event, true);
+        first = false;
+    });
+    json << (first ? "]\n" : "\n  ]\n") << "}\n";
+    buildHTTPResponse(out, request, json.str());
+}
+
+// GET /metrics/schema: every collector, whether it's enabled, and the
+// fields it declares. "column" fields are the /metrics/range, CSV, segment
+// and push columns, in order, for the enabled collectors.
+void PerformanceMonitor::handleSchema(const HttpRequest& request, std::string& out) const {
+    uint32_t enabled = sample.collectors;  // fixed once the sampler runs
+    std::stringstream json;
+    json << "{\n  \"collectors\": [";
+    for (size_t i = 0; i < HostCollectors::kCount; i++) {
+        json << (i ? ",\n" : "\n") << "    {\"name\": \"" << HostCollectors::kNames[i]
+             << "\", \"enabled\": " << ((enabled >> i & 1) ? "true" : "false") << ", \"fields\": [";
+        HostCollectors::forEachField(1u << i, [&](const MetricField& field, size_t) {
+            json << (&field == HostCollectors::kSchemas[i] ? "\n" : ",\n") << "      {\"name\": \"" << field.name
+                 << "\", \"type\": \"" << metricTypeName(field.type) << "\", \"unit\": \"" << field.unit
+                 << "\", \"column\": " << (field.column ? "true" : "false") << ", \"prometheus\": ";
+            if (field.prometheus) {
+                json << '"' << field.prometheus << '"';
+            } else {
+                json << "null";
             }
-            continue;
+            json << ", \"help\": ";
+            appendJSONString(json, field.help);
+            json << "}";
+        });
+        json << "\n    ]}";
+    }
+    json << "\n  ],\n  \"columns\": [";
+    bool first = true;
+    HostCollectors::forEachColumn(enabled, [&](const MetricField& field, size_t) {
+        json << (first ? "" : ", ") << '"' << field.name << '"';
+        first = false;
+    });
+    json << "]\n}\n";
+    buildHTTPResponse(out, request, json.str());
+}
+
+// GET /metrics/range?from=&to=&step=&agg=&metrics=
+//   from, to  unix seconds, 0 being the epoch; negative means relative to now
+//             (default: the last 5 min)
+//   step      bucket width in seconds, 0 or absent for raw samples
+//   agg       mean (default), min, max or last
+//   metrics   comma separated names, default all
+void PerformanceMonitor::handleRangeQuery(const HttpRequest& request, std::string& out) const {
+    int64_t now_ms = toUnixMillis(std::chrono::system_clock::now());
+    int64_t steady_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    double now_sec = now_ms / 1000.0;
+    double from = -300, to = 0, step = 0;
+    std::string_view value;
+    bool ok = true;
+    if (request.param("from", value)) ok = ok && parseSeconds(value, from);
+    bool has_to = request.param("to", value);
+    if (has_to) ok = ok && parseSeconds(value, to);
+    if (request.param("step", value)) ok = ok && parseSeconds(value, step) && step >= 0;
+    if (from < 0) from += now_sec;
+    if (!has_to) to = now_sec;
+    else if (to < 0) to += now_sec;
+
+    TimeSeriesStore::RangeQuery query;
+    query.wall_offset_ms = now_ms - steady_ms;
+    query.from_ms = (int64_t)(from * 1000);
+    query.to_ms = (int64_t)(to * 1000);
+    query.step_ms = (int64_t)(step * 1000);
+
+    if (request.param("agg", value)) {
+        if (value == "mean") query.aggregation = TimeSeriesStore::Aggregation::Mean;
+        else if (value == "min") query.aggregation = TimeSeriesStore::Aggregation::Min;
+        else if (value == "max") query.aggregation = TimeSeriesStore::Aggregation::Max;
+        else if (value == "last") query.aggregation = TimeSeriesStore::Aggregation::Last;
+        else ok = false;
+    }
+    if (request.param("metrics", value)) {
+        while (ok && !value.empty()) {
+            size_t comma = value.find(',');
+            int index = history->metricIndex(value.substr(0, comma));
+            if (index < 0) ok = false;
+            else query.metrics.push_back(index);
+            value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
         }
-        
-        // Handle client in same thread (simple approach)
-        handleClient(client_socket);
-        close(client_socket);
     }
-    
-    close(server_socket);
-    server_socket = -1;
+    if (!ok || query.from_ms > query.to_ms) {
+        buildHTTPResponse(out, request, "{\"error\":\"Bad range query\"}", "application/json", "400 Bad Request");
+        return;
+    }
+
+    // Reused per server thread so repeated queries don't reallocate
+    static thread_local std::string body;
+    body.clear();
+    if (!history->renderRange(query, body)) {
+        buildHTTPResponse(out, request, "{\"error\":\"History overwritten while reading, retry\"}",
+                          "application/json", "503 Service Unavailable");
+        return;
+    }
+    buildHTTPResponse(out, request, body);
 }
 
-void PerformanceMonitor::handleClient(int client_socket) {
-    char buffer[1024] = {0};
-    ssize_t bytes_read = read(client_socket, buffer, 1024);
-    
-    if (bytes_read <= 0) {
+// GET /metrics/sketch?metric=&window=&count=&q=&format=
+//   metric  one /metrics/range name (required)
+//   window  1m (default), 10m or 1h
+//   count   newest windows to return, the open one included (default 1)
+//   q       comma separated quantiles (default 0.5,0.9,0.95,0.99)
+//   format  json (default), or binary for just the merged sketch
+// The JSON has every window and their merge, each with its serialized
+// sketch in base64, so an aggregator can merge hosts without raw samples.
+void PerformanceMonitor::handleSketchQuery(const HttpRequest& request, std::string& out) const {
+    std::string_view value;
+    int metric = request.param("metric", value) ? sketches->metricIndex(value) : -1;
+    int resolution = 0;
+    if (request.param("window", value)) resolution = WindowedSketches::resolutionIndex(value);
+    size_t count = 1;
+    bool ok = metric >= 0 && resolution >= 0;
+    if (request.param("count", value)) {
+        auto result = std::from_chars(value.data(), value.data() + value.size(), count);
+        ok = ok && result.ec == std::errc() && count > 0;
+    }
+    std::vector<std::pair<std::string_view, double>> quantiles;
+    std::string_view list = request.param("q", value) ? value : std::string_view("0.5,0.9,0.95,0.99");
+    while (ok && !list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view text = list.substr(0, comma);
+        double q = 0.0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), q);
+        ok = result.ec == std::errc() && result.ptr == text.data() + text.size() && q >= 0 && q <= 1;
+        quantiles.emplace_back(text, q);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+    }
+    bool binary = request.param("format", value) && value == "binary";
+    if (!ok) {
+        buildHTTPResponse(out, request, "{\"error\":\"Bad sketch query\"}", "application/json", "400 Bad Request");
         return;
     }
-    
-    std::string request(buffer);
-    std::cout << "Request: " << request.substr(0, request.find('\n')) << std::endl;
-    
-    // Parse the request line
-    std::stringstream ss(request);
-    std::string method, path, version;
-    ss >> method >> path >> version;
-    
-    std::string response;
-    
-    if (method == "GET") {
-        if (path == "/metrics" || path == "/") {
-            // Collect fresh metrics
-            const_cast<PerformanceMonitor*>(this)->collectAllMetrics();
-            
-            // Return JSON metrics
-            std::string json = toJSON();
-            response = buildHTTPResponse(json, "application/json");
-        } else if (path == "/health") {
-            // Simple health check
-            response = buildHTTPResponse("{\"status\":\"ok\"}", "application/json");
+
+    thread_local std::vector<WindowedSketches::Window> windows;
+    sketches->windows(metric, resolution, count, windows);
+    DDSketch merged(sketches->relativeAccuracy());
+    DDSketch window_sketch;
+    for (const auto& window : windows) {
+        if (window_sketch.deserialize(window.sketch)) merged.merge(window_sketch);
+    }
+    if (binary) {
+        std::string body;
+        merged.serialize(body);
+        buildHTTPResponse(out, request, body, "application/octet-stream");
+        return;
+    }
+
+    std::stringstream json;
+    json << std::fixed << std::setprecision(2);
+    auto writeSummary = [&](const DDSketch& sketch, int64_t from_ms, int64_t to_ms) {
+        json << "\"start_ms\": " << from_ms << ", \"end_ms\": " << to_ms << ", \"count\": " << sketch.count()
+             << ", \"min\": " << sketch.min() << ", \"max\": " << sketch.max()
+             << ", \"mean\": " << (sketch.count() ? sketch.sum() / sketch.count() : 0.0) << ", \"quantiles\": {";
+        for (size_t i = 0; i < quantiles.size(); i++) {
+            json << (i ? ", " : "") << '"' << quantiles[i].first << "\": " << sketch.quantile(quantiles[i].second);
+        }
+        json << "}, \"sketch\": \"";
+        std::string bytes;
+        sketch.serialize(bytes);
+        appendBase64(json, bytes);
+        json << '"';
+    };
+    json << "{\n  \"metric\": \"" << history->metricName(metric) << "\",\n  \"window\": \""
+         << kSketchResolutions[resolution].name << "\",\n  \"relative_accuracy\": " << sketches->relativeAccuracy()
+         << ",\n  \"merged\": {";
+    writeSummary(merged, windows.empty() ? 0 : windows.front().start_ms, windows.empty() ? 0 : windows.back().end_ms);
+    json << "},\n  \"windows\": [";
+    for (size_t i = 0; i < windows.size(); i++) {
+        json << (i ? ",\n" : "\n") << "    {\"complete\": " << (windows[i].complete ? "true" : "false") << ", ";
+        if (window_sketch.deserialize(windows[i].sketch)) {
+            writeSummary(window_sketch, windows[i].start_ms, windows[i].end_ms);
         } else {
-            // 404 Not Found
-            std::string error = "{\"error\":\"Not Found\"}";
-            response = "HTTP/1.1 404 Not Found\r\n";
-            response += "Content-Type: application/json\r\n";
-            response += "Content-Length: " + std::to_string(error.length()) + "\r\n";
-            response += "Connection: close\r\n\r\n";
-            response += error;
+            // Never the previous window's numbers under this one's times
+            json << "\"start_ms\": " << windows[i].start_ms << ", \"end_ms\": " << windows[i].end_ms
+                 << ", \"error\": \"unreadable sketch\"";
         }
-    } else {
-        // 405 Method Not Allowed
-        std::string error = "{\"error\":\"Method Not Allowed\"}";
-        response = "HTTP/1.1 405 Method Not Allowed\r\n";
-        response += "Content-Type: application/json\r\n";
-        response += "Content-Length: " + std::to_string(error.length()) + "\r\n";
-        response += "Connection: close\r\n\r\n";
-        response += error;
+        json << "}";
     }
-    
-    send(client_socket, response.c_str(), response.length(), 0);
-}
-
-std::string PerformanceMonitor::buildHTTPResponse(const std::string& body, const std::string& content_type) const {
-    std::string response;
-    response += "HTTP/1.1 200 OK\r\n";
-    response += "Content-Type: " + content_type + "\r\n";
-    response += "Content-Length: " + std::to_string(body.length()) + "\r\n";
-    response += "Access-Control-Allow-Origin: *\r\n";  // Enable CORS for web dashboards
-    response += "Connection: close\r\n";
-    response += "\r\n";
-    response += body;
-    return response;
-}
\ No newline at end of file
+    json << (windows.empty() ? "]\n" : "\n  ]\n") << "}\n";
+    buildHTTPResponse(out, request, json.str());
+}
+
+void PerformanceMonitor::buildHTTPResponse(std::string& out, const HttpRequest& request, std::string_view body,
+                                           const char* content_type, const char* status) const {
+    out += "HTTP/1.1 ";
+    out += status;
+    out += "\r\nContent-Type: ";
+    out += content_type;
+    out += "\r\nContent-Length: ";
+    out += std::to_string(body.length());
+    out += "\r\nAccess-Control-Allow-Origin: *\r\n";  // Enable CORS for web dashboards
+    out += request.keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    out += "\r\n";
+    out += body;
+}
@@ -3,77 +3,213 @@
 #include <chrono>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "snapshot.h"
+#include "http_server.h"
+#include "proc_reader.h"
+#include "process_collector.h"
+#include "device_collector.h"
+#include "cgroup_collector.h"
+#include "sched_collector.h"
+#include "memory_collector.h"
+#include "perf_collector.h"
+#include "timeseries.h"
+#include "sketch.h"
+#include "history_writer.h"
+#include "segment.h"
+#include "scheduler.h"
+#include "psi_trigger.h"
+#include "instrument.h"
+#include "shm_channel.h"
+#include "anomaly.h"
+#include "push_exporter.h"
+#include "collector_registry.h"
+#include "profiler.h"
 
-struct NetworkStats {
-    size_t bytes_sent = 0;
-    size_t bytes_received = 0;
-};
+// Raw /proc/stat jiffies in struct-of-arrays form so the per-core delta loop
+// runs over contiguous columns. Slot 0 is the aggregate "cpu" line, slot
+// N + 1 is cpuN.
+struct CpuCounters {
+    std::vector<uint64_t> user;    // user + nice
+    std::vector<uint64_t> system;  // system + irq + softirq
+    std::vector<uint64_t> iowait;
+    std::vector<uint64_t> active;  // user + system + steal
+    std::vector<uint64_t> total;   // active + idle + iowait
 
-struct DiskStats {
-    size_t bytes_read = 0;
-    size_t bytes_written = 0;
+    size_t size() const { return total.size(); }
+    void resize(size_t n);
 };
 
 class PerformanceMonitor {
 public:
+    PerformanceMonitor();
+
+    // One pass over /proc/stat: aggregate and per-core CPU, process and
+    // scheduler counters. collectCPUUsage and collectProcessCount are the
+    // same pass, kept for existing callers.
+    void collectProcStat();
+
     // Existing methods
     void collectCPUUsage();
-    void collectMemoryUsage();
-    
+    void collectMemoryUsage();  // meminfo, vmstat and per-node meminfo
+
     // Phase 1 expansions
     void collectNetworkStats();
     void collectDiskStats();
     void collectProcessCount();
     void collectLoadAverage();
-    
-    // Phase 2: Data export
+    // Run-queue wait per CPU from /proc/schedstat
+    void collectScheduler();
+    void collectProcesses();
+    // perf_event counter groups per CPU and per tracked process: IPC, miss rates
+    void collectPerfCounters();
+    // PSI from /proc/pressure, and per-group stats under the cgroup v2 root
+    void collectPressure();
+    void collectCgroups();
+    // Empty (the default) autodetects; call before the sampler starts
+    void setCgroupRoot(const std::string& path);
+    // Metrics other processes publish over shared memory (shm_channel.h)
+    void collectCustomMetrics();
+
+    // Per-process / per-thread tracking (safe to call while the sampler runs)
+    void trackProcess(const std::string& name, int pid, bool include_threads = false);
+    void trackThread(const std::string& name, int pid, int tid);
+    void untrack(int pid, int tid = 0);
+
+    // Phase 2: Data export (all read the latest published snapshot)
     void printStats() const;
     std::string toJSON() const;
     void saveToFile(const std::string& filename) const;
+    // Appends the latest snapshot as one row (header first if the file is new)
     void appendToCSV(const std::string& filename) const;
-    
-    // Collect all metrics at once
+
+    // Collect all metrics at once and publish them as a new snapshot.
+    // Only the sampler thread should call this once it is running.
     void collectAllMetrics();
 
+    // In-memory history served at /metrics/range. Fixed memory: every
+    // published sample takes one slot. Call before startSampler.
+    void setHistoryCapacity(size_t samples);
+
+    // Durable CSV log of every published sample, written by a background
+    // thread in batches. Start before startSampler, stop after stopSampler.
+    bool startHistoryLog(const HistoryLogConfig& config);
+    void stopHistoryLog();
+
+    // Binary segments (see segment.h) for long retention. Same rules as
+    // the history log: start before startSampler, stop after stopSampler.
+    bool startSegmentLog(const SegmentConfig& config);
+    void stopSegmentLog();
+
+    // Push every published sample to a remote receiver in batches (see
+    // push_exporter.h). Same rules as the history log.
+    bool startPushExport(const PushConfig& config);
+    void stopPushExport();
+
+    // Only sample these collectors (comma separated HostCollectors names,
+    // default all). The rest are never scheduled and read nothing, and
+    // their columns drop out of the history outputs. Call before
+    // startSampler and before starting any history output.
+    bool setCollectors(const std::string& list);
+
+    // Per-collector sampling interval: cpu, memory, network, disk, loadavg,
+    // sched, processes, perf, pressure, cgroups or custom. Unset collectors
+    // run at the startSampler interval. Call before startSampler; false for
+    // an unknown name.
+    bool setCollectorInterval(const std::string& name, std::chrono::milliseconds interval);
+
+    // Event mode: registers PSI triggers and samples at the startSampler
+    // interval as a slow baseline, switching to burst_interval for
+    // burst_window whenever one fires. Call before startSampler; false if
+    // no trigger could be registered.
+    bool setEventMode(const EventModeConfig& config);
+
+    // Scores every sample against per-series baselines and fires the
+    // configured alert rules (served at /alerts, logged on every change).
+    // Call before startSampler; false without rules.
+    bool setAnomalyDetection(const AnomalyConfig& config);
+
+    // Background sampler - owns collection. Collectors due at the same time
+    // share one wakeup and one published sample.
+    void startSampler(std::chrono::milliseconds interval = std::chrono::seconds(1));
+    void stopSampler();
+    bool isSamplerRunning() const;
+
     // Phase 3
     void startHTTPServer(int port = 8080);
+    void startHTTPServer(const HttpServerConfig& config);
     void stopHTTPServer();
     bool isServerRunning() const;
-    
+
 private:
-    // Existing CPU data
-    double cpu_usage = 0.0;
-    long prev_total_time = 0;
-    long prev_active_time = 0;
+    // Working copy filled by the collectors, published at the end of each cycle
+    MetricsSnapshot sample;
+    SnapshotPublisher publisher;
+
+    // /proc sources, kept open and re-read with pread every cycle
+    ProcFile proc_stat{"/proc/stat", 16384};
+    ProcFile proc_loadavg{"/proc/loadavg", 256};
+    ProcessCollector process_collector;
+    NetworkCollector network_collector;
+    BlockDeviceCollector block_collector;
+    PressureCollector pressure_collector;
+    CgroupCollector cgroup_collector;
+    SchedCollector sched_collector;
+    MemoryCollector memory_collector;
+    PerfCollector perf_collector;
+    ShmCollector shm_collector;
+    std::unique_ptr<TimeSeriesStore> history;
+    std::unique_ptr<WindowedSketches> sketches;  // history metrics, for /metrics/sketch
+    std::unique_ptr<HistoryWriter> history_log;
+    std::unique_ptr<SegmentWriter> segment_log;
+    std::unique_ptr<PushExporter> push_exporter;
+
+    // CPU delta state - swapped every cycle so neither side reallocates
+    CpuCounters cpu_now;
+    CpuCounters cpu_prev;
+    uint64_t prev_context_switches = 0;
+    uint64_t prev_interrupts = 0;
+    std::chrono::steady_clock::time_point prev_stat_time;
     bool first_cpu_read = true;
-    
-    // Existing memory data
-    size_t memory_usage = 0;  // in KB
-    size_t total_memory = 0;  // in KB
-    
-    // New metrics
-    NetworkStats network_stats;
-    DiskStats disk_stats;
-    int process_count = 0;
-    double load_average_1min = 0.0;
-    double load_average_5min = 0.0;
-    double load_average_15min = 0.0;
-
-    // disk sector stats
-    size_t prev_sectors_read = 0;
-    size_t prev_sectors_written = 0;
-    bool first_disk_read = true;
+
+    // Sampler thread
+    std::atomic<bool> sampler_running{false};
+    std::thread sampler_thread;
+    std::unique_ptr<SampleScheduler> scheduler;
+    std::vector<size_t> task_collectors;  // scheduler task id -> HostCollectors index
+    std::vector<std::chrono::milliseconds> collector_intervals;  // 0 = sampler default
+    EventModeConfig event_mode;
+    std::vector<PsiTrigger> psi_triggers;
+    std::unique_ptr<AnomalyDetector> anomaly_detector;
+    std::string anomaly_key;  // series name buffer, reused every sample
+
     // HTTP server
-    std::atomic<bool> server_running{false};
-    std::thread server_thread;
-    int server_socket = -1;
-    
-    // Timestamp for this collection cycle
-    std::chrono::system_clock::time_point timestamp;
-    
+    std::unique_ptr<HttpServer> http_server;
+    std::mutex stream_mutex;
+    HttpServer* stream_server = nullptr;  // set while running, for /metrics/stream
+    mutable std::mutex profile_mutex;  // one /profile at a time
+    mutable std::atomic<bool> profile_cancel{false};  // set by stopHTTPServer
+
     // Helper functions
     std::string getCurrentTimestamp() const;
-    void serverLoop(int port);
-    void handleClient(int client_socket);
-    std::string buildHTTPResponse(const std::string& body, const std::string& content_type = "application/json") const;
-};
\ No newline at end of file
+    void computeCpuUsage(double elapsed_sec);
+    void detectAnomalies(uint32_t collectors);  // bit i: HostCollectors source i ran this cycle
+    void publishSample();
+    void renderJSON(const MetricsSnapshot& snap, std::string& out) const;
+    std::string renderEvent(const MetricsSnapshot& snap) const;
+    void samplerLoop();
+    void handleRequest(const HttpRequest& request, std::string& out) const;
+    void handleRangeQuery(const HttpRequest& request, std::string& out) const;
+    void handleSketchQuery(const HttpRequest& request, std::string& out) const;
+    void handlePrometheus(const HttpRequest& request, std::string& out) const;
+    void handleLatency(const HttpRequest& request, std::string& out) const;
+    void handleAlerts(const HttpRequest& request, std::string& out) const;
+    void handleSchema(const HttpRequest& request, std::string& out) const;
+    void handleProfile(const HttpRequest& request, std::string& out) const;
+    void buildHTTPResponse(std::string& out, const HttpRequest& request, std::string_view body,
+                           const char* content_type = "application/json", const char* status = "200 OK") const;
+};
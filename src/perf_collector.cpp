@@ -0,0 +1,324 @@
+#include "perf_collector.h"
+#include "proc_reader.h"
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace {
+
+struct EventSpec {
+    uint32_t type;
+    uint64_t config;
+};
+
+// Indexed by PerfCollector::Counter
+const EventSpec kEvents[] = {
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+// One group read: { nr, time_enabled, time_running, values[nr] }
+const size_t kReadHeader = 3;
+
+int openCounter(const EventSpec& event, int pid, int cpu, int group_fd, bool exclude_kernel) {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, pid, cpu, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+double elapsedSince(std::chrono::steady_clock::time_point& prev, std::chrono::steady_clock::time_point now) {
+    double elapsed_sec = std::chrono::duration<double>(now - prev).count();
+    prev = now;
+    return elapsed_sec;
+}
+
+}
+
+PerfCollector::~PerfCollector() {
+    for (auto& cpu : cpus) {
+        closeGroup(cpu.software);
+        closeGroup(cpu.hardware);
+    }
+    for (auto& target : targets) {
+        for (auto& task : target.tasks) {
+            closeGroup(task.software);
+            closeGroup(task.hardware);
+        }
+    }
+}
+
+// Probes the events on ourselves, then opens the per-CPU groups
+void PerfCollector::start() {
+    started = true;
+    // Half the fd table at most, so counters never starve connections,
+    // logs and /proc reads
+    struct rlimit limit;
+    fd_budget = kMaxFds;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        fd_budget = std::min<size_t>(fd_budget, limit.rlim_cur / 2);
+    }
+    int fd = openCounter(kEvents[PageFaults], 0, -1, -1, false);
+    if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+        exclude_kernel = true;  // perf_event_paranoid >= 2
+        fd = openCounter(kEvents[PageFaults], 0, -1, -1, true);
+    }
+    if (fd < 0) {
+        std::cerr << "perf_event_open failed (" << std::strerror(errno) << "), perf counters disabled" << std::endl;
+        return;
+    }
+    close(fd);
+
+    // Keep whatever joins a group: the PMU refuses members that can't be
+    // scheduled together, and VMs often have no PMU at all
+    for (int c = 0; c < kCounterCount; c++) {
+        bool hardware = kEvents[c].type == PERF_TYPE_HARDWARE;
+        if (exclude_kernel && (c == ContextSwitches || c == CpuMigrations)) {
+            continue;  // only ever counted in the kernel, always zero for user space
+        }
+        std::vector<uint8_t>& events = hardware ? hardware_events : software_events;
+        events.push_back(c);
+        Group group;
+        if (!openGroup(group, events, 0, -1)) {
+            events.pop_back();
+        }
+        closeGroup(group);
+    }
+    if (hardware_events.empty()) {
+        std::cerr << "No hardware perf counters, IPC and miss rates unavailable" << std::endl;
+    }
+
+    for (int id : onlineCpus()) {
+        Task cpu;
+        cpu.id = id;
+        if (openTask(cpu, -1, id)) {
+            cpus.push_back(std::move(cpu));
+        } else if (errno == EACCES || errno == EPERM) {
+            std::cerr << "Host-wide perf counters need CAP_PERFMON or kernel.perf_event_paranoid <= 0, "
+                      << "counting tracked processes only" << std::endl;
+            break;
+        }
+    }
+    host_prev_time = std::chrono::steady_clock::now();
+}
+
+bool PerfCollector::openGroup(Group& group, const std::vector<uint8_t>& events, int pid, int cpu) {
+    if (open_fds + events.size() > fd_budget) {
+        errno = EMFILE;
+        return false;
+    }
+    for (uint8_t c : events) {
+        int fd = openCounter(kEvents[c], pid, cpu, group.fds.empty() ? -1 : group.fds[0], exclude_kernel);
+        if (fd < 0) {
+            int saved = errno;
+            closeGroup(group);
+            errno = saved;
+            return false;
+        }
+        group.fds.push_back(fd);
+        group.counters.push_back(c);
+        open_fds++;
+    }
+    group.prev.assign(group.fds.size(), 0);
+    group.prev_enabled = group.prev_running = 0;
+    return true;
+}
+
+// The software group decides; the hardware one is best effort
+bool PerfCollector::openTask(Task& task, int pid, int cpu) {
+    if (!software_events.empty() && !openGroup(task.software, software_events, pid, cpu)) {
+        return false;
+    }
+    if (!hardware_events.empty() && !openGroup(task.hardware, hardware_events, pid, cpu)) {
+        return !software_events.empty();
+    }
+    return true;
+}
+
+void PerfCollector::closeGroup(Group& group) {
+    for (int fd : group.fds) close(fd);
+    open_fds -= group.fds.size();
+    group.fds.clear();
+    group.counters.clear();
+    group.prev.clear();
+}
+
+void PerfCollector::readGroup(Group& group, Deltas& deltas) {
+    if (group.fds.empty()) {
+        return;
+    }
+    uint64_t values[kReadHeader + kCounterCount];
+    size_t bytes = (kReadHeader + group.fds.size()) * sizeof(uint64_t);
+    if (read(group.fds[0], values, bytes) != (ssize_t)bytes || values[0] != group.fds.size()) {
+        return;
+    }
+    // Multiplexed groups only counted for part of the interval
+    uint64_t enabled = values[1] - group.prev_enabled;
+    uint64_t running = values[2] - group.prev_running;
+    double scale = running > 0 && running < enabled ? (double)enabled / running : 1.0;
+    for (size_t i = 0; i < group.fds.size(); i++) {
+        uint64_t value = values[kReadHeader + i];
+        uint64_t delta = value >= group.prev[i] ? value - group.prev[i] : 0;
+        deltas[group.counters[i]] += scale == 1.0 ? delta : (uint64_t)(delta * scale);
+        group.prev[i] = value;
+    }
+    group.prev_enabled = values[1];
+    group.prev_running = values[2];
+}
+
+void PerfCollector::readTask(Task& task, Deltas& deltas) {
+    readGroup(task.software, deltas);
+    readGroup(task.hardware, deltas);
+}
+
+// Opens groups for new threads, reads every group and closes the groups of
+// threads that are gone (after their last read)
+void PerfCollector::syncThreads(Target& target, Deltas& deltas) {
+    tids.clear();
+    if (target.tid != 0) {
+        tids.push_back(target.tid);
+    } else {
+        std::string path = "/proc/" + std::to_string(target.pid) + "/task";
+        if (DIR* dir = opendir(path.c_str())) {
+            while (struct dirent* entry = readdir(dir)) {
+                int tid = 0;
+                const char* name = entry->d_name;
+                auto result = std::from_chars(name, name + std::strlen(name), tid);
+                if (result.ec == std::errc() && *result.ptr == '\0') tids.push_back(tid);
+            }
+            closedir(dir);
+        }
+        std::sort(tids.begin(), tids.end());
+    }
+
+    for (auto& task : target.tasks) task.seen = false;
+    for (int tid : tids) {
+        auto it = std::lower_bound(target.tasks.begin(), target.tasks.end(), tid,
+                                   [](const Task& task, int id) { return task.id < id; });
+        if (it != target.tasks.end() && it->id == tid) {
+            it->seen = true;
+            continue;
+        }
+        if (target.tasks.size() >= kMaxThreads) {
+            if (!target.full) {
+                std::cerr << "perf: counting only " << kMaxThreads << " threads of pid " << target.pid << std::endl;
+            }
+            target.full = true;
+            continue;
+        }
+        Task task;
+        task.id = tid;
+        task.seen = true;
+        if (openTask(task, tid, -1)) {
+            target.tasks.insert(it, std::move(task));
+        } else if (errno == EMFILE && !budget_warned) {
+            std::cerr << "perf: all " << fd_budget << " fds in use, not counting more threads" << std::endl;
+            budget_warned = true;
+        }
+    }
+
+    for (auto& task : target.tasks) readTask(task, deltas);
+    for (auto& task : target.tasks) {
+        if (task.seen) continue;
+        closeGroup(task.software);
+        closeGroup(task.hardware);
+    }
+    target.tasks.erase(std::remove_if(target.tasks.begin(), target.tasks.end(),
+                                      [](const Task& task) { return !task.seen; }),
+                       target.tasks.end());
+}
+
+bool PerfCollector::hasHardware(const std::vector<Task>& tasks) const {
+    bool ipc = std::count(hardware_events.begin(), hardware_events.end(), Cycles) &&
+               std::count(hardware_events.begin(), hardware_events.end(), Instructions);
+    return ipc && std::any_of(tasks.begin(), tasks.end(), [](const Task& task) { return !task.hardware.fds.empty(); });
+}
+
+void PerfCollector::update(PerfCounters& out, const Deltas& deltas, double elapsed_sec) {
+    auto rate = [elapsed_sec](uint64_t delta) { return elapsed_sec > 0.0 ? delta / elapsed_sec : 0.0; };
+    auto ratio = [](uint64_t num, uint64_t den, double scale) { return den ? num * scale / den : 0.0; };
+    out.context_switches += deltas[ContextSwitches];
+    out.cpu_migrations += deltas[CpuMigrations];
+    out.page_faults += deltas[PageFaults];
+    out.cycles += deltas[Cycles];
+    out.instructions += deltas[Instructions];
+    out.cache_references += deltas[CacheReferences];
+    out.cache_misses += deltas[CacheMisses];
+    out.branches += deltas[Branches];
+    out.branch_misses += deltas[BranchMisses];
+    out.context_switches_per_sec = rate(deltas[ContextSwitches]);
+    out.cpu_migrations_per_sec = rate(deltas[CpuMigrations]);
+    out.page_faults_per_sec = rate(deltas[PageFaults]);
+    out.cycles_per_sec = rate(deltas[Cycles]);
+    out.ipc = ratio(deltas[Instructions], deltas[Cycles], 1.0);
+    out.cache_miss_percent = ratio(deltas[CacheMisses], deltas[CacheReferences], 100.0);
+    out.cache_mpki = ratio(deltas[CacheMisses], deltas[Instructions], 1000.0);
+    out.branch_miss_percent = ratio(deltas[BranchMisses], deltas[Branches], 100.0);
+}
+
+void PerfCollector::collect(PerfCounters& host, std::vector<ProcessStats>& services) {
+    if (!started) {
+        start();
+    }
+    auto now = std::chrono::steady_clock::now();
+
+    Deltas deltas = {};
+    for (auto& cpu : cpus) readTask(cpu, deltas);
+    update(host_counters, deltas, elapsedSince(host_prev_time, now));
+    host_counters.available = !cpus.empty();
+    host_counters.hardware = hasHardware(cpus);
+    host = host_counters;
+
+    // Targets follow the process collector's, matched on pid and tid
+    for (auto& target : targets) target.seen = false;
+    for (auto& service : services) {
+        auto it = std::find_if(targets.begin(), targets.end(), [&](const Target& target) {
+            return target.pid == service.pid && target.tid == service.tid;
+        });
+        if (it == targets.end()) {
+            Target target;
+            target.pid = service.pid;
+            target.tid = service.tid;
+            target.prev_time = now;
+            it = targets.insert(targets.end(), std::move(target));
+        }
+        it->seen = true;
+        Deltas target_deltas = {};
+        if (!software_events.empty() || !hardware_events.empty()) {
+            syncThreads(*it, target_deltas);
+        }
+        update(it->counters, target_deltas, elapsedSince(it->prev_time, now));
+        it->counters.available = !it->tasks.empty();
+        it->counters.hardware = hasHardware(it->tasks);
+        service.perf = it->counters;
+    }
+    for (auto& target : targets) {
+        if (target.seen) continue;
+        for (auto& task : target.tasks) {
+            closeGroup(task.software);
+            closeGroup(task.hardware);
+        }
+    }
+    targets.erase(std::remove_if(targets.begin(), targets.end(), [](const Target& target) { return !target.seen; }),
+                  targets.end());
+}
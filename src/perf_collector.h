@@ -0,0 +1,100 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "snapshot.h"
+
+// Counters from perf_event_open for the host (per online CPU) and every
+// tracked process (per thread) or thread.
+//
+// Each CPU or thread gets two groups: software (context switches, CPU
+// migrations, page faults) and hardware (cycles, instructions, cache
+// references/misses, branches/branch misses). A group is read with a single
+// read() via PERF_FORMAT_GROUP, so IPC and miss rates come from counts taken
+// at the same instant. Hardware groups are scaled by enabled/running time
+// when the PMU multiplexes them.
+//
+// Which events exist is probed on the monitor itself at the first collect:
+// events the PMU or the kernel refuses (no PMU in a VM, too many for one
+// group) are left out and the rest keep counting, so with no hardware
+// counters at all only the software group runs. Kernel-side counting needs
+// perf_event_paranoid <= 1 (or CAP_PERFMON); otherwise only user space is
+// counted, and context switches and migrations (which happen in the kernel)
+// are left out. Host groups need CAP_PERFMON or paranoid <= 0 and are
+// skipped without it. The CPU list is fixed at the first collect.
+//
+// Threads of a tracked process are rescanned every collect; threads that
+// exited are read one last time before their groups are closed, so totals
+// never go back. At most kMaxThreads threads per process are counted, and
+// no group is opened past a budget of kMaxFds perf fds (less under a low
+// RLIMIT_NOFILE).
+class PerfCollector {
+public:
+    PerfCollector() = default;
+    ~PerfCollector();
+    PerfCollector(const PerfCollector&) = delete;
+    PerfCollector& operator=(const PerfCollector&) = delete;
+
+    // Sampler thread only. services is the process collector's output; each
+    // entry's perf field is filled in.
+    void collect(PerfCounters& host, std::vector<ProcessStats>& services);
+
+    static constexpr size_t kMaxThreads = 256;
+    static constexpr size_t kMaxFds = 4096;
+
+private:
+    enum Counter {
+        ContextSwitches, CpuMigrations, PageFaults,
+        Cycles, Instructions, CacheReferences, CacheMisses, Branches, BranchMisses,
+        kCounterCount
+    };
+    using Deltas = uint64_t[kCounterCount];
+
+    struct Group {
+        std::vector<int> fds;           // leader first
+        std::vector<uint8_t> counters;  // Counter of each value, in read order
+        std::vector<uint64_t> prev;     // raw values at the last read
+        uint64_t prev_enabled = 0;
+        uint64_t prev_running = 0;
+    };
+    // Both groups of one CPU or thread
+    struct Task {
+        int id = 0;  // tid, or CPU for the host
+        Group software;
+        Group hardware;
+        bool seen = false;
+    };
+    struct Target {
+        int pid = 0;
+        int tid = 0;  // 0: the whole process
+        std::vector<Task> tasks;  // sorted by id
+        PerfCounters counters;
+        std::chrono::steady_clock::time_point prev_time;
+        bool seen = false;
+        bool full = false;  // hit kMaxThreads, warned once
+    };
+
+    bool started = false;
+    std::vector<uint8_t> software_events;  // Counters that open, in group order
+    std::vector<uint8_t> hardware_events;
+    bool exclude_kernel = false;
+    size_t fd_budget = 0;
+    size_t open_fds = 0;
+    bool budget_warned = false;
+
+    std::vector<Task> cpus;
+    PerfCounters host_counters;
+    std::chrono::steady_clock::time_point host_prev_time;
+    std::vector<Target> targets;
+    std::vector<int> tids;  // reused for the /proc/<pid>/task listing
+
+    void start();
+    bool openGroup(Group& group, const std::vector<uint8_t>& events, int pid, int cpu);
+    bool openTask(Task& task, int pid, int cpu);
+    void readGroup(Group& group, Deltas& deltas);
+    void readTask(Task& task, Deltas& deltas);
+    void syncThreads(Target& target, Deltas& deltas);
+    void closeGroup(Group& group);
+    bool hasHardware(const std::vector<Task>& tasks) const;
+    static void update(PerfCounters& out, const Deltas& deltas, double elapsed_sec);
+};
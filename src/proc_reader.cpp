@@ -0,0 +1,170 @@
+#include "proc_reader.h"
+#include <charconv>
+#include <utility>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+ProcFile::ProcFile(std::string path, size_t initial_capacity) : path(std::move(path)), buffer(initial_capacity) {
+    fd = open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+ProcFile::~ProcFile() {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+ProcFile::ProcFile(ProcFile&& other) noexcept
+    : path(std::move(other.path)), fd(other.fd), buffer(std::move(other.buffer)), length(other.length) {
+    other.fd = -1;
+    other.length = 0;
+}
+
+ProcFile& ProcFile::operator=(ProcFile&& other) noexcept {
+    if (this != &other) {
+        if (fd != -1) close(fd);
+        path = std::move(other.path);
+        fd = other.fd;
+        buffer = std::move(other.buffer);
+        length = other.length;
+        other.fd = -1;
+        other.length = 0;
+    }
+    return *this;
+}
+
+bool ProcFile::read() {
+    length = 0;
+    if (fd == -1) {
+        // File may not have existed at startup (e.g. module loaded later)
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+    }
+
+    // /proc files are generated on read, so the whole thing has to come from
+    // one pass starting at offset 0. If it doesn't fit, grow and start over.
+    for (;;) {
+        size_t total = 0;
+        for (;;) {
+            ssize_t n = pread(fd, buffer.data() + total, buffer.size() - total, total);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (n == 0) break;
+            total += n;
+            if (total == buffer.size()) break;
+        }
+        if (total < buffer.size()) {
+            length = total;
+            return true;
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+}
+
+void ProcScanner::skipSpaces() {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t')) {
+        pos++;
+    }
+}
+
+bool ProcScanner::nextLine() {
+    size_t eol = text.find('\n', pos);
+    if (eol == std::string_view::npos) {
+        pos = text.size();
+        return false;
+    }
+    pos = eol + 1;
+    return pos < text.size();
+}
+
+std::string_view ProcScanner::restOfLine() const {
+    size_t eol = text.find('\n', pos);
+    return text.substr(pos, eol == std::string_view::npos ? std::string_view::npos : eol - pos);
+}
+
+bool ProcScanner::atLineEnd() const {
+    size_t p = pos;
+    while (p < text.size() && (text[p] == ' ' || text[p] == '\t')) p++;
+    return p >= text.size() || text[p] == '\n';
+}
+
+std::string_view ProcScanner::token() {
+    skipSpaces();
+    size_t start = pos;
+    while (pos < text.size() && text[pos] != ' ' && text[pos] != '\t' && text[pos] != '\n') {
+        pos++;
+    }
+    return text.substr(start, pos - start);
+}
+
+uint64_t ProcScanner::u64() {
+    skipSpaces();
+    uint64_t value = 0;
+    auto result = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+    if (result.ec != std::errc()) {
+        token();  // not a number - step over it so callers always make progress
+        return 0;
+    }
+    pos = result.ptr - text.data();
+    return value;
+}
+
+int64_t ProcScanner::i64() {
+    skipSpaces();
+    int64_t value = 0;
+    auto result = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+    if (result.ec != std::errc()) {
+        token();  // not a number - step over it so callers always make progress
+        return 0;
+    }
+    pos = result.ptr - text.data();
+    return value;
+}
+
+double ProcScanner::f64() {
+    skipSpaces();
+    double value = 0.0;
+    auto result = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+    if (result.ec != std::errc()) {
+        token();  // not a number - step over it so callers always make progress
+        return 0;
+    }
+    pos = result.ptr - text.data();
+    return value;
+}
+
+void ProcScanner::skip(int tokens) {
+    for (int i = 0; i < tokens; i++) {
+        token();
+    }
+}
+
+std::vector<int> onlineCpus() {
+    std::vector<int> cpus;
+    ProcFile online("/sys/devices/system/cpu/online", 256);
+    if (!online.read()) {
+        return cpus;
+    }
+    std::string_view text = online.contents();
+    while (!text.empty() && text.back() == '\n') text.remove_suffix(1);
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        std::string_view range = text.substr(0, comma);
+        size_t dash = range.find('-');
+        int first = 0, last = 0;
+        std::from_chars(range.data(), range.data() + range.size(), first);
+        last = first;
+        if (dash != std::string_view::npos) {
+            std::from_chars(range.data() + dash + 1, range.data() + range.size(), last);
+        }
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        if (comma == std::string_view::npos) break;
+        text.remove_prefix(comma + 1);
+    }
+    return cpus;
+}
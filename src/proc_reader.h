@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// A /proc (or sysfs) file kept open for the life of the monitor and re-read
+// with pread() into a buffer that is reused between samples. The buffer only
+// grows when the file outgrows it (e.g. new interfaces appear), so steady-state
+// reads do no heap allocation.
+class ProcFile {
+public:
+    explicit ProcFile(std::string path, size_t initial_capacity = 4096);
+    ~ProcFile();
+    ProcFile(const ProcFile&) = delete;
+    ProcFile& operator=(const ProcFile&) = delete;
+    ProcFile(ProcFile&& other) noexcept;
+    ProcFile& operator=(ProcFile&& other) noexcept;
+
+    // Re-reads the whole file; false if it can't be opened or read
+    bool read();
+    std::string_view contents() const { return std::string_view(buffer.data(), length); }
+    bool isOpen() const { return fd != -1; }
+    const std::string& getPath() const { return path; }
+
+private:
+    std::string path;
+    int fd = -1;
+    std::vector<char> buffer;
+    size_t length = 0;
+};
+
+// Whitespace tokenizer over a view of /proc text. Never allocates; numbers are
+// parsed with std::from_chars. Reading past the end yields empty tokens / 0.
+class ProcScanner {
+public:
+    explicit ProcScanner(std::string_view text) : text(text) {}
+
+    // Moves to the start of the next line; false at end of input
+    bool nextLine();
+    // Remainder of the current line without consuming it
+    std::string_view restOfLine() const;
+
+    std::string_view token();
+    uint64_t u64();
+    int64_t i64();
+    double f64();
+    void skip(int tokens);
+
+    bool atLineEnd() const;
+
+private:
+    std::string_view text;
+    size_t pos = 0;
+
+    void skipSpaces();
+};
+
+// Ids of the online CPUs, from the "0-3,5,8-11" list in
+// /sys/devices/system/cpu/online; empty if it can't be read
+std::vector<int> onlineCpus();
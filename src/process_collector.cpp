@@ -0,0 +1,305 @@
+#include "process_collector.h"
+#include <algorithm>
+#include <charconv>
+#include <dirent.h>
+#include <unistd.h>
+
+namespace {
+
+const auto kThreadRescanInterval = std::chrono::seconds(10);
+
+struct StatFields {
+    std::string_view comm;
+    char state = '?';
+    uint64_t ticks = 0;  // utime + stime
+    int num_threads = 0;
+};
+
+// /proc/[pid]/stat: "pid (comm) state ppid ...". comm may contain spaces and
+// parentheses, so fields are counted from the last ')'.
+bool parseStat(std::string_view text, StatFields& fields) {
+    size_t open = text.find('(');
+    size_t close = text.rfind(')');
+    if (open == std::string_view::npos || close == std::string_view::npos || close < open) {
+        return false;
+    }
+    fields.comm = text.substr(open + 1, close - open - 1);
+
+    ProcScanner ss(text.substr(close + 1));
+    std::string_view state = ss.token();
+    fields.state = state.empty() ? '?' : state[0];
+    ss.skip(10);                       // ppid .. cmajflt
+    uint64_t utime = ss.u64();
+    uint64_t stime = ss.u64();
+    fields.ticks = utime + stime;
+    ss.skip(4);                        // cutime cstime priority nice
+    fields.num_threads = (int)ss.i64();
+    return true;
+}
+
+void parseContextSwitches(std::string_view text, uint64_t& voluntary, uint64_t& nonvoluntary) {
+    ProcScanner ss(text);
+    do {
+        std::string_view key = ss.token();
+        if (key == "voluntary_ctxt_switches:") {
+            voluntary = ss.u64();
+        } else if (key == "nonvoluntary_ctxt_switches:") {
+            nonvoluntary = ss.u64();
+            break;  // always the last of the two
+        }
+    } while (ss.nextLine());
+}
+
+// /proc/[pid]/schedstat: "run_ns wait_ns timeslices"
+bool parseSchedstat(std::string_view text, uint64_t& run_delay_ns, uint64_t& timeslices) {
+    ProcScanner ss(text);
+    ss.skip(1);
+    run_delay_ns = ss.u64();
+    timeslices = ss.u64();
+    return !text.empty();
+}
+
+double ratePerSec(uint64_t now, uint64_t prev, double elapsed_sec) {
+    if (elapsed_sec <= 0.0 || now < prev) {
+        return 0.0;
+    }
+    return (now - prev) / elapsed_sec;
+}
+
+}
+
+ProcessCollector::ThreadEntry::ThreadEntry(int tid, const std::string& dir)
+    : tid(tid),
+      stat(dir + "/task/" + std::to_string(tid) + "/stat", 512),
+      status(dir + "/task/" + std::to_string(tid) + "/status", 2048),
+      schedstat(dir + "/task/" + std::to_string(tid) + "/schedstat", 128) {
+}
+
+ProcessCollector::Target::Target(const std::string& name, int pid, int tid, bool include_threads)
+    : name(name), pid(pid), tid(tid), include_threads(include_threads),
+      dir(tid ? "/proc/" + std::to_string(pid) + "/task/" + std::to_string(tid) : "/proc/" + std::to_string(pid)),
+      stat(dir + "/stat", 512),
+      statm(dir + "/statm", 128),
+      io(dir + "/io", 512),
+      status(dir + "/status", 2048),
+      schedstat(dir + "/schedstat", 128) {
+}
+
+ProcessCollector::ProcessCollector() {
+    clock_ticks = sysconf(_SC_CLK_TCK);
+    page_kb = sysconf(_SC_PAGESIZE) / 1024;
+}
+
+void ProcessCollector::trackProcess(const std::string& name, int pid, bool include_threads) {
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    pending.push_back(Change{true, name, pid, 0, include_threads});
+}
+
+void ProcessCollector::trackThread(const std::string& name, int pid, int tid) {
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    pending.push_back(Change{true, name, pid, tid, false});
+}
+
+void ProcessCollector::untrack(int pid, int tid) {
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    pending.push_back(Change{false, "", pid, tid, false});
+}
+
+void ProcessCollector::applyPending() {
+    std::vector<Change> changes;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        if (pending.empty()) {
+            return;
+        }
+        changes.swap(pending);
+    }
+
+    for (auto& change : changes) {
+        auto it = std::find_if(targets.begin(), targets.end(), [&](const std::unique_ptr<Target>& t) {
+            return t->pid == change.pid && t->tid == change.tid;
+        });
+        if (!change.add) {
+            if (it != targets.end()) targets.erase(it);
+        } else if (it == targets.end()) {
+            targets.push_back(std::make_unique<Target>(change.name, change.pid, change.tid, change.include_threads));
+        }
+    }
+}
+
+void ProcessCollector::collect(std::vector<ProcessStats>& out) {
+    applyPending();
+
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_sec = has_prev_time ? std::chrono::duration<double>(now - prev_time).count() : 0.0;
+    prev_time = now;
+    has_prev_time = true;
+
+    out.resize(targets.size());
+    for (size_t i = 0; i < targets.size(); i++) {
+        sampleTarget(*targets[i], out[i], elapsed_sec);
+    }
+}
+
+void ProcessCollector::sampleTarget(Target& target, ProcessStats& out, double elapsed_sec) {
+    out.name = target.name;
+    out.pid = target.pid;
+    out.tid = target.tid;
+
+    StatFields fields;
+    if (!target.stat.read() || !parseStat(target.stat.contents(), fields)) {
+        // Process (or thread) is gone - keep reporting it as dead until untracked
+        out.alive = false;
+        out.state = 'X';
+        out.cpu_percent = 0.0;
+        out.voluntary_ctxt_switches_per_sec = out.nonvoluntary_ctxt_switches_per_sec = 0.0;
+        out.read_bytes_per_sec = out.write_bytes_per_sec = 0.0;
+        out.run_delay_ms_per_sec = out.timeslices_per_sec = out.avg_delay_us = 0.0;
+        out.threads.clear();
+        target.has_prev = false;
+        return;
+    }
+    out.alive = true;
+    out.state = fields.state;
+    out.num_threads = fields.num_threads;
+
+    if (target.statm.read()) {
+        ProcScanner ss(target.statm.contents());
+        out.virt_kb = ss.u64() * page_kb;
+        out.rss_kb = ss.u64() * page_kb;
+    }
+    if (target.status.read()) {
+        parseContextSwitches(target.status.contents(), out.voluntary_ctxt_switches, out.nonvoluntary_ctxt_switches);
+    }
+    // io needs ptrace access; other users' processes just report 0
+    if (target.io.read()) {
+        ProcScanner ss(target.io.contents());
+        do {
+            std::string_view key = ss.token();
+            if (key == "read_bytes:") {
+                out.read_bytes = ss.u64();
+            } else if (key == "write_bytes:") {
+                out.write_bytes = ss.u64();
+            }
+        } while (ss.nextLine());
+    }
+
+    double since_prev = target.has_prev ? elapsed_sec : 0.0;
+    out.cpu_percent = since_prev > 0.0 && fields.ticks >= target.prev_ticks
+        ? (fields.ticks - target.prev_ticks) * 100.0 / (clock_ticks * since_prev) : 0.0;
+    out.voluntary_ctxt_switches_per_sec = ratePerSec(out.voluntary_ctxt_switches, target.prev_voluntary, since_prev);
+    out.nonvoluntary_ctxt_switches_per_sec = ratePerSec(out.nonvoluntary_ctxt_switches, target.prev_nonvoluntary, since_prev);
+    out.read_bytes_per_sec = ratePerSec(out.read_bytes, target.prev_read_bytes, since_prev);
+    out.write_bytes_per_sec = ratePerSec(out.write_bytes, target.prev_write_bytes, since_prev);
+
+    target.prev_ticks = fields.ticks;
+    target.prev_voluntary = out.voluntary_ctxt_switches;
+    target.prev_nonvoluntary = out.nonvoluntary_ctxt_switches;
+    target.prev_read_bytes = out.read_bytes;
+    target.prev_write_bytes = out.write_bytes;
+    target.has_prev = true;
+
+    if (target.include_threads && target.tid == 0) {
+        sampleThreads(target, out, elapsed_sec, fields.num_threads);
+        out.run_delay_ns = target.thread_run_delay_ns;
+        out.timeslices = target.thread_timeslices;
+    } else {
+        out.threads.clear();
+        if (target.schedstat.read()) {
+            parseSchedstat(target.schedstat.contents(), out.run_delay_ns, out.timeslices);
+        }
+    }
+    uint64_t delay_delta = since_prev > 0.0 && out.run_delay_ns >= target.prev_run_delay_ns
+        ? out.run_delay_ns - target.prev_run_delay_ns : 0;
+    uint64_t slice_delta = since_prev > 0.0 && out.timeslices >= target.prev_timeslices
+        ? out.timeslices - target.prev_timeslices : 0;
+    out.run_delay_ms_per_sec = since_prev > 0.0 ? delay_delta / 1e6 / since_prev : 0.0;
+    out.timeslices_per_sec = since_prev > 0.0 ? slice_delta / since_prev : 0.0;
+    out.avg_delay_us = slice_delta ? delay_delta / 1e3 / slice_delta : 0.0;
+    target.prev_run_delay_ns = out.run_delay_ns;
+    target.prev_timeslices = out.timeslices;
+}
+
+void ProcessCollector::sampleThreads(Target& target, ProcessStats& out, double elapsed_sec, int num_threads) {
+    auto now = std::chrono::steady_clock::now();
+    if ((int)target.threads.size() != num_threads || now - target.last_scan > kThreadRescanInterval) {
+        rescanThreads(target);
+        target.last_scan = now;
+    }
+
+    out.threads.resize(target.threads.size());
+    size_t live = 0;
+    for (auto& entry : target.threads) {
+        StatFields fields;
+        if (!entry->stat.read() || !parseStat(entry->stat.contents(), fields)) {
+            continue;  // exited since the last scan
+        }
+        ThreadStats& thread = out.threads[live++];
+        thread.tid = entry->tid;
+        thread.name.assign(fields.comm.data(), fields.comm.size());
+        thread.state = fields.state;
+        thread.cpu_percent = entry->has_prev && elapsed_sec > 0.0 && fields.ticks >= entry->prev_ticks
+            ? (fields.ticks - entry->prev_ticks) * 100.0 / (clock_ticks * elapsed_sec) : 0.0;
+        if (entry->status.read()) {
+            parseContextSwitches(entry->status.contents(), thread.voluntary_ctxt_switches,
+                                 thread.nonvoluntary_ctxt_switches);
+        }
+        // A thread seen for the first time adds its whole history to the
+        // process totals (on the first sample that is the baseline)
+        uint64_t run_delay_ns = 0, timeslices = 0;
+        thread.run_delay_ms_per_sec = thread.avg_delay_us = 0.0;
+        if (entry->schedstat.read() && parseSchedstat(entry->schedstat.contents(), run_delay_ns, timeslices)) {
+            uint64_t d_delay = !entry->has_sched ? run_delay_ns
+                : run_delay_ns >= entry->prev_run_delay_ns ? run_delay_ns - entry->prev_run_delay_ns : 0;
+            uint64_t d_slices = !entry->has_sched ? timeslices
+                : timeslices >= entry->prev_timeslices ? timeslices - entry->prev_timeslices : 0;
+            target.thread_run_delay_ns += d_delay;
+            target.thread_timeslices += d_slices;
+            if (entry->has_sched) {
+                thread.run_delay_ms_per_sec = elapsed_sec > 0.0 ? d_delay / 1e6 / elapsed_sec : 0.0;
+                thread.avg_delay_us = d_slices ? d_delay / 1e3 / d_slices : 0.0;
+            }
+            entry->prev_run_delay_ns = run_delay_ns;
+            entry->prev_timeslices = timeslices;
+            entry->has_sched = true;
+        }
+        entry->prev_ticks = fields.ticks;
+        entry->has_prev = true;
+    }
+    out.threads.resize(live);
+}
+
+void ProcessCollector::rescanThreads(Target& target) {
+    std::string task_dir = target.dir + "/task";
+    DIR* dir = opendir(task_dir.c_str());
+    if (!dir) {
+        target.threads.clear();
+        return;
+    }
+
+    std::vector<int> tids;
+    while (struct dirent* entry = readdir(dir)) {
+        int tid = 0;
+        const char* name = entry->d_name;
+        auto result = std::from_chars(name, name + std::char_traits<char>::length(name), tid);
+        if (result.ec == std::errc() && *result.ptr == '\0') {
+            tids.push_back(tid);
+        }
+    }
+    closedir(dir);
+    std::sort(tids.begin(), tids.end());
+
+    // Keep the open files (and CPU baselines) of threads we already know
+    std::vector<std::unique_ptr<ThreadEntry>> threads;
+    threads.reserve(tids.size());
+    auto old = target.threads.begin();
+    for (int tid : tids) {
+        while (old != target.threads.end() && (*old)->tid < tid) ++old;
+        if (old != target.threads.end() && (*old)->tid == tid) {
+            threads.push_back(std::move(*old++));
+        } else {
+            threads.push_back(std::make_unique<ThreadEntry>(tid, target.dir));
+        }
+    }
+    target.threads.swap(threads);
+}
@@ -0,0 +1,595 @@
+#include "profiler.h"
+#include "proc_reader.h"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <elf.h>
+#include <cxxabi.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <string_view>
+
+namespace {
+
+const size_t kCpuRingPages = 16;    // data pages per CPU ring (64 KiB)
+const size_t kThreadRingPages = 4;  // per thread ring - processes can have hundreds
+const int kDrainIntervalMs = 100;
+
+// One perf event and its mmap'd ring: a metadata page, then a power-of-two
+// data area the kernel writes records into
+struct Ring {
+    int fd = -1;
+    char* base = nullptr;
+    size_t mapped = 0;
+
+    ~Ring() {
+        if (base) munmap(base, mapped);
+        if (fd != -1) close(fd);
+    }
+};
+
+int openEvent(int pid, int cpu, int frequency, bool kernel) {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    attr.freq = 1;
+    attr.sample_freq = frequency;
+    attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    attr.disabled = 1;
+    attr.exclude_kernel = !kernel;
+    attr.exclude_hv = 1;
+    // Wake poll() at half full rather than per sample
+    attr.watermark = 1;
+    attr.wakeup_watermark = (cpu < 0 ? kThreadRingPages : kCpuRingPages) * sysconf(_SC_PAGESIZE) / 2;
+    return (int)syscall(SYS_perf_event_open, &attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+std::vector<int> threadsOf(int pid) {
+    std::vector<int> tids;
+    std::string path = "/proc/" + std::to_string(pid) + "/task";
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return tids;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        int tid = 0;
+        const char* name = entry->d_name;
+        auto result = std::from_chars(name, name + std::strlen(name), tid);
+        if (result.ec == std::errc() && *result.ptr == '\0') tids.push_back(tid);
+    }
+    closedir(dir);
+    return tids;
+}
+
+std::string demangle(const std::string& name) {
+    if (name.compare(0, 2, "_Z") != 0) {
+        return name;
+    }
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (status != 0 || !demangled) {
+        return name;
+    }
+    std::string result(demangled);
+    std::free(demangled);
+    return result;
+}
+
+// Frame names for the stacks: ELF symbols per mapped file, kallsyms for the
+// kernel. Everything is loaded lazily and lives for one profile run.
+class Symbolizer {
+public:
+    // Comm and executable mappings of pid, read the first time it's seen
+    void notePid(int pid);
+    const std::string& comm(int pid);
+    void appendFrame(int pid, uint64_t ip, bool kernel, std::string& out);
+
+private:
+    struct Symbol {
+        uint64_t addr = 0;
+        uint64_t size = 0;
+        std::string name;
+        bool demangled = false;
+    };
+    struct Load {
+        uint64_t offset, vaddr, filesz;
+    };
+    struct Image {
+        std::string path;     // as opened, under /proc/<pid>/root when possible
+        std::string name;     // basename for unresolved frames
+        bool loaded = false;
+        std::vector<Load> loads;
+        std::vector<Symbol> symbols;  // sorted by addr
+    };
+    struct Mapping {
+        uint64_t start, end, offset;
+        size_t image;
+    };
+    struct Process {
+        std::string comm;
+        std::vector<Mapping> mappings;  // sorted by start
+    };
+
+    std::unordered_map<int, Process> processes;
+    std::unordered_map<std::string, size_t> image_ids;
+    std::vector<Image> images;
+    std::vector<Symbol> kernel_symbols;
+    bool kernel_loaded = false;
+
+    void loadImage(Image& image);
+    void loadKernel();
+    static const Symbol* find(std::vector<Symbol>& symbols, uint64_t addr);
+    static void appendName(Symbol& symbol, std::string& out);
+};
+
+void Symbolizer::notePid(int pid) {
+    if (processes.count(pid)) {
+        return;
+    }
+    Process& process = processes[pid];
+    if (pid == 0) {
+        process.comm = "swapper";  // the idle task
+        return;
+    }
+    std::string dir = "/proc/" + std::to_string(pid);
+    ProcFile comm_file(dir + "/comm", 64);
+    if (comm_file.read()) {
+        std::string_view comm = comm_file.contents();
+        while (!comm.empty() && comm.back() == '\n') comm.remove_suffix(1);
+        process.comm.assign(comm);
+    }
+    if (process.comm.empty()) {
+        process.comm = "pid-" + std::to_string(pid);
+    }
+
+    // "start-end perms offset dev inode   path"
+    ProcFile maps(dir + "/maps", 65536);
+    if (!maps.read()) {
+        return;
+    }
+    ProcScanner ss(maps.contents());
+    do {
+        std::string_view range = ss.token();
+        std::string_view perms = ss.token();
+        std::string_view offset = ss.token();
+        ss.skip(2);
+        std::string_view path = ss.restOfLine();
+        while (!path.empty() && path.front() == ' ') path.remove_prefix(1);
+        if (perms.size() < 3 || perms[2] != 'x' || path.empty()) continue;
+
+        Mapping mapping{0, 0, 0, 0};
+        size_t dash = range.find('-');
+        if (dash == std::string_view::npos) continue;
+        std::from_chars(range.data(), range.data() + dash, mapping.start, 16);
+        std::from_chars(range.data() + dash + 1, range.data() + range.size(), mapping.end, 16);
+        std::from_chars(offset.data(), offset.data() + offset.size(), mapping.offset, 16);
+
+        std::string key(path);
+        auto it = image_ids.find(key);
+        if (it == image_ids.end()) {
+            Image image;
+            image.name = key.substr(key.rfind('/') + 1);
+            if (path.front() == '/') {
+                // The process's own view of the file (containers, deleted binaries)
+                image.path = dir + "/root" + key;
+            }
+            it = image_ids.emplace(key, images.size()).first;
+            images.push_back(std::move(image));
+        }
+        mapping.image = it->second;
+        process.mappings.push_back(mapping);
+    } while (ss.nextLine());
+    std::sort(process.mappings.begin(), process.mappings.end(),
+              [](const Mapping& a, const Mapping& b) { return a.start < b.start; });
+}
+
+const std::string& Symbolizer::comm(int pid) {
+    notePid(pid);
+    return processes[pid].comm;
+}
+
+void Symbolizer::loadImage(Image& image) {
+    image.loaded = true;
+    if (image.path.empty()) {
+        return;  // [vdso] and friends
+    }
+    int fd = open(image.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Elf64_Ehdr)) {
+        map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    const char* base = (const char*)map;
+    size_t size = st.st_size;
+    auto inside = [size](uint64_t offset, uint64_t length) { return offset <= size && length <= size - offset; };
+
+    const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*)base;
+    if (std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        !inside(ehdr->e_phoff, (uint64_t)ehdr->e_phnum * sizeof(Elf64_Phdr)) ||
+        !inside(ehdr->e_shoff, (uint64_t)ehdr->e_shnum * sizeof(Elf64_Shdr))) {
+        munmap(map, size);
+        return;
+    }
+    const Elf64_Phdr* phdrs = (const Elf64_Phdr*)(base + ehdr->e_phoff);
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD) {
+            image.loads.push_back(Load{phdrs[i].p_offset, phdrs[i].p_vaddr, phdrs[i].p_filesz});
+        }
+    }
+
+    // Full symbol table if not stripped, else the dynamic one
+    const Elf64_Shdr* shdrs = (const Elf64_Shdr*)(base + ehdr->e_shoff);
+    const Elf64_Shdr* symtab = nullptr;
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        if (shdrs[i].sh_type == SHT_SYMTAB || (shdrs[i].sh_type == SHT_DYNSYM && !symtab)) {
+            symtab = &shdrs[i];
+        }
+    }
+    if (symtab && symtab->sh_link < ehdr->e_shnum && inside(symtab->sh_offset, symtab->sh_size)) {
+        const Elf64_Shdr& strtab = shdrs[symtab->sh_link];
+        if (inside(strtab.sh_offset, strtab.sh_size)) {
+            const Elf64_Sym* syms = (const Elf64_Sym*)(base + symtab->sh_offset);
+            size_t count = symtab->sh_size / sizeof(Elf64_Sym);
+            const char* strings = base + strtab.sh_offset;
+            for (size_t i = 0; i < count; i++) {
+                int type = ELF64_ST_TYPE(syms[i].st_info);
+                if ((type != STT_FUNC && type != STT_GNU_IFUNC) || syms[i].st_value == 0 ||
+                    syms[i].st_shndx == SHN_UNDEF || syms[i].st_name >= strtab.sh_size) {
+                    continue;
+                }
+                const char* name = strings + syms[i].st_name;
+                size_t length = strnlen(name, strtab.sh_size - syms[i].st_name);
+                image.symbols.push_back(Symbol{syms[i].st_value, syms[i].st_size, std::string(name, length), false});
+            }
+        }
+    }
+    munmap(map, size);
+    std::sort(image.symbols.begin(), image.symbols.end(),
+              [](const Symbol& a, const Symbol& b) { return a.addr < b.addr; });
+}
+
+void Symbolizer::loadKernel() {
+    kernel_loaded = true;
+    FILE* file = std::fopen("/proc/kallsyms", "re");
+    if (!file) {
+        return;
+    }
+    // "ffffffff81000000 T _stext [module]"; all zeros under kptr_restrict
+    char line[512];
+    while (std::fgets(line, sizeof(line), file)) {
+        std::string_view text(line);
+        size_t sp1 = text.find(' ');
+        if (sp1 == std::string_view::npos || sp1 + 3 >= text.size()) continue;
+        char type = text[sp1 + 1];
+        if (type != 't' && type != 'T') continue;
+        uint64_t addr = 0;
+        std::from_chars(text.data(), text.data() + sp1, addr, 16);
+        if (addr == 0) continue;
+        std::string_view name = text.substr(sp1 + 3);
+        name = name.substr(0, name.find_first_of(" \t\n"));
+        kernel_symbols.push_back(Symbol{addr, 0, std::string(name), true});
+    }
+    std::fclose(file);
+    std::sort(kernel_symbols.begin(), kernel_symbols.end(),
+              [](const Symbol& a, const Symbol& b) { return a.addr < b.addr; });
+}
+
+// The symbol covering addr. Symbols without a size cover up to the next one.
+const Symbolizer::Symbol* Symbolizer::find(std::vector<Symbol>& symbols, uint64_t addr) {
+    auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+                               [](uint64_t a, const Symbol& s) { return a < s.addr; });
+    if (it == symbols.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (it->size != 0 && addr >= it->addr + it->size) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+void Symbolizer::appendName(Symbol& symbol, std::string& out) {
+    if (!symbol.demangled) {
+        symbol.name = demangle(symbol.name);
+        // ';' separates frames in the folded format
+        std::replace(symbol.name.begin(), symbol.name.end(), ';', ':');
+        symbol.demangled = true;
+    }
+    out += symbol.name;
+}
+
+void Symbolizer::appendFrame(int pid, uint64_t ip, bool kernel, std::string& out) {
+    if (kernel) {
+        if (!kernel_loaded) loadKernel();
+        if (const Symbol* symbol = find(kernel_symbols, ip)) {
+            appendName(const_cast<Symbol&>(*symbol), out);
+        } else {
+            out += "[kernel]";
+        }
+        out += "_[k]";
+        return;
+    }
+
+    notePid(pid);
+    const auto& mappings = processes[pid].mappings;
+    auto it = std::upper_bound(mappings.begin(), mappings.end(), ip,
+                               [](uint64_t a, const Mapping& m) { return a < m.start; });
+    if (it == mappings.begin() || ip >= (it - 1)->end) {
+        out += "[unknown]";
+        return;
+    }
+    const Mapping& mapping = *(it - 1);
+    Image& image = images[mapping.image];
+    if (!image.loaded) loadImage(image);
+
+    // Address -> file offset -> the vaddr symbols are expressed in
+    uint64_t file_offset = ip - mapping.start + mapping.offset;
+    uint64_t vaddr = file_offset;
+    for (const Load& load : image.loads) {
+        if (file_offset >= load.offset && file_offset < load.offset + load.filesz) {
+            vaddr = file_offset - load.offset + load.vaddr;
+            break;
+        }
+    }
+    if (const Symbol* symbol = find(image.symbols, vaddr)) {
+        appendName(const_cast<Symbol&>(*symbol), out);
+    } else {
+        out += '[';
+        out += image.name;
+        out += ']';
+    }
+}
+
+// Raw stacks as sampled: pid, then the callchain words (leaf first, with
+// the kernel's PERF_CONTEXT_* markers) - symbolized once the run is over
+struct RawStacks {
+    std::unordered_map<std::string, uint64_t> counts;
+    std::string key;  // reused for every sample
+    uint64_t samples = 0;
+    uint64_t lost = 0;
+};
+
+// Consumes everything between data_tail and data_head. Records are read
+// where the kernel wrote them: they're 8-byte aligned and the data area is a
+// power of two, so a word never straddles the wrap.
+void drain(Ring& ring, RawStacks& raw, Symbolizer& symbolizer) {
+    auto* meta = (struct perf_event_mmap_page*)ring.base;
+    const char* data = ring.base + sysconf(_SC_PAGESIZE);
+    uint64_t mask = ring.mapped - sysconf(_SC_PAGESIZE) - 1;
+    auto word = [data, mask](uint64_t pos) { return *(const uint64_t*)(data + (pos & mask)); };
+
+    uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = meta->data_tail;
+    while (tail < head) {
+        const auto* header = (const struct perf_event_header*)(data + (tail & mask));
+        if (header->size < sizeof(*header)) {
+            break;
+        }
+        if (header->type == PERF_RECORD_SAMPLE && header->size >= sizeof(*header) + 16) {
+            // { u32 pid, tid; u64 nr; u64 ips[nr]; }
+            uint64_t pos = tail + sizeof(*header);
+            uint32_t pid = (uint32_t)word(pos);
+            uint64_t nr = std::min<uint64_t>(word(pos + 8), (header->size - sizeof(*header) - 16) / 8);
+            raw.key.assign((const char*)&pid, sizeof(pid));
+            for (uint64_t i = 0; i < nr; i++) {
+                uint64_t ip = word(pos + 16 + i * 8);
+                raw.key.append((const char*)&ip, sizeof(ip));
+            }
+            auto it = raw.counts.find(raw.key);
+            if (it == raw.counts.end()) {
+                raw.counts.emplace(raw.key, 1);
+                symbolizer.notePid((int)pid);
+            } else {
+                it->second++;
+            }
+            raw.samples++;
+        } else if (header->type == PERF_RECORD_LOST) {
+            raw.lost += word(tail + sizeof(*header) + 8);  // { u64 id; u64 lost; }
+        }
+        tail += header->size;
+    }
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+}
+
+bool SamplingProfiler::run(const ProfileOptions& opts, const std::atomic<bool>& cancel, std::string& error) {
+    options = opts;
+    folded.clear();
+    total_samples = lost_samples = 0;
+    kernel_frames = true;
+
+    // (pid, cpu) per event: every online CPU, or every thread of the process
+    std::vector<std::pair<int, int>> targets;
+    if (options.pid > 0) {
+        for (int tid : threadsOf(options.pid)) targets.emplace_back(tid, -1);
+        if (targets.empty()) {
+            error = "no such process: " + std::to_string(options.pid);
+            return false;
+        }
+    } else {
+        for (int cpu : onlineCpus()) targets.emplace_back(-1, cpu);
+        if (targets.empty()) {
+            error = "can't read the online CPU list";
+            return false;
+        }
+    }
+
+    bool per_thread = options.pid > 0;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t mapped = (1 + (per_thread ? kThreadRingPages : kCpuRingPages)) * page;
+    std::vector<std::unique_ptr<Ring>> rings;
+    for (const auto& target : targets) {
+        int fd = openEvent(target.first, target.second, options.frequency, kernel_frames);
+        if (fd < 0 && (errno == EACCES || errno == EPERM) && kernel_frames && rings.empty()) {
+            // perf_event_paranoid >= 2 without CAP_PERFMON: user frames only
+            kernel_frames = false;
+            fd = openEvent(target.first, target.second, options.frequency, false);
+        }
+        if (fd < 0) {
+            if (errno == ESRCH) continue;  // thread exited since the listing
+            error = std::string("perf_event_open: ") + std::strerror(errno);
+            if (errno == EACCES || errno == EPERM) error += " (check kernel.perf_event_paranoid)";
+            return false;
+        }
+        auto ring = std::make_unique<Ring>();
+        ring->fd = fd;
+        void* base = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            error = std::string("mmap of the perf ring: ") + std::strerror(errno);
+            if (errno == EPERM) error += " (raise kernel.perf_event_mlock_kb)";
+            return false;
+        }
+        ring->base = (char*)base;
+        ring->mapped = mapped;
+        rings.push_back(std::move(ring));
+    }
+    if (rings.empty()) {
+        error = "no such process: " + std::to_string(options.pid);
+        return false;
+    }
+
+    std::vector<struct pollfd> fds(rings.size());
+    for (size_t i = 0; i < rings.size(); i++) {
+        fds[i].fd = rings[i]->fd;
+        fds[i].events = POLLIN;
+        ioctl(rings[i]->fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    RawStacks raw;
+    Symbolizer symbolizer;
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(options.seconds);
+    while (!cancel.load(std::memory_order_relaxed) && std::chrono::steady_clock::now() < deadline) {
+        poll(fds.data(), fds.size(), kDrainIntervalMs);
+        for (auto& ring : rings) drain(*ring, raw, symbolizer);
+    }
+    for (auto& ring : rings) {
+        ioctl(ring->fd, PERF_EVENT_IOC_DISABLE, 0);
+        drain(*ring, raw, symbolizer);
+    }
+    rings.clear();
+    elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    total_samples = raw.samples;
+    lost_samples = raw.lost;
+
+    // Symbolize each distinct stack once; stacks that differ only in
+    // addresses within the same functions merge here
+    std::vector<std::string> frames;
+    std::string line;
+    for (const auto& entry : raw.counts) {
+        const std::string& key = entry.first;
+        int pid = 0;
+        std::memcpy(&pid, key.data(), sizeof(int));
+        size_t nr = (key.size() - sizeof(int)) / 8;
+        frames.clear();
+        bool kernel = false;
+        bool leaf = true;
+        for (size_t i = 0; i < nr; i++) {
+            uint64_t ip;
+            std::memcpy(&ip, key.data() + sizeof(int) + i * 8, sizeof(ip));
+            if (ip >= (uint64_t)PERF_CONTEXT_MAX) {
+                kernel = ip == (uint64_t)PERF_CONTEXT_KERNEL;
+                continue;
+            }
+            frames.emplace_back();
+            // Return addresses point past the call; look up the call itself
+            symbolizer.appendFrame(pid, leaf ? ip : ip - 1, kernel, frames.back());
+            leaf = false;
+        }
+        line = symbolizer.comm(pid);
+        std::replace(line.begin(), line.end(), ';', ':');
+        std::replace(line.begin(), line.end(), ' ', '_');
+        if (frames.empty()) {
+            line += ";[unknown]";
+        }
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+            line += ';';
+            line += *it;
+        }
+        folded[line] += entry.second;
+    }
+    return true;
+}
+
+void SamplingProfiler::renderFolded(std::string& out) const {
+    std::vector<const std::pair<const std::string, uint64_t>*> lines;
+    lines.reserve(folded.size());
+    for (const auto& entry : folded) lines.push_back(&entry);
+    std::sort(lines.begin(), lines.end(), [](auto* a, auto* b) { return a->first < b->first; });
+    char count[24];
+    for (const auto* entry : lines) {
+        out += entry->first;
+        out += ' ';
+        auto result = std::to_chars(count, count + sizeof(count), entry->second);
+        out.append(count, result.ptr - count);
+        out += '\n';
+    }
+}
+
+void SamplingProfiler::renderFlat(std::string& out) const {
+    // Self: the leaf frame. Total: every stack the function appears in,
+    // once per stack even when recursive.
+    std::unordered_map<std::string_view, std::pair<uint64_t, uint64_t>> functions;
+    std::vector<std::string_view> seen;
+    for (const auto& entry : folded) {
+        std::string_view stack = entry.first;
+        stack.remove_prefix(std::min(stack.size(), stack.find(';') + 1));  // comm
+        seen.clear();
+        while (!stack.empty()) {
+            size_t semi = stack.find(';');
+            std::string_view frame = stack.substr(0, semi);
+            if (std::find(seen.begin(), seen.end(), frame) == seen.end()) {
+                functions[frame].second += entry.second;
+                seen.push_back(frame);
+            }
+            if (semi == std::string_view::npos) {
+                functions[frame].first += entry.second;
+                break;
+            }
+            stack.remove_prefix(semi + 1);
+        }
+    }
+    std::vector<std::pair<std::string_view, std::pair<uint64_t, uint64_t>>> rows(functions.begin(), functions.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.first != b.second.first ? a.second.first > b.second.first : a.second.second > b.second.second;
+    });
+
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "# %llu samples, %llu lost, %d Hz over %.1fs, %s%s\n",
+                  (unsigned long long)total_samples, (unsigned long long)lost_samples, options.frequency,
+                  elapsed_sec, options.pid > 0 ? ("pid " + std::to_string(options.pid)).c_str() : "system-wide",
+                  kernel_frames ? "" : ", user frames only");
+    out += buf;
+    out += "#  self%  total%     self    total  function\n";
+    double scale = total_samples ? 100.0 / total_samples : 0.0;
+    for (const auto& row : rows) {
+        std::snprintf(buf, sizeof(buf), "%8.2f %7.2f %8llu %8llu  ", row.second.first * scale,
+                      row.second.second * scale, (unsigned long long)row.second.first,
+                      (unsigned long long)row.second.second);
+        out += buf;
+        out += row.first;
+        out += '\n';
+    }
+}
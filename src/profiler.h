@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+
+struct ProfileOptions {
+    int pid = 0;           // 0: every CPU, system-wide
+    int seconds = 10;
+    int frequency = 99;    // samples per second, per CPU (or per thread with pid)
+};
+
+// On-demand sampling profiler on perf_event_open's software CPU clock, so it
+// works without a PMU (VMs, containers). System-wide it opens one event per
+// online CPU; for a pid, one per thread. The kernel won't mmap inherited
+// per-thread events, so threads started during the run aren't sampled.
+//
+// Each event has its own mmap ring. Samples are decoded in place in the
+// ring, wrap included (records are 8-byte aligned in a power-of-two area),
+// and only the pid and callchain are copied into the stack table. User
+// frames come from the kernel's frame-pointer unwinder, so code built
+// without frame pointers shows short stacks.
+//
+// Symbols come from the ELF .symtab (else .dynsym) of each mapped file and
+// from /proc/kallsyms. Executable mappings are read when a pid is first
+// seen, so processes that exit mid-run still resolve.
+class SamplingProfiler {
+public:
+    // Blocks for options.seconds, or until cancel is set. False with error
+    // set if nothing could be opened.
+    bool run(const ProfileOptions& options, const std::atomic<bool>& cancel, std::string& error);
+
+    // "comm;outer;...;leaf count" lines for flamegraph.pl / speedscope.
+    // Kernel frames end in "_[k]".
+    void renderFolded(std::string& out) const;
+    // Functions by self samples, with inclusive counts
+    void renderFlat(std::string& out) const;
+
+    uint64_t samples() const { return total_samples; }
+    uint64_t lost() const { return lost_samples; }
+
+private:
+    ProfileOptions options;
+    bool kernel_frames = true;   // false when the kernel wouldn't allow them
+    uint64_t total_samples = 0;
+    uint64_t lost_samples = 0;
+    double elapsed_sec = 0.0;
+    // Symbolized stacks ("comm;outer;...;leaf") -> samples
+    std::unordered_map<std::string, uint64_t> folded;
+};
@@ -0,0 +1,433 @@
+#include "prometheus.h"
+#include "collector_registry.h"
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+void appendUnsigned(std::string& out, uint64_t value) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, result.ptr - buf);
+}
+
+void appendDouble(std::string& out, double value) {
+    char buf[48];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, result.ptr - buf);
+}
+
+void family(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void gauge(std::string& out, std::string_view name, std::string_view help, double value) {
+    family(out, name, "gauge", help);
+    out += name;
+    out += ' ';
+    appendDouble(out, value);
+    out += '\n';
+}
+
+void counter(std::string& out, std::string_view name, std::string_view help, uint64_t value) {
+    family(out, name, "counter", help);
+    out += name;
+    out += ' ';
+    appendUnsigned(out, value);
+    out += '\n';
+}
+
+// Label values are user-chosen service names; escape per the text format
+void appendLabelValue(std::string& out, std::string_view value) {
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+}
+
+void coreSeries(std::string& out, const std::vector<double>& values, std::string_view mode) {
+    for (size_t i = 0; i < values.size(); i++) {
+        out += "mpm_cpu_core_percent{core=\"";
+        appendUnsigned(out, i);
+        out += "\",mode=\"";
+        out += mode;
+        out += "\"} ";
+        appendDouble(out, values[i]);
+        out += '\n';
+    }
+}
+
+// One family with a row per named entry: interface, block device, cgroup
+template <typename Device, typename Extract>
+void deviceSeries(std::string& out, const std::vector<Device>& devices, std::string_view label,
+                  std::string_view name, std::string_view type, std::string_view help, Extract extract) {
+    if (devices.empty()) {
+        return;
+    }
+    family(out, name, type, help);
+    for (const auto& device : devices) {
+        out += name;
+        out += '{';
+        out += label;
+        out += "=\"";
+        appendLabelValue(out, device.name);
+        out += "\"} ";
+        if constexpr (std::is_floating_point_v<decltype(extract(device))>) {
+            appendDouble(out, extract(device));
+        } else {
+            appendUnsigned(out, extract(device));
+        }
+        out += '\n';
+    }
+}
+
+void pressureSeries(std::string& out, std::string_view name, std::string_view resource, uint64_t total_us) {
+    out += name;
+    out += "{resource=\"";
+    out += resource;
+    out += "\"} ";
+    appendDouble(out, total_us / 1e6);
+    out += '\n';
+}
+
+void schedSeries(std::string& out, std::string_view name, const std::vector<uint64_t>& values, double scale) {
+    for (size_t i = 0; i < values.size(); i++) {
+        out += name;
+        out += "{cpu=\"";
+        appendUnsigned(out, i);
+        out += "\"} ";
+        appendDouble(out, values[i] * scale);
+        out += '\n';
+    }
+}
+
+// Per-NUMA-node meminfo gauges, values in KB
+template <typename Extract>
+void numaSeries(std::string& out, const std::vector<NumaNodeStats>& nodes, std::string_view name,
+                std::string_view help, Extract extract) {
+    if (nodes.empty()) {
+        return;
+    }
+    family(out, name, "gauge", help);
+    for (const auto& node : nodes) {
+        out += name;
+        out += "{node=\"";
+        appendUnsigned(out, node.node);
+        out += "\"} ";
+        appendUnsigned(out, extract(node.meminfo) * 1024);
+        out += '\n';
+    }
+}
+
+void appendCustomLabels(std::string& out, const CustomMetric& metric) {
+    out += "{service=\"";
+    appendLabelValue(out, metric.service);
+    out += "\",pid=\"";
+    appendUnsigned(out, metric.pid);
+    out += "\",name=\"";
+    appendLabelValue(out, metric.name);
+    out += '"';
+}
+
+// Shared-memory metrics: arbitrary names, so they go in a label of three
+// fixed families rather than becoming metric names
+void customSeries(std::string& out, const std::vector<CustomMetric>& metrics) {
+    static const char* const kFamilies[] = {"mpm_custom_total", "mpm_custom", "mpm_custom_histogram"};
+    static const char* const kTypes[] = {"counter", "gauge", "summary"};
+    static const char* const kHelp[] = {"Counters published over shared memory.",
+                                        "Gauges published over shared memory.",
+                                        "Histograms published over shared memory, in the writer's unit."};
+    static const char kKinds[] = {'c', 'g', 'h'};
+    for (int f = 0; f < 3; f++) {
+        bool first = true;
+        for (const auto& metric : metrics) {
+            if (metric.kind != kKinds[f]) continue;
+            if (first) {
+                family(out, kFamilies[f], kTypes[f], kHelp[f]);
+                first = false;
+            }
+            if (metric.kind != 'h') {
+                out += kFamilies[f];
+                appendCustomLabels(out, metric);
+                out += "} ";
+                appendDouble(out, metric.value);
+                out += '\n';
+                continue;
+            }
+            const double quantiles[] = {metric.p50, metric.p90, metric.p99, metric.p999};
+            const char* labels[] = {"0.5", "0.9", "0.99", "0.999"};
+            for (int q = 0; q < 4; q++) {
+                out += kFamilies[f];
+                appendCustomLabels(out, metric);
+                out += ",quantile=\"";
+                out += labels[q];
+                out += "\"} ";
+                appendDouble(out, quantiles[q]);
+                out += '\n';
+            }
+            out += "mpm_custom_histogram_sum";
+            appendCustomLabels(out, metric);
+            out += "} ";
+            appendDouble(out, metric.mean * metric.count);
+            out += "\nmpm_custom_histogram_count";
+            appendCustomLabels(out, metric);
+            out += "} ";
+            appendUnsigned(out, metric.count);
+            out += '\n';
+        }
+    }
+}
+
+template <typename Value>
+void serviceSeries(std::string& out, const std::vector<ProcessStats>& services, std::string_view name,
+                   std::string_view type, std::string_view help, Value (*extract)(const ProcessStats&)) {
+    family(out, name, type, help);
+    for (const auto& service : services) {
+        out += name;
+        out += "{service=\"";
+        appendLabelValue(out, service.name);
+        out += "\",pid=\"";
+        appendUnsigned(out, service.pid);
+        out += "\",tid=\"";
+        appendUnsigned(out, service.tid);
+        out += "\"} ";
+        if constexpr (std::is_floating_point_v<Value>) {
+            appendDouble(out, extract(service));
+        } else {
+            appendUnsigned(out, extract(service));
+        }
+        out += '\n';
+    }
+}
+
+}
+
+void renderPrometheus(const MetricsSnapshot& snap, std::string& out) {
+    // Host-wide scalars straight from the enabled collectors' schemas
+    HostCollectors::forEachField(snap.collectors, [&](const MetricField& field, size_t) {
+        if (!field.prometheus) {
+            return;
+        }
+        double value = field.extract(snap) * field.prometheus_scale;
+        if (field.type == MetricType::Counter) {
+            counter(out, field.prometheus, field.help, (uint64_t)value);
+        } else {
+            gauge(out, field.prometheus, field.help, value);
+        }
+    });
+
+    const auto& nodes = snap.memory.nodes;
+    numaSeries(out, nodes, "mpm_numa_memory_total_bytes", "Memory on the node.",
+               [](const MemInfo& m) { return m.total_kb; });
+    numaSeries(out, nodes, "mpm_numa_memory_free_bytes", "Free memory on the node.",
+               [](const MemInfo& m) { return m.free_kb; });
+    numaSeries(out, nodes, "mpm_numa_memory_file_bytes", "Page cache on the node.",
+               [](const MemInfo& m) { return m.file_pages_kb; });
+    numaSeries(out, nodes, "mpm_numa_memory_anon_bytes", "Anonymous memory on the node.",
+               [](const MemInfo& m) { return m.anon_pages_kb; });
+    numaSeries(out, nodes, "mpm_numa_memory_slab_bytes", "Kernel slab memory on the node.",
+               [](const MemInfo& m) { return m.slab_kb; });
+    numaSeries(out, nodes, "mpm_numa_memory_dirty_bytes", "Dirty page cache on the node.",
+               [](const MemInfo& m) { return m.dirty_kb; });
+
+    const CpuStats& cpu = snap.cpu_stats;
+    if (!cpu.core_usage.empty()) {
+        family(out, "mpm_cpu_core_percent", "gauge", "Per-core CPU percent by mode over the last sample interval.");
+        coreSeries(out, cpu.core_usage, "busy");
+        coreSeries(out, cpu.core_user, "user");
+        coreSeries(out, cpu.core_system, "system");
+        coreSeries(out, cpu.core_iowait, "iowait");
+    }
+
+    const auto& interfaces = snap.network_stats.interfaces;
+    deviceSeries(out, interfaces, "interface", "mpm_interface_receive_bytes_total", "counter", "Bytes received.",
+                 [](const InterfaceStats& i) { return i.rx_bytes; });
+    deviceSeries(out, interfaces, "interface", "mpm_interface_transmit_bytes_total", "counter", "Bytes sent.",
+                 [](const InterfaceStats& i) { return i.tx_bytes; });
+    deviceSeries(out, interfaces, "interface", "mpm_interface_receive_packets_total", "counter", "Packets received.",
+                 [](const InterfaceStats& i) { return i.rx_packets; });
+    deviceSeries(out, interfaces, "interface", "mpm_interface_transmit_packets_total", "counter", "Packets sent.",
+                 [](const InterfaceStats& i) { return i.tx_packets; });
+    deviceSeries(out, interfaces, "interface", "mpm_interface_errors_total", "counter", "Receive plus transmit errors.",
+                 [](const InterfaceStats& i) { return i.rx_errors + i.tx_errors; });
+    deviceSeries(out, interfaces, "interface", "mpm_interface_dropped_total", "counter", "Receive plus transmit drops.",
+                 [](const InterfaceStats& i) { return i.rx_dropped + i.tx_dropped; });
+
+    const auto& devices = snap.disk_stats.devices;
+    deviceSeries(out, devices, "device", "mpm_block_reads_total", "counter", "Reads completed.",
+                 [](const BlockDeviceStats& d) { return d.reads; });
+    deviceSeries(out, devices, "device", "mpm_block_writes_total", "counter", "Writes completed.",
+                 [](const BlockDeviceStats& d) { return d.writes; });
+    deviceSeries(out, devices, "device", "mpm_block_read_bytes_total", "counter", "Bytes read.",
+                 [](const BlockDeviceStats& d) { return d.read_bytes; });
+    deviceSeries(out, devices, "device", "mpm_block_written_bytes_total", "counter", "Bytes written.",
+                 [](const BlockDeviceStats& d) { return d.write_bytes; });
+    deviceSeries(out, devices, "device", "mpm_block_io_time_ms_total", "counter",
+                 "Milliseconds with I/O in flight; rate() / 10 is busy percent.",
+                 [](const BlockDeviceStats& d) { return d.io_ticks_ms; });
+
+    if (snap.pressure.available) {
+        const char* resources[] = {"cpu", "memory", "io"};
+        const PressureStats* stats[] = {&snap.pressure.cpu, &snap.pressure.memory, &snap.pressure.io};
+        family(out, "mpm_pressure_some_seconds_total", "counter", "Time at least one task was stalled on the resource.");
+        for (int i = 0; i < 3; i++) {
+            pressureSeries(out, "mpm_pressure_some_seconds_total", resources[i], stats[i]->some_total_us);
+        }
+        family(out, "mpm_pressure_full_seconds_total", "counter", "Time all non-idle tasks were stalled on the resource.");
+        for (int i = 0; i < 3; i++) {
+            pressureSeries(out, "mpm_pressure_full_seconds_total", resources[i], stats[i]->full_total_us);
+        }
+    }
+
+    if (snap.scheduler.available) {
+        family(out, "mpm_sched_run_delay_seconds_total", "counter", "Time runnable tasks waited for this CPU.");
+        schedSeries(out, "mpm_sched_run_delay_seconds_total", snap.scheduler.cpu_run_delay_ns, 1e-9);
+        family(out, "mpm_sched_timeslices_total", "counter", "Timeslices run on this CPU.");
+        schedSeries(out, "mpm_sched_timeslices_total", snap.scheduler.cpu_timeslices, 1);
+    }
+
+    // perf_event counters, only the ones this host can count
+    const PerfCounters& perf = snap.perf;
+    if (perf.available) {
+        counter(out, "mpm_perf_cpu_migrations_total", "Tasks moved between CPUs.", perf.cpu_migrations);
+    }
+    if (perf.hardware) {
+        counter(out, "mpm_perf_cycles_total", "CPU cycles, all CPUs.", perf.cycles);
+        counter(out, "mpm_perf_instructions_total", "Instructions retired, all CPUs.", perf.instructions);
+        counter(out, "mpm_perf_cache_references_total", "Last-level cache references.", perf.cache_references);
+        counter(out, "mpm_perf_cache_misses_total", "Last-level cache misses.", perf.cache_misses);
+        counter(out, "mpm_perf_branches_total", "Branch instructions retired.", perf.branches);
+        counter(out, "mpm_perf_branch_misses_total", "Mispredicted branches.", perf.branch_misses);
+    }
+
+    const auto& cgroups = snap.cgroups;
+    deviceSeries(out, cgroups, "cgroup", "mpm_cgroup_cpu_usage_seconds_total", "counter", "CPU time used.",
+                 [](const CgroupStats& g) { return g.cpu_usage_usec / 1e6; });
+    deviceSeries(out, cgroups, "cgroup", "mpm_cgroup_cpu_periods_total", "counter", "CPU quota enforcement periods.",
+                 [](const CgroupStats& g) { return g.cpu_periods; });
+    deviceSeries(out, cgroups, "cgroup", "mpm_cgroup_cpu_throttled_periods_total", "counter",
+                 "Enforcement periods in which the group was throttled.",
+                 [](const CgroupStats& g) { return g.cpu_throttled_periods; });
+    deviceSeries(out, cgroups, "cgroup", "mpm_cgroup_cpu_throttled_seconds_total", "counter",
+                 "Time the group's tasks spent throttled.",
+                 [](const CgroupStats& g) { return g.cpu_throttled_usec / 1e6; });
+    deviceSeries(out, cgroups, "cgroup", "mpm_cgroup_memory_current_bytes", "gauge", "Memory charged to the group.",
+                 [](const CgroupStats& g) { return g.memory_current; });
+    deviceSeries(out, cgroups, "cgroup", "mpm_cgroup_memory_pressure_some_seconds_total", "counter",
+                 "Time some of the group's tasks were stalled on memory.",
+                 [](const CgroupStats& g) { return g.memory_pressure.some_total_us / 1e6; });
+    deviceSeries(out, cgroups, "cgroup", "mpm_cgroup_memory_pressure_full_seconds_total", "counter",
+                 "Time all of the group's tasks were stalled on memory.",
+                 [](const CgroupStats& g) { return g.memory_pressure.full_total_us / 1e6; });
+    deviceSeries(out, cgroups, "cgroup", "mpm_cgroup_io_read_bytes_total", "counter", "Bytes read by the group.",
+                 [](const CgroupStats& g) { return g.io_read_bytes; });
+    deviceSeries(out, cgroups, "cgroup", "mpm_cgroup_io_written_bytes_total", "counter", "Bytes written by the group.",
+                 [](const CgroupStats& g) { return g.io_write_bytes; });
+
+    customSeries(out, snap.custom_metrics);
+
+    gauge(out, "mpm_sampling_burst", "1 while event mode samples fast after a PSI trigger.", snap.burst ? 1.0 : 0.0);
+    counter(out, "mpm_psi_trigger_events_total", "PSI trigger firings seen by the sampler.", snap.psi_events);
+    gauge(out, "mpm_alerts_active", "Anomaly alerts firing (see /alerts).", (double)snap.alerts_active);
+
+    if (snap.services.empty()) {
+        return;
+    }
+    const auto& services = snap.services;
+    serviceSeries<uint64_t>(out, services, "mpm_service_up", "gauge", "1 while the tracked process or thread exists.",
+                            [](const ProcessStats& s) -> uint64_t { return s.alive; });
+    serviceSeries<double>(out, services, "mpm_service_cpu_percent", "gauge", "CPU percent, 100 = one full core.",
+                          [](const ProcessStats& s) { return s.cpu_percent; });
+    serviceSeries<uint64_t>(out, services, "mpm_service_resident_bytes", "gauge", "Resident set size.",
+                            [](const ProcessStats& s) -> uint64_t { return s.rss_kb * 1024; });
+    serviceSeries<uint64_t>(out, services, "mpm_service_threads", "gauge", "Thread count.",
+                            [](const ProcessStats& s) -> uint64_t { return s.num_threads; });
+    serviceSeries<uint64_t>(out, services, "mpm_service_read_bytes_total", "counter", "Storage bytes read.",
+                            [](const ProcessStats& s) { return s.read_bytes; });
+    serviceSeries<uint64_t>(out, services, "mpm_service_written_bytes_total", "counter", "Storage bytes written.",
+                            [](const ProcessStats& s) { return s.write_bytes; });
+    serviceSeries<double>(out, services, "mpm_service_run_delay_seconds_total", "counter",
+                          "Time spent runnable but waiting for a CPU.",
+                          [](const ProcessStats& s) { return s.run_delay_ns / 1e9; });
+    serviceSeries<uint64_t>(out, services, "mpm_service_timeslices_total", "counter", "Timeslices run.",
+                            [](const ProcessStats& s) { return s.timeslices; });
+    if (std::any_of(services.begin(), services.end(), [](const ProcessStats& s) { return s.perf.available; })) {
+        serviceSeries<uint64_t>(out, services, "mpm_service_page_faults_total", "counter", "Page faults.",
+                                [](const ProcessStats& s) { return s.perf.page_faults; });
+        serviceSeries<uint64_t>(out, services, "mpm_service_cpu_migrations_total", "counter",
+                                "Times a thread moved to another CPU.",
+                                [](const ProcessStats& s) { return s.perf.cpu_migrations; });
+    }
+    if (std::any_of(services.begin(), services.end(), [](const ProcessStats& s) { return s.perf.hardware; })) {
+        serviceSeries<uint64_t>(out, services, "mpm_service_cycles_total", "counter", "CPU cycles.",
+                                [](const ProcessStats& s) { return s.perf.cycles; });
+        serviceSeries<uint64_t>(out, services, "mpm_service_instructions_total", "counter", "Instructions retired.",
+                                [](const ProcessStats& s) { return s.perf.instructions; });
+        serviceSeries<uint64_t>(out, services, "mpm_service_cache_misses_total", "counter", "Last-level cache misses.",
+                                [](const ProcessStats& s) { return s.perf.cache_misses; });
+    }
+}
+
+void renderInstruments(const InstrumentRegistry& registry, std::string& out) {
+    static const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    static const char* kQuantileLabels[] = {"0.5", "0.9", "0.99", "0.999"};
+    double seconds_per_tick = registry.nanosecondsPerTick() / 1e9;
+
+    bool first = true;
+    HistogramSnapshot merged;
+    registry.forEachHistogram([&](const LatencyHistogram& histogram) {
+        if (first) {
+            family(out, "mpm_latency_seconds", "summary", "In-process latency recorded with ScopedTimer.");
+            first = false;
+        }
+        histogram.merge(merged);
+        for (int i = 0; i < 4; i++) {
+            out += "mpm_latency_seconds{name=\"";
+            appendLabelValue(out, histogram.getName());
+            out += "\",quantile=\"";
+            out += kQuantileLabels[i];
+            out += "\"} ";
+            appendDouble(out, merged.quantile(kQuantiles[i]) * seconds_per_tick);
+            out += '\n';
+        }
+        out += "mpm_latency_seconds_sum{name=\"";
+        appendLabelValue(out, histogram.getName());
+        out += "\"} ";
+        appendDouble(out, merged.sum * seconds_per_tick);
+        out += "\nmpm_latency_seconds_count{name=\"";
+        appendLabelValue(out, histogram.getName());
+        out += "\"} ";
+        appendUnsigned(out, merged.count);
+        out += '\n';
+    });
+
+    first = true;
+    registry.forEachCounter([&](const EventCounter& counter) {
+        if (first) {
+            family(out, "mpm_events_total", "counter", "In-process event counters.");
+            first = false;
+        }
+        out += "mpm_events_total{name=\"";
+        appendLabelValue(out, counter.getName());
+        out += "\"} ";
+        appendUnsigned(out, counter.value());
+        out += '\n';
+    });
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+#include "snapshot.h"
+#include "instrument.h"
+
+// Prometheus text exposition (format 0.0.4) of a snapshot.
+// Appends to out with std::to_chars only - no iostreams, and no allocation
+// once out has grown to a typical document's size.
+void renderPrometheus(const MetricsSnapshot& snap, std::string& out);
+
+// In-process instruments: histograms as summaries (p50/p90/p99/p999, in
+// seconds) and counters, merged across threads at call time
+void renderInstruments(const InstrumentRegistry& registry, std::string& out);
+
+const char kPrometheusContentType[] = "text/plain; version=0.0.4; charset=utf-8";
@@ -0,0 +1,75 @@
+#include "psi_trigger.h"
+#include <iostream>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool parsePsiTrigger(const std::string& text, PsiTriggerSpec& out) {
+    size_t first = text.find(':');
+    size_t second = first == std::string::npos ? first : text.find(':', first + 1);
+    size_t slash = second == std::string::npos ? second : text.find('/', second + 1);
+    if (slash == std::string::npos) {
+        return false;
+    }
+    std::string resource = text.substr(0, first);
+    std::string kind = text.substr(first + 1, second - first - 1);
+    if ((resource != "cpu" && resource != "memory" && resource != "io") || (kind != "some" && kind != "full")) {
+        return false;
+    }
+    long stall_ms = std::atol(text.c_str() + second + 1);
+    long window_ms = std::atol(text.c_str() + slash + 1);
+    if (stall_ms <= 0 || window_ms <= 0 || stall_ms > window_ms) {
+        return false;
+    }
+    out.resource = resource;
+    out.full = kind == "full";
+    out.stall = std::chrono::milliseconds(stall_ms);
+    out.window = std::chrono::milliseconds(window_ms);
+    return true;
+}
+
+PsiTrigger::~PsiTrigger() {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+PsiTrigger& PsiTrigger::operator=(PsiTrigger&& other) noexcept {
+    if (this != &other) {
+        if (fd != -1) close(fd);
+        fd = other.fd;
+        spec = std::move(other.spec);
+        other.fd = -1;
+    }
+    return *this;
+}
+
+bool PsiTrigger::open(const PsiTriggerSpec& trigger) {
+    std::string path = "/proc/pressure/" + trigger.resource;
+    int new_fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (new_fd == -1) {
+        std::cerr << "Failed to open " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // "some 150000 1000000": stall and window in microseconds, NUL included
+    char text[64];
+    int length = std::snprintf(text, sizeof(text), "%s %lld %lld", trigger.full ? "full" : "some",
+                               (long long)trigger.stall.count(), (long long)trigger.window.count());
+    if (write(new_fd, text, length + 1) < 0) {
+        std::cerr << "Failed to register PSI trigger \"" << text << "\" on " << path << ": "
+                  << std::strerror(errno) << std::endl;
+        if (errno == EINVAL && trigger.window.count() % 2000000 != 0) {
+            // Without CAP_SYS_RESOURCE the kernel only takes whole 2s windows
+            std::cerr << "  unprivileged triggers need a window that is a multiple of 2000ms" << std::endl;
+        }
+        close(new_fd);
+        return false;
+    }
+    if (fd != -1) close(fd);
+    fd = new_fd;
+    spec = trigger;
+    return true;
+}
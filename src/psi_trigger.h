@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+
+// A PSI trigger: notify when tasks stall on resource for at least stall
+// within any window (the kernel wants 500ms <= window <= 10s)
+struct PsiTriggerSpec {
+    std::string resource = "memory";  // cpu, memory or io
+    bool full = false;                // "full" instead of "some"
+    std::chrono::microseconds stall{100000};
+    std::chrono::microseconds window{1000000};
+};
+
+// Parses "memory:some:100/1000" (resource:kind:stall_ms/window_ms)
+bool parsePsiTrigger(const std::string& text, PsiTriggerSpec& out);
+
+// Sampling policy for event mode: slow baseline polling, bursts of fast
+// sampling whenever a trigger fires
+struct EventModeConfig {
+    std::vector<PsiTriggerSpec> triggers;
+    std::chrono::milliseconds burst_interval{100};
+    std::chrono::milliseconds burst_window{30000};  // extended by every firing
+};
+
+// A registered trigger. The kernel keeps it armed for as long as the fd is
+// open and raises POLLPRI on it, at most once per window.
+class PsiTrigger {
+public:
+    PsiTrigger() = default;
+    ~PsiTrigger();
+    PsiTrigger(PsiTrigger&& other) noexcept : fd(other.fd), spec(std::move(other.spec)) { other.fd = -1; }
+    PsiTrigger& operator=(PsiTrigger&& other) noexcept;
+    PsiTrigger(const PsiTrigger&) = delete;
+    PsiTrigger& operator=(const PsiTrigger&) = delete;
+
+    bool open(const PsiTriggerSpec& trigger);
+    int getFd() const { return fd; }
+    const PsiTriggerSpec& getSpec() const { return spec; }
+
+private:
+    int fd = -1;
+    PsiTriggerSpec spec;
+};
@@ -0,0 +1,653 @@
+#include "push_exporter.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace {
+
+const char kSpillSuffix[] = ".mpmb";
+const std::chrono::milliseconds kMinBackoff{500};
+const std::chrono::milliseconds kMaxBackoff{30000};
+
+void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += char(value | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+void appendString(std::string& out, std::string_view value) {
+    appendVarint(out, value.size());
+    out.append(value.data(), value.size());
+}
+
+uint64_t zigzag(int64_t value) {
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+uint64_t doubleBits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Bounds-checked reads; any failure sticks
+struct Reader {
+    std::string_view data;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (data.empty()) break;
+            uint8_t byte = data[0];
+            data.remove_prefix(1);
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    std::string_view bytes(size_t n) {
+        if (data.size() < n) {
+            ok = false;
+            return std::string_view();
+        }
+        std::string_view out = data.substr(0, n);
+        data.remove_prefix(n);
+        return out;
+    }
+};
+
+bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;  // EAGAIN here is SO_SNDTIMEO expiring
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+std::string spillPath(const std::string& dir, uint64_t seq) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%020llu", (unsigned long long)seq);
+    return dir + name + kSpillSuffix;
+}
+
+}
+
+void encodeMetricBatch(const MetricBatch& batch, std::string& out) {
+    out.append(kBatchMagic, sizeof(kBatchMagic));
+    out += char(kBatchVersion);
+    appendString(out, batch.source);
+    appendVarint(out, batch.seq);
+    appendVarint(out, batch.columns.size());
+    for (const auto& column : batch.columns) {
+        appendString(out, column);
+    }
+    size_t rows = batch.timestamps.size();
+    appendVarint(out, rows);
+
+    int64_t prev = 0, prev_delta = 0;
+    for (size_t r = 0; r < rows; r++) {
+        if (r == 0) {
+            appendVarint(out, zigzag(batch.timestamps[0]));
+        } else {
+            int64_t delta = batch.timestamps[r] - prev;
+            appendVarint(out, zigzag(delta - prev_delta));  // 0 for a steady interval
+            prev_delta = delta;
+        }
+        prev = batch.timestamps[r];
+    }
+
+    size_t cols = batch.columns.size();
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < cols; c++) {
+            uint64_t x = doubleBits(batch.values[r * cols + c]) ^ (r ? doubleBits(batch.values[(r - 1) * cols + c]) : 0);
+            if (x == 0) {
+                out += char(0x80);
+                continue;
+            }
+            int lead = __builtin_clzll(x) / 8;
+            int trail = __builtin_ctzll(x) / 8;
+            out += char(lead << 4 | trail);
+            for (int b = trail; b < 8 - lead; b++) {
+                out += char(x >> (8 * b));
+            }
+        }
+    }
+}
+
+bool decodeMetricBatch(std::string_view data, MetricBatch& out) {
+    if (data.size() < 5 || std::memcmp(data.data(), kBatchMagic, sizeof(kBatchMagic)) != 0 ||
+        uint8_t(data[4]) != kBatchVersion) {
+        return false;
+    }
+    Reader reader{data.substr(5)};
+    std::string_view source = reader.bytes(reader.varint());
+    out.source.assign(source.data(), source.size());
+    out.seq = reader.varint();
+    uint64_t cols = reader.varint();
+    if (!reader.ok || cols > reader.data.size()) {
+        return false;
+    }
+    out.columns.resize(cols);
+    for (auto& column : out.columns) {
+        std::string_view name = reader.bytes(reader.varint());
+        column.assign(name.data(), name.size());
+    }
+    uint64_t rows = reader.varint();
+    // Every timestamp and every value takes at least a byte
+    if (!reader.ok || rows > reader.data.size() || (cols && rows * cols > reader.data.size())) {
+        return false;
+    }
+
+    out.timestamps.resize(rows);
+    int64_t prev = 0, prev_delta = 0;
+    for (uint64_t r = 0; r < rows; r++) {
+        int64_t value = unzigzag(reader.varint());
+        if (r == 0) {
+            out.timestamps[0] = value;
+        } else {
+            prev_delta += value;
+            out.timestamps[r] = prev + prev_delta;
+        }
+        prev = out.timestamps[r];
+    }
+
+    out.values.resize(rows * cols);
+    for (uint64_t r = 0; r < rows && reader.ok; r++) {
+        for (uint64_t c = 0; c < cols; c++) {
+            std::string_view control = reader.bytes(1);
+            if (!reader.ok) break;
+            int lead = uint8_t(control[0]) >> 4;
+            int trail = uint8_t(control[0]) & 0x0f;
+            if (lead + trail > 8) {
+                return false;
+            }
+            std::string_view middle = reader.bytes(8 - lead - trail);
+            uint64_t x = 0;
+            for (int b = 0; b < (int)middle.size(); b++) {
+                x |= uint64_t(uint8_t(middle[b])) << (8 * (trail + b));
+            }
+            uint64_t bits = x ^ (r ? doubleBits(out.values[(r - 1) * cols + c]) : 0);
+            std::memcpy(&out.values[r * cols + c], &bits, sizeof(bits));
+        }
+    }
+    return reader.ok && reader.data.empty();
+}
+
+PushExporter::PushExporter(std::vector<std::string> columns, const PushConfig& config)
+    : columns(std::move(columns)), config(config),
+      capacity(config.queue_capacity ? config.queue_capacity : 1),
+      rows_per_batch(config.batch_rows ? config.batch_rows : 1),
+      timestamps(new int64_t[capacity]),
+      rows(new double[capacity * this->columns.size()]) {
+    if (this->config.source.empty()) {
+        char name[256] = {};
+        gethostname(name, sizeof(name) - 1);
+        this->config.source = name;
+    }
+    batch.source = this->config.source;
+    batch.columns = this->columns;
+    if (this->config.udp) {
+        // Worst case 9 bytes per value and 10 per timestamp, names and all
+        // in one datagram
+        size_t fixed = 64 + batch.source.size();
+        for (const auto& column : this->columns) fixed += column.size() + 2;
+        size_t per_row = 9 * this->columns.size() + 10;
+        size_t fit = fixed < kMaxDatagramBytes ? (kMaxDatagramBytes - fixed) / per_row : 1;
+        rows_per_batch = std::max<size_t>(1, std::min(rows_per_batch, fit));
+    }
+}
+
+PushExporter::~PushExporter() {
+    stop();
+}
+
+bool PushExporter::start() {
+    if (running) {
+        return true;
+    }
+    if (!config.spill_dir.empty()) {
+        if (mkdir(config.spill_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "Failed to create spill directory " << config.spill_dir << ": " << std::strerror(errno)
+                      << std::endl;
+            return false;
+        }
+        loadSpilled();
+    }
+    running = true;
+    thread = std::thread(&PushExporter::senderLoop, this);
+    return true;
+}
+
+void PushExporter::stop() {
+    if (!running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        running = false;
+    }
+    wake_cv.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void PushExporter::push(int64_t timestamp_ms, const double* values) {
+    uint64_t index = head.load(std::memory_order_relaxed);
+    uint64_t queued = index - tail.load(std::memory_order_acquire);
+    if (queued >= capacity) {
+        dropped_rows.fetch_add(1, std::memory_order_relaxed);  // sender is behind, never wait for it
+        return;
+    }
+    size_t slot = index % capacity;
+    timestamps[slot] = timestamp_ms;
+    std::memcpy(&rows[slot * columns.size()], values, columns.size() * sizeof(double));
+    head.store(index + 1, std::memory_order_release);
+    if (queued + 1 == capacity / 2) {
+        wake_cv.notify_one();  // don't wait out the interval with the ring half full
+    }
+}
+
+void PushExporter::senderLoop() {
+    auto interval = std::chrono::milliseconds(config.flush_interval_ms > 0 ? config.flush_interval_ms : 1000);
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake_cv.wait_for(lock, interval, [this] { return !running; });
+        }
+        drainRows();
+        transmit();
+    }
+
+    // Last round: send what's queued and give the acks a moment
+    drainRows();
+    retry_at = std::chrono::steady_clock::now();
+    transmit();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.timeout_ms);
+    while (fd >= 0 && !in_flight.empty() && std::chrono::steady_clock::now() < deadline) {
+        if (!readAcks(100)) break;
+    }
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    // Leftovers wait on disk for the next run
+    if (!config.spill_dir.empty()) {
+        while (!in_flight.empty()) {
+            if (in_flight.back().spill_path.empty()) outbox.push_front(std::move(in_flight.back()));
+            in_flight.pop_back();
+        }
+        while (!outbox.empty()) spillOldest();
+    }
+    if (!outbox.empty() || !in_flight.empty()) {
+        dropped_batches.fetch_add(outbox.size() + in_flight.size(), std::memory_order_relaxed);
+    }
+    updateQueued();
+}
+
+void PushExporter::drainRows() {
+    uint64_t first = tail.load(std::memory_order_relaxed);
+    uint64_t last = head.load(std::memory_order_acquire);
+    size_t cols = columns.size();
+    while (first < last) {
+        size_t n = std::min<uint64_t>(last - first, rows_per_batch);
+        batch.timestamps.clear();
+        batch.values.clear();
+        for (uint64_t index = first; index < first + n; index++) {
+            size_t slot = index % capacity;
+            batch.timestamps.push_back(timestamps[slot]);
+            batch.values.insert(batch.values.end(), &rows[slot * cols], &rows[slot * cols] + cols);
+        }
+        first += n;
+        tail.store(first, std::memory_order_release);
+
+        Pending pending;
+        pending.seq = batch.seq = next_seq++;
+        encodeMetricBatch(batch, pending.payload);
+        enqueue(std::move(pending));
+    }
+    updateQueued();
+}
+
+void PushExporter::enqueue(Pending pending) {
+    outbox.push_back(std::move(pending));
+    while (outbox.size() > config.memory_batches) {
+        if (config.spill_dir.empty()) {
+            outbox.pop_front();
+            dropped_batches.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            spillOldest();
+        }
+    }
+}
+
+// Moves the oldest in-memory batch to disk, trimming the oldest spill files
+// past spill_max_bytes. Written under a temporary name and renamed, so a
+// crash never leaves a torn batch to replay.
+void PushExporter::spillOldest() {
+    Pending pending = std::move(outbox.front());
+    outbox.pop_front();
+
+    Spilled file;
+    file.seq = pending.seq;
+    file.path = spillPath(config.spill_dir, pending.seq);
+    file.bytes = pending.payload.size();
+    std::string temp = file.path + ".tmp";
+    int out = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = out >= 0;
+    for (size_t done = 0; ok && done < pending.payload.size(); ) {
+        ssize_t written = write(out, pending.payload.data() + done, pending.payload.size() - done);
+        if (written < 0 && errno == EINTR) continue;
+        ok = written > 0;
+        done += ok ? written : 0;
+    }
+    if (out >= 0) close(out);
+    if (!ok || rename(temp.c_str(), file.path.c_str()) != 0) {
+        std::cerr << "Failed to spill batch to " << file.path << ": " << std::strerror(errno) << std::endl;
+        unlink(temp.c_str());
+        dropped_batches.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    spill_bytes += file.bytes;
+    spilled.push_back(std::move(file));
+    while (spill_bytes > config.spill_max_bytes && spilled.size() > 1) {
+        unlink(spilled.front().path.c_str());
+        spill_bytes -= spilled.front().bytes;
+        spilled.pop_front();
+        dropped_batches.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Batches left by an earlier run go out first, oldest first
+void PushExporter::loadSpilled() {
+    DIR* dir = opendir(config.spill_dir.c_str());
+    if (!dir) {
+        return;
+    }
+    const size_t suffix = sizeof(kSpillSuffix) - 1;
+    while (struct dirent* entry = readdir(dir)) {
+        std::string_view name = entry->d_name;
+        if (name.size() <= suffix || name.substr(name.size() - suffix) != kSpillSuffix) {
+            continue;
+        }
+        Spilled file;
+        file.seq = std::strtoull(entry->d_name, nullptr, 10);
+        file.path = config.spill_dir + "/" + entry->d_name;
+        struct stat st;
+        if (file.seq == 0 || stat(file.path.c_str(), &st) != 0) {
+            continue;
+        }
+        file.bytes = st.st_size;
+        spill_bytes += file.bytes;
+        next_seq = std::max(next_seq, file.seq + 1);
+        spilled.push_back(std::move(file));
+    }
+    closedir(dir);
+    std::sort(spilled.begin(), spilled.end(), [](const Spilled& a, const Spilled& b) { return a.seq < b.seq; });
+    if (!spilled.empty()) {
+        std::cout << "Push exporter: " << spilled.size() << " spilled batches to resend from " << config.spill_dir
+                  << std::endl;
+    }
+    updateQueued();
+}
+
+bool PushExporter::nextPending(Pending& out) {
+    while (!spilled.empty()) {
+        Spilled file = std::move(spilled.front());
+        spilled.pop_front();
+        spill_bytes -= file.bytes;
+        int in = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in >= 0) {
+            out.payload.resize(file.bytes);
+            ssize_t got = pread(in, out.payload.data(), file.bytes, 0);
+            close(in);
+            if (got == (ssize_t)file.bytes) {
+                out.seq = file.seq;
+                out.spill_path = std::move(file.path);
+                return true;
+            }
+        }
+        std::cerr << "Dropping unreadable spill file " << file.path << std::endl;
+        unlink(file.path.c_str());
+        dropped_batches.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (outbox.empty()) {
+        return false;
+    }
+    out = std::move(outbox.front());
+    outbox.pop_front();
+    return true;
+}
+
+void PushExporter::transmit() {
+    auto now = std::chrono::steady_clock::now();
+    if (fd < 0) {
+        if (now < retry_at || (spilled.empty() && outbox.empty())) {
+            return;
+        }
+        if (!connect()) {
+            backoff = std::min(std::max(backoff * 2, kMinBackoff), kMaxBackoff);
+            retry_at = now + backoff;
+            return;
+        }
+    }
+
+    while (true) {
+        if (!config.udp) {
+            if (!readAcks(0)) {
+                disconnect("connection closed or bad ack");
+                return;
+            }
+            if (in_flight.size() >= config.window) {
+                // Backpressure: wait for the receiver rather than piling on
+                if (!readAcks(config.timeout_ms)) {
+                    disconnect("connection closed or bad ack");
+                    return;
+                }
+                if (in_flight.size() >= config.window) {
+                    break;  // still stalled, batches keep queueing until the next round
+                }
+                continue;
+            }
+        }
+        Pending pending;
+        if (!nextPending(pending)) {
+            break;
+        }
+        if (!sendPayload(pending.payload)) {
+            in_flight.push_back(std::move(pending));
+            disconnect(std::strerror(errno));
+            return;
+        }
+        sent_batches.fetch_add(1, std::memory_order_relaxed);
+        sent_bytes.fetch_add(pending.payload.size(), std::memory_order_relaxed);
+        if (config.udp) {
+            if (!pending.spill_path.empty()) unlink(pending.spill_path.c_str());
+        } else {
+            in_flight.push_back(std::move(pending));
+        }
+    }
+    updateQueued();
+}
+
+bool PushExporter::connect() {
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = config.udp ? SOCK_DGRAM : SOCK_STREAM;
+    struct addrinfo* addresses = nullptr;
+    std::string port = std::to_string(config.port);
+    int rc = getaddrinfo(config.host.c_str(), port.c_str(), &hints, &addresses);
+    if (rc != 0) {
+        if (!reported_down) {
+            std::cerr << "Push receiver " << config.host << ": " << gai_strerror(rc) << std::endl;
+            reported_down = true;
+        }
+        return false;
+    }
+    int err = 0;
+    for (struct addrinfo* a = addresses; a && fd < 0; a = a->ai_next) {
+        int s = socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, a->ai_protocol);
+        if (s < 0) {
+            err = errno;
+            continue;
+        }
+        if (::connect(s, a->ai_addr, a->ai_addrlen) != 0) {
+            struct pollfd pfd = {s, POLLOUT, 0};
+            socklen_t len = sizeof(err);
+            err = errno;
+            if (err != EINPROGRESS || poll(&pfd, 1, config.timeout_ms) != 1 ||
+                getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err) {
+                err = err && err != EINPROGRESS ? err : ETIMEDOUT;
+                close(s);
+                continue;
+            }
+        }
+        // Blocking from here on, but never for longer than the timeout
+        fcntl(s, F_SETFL, fcntl(s, F_GETFL) & ~O_NONBLOCK);
+        struct timeval tv = {config.timeout_ms / 1000, (config.timeout_ms % 1000) * 1000};
+        setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (!config.udp) {
+            int one = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        fd = s;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        if (!reported_down) {
+            std::cerr << "Push receiver " << config.host << ":" << config.port << " unreachable ("
+                      << std::strerror(err ? err : ECONNREFUSED) << "); queueing batches" << std::endl;
+            reported_down = true;
+        }
+        return false;
+    }
+    if (reported_down) {
+        std::cout << "Push receiver " << config.host << ":" << config.port << " is back" << std::endl;
+        reported_down = false;
+    }
+    backoff = std::chrono::milliseconds(0);
+    ack_used = 0;
+    return true;
+}
+
+// Unacknowledged batches go back to the front of their queues and are sent
+// again on the next connection
+void PushExporter::disconnect(const char* reason) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (!reported_down) {
+        std::cerr << "Push receiver " << config.host << ":" << config.port << " lost (" << reason
+                  << "); queueing batches" << std::endl;
+        reported_down = true;
+    }
+    while (!in_flight.empty()) {
+        Pending& pending = in_flight.back();
+        if (pending.spill_path.empty()) {
+            outbox.push_front(std::move(pending));
+        } else {
+            Spilled file;
+            file.seq = pending.seq;
+            file.path = std::move(pending.spill_path);
+            file.bytes = pending.payload.size();
+            spill_bytes += file.bytes;
+            spilled.push_front(std::move(file));
+        }
+        in_flight.pop_back();
+    }
+    while (outbox.size() > config.memory_batches) {
+        if (config.spill_dir.empty()) {
+            outbox.pop_front();
+            dropped_batches.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            spillOldest();
+        }
+    }
+    backoff = std::min(std::max(backoff * 2, kMinBackoff), kMaxBackoff);
+    retry_at = std::chrono::steady_clock::now() + backoff;
+    updateQueued();
+}
+
+bool PushExporter::sendPayload(const std::string& payload) {
+    if (config.udp) {
+        if (payload.size() > kMaxDatagramBytes) {
+            dropped_batches.fetch_add(1, std::memory_order_relaxed);  // e.g. spilled by a TCP run
+            return true;
+        }
+        return send(fd, payload.data(), payload.size(), MSG_NOSIGNAL) == (ssize_t)payload.size();
+    }
+    char length[4];
+    uint32_t size = payload.size();
+    for (int i = 0; i < 4; i++) length[i] = char(size >> (8 * i));
+    return sendAll(fd, length, sizeof(length)) && sendAll(fd, payload.data(), payload.size());
+}
+
+// False once the receiver has closed the connection or acked out of order
+bool PushExporter::readAcks(int timeout_ms) {
+    if (timeout_ms > 0) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) == 0) {
+            return true;
+        }
+    }
+    while (true) {
+        ssize_t got = recv(fd, ack_buffer + ack_used, sizeof(ack_buffer) - ack_used, MSG_DONTWAIT);
+        if (got == 0) {
+            return false;
+        }
+        if (got < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        ack_used += got;
+        if (ack_used == sizeof(ack_buffer)) {
+            uint64_t seq = 0;
+            for (int i = 0; i < 8; i++) seq |= uint64_t(uint8_t(ack_buffer[i])) << (8 * i);
+            ack_used = 0;
+            if (!acknowledge(seq)) return false;
+        }
+    }
+}
+
+// The receiver answers every frame in order, so an ack is for the oldest
+// batch in flight; 0 acks a frame it couldn't decode (dropped, not resent)
+bool PushExporter::acknowledge(uint64_t seq) {
+    if (in_flight.empty() || (seq != 0 && in_flight.front().seq != seq)) {
+        return false;
+    }
+    if (!in_flight.front().spill_path.empty()) {
+        unlink(in_flight.front().spill_path.c_str());
+    }
+    in_flight.pop_front();
+    return true;
+}
+
+void PushExporter::updateQueued() {
+    queued_batches.store(spilled.size() + outbox.size() + in_flight.size(), std::memory_order_relaxed);
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+// Batch wire format, shared by the exporter and push_receiver. One batch is
+// self-contained (source, column names, rows) so it can sit in a spill file
+// and be replayed over any later connection.
+//
+//   "MPMB" version:u8 source seq columns names... rows
+//   timestamps: zigzag varint of the first, then of each delta-of-delta
+//   values, row by row: each double XORed with the same column of the
+//   previous row, sent as one byte (leading << 4 | trailing zero bytes)
+//   plus the bytes in between - one byte for an unchanged value
+//
+// Over TCP every batch is framed with its length as a little-endian u32 and
+// the receiver answers each frame, in order, with its seq as a little-endian
+// u64 (0 if it couldn't decode it). Over UDP a batch is one datagram and
+// nothing comes back.
+const char kBatchMagic[4] = {'M', 'P', 'M', 'B'};
+const uint8_t kBatchVersion = 1;
+const size_t kMaxBatchBytes = 16 * 1024 * 1024;  // receivers reject bigger frames
+const size_t kMaxDatagramBytes = 65000;
+
+struct MetricBatch {
+    std::string source;
+    uint64_t seq = 0;
+    std::vector<std::string> columns;
+    std::vector<int64_t> timestamps;
+    std::vector<double> values;        // rows * columns, row-major
+};
+
+void encodeMetricBatch(const MetricBatch& batch, std::string& out);
+bool decodeMetricBatch(std::string_view data, MetricBatch& out);
+
+struct PushConfig {
+    std::string host = "127.0.0.1";
+    int port = 9109;
+    bool udp = false;
+    std::string source;                   // names this host in every batch; default hostname
+    int flush_interval_ms = 5000;         // one send round per interval
+    size_t batch_rows = 600;              // rows per batch at most
+    size_t queue_capacity = 4096;         // rows between the sampler and the sender
+    size_t memory_batches = 64;           // encoded batches held while the receiver is away
+    size_t window = 16;                   // TCP batches sent but not acknowledged
+    std::string spill_dir;                // older batches overflow here; empty: dropped
+    size_t spill_max_bytes = 256 * 1024 * 1024;
+    int timeout_ms = 2000;                // connect, send and ack waits
+};
+
+// Pushes published samples to a remote receiver, off the sampling thread.
+//
+// push() is the same non-blocking SPSC ring as HistoryWriter. Every flush
+// interval the sender thread encodes what is queued into batches and sends
+// them over one persistent connection. TCP batches stay queued until
+// acknowledged, and at most `window` are in flight, so a slow receiver
+// pushes back instead of being flooded. While it is unreachable or stalled,
+// batches wait in memory, then in spill_dir (oldest first) up to
+// spill_max_bytes, then the oldest are dropped. Spill files outlive the
+// process and are sent first on the next start. Delivery is at least once.
+class PushExporter {
+public:
+    PushExporter(std::vector<std::string> columns, const PushConfig& config);
+    ~PushExporter();
+
+    bool start();
+    void stop();  // one last send round, then spills what's left
+
+    // Producer side (sampler thread). values holds one entry per column.
+    void push(int64_t timestamp_ms, const double* values);
+
+    uint64_t droppedRows() const { return dropped_rows.load(std::memory_order_relaxed); }
+    uint64_t droppedBatches() const { return dropped_batches.load(std::memory_order_relaxed); }
+    uint64_t sentBatches() const { return sent_batches.load(std::memory_order_relaxed); }
+    uint64_t sentBytes() const { return sent_bytes.load(std::memory_order_relaxed); }
+    size_t queuedBatches() const { return queued_batches.load(std::memory_order_relaxed); }
+
+private:
+    struct Pending {
+        uint64_t seq = 0;
+        std::string payload;
+        std::string spill_path;          // set when it came from disk
+    };
+    struct Spilled {
+        uint64_t seq = 0;
+        std::string path;
+        size_t bytes = 0;
+    };
+
+    std::vector<std::string> columns;
+    PushConfig config;
+    size_t capacity;
+    size_t rows_per_batch;
+    std::unique_ptr<int64_t[]> timestamps;
+    std::unique_ptr<double[]> rows;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+
+    // Sender thread only. Everything on disk is older than everything in
+    // memory, and in-flight batches are older than both.
+    uint64_t next_seq = 1;
+    std::deque<Spilled> spilled;
+    size_t spill_bytes = 0;
+    std::deque<Pending> outbox;
+    std::deque<Pending> in_flight;
+    MetricBatch batch;
+    int fd = -1;
+    std::chrono::steady_clock::time_point retry_at;
+    std::chrono::milliseconds backoff{0};
+    bool reported_down = false;
+    char ack_buffer[8];
+    size_t ack_used = 0;
+
+    std::atomic<uint64_t> dropped_rows{0};
+    std::atomic<uint64_t> dropped_batches{0};
+    std::atomic<uint64_t> sent_batches{0};
+    std::atomic<uint64_t> sent_bytes{0};
+    std::atomic<size_t> queued_batches{0};
+
+    std::atomic<bool> running{false};
+    std::thread thread;
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+
+    void senderLoop();
+    void drainRows();
+    void enqueue(Pending pending);
+    void spillOldest();
+    void loadSpilled();
+    bool nextPending(Pending& out);
+    void transmit();
+    bool connect();
+    void disconnect(const char* reason);
+    bool sendPayload(const std::string& payload);
+    bool readAcks(int timeout_ms);
+    bool acknowledge(uint64_t seq);
+    void updateQueued();
+};
@@ -0,0 +1,200 @@
+// Local receiver for the push exporter (push_exporter.h): accepts batches
+// over TCP and UDP on one port, acknowledges TCP frames and prints
+// throughput once a second. Meant for benchmarking on one machine and as a
+// reference for a real aggregator.
+//
+//   ./push_receiver [--port N] [--csv]
+
+#include "push_exporter.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+namespace {
+
+volatile sig_atomic_t stopping = 0;
+
+struct Totals {
+    uint64_t batches = 0;
+    uint64_t rows = 0;
+    uint64_t values = 0;
+    uint64_t bytes = 0;
+    uint64_t bad = 0;
+};
+
+int listenOn(int port, int type) {
+    int fd = socket(AF_INET6, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1, zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));  // v4-mapped too
+    if (type == SOCK_DGRAM) {
+        int bytes = 8 * 1024 * 1024;  // room for bursts of near-64K datagrams
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+    }
+    struct sockaddr_in6 addr = {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || (type == SOCK_STREAM && listen(fd, 1024) != 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Returns the seq to acknowledge, 0 for a batch that didn't decode
+uint64_t handleBatch(std::string_view payload, MetricBatch& batch, Totals& totals, bool csv) {
+    totals.bytes += payload.size();
+    if (!decodeMetricBatch(payload, batch)) {
+        totals.bad++;
+        return 0;
+    }
+    totals.batches++;
+    totals.rows += batch.timestamps.size();
+    totals.values += batch.values.size();
+    if (csv) {
+        size_t cols = batch.columns.size();
+        for (size_t r = 0; r < batch.timestamps.size(); r++) {
+            std::printf("%s,%lld", batch.source.c_str(), (long long)batch.timestamps[r]);
+            for (size_t c = 0; c < cols; c++) std::printf(",%.2f", batch.values[r * cols + c]);
+            std::printf("\n");
+        }
+    }
+    return batch.seq;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int port = 9109;
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--port N] [--csv]" << std::endl;
+            return 1;
+        }
+    }
+    signal(SIGINT, [](int) { stopping = 1; });
+    signal(SIGTERM, [](int) { stopping = 1; });
+    signal(SIGPIPE, SIG_IGN);
+
+    int tcp = listenOn(port, SOCK_STREAM);
+    int udp = listenOn(port, SOCK_DGRAM);
+    if (tcp < 0 || udp < 0) {
+        std::cerr << "Failed to listen on port " << port << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = tcp;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tcp, &ev);
+    ev.data.fd = udp;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, udp, &ev);
+    std::cerr << "Receiving on port " << port << " (tcp and udp)" << std::endl;
+
+    std::unordered_map<int, std::string> buffers;  // per TCP connection
+    std::vector<char> datagram(kMaxDatagramBytes + 1);
+    std::vector<char> chunk(256 * 1024);
+    MetricBatch batch;
+    Totals totals, reported;
+    auto last_report = std::chrono::steady_clock::now();
+
+    struct epoll_event events[64];
+    while (!stopping) {
+        int n = epoll_wait(epfd, events, 64, 200);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == tcp) {
+                int client;
+                while ((client = accept4(tcp, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    ev.events = EPOLLIN;
+                    ev.data.fd = client;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, client, &ev);
+                    buffers[client].clear();
+                }
+            } else if (fd == udp) {
+                ssize_t got;
+                while ((got = recv(udp, datagram.data(), datagram.size(), 0)) > 0) {
+                    handleBatch(std::string_view(datagram.data(), got), batch, totals, csv);
+                }
+            } else {
+                std::string& buffer = buffers[fd];
+                bool closed = false;
+                while (true) {
+                    ssize_t got = recv(fd, chunk.data(), chunk.size(), 0);
+                    if (got > 0) {
+                        buffer.append(chunk.data(), got);
+                        continue;
+                    }
+                    closed = got == 0 || (errno != EAGAIN && errno != EINTR);
+                    break;
+                }
+                // Whole frames only; each gets its ack in order
+                std::string acks;
+                size_t used = 0;
+                while (buffer.size() - used >= 4) {
+                    uint32_t length = 0;
+                    for (int b = 0; b < 4; b++) length |= uint32_t(uint8_t(buffer[used + b])) << (8 * b);
+                    if (length > kMaxBatchBytes) {
+                        closed = true;
+                        break;
+                    }
+                    if (buffer.size() - used - 4 < length) break;
+                    uint64_t seq = handleBatch(std::string_view(buffer.data() + used + 4, length), batch, totals, csv);
+                    for (int b = 0; b < 8; b++) acks += char(seq >> (8 * b));
+                    used += 4 + length;
+                }
+                buffer.erase(0, used);
+                if (!acks.empty() && send(fd, acks.data(), acks.size(), MSG_NOSIGNAL) != (ssize_t)acks.size()) {
+                    closed = true;  // acks are tiny; a full send buffer means a dead peer
+                }
+                if (closed) {
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+                    close(fd);
+                    buffers.erase(fd);
+                }
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_report).count();
+        if (elapsed >= 1.0) {
+            uint64_t rows = totals.rows - reported.rows;
+            uint64_t values = totals.values - reported.values;
+            uint64_t bytes = totals.bytes - reported.bytes;
+            if (rows > 0 || totals.bad != reported.bad) {
+                // Raw: a timestamp and a double per value, as in a segment record
+                double raw = rows * 8.0 + values * 8.0;
+                std::fprintf(stderr, "%8.0f batches/s %10.0f rows/s %10.0f values/s %8.2f MB/s  %6.1f B/row  %5.1fx  bad %llu\n",
+                             (totals.batches - reported.batches) / elapsed, rows / elapsed, values / elapsed,
+                             bytes / elapsed / 1e6, rows ? double(bytes) / rows : 0.0, bytes ? raw / bytes : 0.0,
+                             (unsigned long long)totals.bad);
+            }
+            reported = totals;
+            last_report = now;
+        }
+    }
+    std::fprintf(stderr, "total: %llu batches, %llu rows, %llu bytes, %llu bad\n", (unsigned long long)totals.batches,
+                 (unsigned long long)totals.rows, (unsigned long long)totals.bytes, (unsigned long long)totals.bad);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "sched_collector.h"
+#include <charconv>
+#include <utility>
+
+namespace {
+
+bool startsWith(std::string_view s, std::string_view prefix) {
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+}
+
+SchedCollector::SchedCollector(std::string path) : schedstat(std::move(path), 8192) {}
+
+void SchedCollector::collect(SchedStats& out) {
+    if (!schedstat.read()) {
+        out.available = false;
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_sec = std::chrono::duration<double>(now - prev_time).count();
+    prev_time = now;
+
+    for (auto& state : states) state.seen = false;
+    uint64_t delay_delta = 0, slice_delta = 0;
+    uint64_t delay_sum = 0, slice_sum = 0;
+    bool versioned = false;
+
+    ProcScanner ss(schedstat.contents());
+    do {
+        std::string_view key = ss.token();
+        if (key == "version") {
+            versioned = ss.u64() >= 15;  // older kernels count jiffies
+            continue;
+        }
+        if (!startsWith(key, "cpu") || key.size() == 3) {
+            continue;  // timestamp and domainN lines
+        }
+        size_t cpu = 0;
+        auto result = std::from_chars(key.data() + 3, key.data() + key.size(), cpu);
+        if (result.ec != std::errc() || cpu > 65535) {
+            continue;
+        }
+        ss.skip(7);
+        uint64_t run_delay = ss.u64();
+        uint64_t timeslices = ss.u64();
+        if (cpu >= states.size()) {
+            size_t n = cpu + 1;
+            states.resize(n);
+            out.cpu_run_delay_ns.resize(n);
+            out.cpu_timeslices.resize(n);
+            out.cpu_run_delay_ms_per_sec.resize(n);
+            out.cpu_timeslices_per_sec.resize(n);
+            out.cpu_avg_delay_us.resize(n);
+        }
+        State& state = states[cpu];
+        uint64_t d_delay = state.has_prev && run_delay >= state.run_delay_ns ? run_delay - state.run_delay_ns : 0;
+        uint64_t d_slices = state.has_prev && timeslices >= state.timeslices ? timeslices - state.timeslices : 0;
+        out.cpu_run_delay_ns[cpu] = run_delay;
+        out.cpu_timeslices[cpu] = timeslices;
+        out.cpu_run_delay_ms_per_sec[cpu] = elapsed_sec > 0.0 ? d_delay / 1e6 / elapsed_sec : 0.0;
+        out.cpu_timeslices_per_sec[cpu] = elapsed_sec > 0.0 ? d_slices / elapsed_sec : 0.0;
+        out.cpu_avg_delay_us[cpu] = d_slices ? d_delay / 1e3 / d_slices : 0.0;
+        delay_sum += run_delay;
+        slice_sum += timeslices;
+        delay_delta += d_delay;
+        slice_delta += d_slices;
+        state.run_delay_ns = run_delay;
+        state.timeslices = timeslices;
+        state.has_prev = state.seen = true;
+    } while (ss.nextLine());
+
+    if (!versioned) {
+        out.available = false;
+        return;
+    }
+    // Offline CPUs report zero rates and start over when they come back
+    for (size_t cpu = 0; cpu < states.size(); cpu++) {
+        if (states[cpu].seen) continue;
+        states[cpu].has_prev = false;
+        out.cpu_run_delay_ms_per_sec[cpu] = out.cpu_timeslices_per_sec[cpu] = out.cpu_avg_delay_us[cpu] = 0.0;
+    }
+    // After the first read the totals add up deltas, so they keep growing
+    // when a CPU goes offline
+    out.available = true;
+    out.run_delay_ns = has_totals ? out.run_delay_ns + delay_delta : delay_sum;
+    out.timeslices = has_totals ? out.timeslices + slice_delta : slice_sum;
+    out.run_delay_ms_per_sec = has_totals && elapsed_sec > 0.0 ? delay_delta / 1e6 / elapsed_sec : 0.0;
+    out.timeslices_per_sec = has_totals && elapsed_sec > 0.0 ? slice_delta / elapsed_sec : 0.0;
+    out.avg_delay_us = slice_delta ? delay_delta / 1e3 / slice_delta : 0.0;
+    has_totals = true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "proc_reader.h"
+#include "snapshot.h"
+
+// Per-CPU run-queue wait and timeslices from /proc/schedstat:
+//
+//   cpuN yld 0 schedule goidle ttwu ttwu_local run_ns wait_ns timeslices
+//
+// Only the last three columns are used (version 15 and later count them in
+// nanoseconds). Kernels without CONFIG_SCHEDSTATS have no such file and
+// leave the stats unavailable; /proc/[pid]/schedstat (CONFIG_SCHED_INFO)
+// is read by ProcessCollector.
+class SchedCollector {
+public:
+    explicit SchedCollector(std::string path = "/proc/schedstat");
+
+    // Sampler thread only
+    void collect(SchedStats& out);
+
+private:
+    struct State {
+        bool seen = false;
+        bool has_prev = false;
+        uint64_t run_delay_ns = 0;
+        uint64_t timeslices = 0;
+    };
+
+    ProcFile schedstat;
+    std::vector<State> states;  // by CPU id
+    bool has_totals = false;
+    std::chrono::steady_clock::time_point prev_time;
+};
@@ -0,0 +1,181 @@
+#include "scheduler.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+SampleScheduler::SampleScheduler() {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (isOpen()) {
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = timer_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+        ev.data.fd = stop_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &ev);
+    } else {
+        std::cerr << "Failed to create sampler timer: " << std::strerror(errno) << std::endl;
+    }
+}
+
+SampleScheduler::~SampleScheduler() {
+    if (timer_fd != -1) close(timer_fd);
+    if (stop_fd != -1) close(stop_fd);
+    if (epoll_fd != -1) close(epoll_fd);
+}
+
+size_t SampleScheduler::add(std::chrono::nanoseconds interval) {
+    if (interval <= std::chrono::nanoseconds::zero()) {
+        interval = std::chrono::milliseconds(1);
+    }
+    tasks.push_back(Task{interval, interval / 20, Clock::time_point()});
+    return tasks.size() - 1;
+}
+
+bool SampleScheduler::watch(int fd, uint32_t events) {
+    struct epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        std::cerr << "Failed to watch fd " << fd << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void SampleScheduler::stop() {
+    uint64_t one = 1;
+    ssize_t ignored = write(stop_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+std::chrono::nanoseconds SampleScheduler::period(const Task& task) const {
+    return inBurst() ? std::min(task.interval, burst_interval) : task.interval;
+}
+
+void SampleScheduler::beginBurst(std::chrono::nanoseconds interval) {
+    if (interval <= std::chrono::nanoseconds::zero()) {
+        interval = std::chrono::milliseconds(1);
+    }
+    burst_interval = interval;
+    // Everything is due right away; the burst grid starts from here
+    auto now = Clock::now();
+    for (auto& task : tasks) {
+        task.next = now;
+        task.slack = period(task) / 20;
+    }
+}
+
+void SampleScheduler::endBurst() {
+    burst_interval = std::chrono::nanoseconds(0);
+    auto now = Clock::now();
+    for (auto& task : tasks) {
+        task.next = now + task.interval;
+        task.slack = task.interval / 20;
+    }
+}
+
+bool SampleScheduler::wait(std::vector<size_t>& due, Clock::time_point& now) {
+    due.clear();
+    fired_fds.clear();
+    if (!isOpen() || tasks.empty()) {
+        return false;
+    }
+    if (!started) {
+        now = Clock::now();
+        for (size_t id = 0; id < tasks.size(); id++) {
+            tasks[id].next = now + period(tasks[id]);
+            due.push_back(id);
+        }
+        started = true;
+        // Still honour a stop() issued before the first wait
+        struct pollfd pfd{stop_fd, POLLIN, 0};
+        return poll(&pfd, 1, 0) <= 0;
+    }
+
+    for (;;) {
+        now = Clock::now();
+        auto earliest = Clock::time_point::max();
+        for (size_t id = 0; id < tasks.size(); id++) {
+            Task& task = tasks[id];
+            if (task.next - task.slack <= now) {
+                due.push_back(id);
+                // Next grid point after now; skipped ticks are not made up
+                auto every = period(task);
+                task.next += every;
+                if (task.next <= now) {
+                    task.next += ((now - task.next) / every + 1) * every;
+                }
+            } else {
+                earliest = std::min(earliest, task.next);
+            }
+        }
+        if (!due.empty()) {
+            return true;
+        }
+        Wake wake = sleepUntil(earliest);
+        if (wake == Wake::Stopped) {
+            return false;
+        }
+        if (wake == Wake::Event) {
+            now = Clock::now();
+            return true;
+        }
+    }
+}
+
+// Arms the timer for deadline and sleeps until it fires, a watched fd is
+// ready or stop() is called
+SampleScheduler::Wake SampleScheduler::sleepUntil(Clock::time_point deadline) {
+    auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    struct itimerspec spec;
+    std::memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = since_epoch / 1000000000;
+    spec.it_value.tv_nsec = since_epoch % 1000000000;
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1;  // all-zero would disarm
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+
+    struct epoll_event events[16];
+    for (;;) {
+        int n = epoll_wait(epoll_fd, events, 16, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Sampler wait failed: " << std::strerror(errno) << std::endl;
+            return Wake::Stopped;
+        }
+        bool timer = false;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == stop_fd) {
+                return Wake::Stopped;
+            } else if (fd == timer_fd) {
+                uint64_t expirations;
+                ssize_t ignored = read(timer_fd, &expirations, sizeof(expirations));
+                (void)ignored;
+                timer = true;
+            } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                // Would be reported on every wait from here on
+                std::cerr << "Dropping watched fd " << fd << " after an error" << std::endl;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            } else {
+                fired_fds.push_back(fd);
+            }
+        }
+        if (!fired_fds.empty()) {
+            return Wake::Event;
+        }
+        if (timer) {
+            return Wake::Timer;
+        }
+    }
+}
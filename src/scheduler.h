@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Drives periodic tasks with different intervals from one thread using a
+// single timerfd (CLOCK_MONOTONIC, absolute deadlines) in an epoll set that
+// can also hold event sources such as PSI triggers.
+//
+// Every task's deadlines sit on a grid anchored at the first wait(), so a
+// 100ms and a 5s task fall due at the same instant every 5s. Wakeups happen
+// at exact deadlines; a task within 5% of its interval of being due rides
+// along early rather than costing its own wakeup. Missed ticks are skipped,
+// never replayed.
+//
+// A burst temporarily caps every task's interval (e.g. 100ms while a PSI
+// trigger is firing); tasks are due immediately when it begins and resume
+// their normal grid when it ends.
+class SampleScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    SampleScheduler();
+    ~SampleScheduler();
+    SampleScheduler(const SampleScheduler&) = delete;
+    SampleScheduler& operator=(const SampleScheduler&) = delete;
+
+    bool isOpen() const { return timer_fd != -1 && stop_fd != -1 && epoll_fd != -1; }
+
+    // Returns the task id; call before the first wait()
+    size_t add(std::chrono::nanoseconds interval);
+
+    // Blocks until at least one task is due and fills due with every task id
+    // runnable in this wakeup; now is when they became due. All tasks are due
+    // on the first call. False once stop() has been called.
+    bool wait(std::vector<size_t>& due, Clock::time_point& now);
+
+    // Any thread
+    void stop();
+
+    // Adds an fd (e.g. a PSI trigger, which signals POLLPRI) to the wait set.
+    // wait() returns as soon as one is ready, possibly with nothing due.
+    bool watch(int fd, uint32_t events);
+    // Watched fds that were ready when the last wait() returned
+    const std::vector<int>& fired() const { return fired_fds; }
+
+    // Sampler thread, between waits
+    void beginBurst(std::chrono::nanoseconds interval);
+    void endBurst();
+    bool inBurst() const { return burst_interval.count() > 0; }
+
+private:
+    struct Task {
+        std::chrono::nanoseconds interval;
+        std::chrono::nanoseconds slack;
+        Clock::time_point next;
+    };
+
+    enum class Wake { Timer, Event, Stopped };
+
+    std::vector<Task> tasks;
+    int timer_fd = -1;
+    int stop_fd = -1;
+    int epoll_fd = -1;
+    bool started = false;
+    std::chrono::nanoseconds burst_interval{0};  // 0 = no burst
+    std::vector<int> fired_fds;
+
+    std::chrono::nanoseconds period(const Task& task) const;
+    Wake sleepUntil(Clock::time_point deadline);
+};
@@ -0,0 +1,226 @@
+#include "segment.h"
+#include <iostream>
+#include <algorithm>
+#include <new>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "record_count is shared through a mapping");
+
+namespace {
+
+size_t headerBytes(size_t column_count) {
+    size_t bytes = sizeof(SegmentHeader) + column_count * kSegmentColumnNameBytes;
+    return (bytes + kSegmentPageSize - 1) / kSegmentPageSize * kSegmentPageSize;
+}
+
+size_t recordBytes(size_t column_count) {
+    return sizeof(int64_t) + column_count * sizeof(double);
+}
+
+}
+
+SegmentWriter::SegmentWriter(std::vector<std::string> columns, const SegmentConfig& config)
+    : columns(std::move(columns)), config(config) {
+    if (this->config.records_per_segment == 0) {
+        this->config.records_per_segment = 1;
+    }
+}
+
+SegmentWriter::~SegmentWriter() {
+    close();
+}
+
+bool SegmentWriter::prepare() {
+    if (mkdir(config.dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Failed to create segment directory " << config.dir << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (stat(config.dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        std::cerr << "Segment directory " << config.dir << " is not a directory" << std::endl;
+        return false;
+    }
+    if (access(config.dir.c_str(), W_OK | X_OK) != 0) {
+        std::cerr << "Segment directory " << config.dir << " is not writable: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SegmentWriter::openSegment(int64_t first_timestamp_ms) {
+    path = config.dir + "/segment-" + std::to_string(first_timestamp_ms) + ".mpm";
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to create segment " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    size_t header_bytes = headerBytes(columns.size());
+    size_t record_bytes = recordBytes(columns.size());
+    map_bytes = header_bytes + config.records_per_segment * record_bytes;
+    // Real blocks, not a sparse file: stores into a hole the disk can't
+    // back raise SIGBUS. close() trims what wasn't used.
+    int error = posix_fallocate(fd, 0, map_bytes);
+    if (error != 0) {
+        std::cerr << "Failed to allocate segment " << path << ": " << std::strerror(error) << std::endl;
+        ::close(fd);
+        unlink(path.c_str());
+        fd = -1;
+        return false;
+    }
+    void* mapping = mmap(nullptr, map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map segment " << path << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    map = static_cast<char*>(mapping);
+
+    header = new (map) SegmentHeader;
+    std::memcpy(header->magic, kSegmentMagic, sizeof(kSegmentMagic));
+    header->version = kSegmentVersion;
+    header->column_count = columns.size();
+    header->header_bytes = header_bytes;
+    header->record_bytes = record_bytes;
+    header->capacity = config.records_per_segment;
+    header->record_count.store(0, std::memory_order_relaxed);
+
+    char* names = map + sizeof(SegmentHeader);
+    for (size_t i = 0; i < columns.size(); i++) {
+        std::strncpy(names + i * kSegmentColumnNameBytes, columns[i].c_str(), kSegmentColumnNameBytes - 1);
+    }
+    return true;
+}
+
+bool SegmentWriter::append(int64_t timestamp_ms, const double* values) {
+    if (header && header->record_count.load(std::memory_order_relaxed) >= header->capacity) {
+        close();
+    }
+    // Readers binary-search the timestamps, so a wall clock stepped back
+    // (NTP) holds at the last one written until it catches up
+    timestamp_ms = std::max(timestamp_ms, last_timestamp_ms);
+    if (!header && !openSegment(timestamp_ms)) {
+        return false;
+    }
+    last_timestamp_ms = timestamp_ms;
+
+    uint64_t index = header->record_count.load(std::memory_order_relaxed);
+    char* record = map + header->header_bytes + index * header->record_bytes;
+    std::memcpy(record, &timestamp_ms, sizeof(timestamp_ms));
+    std::memcpy(record + sizeof(timestamp_ms), values, columns.size() * sizeof(double));
+    header->record_count.store(index + 1, std::memory_order_release);
+    return true;
+}
+
+void SegmentWriter::close() {
+    if (!map) {
+        return;
+    }
+    size_t used = header->header_bytes + header->record_count.load(std::memory_order_relaxed) * header->record_bytes;
+    msync(map, map_bytes, MS_SYNC);
+    munmap(map, map_bytes);
+    map = nullptr;
+    header = nullptr;
+    if (ftruncate(fd, used) != 0) {
+        std::cerr << "Failed to trim segment " << path << std::endl;
+    }
+    ::close(fd);
+    fd = -1;
+}
+
+SegmentReader::~SegmentReader() {
+    if (map) {
+        munmap(const_cast<char*>(map), map_bytes);
+    }
+}
+
+bool SegmentReader::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Failed to open segment " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SegmentHeader)) {
+        std::cerr << "Not a segment file: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    map_bytes = st.st_size;
+    void* mapping = mmap(nullptr, map_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map segment " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    map = static_cast<const char*>(mapping);
+    madvise(mapping, map_bytes, MADV_SEQUENTIAL);
+
+    auto* header = reinterpret_cast<const SegmentHeader*>(map);
+    if (std::memcmp(header->magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 ||
+        header->version != kSegmentVersion ||
+        header->header_bytes != headerBytes(header->column_count) ||
+        header->record_bytes != recordBytes(header->column_count) ||
+        header->header_bytes > map_bytes) {
+        std::cerr << "Not a segment file (or unsupported version): " << path << std::endl;
+        return false;
+    }
+    column_count = header->column_count;
+    header_bytes = header->header_bytes;
+    record_bytes = header->record_bytes;
+
+    // A segment still being written may be mapped mid-append; the count is
+    // only trusted as far as the file actually reaches
+    size_t committed = header->record_count.load(std::memory_order_acquire);
+    records = std::min(committed, (map_bytes - header_bytes) / record_bytes);
+    return true;
+}
+
+std::string_view SegmentReader::columnName(size_t column) const {
+    const char* name = map + sizeof(SegmentHeader) + column * kSegmentColumnNameBytes;
+    return std::string_view(name, strnlen(name, kSegmentColumnNameBytes));
+}
+
+int SegmentReader::columnIndex(std::string_view name) const {
+    for (size_t i = 0; i < column_count; i++) {
+        if (columnName(i) == name) return (int)i;
+    }
+    return -1;
+}
+
+int64_t SegmentReader::timestamp(size_t index) const {
+    int64_t ts;
+    std::memcpy(&ts, recordAt(index), sizeof(ts));
+    return ts;
+}
+
+double SegmentReader::value(size_t index, size_t column) const {
+    double v;
+    std::memcpy(&v, recordAt(index) + sizeof(int64_t) + column * sizeof(double), sizeof(v));
+    return v;
+}
+
+const double* SegmentReader::row(size_t index) const {
+    return reinterpret_cast<const double*>(recordAt(index) + sizeof(int64_t));
+}
+
+size_t SegmentReader::lowerBound(int64_t timestamp_ms) const {
+    size_t first = 0;
+    size_t last = records;
+    while (first < last) {
+        size_t mid = first + (last - first) / 2;
+        if (timestamp(mid) < timestamp_ms) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
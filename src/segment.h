@@ -0,0 +1,108 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+// On-disk segment of fixed-size sample records, for long retention.
+//
+//   [SegmentHeader][column names, 32 bytes each] ... padded to kSegmentPageSize
+//   [record 0][record 1]...   record = int64 timestamp_ms + double per column
+//
+// Fixed records keep the format trivially seekable: record i lives at
+// header_bytes + i * record_bytes, so a reader can mmap the file, binary
+// search on timestamp and walk a range without decoding anything. A day of
+// 1s samples for the 13 host metrics is ~9.5 MiB.
+//
+// record_count is bumped only after a record is fully written, so a reader
+// (or a crash) never sees a torn record.
+
+const char kSegmentMagic[8] = {'M', 'P', 'M', 'S', 'E', 'G', '1', '\0'};
+const uint32_t kSegmentVersion = 1;
+const size_t kSegmentColumnNameBytes = 32;
+const size_t kSegmentPageSize = 4096;
+
+struct SegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t column_count;
+    uint32_t header_bytes;              // offset of record 0
+    uint32_t record_bytes;
+    uint64_t capacity;                  // records the file was sized for
+    std::atomic<uint64_t> record_count; // committed records
+};
+
+struct SegmentConfig {
+    std::string dir = "segments";
+    size_t records_per_segment = 86400;  // a day at 1s, then roll to a new file
+};
+
+// Appends records into a memory-mapped, pre-sized file. append() is a
+// memcpy plus one atomic store - no syscalls except when a segment fills
+// and the next one is created. Segments are allocated in full when created,
+// so a full disk fails that open rather than SIGBUS-ing a later store.
+// Timestamps never go backwards within a writer, even if the wall clock does.
+class SegmentWriter {
+public:
+    SegmentWriter(std::vector<std::string> columns, const SegmentConfig& config);
+    ~SegmentWriter();
+
+    // Creates the directory if it's missing and checks it's writable
+    bool prepare();
+
+    // Sampler thread only; values holds one entry per column
+    bool append(int64_t timestamp_ms, const double* values);
+    // Syncs and trims the current segment to its used size
+    void close();
+
+    const std::string& currentPath() const { return path; }
+
+private:
+    std::vector<std::string> columns;
+    SegmentConfig config;
+    std::string path;
+    int fd = -1;
+    char* map = nullptr;
+    size_t map_bytes = 0;
+    SegmentHeader* header = nullptr;
+    int64_t last_timestamp_ms = std::numeric_limits<int64_t>::min();
+
+    bool openSegment(int64_t first_timestamp_ms);
+};
+
+// Read-only view of a segment. Nothing is copied onto the heap; accessors
+// read straight from the mapping, so ranges are scanned at memory speed.
+class SegmentReader {
+public:
+    SegmentReader() = default;
+    ~SegmentReader();
+    SegmentReader(const SegmentReader&) = delete;
+    SegmentReader& operator=(const SegmentReader&) = delete;
+
+    bool open(const std::string& path);
+
+    size_t size() const { return records; }
+    size_t columnCount() const { return column_count; }
+    std::string_view columnName(size_t column) const;
+    // Index of a column by name, or -1
+    int columnIndex(std::string_view name) const;
+
+    int64_t timestamp(size_t index) const;
+    double value(size_t index, size_t column) const;
+    const double* row(size_t index) const;
+    // First record with timestamp >= timestamp_ms
+    size_t lowerBound(int64_t timestamp_ms) const;
+
+private:
+    const char* map = nullptr;
+    size_t map_bytes = 0;
+    size_t records = 0;
+    size_t column_count = 0;
+    size_t header_bytes = 0;
+    size_t record_bytes = 0;
+
+    const char* recordAt(size_t index) const { return map + header_bytes + index * record_bytes; }
+};
@@ -0,0 +1,598 @@
+#include "shm_channel.h"
+#include "proc_reader.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+const auto kRescanInterval = std::chrono::seconds(10);
+const auto kReadyTimeout = std::chrono::seconds(5);
+
+size_t alignUp(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+// Copies a fixed-size, possibly unterminated name field
+void assignField(std::string& out, const char* field, size_t bytes) {
+    out.assign(field, strnlen(field, bytes));
+}
+
+void copyField(char* field, size_t bytes, const std::string& value) {
+    size_t n = std::min(value.size(), bytes - 1);
+    std::memcpy(field, value.data(), n);
+    field[n] = '\0';
+}
+
+// Placeholders handed out when a publisher is full or closed
+std::atomic<uint64_t> dummy_value{0};
+ShmHistogramData dummy_histogram{};
+
+// Filesystem uid of a process, which owns the files it creates
+bool processFsUid(int pid, uid_t& uid) {
+    ProcFile status("/proc/" + std::to_string(pid) + "/status");
+    if (!status.read()) {
+        return false;
+    }
+    ProcScanner ss(status.contents());
+    do {
+        if (ss.token() == "Uid:") {
+            ss.skip(3);  // real, effective, saved
+            uid = ss.u64();
+            return true;
+        }
+    } while (ss.nextLine());
+    return false;
+}
+
+// Guard for reads of writer-owned mappings: a writer can shrink its file at
+// any moment, and touching a page past the new end raises SIGBUS. A fault
+// on a thread inside a guarded read jumps back to it; any other SIGBUS gets
+// the previous disposition.
+thread_local sigjmp_buf* bus_guard = nullptr;
+struct sigaction previous_bus_action;
+
+void onBusError(int signum, siginfo_t* info, void*) {
+    if (bus_guard) {
+        siglongjmp(*bus_guard, 1);
+    }
+    // Not ours: a fault repeats under the old disposition when we return,
+    // one sent with kill() has to be raised again
+    sigaction(SIGBUS, &previous_bus_action, nullptr);
+    if (info->si_code <= 0) {
+        raise(signum);
+    }
+}
+
+void installBusGuard() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_sigaction = onBusError;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGBUS, &action, &previous_bus_action);
+    });
+}
+
+// What attach() needs from a header, copied out of the mapping
+struct HeaderCopy {
+    uint32_t ready;
+    bool known;  // magic and version match
+    uint32_t slot_offset, slot_capacity, histogram_offset, histogram_capacity;
+    int32_t pid;
+    uint64_t start_time;
+    char service[kShmServiceBytes];
+};
+
+// False if the mapping faulted
+bool copyHeader(const ShmHeader& header, HeaderCopy& out) {
+    sigjmp_buf jump;
+    if (sigsetjmp(jump, 1) != 0) {
+        bus_guard = nullptr;
+        return false;
+    }
+    bus_guard = &jump;
+    out.ready = header.ready.load(std::memory_order_acquire);
+    out.known = std::memcmp(header.magic, kShmMagic, sizeof(kShmMagic)) == 0 && header.version == kShmVersion;
+    out.slot_offset = header.slot_offset;
+    out.slot_capacity = header.slot_capacity;
+    out.histogram_offset = header.histogram_offset;
+    out.histogram_capacity = header.histogram_capacity;
+    out.pid = header.pid;
+    out.start_time = header.start_time;
+    std::memcpy(out.service, header.service, sizeof(out.service));
+    bus_guard = nullptr;
+    return true;
+}
+
+int pidfdOpen(int pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+}
+
+uint64_t processStartTime(int pid) {
+    std::string path = "/proc/" + std::to_string(pid) + "/stat";
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    char buf[1024];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    ::close(fd);
+    if (n <= 0) {
+        return 0;
+    }
+    // comm can hold spaces and parens; fields restart after the last ')'
+    std::string_view text(buf, n);
+    size_t paren = text.rfind(')');
+    if (paren == std::string_view::npos) {
+        return 0;
+    }
+    ProcScanner ss(text.substr(paren + 1));
+    ss.skip(19);  // state .. itrealvalue (fields 3-21)
+    return ss.u64();
+}
+
+void ShmGauge::set(double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    value->store(bits, std::memory_order_relaxed);
+}
+
+void ShmHistogram::record(uint64_t value) {
+    data->buckets[histogramBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    data->sum.fetch_add(value, std::memory_order_relaxed);
+    instrument_detail::raiseTo(data->max, value);
+}
+
+ShmPublisher::~ShmPublisher() {
+    close();
+    if (base) {
+        munmap(base, size);
+    }
+}
+
+bool ShmPublisher::open(const std::string& service, uint32_t slots, uint32_t histograms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+        std::cerr << "Shared memory " << shm_name << " was closed; not reopening" << std::endl;
+        return false;
+    }
+    if (header) {
+        return true;
+    }
+    int pid = getpid();
+    // Region names can't hold '/'
+    std::string safe_service = service;
+    std::replace(safe_service.begin(), safe_service.end(), '/', '_');
+    shm_name = "/" + std::string(kShmPrefix) + safe_service + "." + std::to_string(pid);
+
+    size_t slot_offset = alignUp(sizeof(ShmHeader), 64);
+    size_t histogram_offset = alignUp(slot_offset + slots * sizeof(ShmSlot), 64);
+    size = histogram_offset + histograms * sizeof(ShmHistogramData);
+
+    shm_unlink(shm_name.c_str());  // leftover from an earlier process with this PID
+    int fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to create shared memory " << shm_name << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, size) != 0) {
+        std::cerr << "Failed to size shared memory " << shm_name << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        shm_unlink(shm_name.c_str());
+        return false;
+    }
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory " << shm_name << ": " << std::strerror(errno) << std::endl;
+        base = nullptr;
+        shm_unlink(shm_name.c_str());
+        return false;
+    }
+
+    // Fresh pages are zero, so every counter and bucket already starts at 0
+    header = static_cast<ShmHeader*>(base);
+    header->version = kShmVersion;
+    header->slot_offset = slot_offset;
+    header->slot_capacity = slots;
+    header->histogram_offset = histogram_offset;
+    header->histogram_capacity = histograms;
+    header->pid = pid;
+    header->start_time = processStartTime(pid);
+    copyField(header->service, kShmServiceBytes, service);
+    std::memcpy(header->magic, kShmMagic, sizeof(kShmMagic));
+    header->ready.store(1, std::memory_order_release);
+    histogram_count = 0;
+    return true;
+}
+
+void ShmPublisher::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!header || closed) {
+        return;
+    }
+    shm_unlink(shm_name.c_str());
+    closed = true;
+}
+
+ShmSlot* ShmPublisher::registerSlot(const std::string& name, ShmKind kind) {
+    if (!header || closed) {
+        return nullptr;
+    }
+    auto* slots = reinterpret_cast<ShmSlot*>(static_cast<char*>(base) + header->slot_offset);
+    uint32_t count = header->slot_count.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < count; i++) {
+        if (slots[i].kind == (uint32_t)kind && strncmp(slots[i].name, name.c_str(), kShmNameBytes) == 0) {
+            return &slots[i];
+        }
+    }
+    if (count == header->slot_capacity ||
+        (kind == ShmKind::Histogram && histogram_count == header->histogram_capacity)) {
+        std::cerr << "Shared memory metrics full; not publishing " << name << std::endl;
+        return nullptr;
+    }
+    ShmSlot& slot = slots[count];
+    copyField(slot.name, kShmNameBytes, name);
+    slot.kind = (uint32_t)kind;
+    slot.histogram = kind == ShmKind::Histogram ? histogram_count++ : 0;
+    // The monitor only looks at slots below slot_count
+    header->slot_count.store(count + 1, std::memory_order_release);
+    return &slot;
+}
+
+ShmCounter ShmPublisher::counter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ShmSlot* slot = registerSlot(name, ShmKind::Counter);
+    return ShmCounter(slot ? &slot->value : &dummy_value);
+}
+
+ShmGauge ShmPublisher::gauge(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ShmSlot* slot = registerSlot(name, ShmKind::Gauge);
+    return ShmGauge(slot ? &slot->value : &dummy_value);
+}
+
+ShmHistogram ShmPublisher::histogram(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ShmSlot* slot = registerSlot(name, ShmKind::Histogram);
+    if (!slot) {
+        return ShmHistogram(&dummy_histogram);
+    }
+    auto* histograms = reinterpret_cast<ShmHistogramData*>(static_cast<char*>(base) + header->histogram_offset);
+    return ShmHistogram(&histograms[slot->histogram]);
+}
+
+ShmCollector::~ShmCollector() {
+    for (auto& region : regions) {
+        detach(region, false);
+    }
+    if (inotify_fd != -1) {
+        close(inotify_fd);
+    }
+}
+
+void ShmCollector::scanDir() {
+    last_scan = std::chrono::steady_clock::now();
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    while (struct dirent* entry = readdir(d)) {
+        consider(entry->d_name);
+    }
+    closedir(d);
+}
+
+// A name in the directory: attach now if it's ready, else remember it
+void ShmCollector::consider(const std::string& file) {
+    if (file.compare(0, sizeof(kShmPrefix) - 1, kShmPrefix) != 0 || ignored.count(file)) {
+        return;
+    }
+    for (const auto& region : regions) {
+        if (region.file == file) return;
+    }
+    for (const auto& entry : pending) {
+        if (entry.file == file) return;
+    }
+    if (attach(file) == 0) {
+        pending.push_back(Pending{file, std::chrono::steady_clock::now()});
+    }
+}
+
+void ShmCollector::forget(const std::string& file) {
+    ignored.erase(file);
+    pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                 [&file](const Pending& entry) { return entry.file == file; }),
+                  pending.end());
+    for (auto& region : regions) {
+        if (region.file == file) {
+            region.dead = true;  // the writer closed it; nothing to unlink
+        }
+    }
+}
+
+int ShmCollector::attach(const std::string& file) {
+    std::string path = dir + "/" + file;
+    // No following links out of the directory, no blocking on a FIFO
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        std::cerr << "Ignoring " << path << ": not a regular file writable only by its owner" << std::endl;
+        close(fd);
+        ignored.insert(file);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(ShmHeader)) {
+        close(fd);
+        return 0;  // not sized yet
+    }
+    size_t size = st.st_size;
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    const auto* header = static_cast<const ShmHeader*>(base);
+    HeaderCopy copy;
+    if (!copyHeader(*header, copy)) {
+        std::cerr << "Ignoring " << path << ": shrank while being attached" << std::endl;
+        munmap(base, size);
+        ignored.insert(file);
+        return -1;
+    }
+    if (copy.ready == 0) {
+        munmap(base, size);
+        return 0;
+    }
+
+    Region region;
+    region.file = file;
+    region.base = base;
+    region.size = size;
+    region.header = header;
+    region.slot_offset = copy.slot_offset;
+    region.slot_capacity = copy.slot_capacity;
+    region.histogram_offset = copy.histogram_offset;
+    region.histogram_capacity = copy.histogram_capacity;
+    region.pid = copy.pid;
+    assignField(region.service, copy.service, kShmServiceBytes);
+    uint64_t start_time = copy.start_time;
+
+    // Slots, then histograms, both inside the file and aligned for their atomics
+    uint64_t slots_end = region.slot_offset + (uint64_t)region.slot_capacity * sizeof(ShmSlot);
+    uint64_t histograms_end = region.histogram_offset + (uint64_t)region.histogram_capacity * sizeof(ShmHistogramData);
+    bool layout_ok = region.slot_offset >= sizeof(ShmHeader) && region.slot_offset % alignof(ShmSlot) == 0 &&
+                     region.histogram_offset % alignof(ShmHistogramData) == 0 &&
+                     slots_end <= region.histogram_offset && histograms_end <= size;
+    if (!copy.known || !layout_ok) {
+        std::cerr << "Ignoring " << path << ": not a metrics region this monitor understands" << std::endl;
+        detach(region, false);
+        ignored.insert(file);
+        return -1;
+    }
+
+    // A writer that's gone, or whose PID now belongs to someone else, left
+    // this behind
+    region.pidfd = pidfdOpen(region.pid);
+    bool alive = region.pidfd >= 0 || (errno != ESRCH && kill(region.pid, 0) == 0);
+    if (alive && start_time != 0 && processStartTime(region.pid) != start_time) {
+        alive = false;
+    }
+    if (!alive) {
+        detach(region, true);
+        return -1;
+    }
+    // Anyone can name someone else's PID in a header
+    uid_t writer_uid;
+    if (!processFsUid(region.pid, writer_uid) || writer_uid != st.st_uid) {
+        std::cerr << "Ignoring " << path << ": not owned by its writer " << region.pid << std::endl;
+        detach(region, false);
+        ignored.insert(file);
+        return -1;
+    }
+    regions.push_back(std::move(region));
+    return 1;
+}
+
+// One poll() over every writer's pidfd: a pidfd turns readable when its
+// process exits
+void ShmCollector::checkLiveness() {
+    std::vector<struct pollfd> fds;
+    fds.reserve(regions.size());
+    for (auto& region : regions) {
+        if (region.dead) continue;
+        if (region.pidfd >= 0) {
+            fds.push_back({region.pidfd, POLLIN, 0});
+        } else if (kill(region.pid, 0) != 0 && errno == ESRCH) {
+            region.dead = true;
+        }
+    }
+    if (fds.empty() || poll(fds.data(), fds.size(), 0) <= 0) {
+        return;
+    }
+    for (const auto& pfd : fds) {
+        if (!pfd.revents) continue;
+        for (auto& region : regions) {
+            if (region.pidfd == pfd.fd) region.dead = true;
+        }
+    }
+}
+
+void ShmCollector::detach(Region& region, bool unlink_file) {
+    if (unlink_file) {
+        std::cerr << "Writer " << region.pid << " of " << region.file
+                  << " is gone; dropping its metrics" << std::endl;
+        shm_unlink(("/" + region.file).c_str());
+    }
+    if (region.base) munmap(const_cast<void*>(region.base), region.size);
+    if (region.pidfd >= 0) close(region.pidfd);
+    region.base = nullptr;
+    region.header = nullptr;
+    region.pidfd = -1;
+}
+
+void ShmCollector::collect(std::vector<CustomMetric>& out) {
+    auto now = std::chrono::steady_clock::now();
+    if (!initialized) {
+        initialized = true;
+        installBusGuard();
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd != -1 && inotify_add_watch(inotify_fd, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_DELETE) < 0) {
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+        scanDir();
+    } else if (now - last_scan >= kRescanInterval) {
+        scanDir();
+    }
+
+    if (inotify_fd != -1) {
+        alignas(struct inotify_event) char buf[4096];
+        ssize_t n;
+        while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+            for (char* p = buf; p < buf + n;) {
+                const auto* event = reinterpret_cast<const struct inotify_event*>(p);
+                p += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    scanDir();
+                } else if (event->len == 0) {
+                    continue;
+                } else if (event->mask & IN_DELETE) {
+                    forget(event->name);
+                } else {
+                    consider(event->name);
+                }
+            }
+        }
+    }
+
+    // Regions created just before a sample get their header a moment later
+    for (size_t i = 0; i < pending.size();) {
+        int result = attach(pending[i].file);
+        if (result == 0 && now - pending[i].since > kReadyTimeout) {
+            ignored.insert(pending[i].file);
+            result = -1;
+        }
+        if (result != 0) {
+            pending.erase(pending.begin() + i);
+        } else {
+            i++;
+        }
+    }
+
+    checkLiveness();
+    for (auto& region : regions) {
+        if (region.dead) {
+            // Still mapped means nobody unlinked it: the writer crashed
+            bool crashed = access((dir + "/" + region.file).c_str(), F_OK) == 0;
+            detach(region, crashed);
+        }
+    }
+    regions.erase(std::remove_if(regions.begin(), regions.end(), [](const Region& r) { return r.dead; }),
+                  regions.end());
+
+    // Everything below reads the mappings only - no syscalls
+    size_t count = 0;
+    for (auto& region : regions) {
+        if (!readRegion(region, out, count)) {
+            std::cerr << "Writer " << region.pid << " shrank " << region.file << "; dropping its metrics" << std::endl;
+            detach(region, false);
+            ignored.insert(region.file);
+            region.dead = true;
+        }
+    }
+    regions.erase(std::remove_if(regions.begin(), regions.end(), [](const Region& r) { return r.dead; }),
+                  regions.end());
+    out.resize(count);
+}
+
+// Appends one region's metrics to out[count...]. False if the mapping
+// faulted, with the region's partial rows dropped. Between sigsetjmp and
+// the end only plain loads touch the mapping, and nothing that owns memory
+// is left half-built by the jump.
+bool ShmCollector::readRegion(const Region& region, std::vector<CustomMetric>& out, size_t& count) {
+    size_t start = count;
+    sigjmp_buf jump;
+    if (sigsetjmp(jump, 1) != 0) {
+        bus_guard = nullptr;
+        count = start;
+        return false;
+    }
+    bus_guard = &jump;
+
+    const auto* base = static_cast<const char*>(region.base);
+    const auto* slots = reinterpret_cast<const ShmSlot*>(base + region.slot_offset);
+    const auto* histograms = reinterpret_cast<const ShmHistogramData*>(base + region.histogram_offset);
+    uint32_t slot_count = std::min(region.header->slot_count.load(std::memory_order_acquire), region.slot_capacity);
+    merged.counts.resize(kHistogramBuckets);
+
+    for (uint32_t i = 0; i < slot_count; i++) {
+        const ShmSlot& slot = slots[i];
+        char name[kShmNameBytes];
+        std::memcpy(name, slot.name, sizeof(name));
+        uint32_t kind = slot.kind;
+        uint32_t histogram = slot.histogram;
+        uint64_t bits = slot.value.load(std::memory_order_relaxed);
+
+        if (count == out.size()) out.emplace_back();
+        CustomMetric& metric = out[count++];
+        metric.service = region.service;
+        metric.pid = region.pid;
+        assignField(metric.name, name, kShmNameBytes);
+        metric.count = 0;
+        metric.mean = metric.p50 = metric.p90 = metric.p99 = metric.p999 = metric.max = 0.0;
+
+        if (kind == (uint32_t)ShmKind::Gauge) {
+            metric.kind = 'g';
+            std::memcpy(&metric.value, &bits, sizeof(bits));
+        } else if (kind == (uint32_t)ShmKind::Histogram && histogram < region.histogram_capacity) {
+            metric.kind = 'h';
+            const ShmHistogramData& data = histograms[histogram];
+            merged.count = 0;
+            for (size_t b = 0; b < kHistogramBuckets; b++) {
+                merged.counts[b] = data.buckets[b].load(std::memory_order_relaxed);
+                merged.count += merged.counts[b];
+            }
+            merged.sum = data.sum.load(std::memory_order_relaxed);
+            merged.max = data.max.load(std::memory_order_relaxed);
+            metric.value = merged.count;
+            metric.count = merged.count;
+            metric.mean = merged.count ? (double)merged.sum / merged.count : 0.0;
+            metric.p50 = merged.quantile(0.5);
+            metric.p90 = merged.quantile(0.9);
+            metric.p99 = merged.quantile(0.99);
+            metric.p999 = merged.quantile(0.999);
+            metric.max = merged.max;
+        } else {
+            metric.kind = 'c';
+            metric.value = bits;
+        }
+    }
+    bus_guard = nullptr;
+    return true;
+}
@@ -0,0 +1,191 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include "instrument.h"
+#include "snapshot.h"
+
+// Shared-memory metrics channel between instrumented processes and the
+// monitor.
+//
+// A client creates one POSIX shared memory object, /dev/shm/mpm.<service>.<pid>,
+// holding a header, a table of fixed metric slots and an area of histograms.
+// Registering a metric writes its slot and then publishes it by bumping
+// slot_count with release ordering. After that, updates are atomic ops on
+// the mapping and never make a syscall. The monitor maps every region
+// read-only and reads the values in place at sample time.
+//
+// A crashed client leaves its object behind. The monitor notices the dead
+// PID through a pidfd (start time checked, so PID reuse is caught), drops
+// the region and unlinks it.
+//
+// Any local user can put a file in /dev/shm, so the monitor only attaches
+// regular files owned by the writer they name and writable by nobody else,
+// checks every offset in the header against the file size and copies the
+// layout out of the header once at attach. The writer can still shrink its
+// file at any time, so every read of a mapping runs under a SIGBUS guard
+// and a region that faults is dropped.
+
+const char kShmMagic[8] = "MPMSHM1";
+const uint32_t kShmVersion = 1;
+const char kShmPrefix[] = "mpm.";
+const size_t kShmNameBytes = 48;
+const size_t kShmServiceBytes = 64;
+
+enum class ShmKind : uint32_t { Counter = 1, Gauge = 2, Histogram = 3 };
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory atomics must be lock-free");
+
+struct ShmHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_offset;            // bytes from the start of the region
+    uint32_t slot_capacity;
+    uint32_t histogram_offset;
+    uint32_t histogram_capacity;
+    int32_t pid;
+    uint64_t start_time;             // /proc/<pid>/stat starttime of the writer
+    char service[kShmServiceBytes];
+    std::atomic<uint32_t> slot_count;  // slots [0, slot_count) are complete
+    std::atomic<uint32_t> ready;       // set last when the region is created
+};
+
+struct alignas(64) ShmSlot {
+    char name[kShmNameBytes];
+    uint32_t kind;                   // ShmKind
+    uint32_t histogram;              // index into the histogram area
+    std::atomic<uint64_t> value;     // counter total, or a gauge's double bits
+};
+
+// Same log-linear buckets as LatencyHistogram (instrument.h)
+struct alignas(64) ShmHistogramData {
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[kHistogramBuckets];
+};
+
+// Handles into a client's mapping. Safe to share between the client's
+// threads; a handle from a full, failed or closed publisher updates a
+// dummy. Handles stay valid until their publisher is destroyed.
+class ShmCounter {
+public:
+    explicit ShmCounter(std::atomic<uint64_t>* value) : value(value) {}
+    void add(uint64_t n = 1) { value->fetch_add(n, std::memory_order_relaxed); }
+    // Single-writer counters can skip the locked add
+    void set(uint64_t total) { value->store(total, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t>* value;
+};
+
+class ShmGauge {
+public:
+    explicit ShmGauge(std::atomic<uint64_t>* value) : value(value) {}
+    void set(double v);
+
+private:
+    std::atomic<uint64_t>* value;
+};
+
+class ShmHistogram {
+public:
+    explicit ShmHistogram(ShmHistogramData* data) : data(data) {}
+    // Any unit; by convention nanoseconds for latencies
+    void record(uint64_t value);
+
+private:
+    ShmHistogramData* data;
+};
+
+// Client side: one per process
+class ShmPublisher {
+public:
+    ShmPublisher() = default;
+    ~ShmPublisher();
+    ShmPublisher(const ShmPublisher&) = delete;
+    ShmPublisher& operator=(const ShmPublisher&) = delete;
+
+    bool open(const std::string& service, uint32_t slots = 256, uint32_t histograms = 16);
+    // Unlinks the region so the monitor drops it. The mapping stays until
+    // the publisher is destroyed, since handles point into it; a closed
+    // publisher can't be opened again.
+    void close();
+    bool isOpen() const { return header != nullptr && !closed; }
+
+    // Registering a name again returns the same metric
+    ShmCounter counter(const std::string& name);
+    ShmGauge gauge(const std::string& name);
+    ShmHistogram histogram(const std::string& name);
+
+private:
+    std::mutex mutex;
+    std::string shm_name;
+    void* base = nullptr;
+    size_t size = 0;
+    ShmHeader* header = nullptr;
+    bool closed = false;
+    uint32_t histogram_count = 0;
+
+    ShmSlot* registerSlot(const std::string& name, ShmKind kind);
+};
+
+// Monitor side: finds regions in /dev/shm (inotify, plus a periodic rescan)
+// and turns them into CustomMetric rows
+class ShmCollector {
+public:
+    explicit ShmCollector(std::string dir = "/dev/shm") : dir(std::move(dir)) {}
+    ~ShmCollector();
+    ShmCollector(const ShmCollector&) = delete;
+    ShmCollector& operator=(const ShmCollector&) = delete;
+
+    // Sampler thread only
+    void collect(std::vector<CustomMetric>& out);
+
+private:
+    struct Region {
+        std::string file;
+        const void* base = nullptr;
+        size_t size = 0;
+        const ShmHeader* header = nullptr;
+        // Layout copied from the header when it was validated; the writer
+        // could change the header afterwards
+        uint32_t slot_offset = 0;
+        uint32_t slot_capacity = 0;
+        uint32_t histogram_offset = 0;
+        uint32_t histogram_capacity = 0;
+        int pid = 0;
+        std::string service;
+        int pidfd = -1;              // -1: fall back to kill(pid, 0)
+        bool dead = false;
+    };
+
+    std::string dir;
+    bool initialized = false;
+    int inotify_fd = -1;
+    std::chrono::steady_clock::time_point last_scan;
+    struct Pending {
+        std::string file;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    std::vector<Region> regions;
+    std::vector<Pending> pending;         // created but not marked ready yet
+    std::unordered_set<std::string> ignored;  // never became valid; skipped until deleted
+    HistogramSnapshot merged;
+
+    void scanDir();
+    void consider(const std::string& file);
+    void forget(const std::string& file);
+    int attach(const std::string& file);  // 1 attached, 0 not ready, -1 drop
+    void checkLiveness();
+    void detach(Region& region, bool unlink_file);
+    bool readRegion(const Region& region, std::vector<CustomMetric>& out, size_t& count);
+};
+
+// starttime field of /proc/<pid>/stat, 0 if unreadable
+uint64_t processStartTime(int pid);
@@ -0,0 +1,336 @@
+#include "sketch.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Magnitudes below this count as zero (log bins can't reach 0)
+const double kMinMagnitude = 1e-9;
+const char kSketchMagic[3] = {'D', 'D', 'S'};
+const uint8_t kSketchVersion = 1;
+
+void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += char(value | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+void appendFixedDouble(std::string& out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; i++) {
+        out += char(bits >> (8 * i));  // little-endian on the wire
+    }
+}
+
+uint64_t zigzag(int64_t value) {
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+// Bounds-checked reads; any failure sticks
+struct Reader {
+    std::string_view data;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (data.empty()) break;
+            uint8_t byte = data[0];
+            data.remove_prefix(1);
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    double fixedDouble() {
+        if (data.size() < 8) {
+            ok = false;
+            return 0.0;
+        }
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; i++) {
+            bits |= uint64_t(uint8_t(data[i])) << (8 * i);
+        }
+        data.remove_prefix(8);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+}
+
+DDSketch::DDSketch(double relative_accuracy, size_t max_bins)
+    : accuracy(relative_accuracy), max_bins(max_bins ? max_bins : 1),
+      gamma((1 + relative_accuracy) / (1 - relative_accuracy)), log_gamma(std::log(gamma)) {}
+
+int DDSketch::binIndex(double magnitude) const {
+    return (int)std::ceil(std::log(magnitude) / log_gamma);
+}
+
+// Midpoint of the bin in relative terms, so both edges are within accuracy
+double DDSketch::binValue(int index) const {
+    return 2.0 * std::exp(index * log_gamma) / (gamma + 1);
+}
+
+void DDSketch::Store::add(int index, uint64_t n, size_t max_bins) {
+    if (counts.empty()) {
+        offset = index;
+        counts.assign(1, 0);
+    }
+    int last = offset + (int)counts.size() - 1;
+    if (index < offset) {
+        int lo = std::max(index, last - (int)max_bins + 1);
+        if (lo < offset) {
+            counts.insert(counts.begin(), offset - lo, 0);
+            offset = lo;
+        }
+        index = std::max(index, lo);
+    } else if (index > last) {
+        int lo = std::max(offset, index - (int)max_bins + 1);
+        if (lo > offset) {
+            size_t fold = std::min<size_t>(lo - offset, counts.size());
+            uint64_t folded = std::accumulate(counts.begin(), counts.begin() + fold, uint64_t(0));
+            counts.erase(counts.begin(), counts.begin() + fold);
+            offset = lo;
+            counts.resize(index - offset + 1, 0);
+            counts[0] += folded;
+        } else {
+            counts.resize(index - offset + 1, 0);
+        }
+    }
+    counts[index - offset] += n;
+    total += n;
+}
+
+void DDSketch::Store::clear() {
+    offset = 0;
+    counts.clear();
+    total = 0;
+}
+
+void DDSketch::add(double value) {
+    if (!std::isfinite(value)) {
+        return;
+    }
+    if (value > kMinMagnitude) {
+        positive.add(binIndex(value), 1, max_bins);
+    } else if (value < -kMinMagnitude) {
+        negative.add(binIndex(-value), 1, max_bins);
+    } else {
+        zeros++;
+    }
+    value_min = total ? std::min(value_min, value) : value;
+    value_max = total ? std::max(value_max, value) : value;
+    value_sum += value;
+    total++;
+}
+
+bool DDSketch::merge(const DDSketch& other) {
+    if (std::fabs(other.accuracy - accuracy) > 1e-12) {
+        return false;
+    }
+    if (other.total == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < other.positive.counts.size(); i++) {
+        if (other.positive.counts[i]) positive.add(other.positive.offset + (int)i, other.positive.counts[i], max_bins);
+    }
+    for (size_t i = 0; i < other.negative.counts.size(); i++) {
+        if (other.negative.counts[i]) negative.add(other.negative.offset + (int)i, other.negative.counts[i], max_bins);
+    }
+    zeros += other.zeros;
+    value_min = total ? std::min(value_min, other.value_min) : other.value_min;
+    value_max = total ? std::max(value_max, other.value_max) : other.value_max;
+    value_sum += other.value_sum;
+    total += other.total;
+    return true;
+}
+
+void DDSketch::clear() {
+    positive.clear();
+    negative.clear();
+    zeros = total = 0;
+    value_sum = value_min = value_max = 0.0;
+}
+
+double DDSketch::quantile(double q) const {
+    if (total == 0) {
+        return 0.0;
+    }
+    q = std::clamp(q, 0.0, 1.0);
+    double rank = q * (total - 1);
+    double value = value_max;
+    uint64_t seen = 0;
+    bool found = false;
+    // Ascending order: largest negative magnitudes first, then zero, then positives
+    for (size_t i = negative.counts.size(); i-- > 0 && !found; ) {
+        seen += negative.counts[i];
+        if (seen > rank) {
+            value = -binValue(negative.offset + (int)i);
+            found = true;
+        }
+    }
+    if (!found) {
+        seen += zeros;
+        if (seen > rank) {
+            value = 0.0;
+            found = true;
+        }
+    }
+    for (size_t i = 0; i < positive.counts.size() && !found; i++) {
+        seen += positive.counts[i];
+        if (seen > rank) {
+            value = binValue(positive.offset + (int)i);
+            found = true;
+        }
+    }
+    return std::clamp(value, value_min, value_max);
+}
+
+// "DDS" version accuracy total sum min max zeros, then per store the number
+// of non-empty bins and (zigzag index delta, count) for each
+void DDSketch::serialize(std::string& out) const {
+    out.append(kSketchMagic, sizeof(kSketchMagic));
+    out += char(kSketchVersion);
+    appendFixedDouble(out, accuracy);
+    appendVarint(out, total);
+    appendFixedDouble(out, value_sum);
+    appendFixedDouble(out, min());
+    appendFixedDouble(out, max());
+    appendVarint(out, zeros);
+    for (const Store* store : {&positive, &negative}) {
+        size_t bins = store->counts.size() - std::count(store->counts.begin(), store->counts.end(), 0);
+        appendVarint(out, bins);
+        int64_t prev = 0;
+        for (size_t i = 0; i < store->counts.size(); i++) {
+            if (!store->counts[i]) continue;
+            int64_t index = store->offset + (int64_t)i;
+            appendVarint(out, zigzag(index - prev));
+            appendVarint(out, store->counts[i]);
+            prev = index;
+        }
+    }
+}
+
+bool DDSketch::deserialize(std::string_view data) {
+    if (data.size() < 4 || std::memcmp(data.data(), kSketchMagic, sizeof(kSketchMagic)) != 0 ||
+        uint8_t(data[3]) != kSketchVersion) {
+        clear();
+        return false;
+    }
+    Reader reader{data.substr(4)};
+    double new_accuracy = reader.fixedDouble();
+    if (!reader.ok || !(new_accuracy > 0 && new_accuracy < 1)) {
+        clear();
+        return false;
+    }
+    *this = DDSketch(new_accuracy, max_bins);
+    total = reader.varint();
+    value_sum = reader.fixedDouble();
+    value_min = reader.fixedDouble();
+    value_max = reader.fixedDouble();
+    zeros = reader.varint();
+    for (Store* store : {&positive, &negative}) {
+        uint64_t bins = reader.varint();
+        int64_t index = 0;
+        for (uint64_t b = 0; b < bins && reader.ok; b++) {
+            index += unzigzag(reader.varint());
+            uint64_t n = reader.varint();
+            if (index < -100000 || index > 100000 || n == 0) {
+                reader.ok = false;
+                break;
+            }
+            store->add((int)index, n, max_bins);
+        }
+    }
+    if (!reader.ok || !reader.data.empty() || positive.total + negative.total + zeros != total) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+WindowedSketches::WindowedSketches(std::vector<std::string> names, double relative_accuracy)
+    : names(std::move(names)), accuracy(relative_accuracy), series(this->names.size()) {
+    for (auto& s : series) {
+        for (auto& sketch : s.open) {
+            sketch = DDSketch(relative_accuracy);
+        }
+    }
+}
+
+int WindowedSketches::metricIndex(std::string_view name) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) return (int)i;
+    }
+    return -1;
+}
+
+int WindowedSketches::resolutionIndex(std::string_view name) {
+    for (size_t r = 0; r < kSketchResolutionCount; r++) {
+        if (name == kSketchResolutions[r].name) return (int)r;
+    }
+    return -1;
+}
+
+void WindowedSketches::add(int64_t timestamp_ms, const double* row) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t r = 0; r < kSketchResolutionCount; r++) {
+        const SketchResolution& resolution = kSketchResolutions[r];
+        int64_t start = timestamp_ms - timestamp_ms % resolution.width_ms;
+        if (start == open_start[r]) {
+            continue;
+        }
+        // First sample of a new window: close the open one everywhere
+        for (auto& s : series) {
+            DDSketch& sketch = s.open[r];
+            if (sketch.count() > 0) {
+                Window window;
+                window.start_ms = open_start[r];
+                window.end_ms = open_start[r] + resolution.width_ms;
+                sketch.serialize(window.sketch);
+                s.closed[r].push_back(std::move(window));
+                if (s.closed[r].size() > resolution.retention) s.closed[r].pop_front();
+                sketch.clear();
+            }
+        }
+        open_start[r] = start;
+    }
+    for (size_t m = 0; m < series.size(); m++) {
+        for (auto& sketch : series[m].open) {
+            sketch.add(row[m]);
+        }
+    }
+}
+
+void WindowedSketches::windows(size_t metric, size_t resolution, size_t count, std::vector<Window>& out) const {
+    out.clear();
+    if (metric >= series.size() || resolution >= kSketchResolutionCount || count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    const Series& s = series[metric];
+    const DDSketch& open = s.open[resolution];
+    size_t closed = std::min(s.closed[resolution].size(), open.count() > 0 ? count - 1 : count);
+    out.assign(s.closed[resolution].end() - closed, s.closed[resolution].end());
+    if (open.count() > 0) {
+        Window window;
+        window.start_ms = open_start[resolution];
+        window.end_ms = open_start[resolution] + kSketchResolutions[resolution].width_ms;
+        window.complete = false;
+        open.serialize(window.sketch);
+        out.push_back(std::move(window));
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// DDSketch: quantiles with a relative error bound. Values fall into
+// logarithmic bins (bin i holds (gamma^(i-1), gamma^i]) so any quantile is
+// within relative_accuracy of the true one, and two sketches with the same
+// accuracy merge exactly by adding bin counts - across windows or hosts.
+class DDSketch {
+public:
+    explicit DDSketch(double relative_accuracy = 0.01, size_t max_bins = 2048);
+
+    void add(double value);
+    // False if the accuracies differ
+    bool merge(const DDSketch& other);
+    // Keeps capacity
+    void clear();
+
+    // q in [0, 1]; 0 for an empty sketch
+    double quantile(double q) const;
+    uint64_t count() const { return total; }
+    double sum() const { return value_sum; }
+    double min() const { return total ? value_min : 0.0; }
+    double max() const { return total ? value_max : 0.0; }
+    double relativeAccuracy() const { return accuracy; }
+
+    // Compact binary form (only non-empty bins, as varint deltas), appended
+    // to out. A few hundred bytes for a typical window.
+    void serialize(std::string& out) const;
+    // False, leaving the sketch empty, if data isn't a sketch
+    bool deserialize(std::string_view data);
+
+private:
+    // Dense run of bins starting at index `offset`. Past max_bins the lowest
+    // bins are folded together, which only costs accuracy at the low end.
+    struct Store {
+        int offset = 0;
+        std::vector<uint64_t> counts;
+        uint64_t total = 0;
+
+        void add(int index, uint64_t n, size_t max_bins);
+        void clear();
+    };
+
+    double accuracy;
+    size_t max_bins;
+    double gamma;
+    double log_gamma;
+    Store positive;
+    Store negative;                  // by magnitude
+    uint64_t zeros = 0;
+    uint64_t total = 0;
+    double value_sum = 0.0;
+    double value_min = 0.0;
+    double value_max = 0.0;
+
+    int binIndex(double magnitude) const;
+    double binValue(int index) const;
+};
+
+// Tumbling, wall-clock aligned windows of sketches for a fixed set of
+// metrics, at each resolution in kSketchResolutions. Alignment to the epoch
+// means every host's "12:05" window covers the same minute, so an aggregator
+// can merge them.
+//
+// Every sample goes into the open window of each resolution; closed windows
+// are kept serialized, so retention costs bytes rather than bins.
+struct SketchResolution {
+    const char* name;
+    int64_t width_ms;
+    size_t retention;                // closed windows kept
+};
+
+const SketchResolution kSketchResolutions[] = {
+    {"1m", 60 * 1000, 60},
+    {"10m", 10 * 60 * 1000, 36},
+    {"1h", 60 * 60 * 1000, 24},
+};
+const size_t kSketchResolutionCount = sizeof(kSketchResolutions) / sizeof(kSketchResolutions[0]);
+
+class WindowedSketches {
+public:
+    struct Window {
+        int64_t start_ms = 0;
+        int64_t end_ms = 0;
+        bool complete = true;
+        std::string sketch;          // DDSketch::serialize
+    };
+
+    WindowedSketches(std::vector<std::string> names, double relative_accuracy = 0.01);
+
+    size_t metricCount() const { return names.size(); }
+    // Index of a metric by name, or -1
+    int metricIndex(std::string_view name) const;
+    // Index into kSketchResolutions by name ("10m"), or -1
+    static int resolutionIndex(std::string_view name);
+    double relativeAccuracy() const { return accuracy; }
+
+    // Sampler thread; row holds metricCount() values
+    void add(int64_t timestamp_ms, const double* row);
+
+    // The newest `count` windows of one metric, oldest first, ending with the
+    // open one (complete = false) if it has samples. Any thread.
+    void windows(size_t metric, size_t resolution, size_t count, std::vector<Window>& out) const;
+
+private:
+    struct Series {
+        DDSketch open[kSketchResolutionCount];
+        std::deque<Window> closed[kSketchResolutionCount];
+    };
+
+    std::vector<std::string> names;
+    double accuracy;
+    int64_t open_start[kSketchResolutionCount] = {};
+    std::vector<Series> series;
+    mutable std::mutex mutex;
+};
@@ -0,0 +1,67 @@
+#include "snapshot.h"
+
+SnapshotPublisher::Handle& SnapshotPublisher::Handle::operator=(Handle&& other) noexcept {
+    if (this != &other) {
+        release();
+        slot = other.slot;
+        other.slot = nullptr;
+    }
+    return *this;
+}
+
+void SnapshotPublisher::Handle::release() {
+    if (slot) {
+        slot->readers.fetch_sub(1, std::memory_order_release);
+        slot = nullptr;
+    }
+}
+
+SnapshotPublisher::SnapshotPublisher() {
+    // current + one being written + one lingering reader covers the common case;
+    // beginWrite grows the pool if readers pin more than that
+    for (int i = 0; i < 3; i++) {
+        slots.push_back(std::make_unique<Slot>());
+    }
+}
+
+MetricsSnapshot& SnapshotPublisher::beginWrite() {
+    Slot* live = current.load(std::memory_order_seq_cst);
+    pending = nullptr;
+    for (auto& slot : slots) {
+        if (slot.get() != live && slot->readers.load(std::memory_order_seq_cst) == 0) {
+            pending = slot.get();
+            break;
+        }
+    }
+    if (!pending) {
+        slots.push_back(std::make_unique<Slot>());
+        pending = slots.back().get();
+    }
+    return pending->snapshot;
+}
+
+void SnapshotPublisher::publish() {
+    if (!pending) {
+        return;
+    }
+    pending->snapshot.generation = published_generation.load(std::memory_order_relaxed) + 1;
+    current.store(pending, std::memory_order_seq_cst);
+    published_generation.store(pending->snapshot.generation, std::memory_order_release);
+    pending = nullptr;
+}
+
+SnapshotPublisher::Handle SnapshotPublisher::acquire() const {
+    for (;;) {
+        Slot* slot = current.load(std::memory_order_seq_cst);
+        if (!slot) {
+            return Handle();
+        }
+        slot->readers.fetch_add(1, std::memory_order_seq_cst);
+        // If the writer swapped in a new slot meanwhile, this one may be about
+        // to be refilled - back off and pin the new one instead
+        if (current.load(std::memory_order_seq_cst) == slot) {
+            return Handle(slot);
+        }
+        slot->readers.fetch_sub(1, std::memory_order_release);
+    }
+}
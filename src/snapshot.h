@@ -0,0 +1,389 @@
+#pragma once
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+// One row of /proc/net/dev. Counters are as the kernel reports them; rates
+// are wrap-corrected and measured over the network collector's interval.
+struct InterfaceStats {
+    std::string name;
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+    uint64_t rx_packets = 0;
+    uint64_t tx_packets = 0;
+    uint64_t rx_errors = 0;
+    uint64_t tx_errors = 0;
+    uint64_t rx_dropped = 0;
+    uint64_t tx_dropped = 0;
+    double rx_bytes_per_sec = 0.0;
+    double tx_bytes_per_sec = 0.0;
+    double rx_packets_per_sec = 0.0;
+    double tx_packets_per_sec = 0.0;
+    double errors_per_sec = 0.0;     // rx + tx
+    double dropped_per_sec = 0.0;    // rx + tx
+};
+
+// A whole block device from /proc/diskstats (partitions are skipped)
+struct BlockDeviceStats {
+    std::string name;
+    bool is_virtual = false;         // no backing hardware: dm-*, md*, zram*...
+    uint32_t sector_size = 512;      // logical block size from sysfs
+    uint64_t reads = 0;              // completed I/Os, cumulative
+    uint64_t writes = 0;
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+    uint64_t io_ticks_ms = 0;        // time spent with I/O in flight
+    double read_iops = 0.0;
+    double write_iops = 0.0;
+    double read_bytes_per_sec = 0.0;
+    double write_bytes_per_sec = 0.0;
+    double busy_percent = 0.0;       // io_ticks over wall time
+};
+
+struct NetworkStats {
+    size_t bytes_sent = 0;           // cumulative, all interfaces but lo
+    size_t bytes_received = 0;
+    double bytes_sent_per_sec = 0.0;
+    double bytes_received_per_sec = 0.0;
+    std::vector<InterfaceStats> interfaces;
+};
+
+struct DiskStats {
+    size_t bytes_read = 0;           // since the previous sample, physical disks only
+    size_t bytes_written = 0;
+    uint64_t total_bytes_read = 0;   // cumulative since boot
+    uint64_t total_bytes_written = 0;
+    double read_bytes_per_sec = 0.0;
+    double write_bytes_per_sec = 0.0;
+    std::vector<BlockDeviceStats> devices;
+};
+
+// One PSI file (/proc/pressure/* or a cgroup's *.pressure). The avgN values
+// are the kernel's running averages; the percents come from the totals over
+// the collector's own interval, so they catch stalls shorter than 10s.
+struct PressureStats {
+    double some_avg10 = 0.0;
+    double some_avg60 = 0.0;
+    double some_avg300 = 0.0;
+    double full_avg10 = 0.0;
+    double full_avg60 = 0.0;
+    double full_avg300 = 0.0;
+    uint64_t some_total_us = 0;      // cumulative stall time
+    uint64_t full_total_us = 0;
+    double some_percent = 0.0;       // share of the last interval stalled
+    double full_percent = 0.0;
+};
+
+struct SystemPressure {
+    bool available = false;          // kernel built with PSI and not disabled
+    PressureStats cpu;
+    PressureStats memory;
+    PressureStats io;
+};
+
+// One cgroup v2 group under the configured root. Missing controller files
+// (controller not enabled for the group) leave their fields at zero.
+struct CgroupStats {
+    std::string name;                // path below the root, "/" for the root
+    uint64_t cpu_usage_usec = 0;     // cpu.stat, cumulative
+    uint64_t cpu_user_usec = 0;
+    uint64_t cpu_system_usec = 0;
+    uint64_t cpu_periods = 0;        // quota enforcement periods
+    uint64_t cpu_throttled_periods = 0;
+    uint64_t cpu_throttled_usec = 0;
+    double cpu_percent = 0.0;        // 100 = one full core
+    double throttled_percent = 0.0;  // share of the interval's periods throttled
+    uint64_t memory_current = 0;     // bytes
+    uint64_t memory_anon = 0;        // memory.stat
+    uint64_t memory_file = 0;
+    uint64_t memory_kernel = 0;
+    uint64_t major_faults = 0;
+    double major_faults_per_sec = 0.0;
+    PressureStats memory_pressure;
+    uint64_t io_read_bytes = 0;      // io.stat, summed over devices
+    uint64_t io_write_bytes = 0;
+    double io_read_bytes_per_sec = 0.0;
+    double io_write_bytes_per_sec = 0.0;
+};
+
+// A metric published by another process over the shared-memory channel
+// (shm_channel.h). Histogram values are in whatever unit the writer used.
+struct CustomMetric {
+    std::string service;
+    int pid = 0;
+    std::string name;
+    char kind = 'c';                 // 'c' counter, 'g' gauge, 'h' histogram
+    double value = 0.0;              // counter total or gauge value
+    uint64_t count = 0;              // histogram only from here on
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double p999 = 0.0;
+    double max = 0.0;
+};
+
+// /proc/meminfo, or one NUMA node's meminfo, in KB. Keys a kernel doesn't
+// report (or a node file doesn't carry) stay zero. HugePages_* are page
+// counts, not KB.
+struct MemInfo {
+    uint64_t total_kb = 0;
+    uint64_t free_kb = 0;
+    uint64_t available_kb = 0;       // not in node files
+    uint64_t used_kb = 0;            // node files only
+    uint64_t buffers_kb = 0;
+    uint64_t cached_kb = 0;          // page cache, minus swap cache
+    uint64_t file_pages_kb = 0;      // node files' name for the page cache
+    uint64_t swap_cached_kb = 0;
+    uint64_t active_kb = 0;
+    uint64_t inactive_kb = 0;
+    uint64_t active_anon_kb = 0;
+    uint64_t inactive_anon_kb = 0;
+    uint64_t active_file_kb = 0;
+    uint64_t inactive_file_kb = 0;
+    uint64_t unevictable_kb = 0;
+    uint64_t mlocked_kb = 0;
+    uint64_t swap_total_kb = 0;
+    uint64_t swap_free_kb = 0;
+    uint64_t dirty_kb = 0;
+    uint64_t writeback_kb = 0;
+    uint64_t anon_pages_kb = 0;
+    uint64_t mapped_kb = 0;
+    uint64_t shmem_kb = 0;
+    uint64_t slab_kb = 0;
+    uint64_t slab_reclaimable_kb = 0;
+    uint64_t slab_unreclaimable_kb = 0;
+    uint64_t kernel_stack_kb = 0;
+    uint64_t page_tables_kb = 0;
+    uint64_t commit_limit_kb = 0;
+    uint64_t committed_as_kb = 0;
+    uint64_t anon_huge_pages_kb = 0;
+    uint64_t huge_pages_total = 0;
+    uint64_t huge_pages_free = 0;
+    uint64_t huge_pages_reserved = 0;
+    uint64_t huge_pages_surplus = 0;
+    uint64_t huge_page_size_kb = 0;
+};
+
+struct NumaNodeStats {
+    int node = 0;
+    MemInfo meminfo;
+};
+
+// Page and swap activity from /proc/vmstat: cumulative counts since boot,
+// rates over the memory collector's interval
+struct VmStats {
+    uint64_t page_faults = 0;
+    uint64_t major_faults = 0;
+    uint64_t pages_paged_in = 0;     // pgpgin/pgpgout, in KB despite the name
+    uint64_t pages_paged_out = 0;
+    uint64_t swap_in = 0;            // pages
+    uint64_t swap_out = 0;
+    uint64_t pages_scanned_kswapd = 0;
+    uint64_t pages_scanned_direct = 0;
+    uint64_t oom_kills = 0;
+    double page_faults_per_sec = 0.0;
+    double major_faults_per_sec = 0.0;
+    double paged_in_kb_per_sec = 0.0;
+    double paged_out_kb_per_sec = 0.0;
+    double swap_in_per_sec = 0.0;
+    double swap_out_per_sec = 0.0;
+    double pages_scanned_kswapd_per_sec = 0.0;
+    double pages_scanned_direct_per_sec = 0.0;  // reclaim stalls in allocating tasks
+};
+
+struct MemoryStats {
+    MemInfo meminfo;
+    VmStats vmstat;
+    std::vector<NumaNodeStats> nodes;  // empty without NUMA support in sysfs
+};
+
+// Everything derived from one pass over /proc/stat besides the aggregate
+// cpu_usage. Per-core values are parallel arrays indexed by CPU id.
+struct CpuStats {
+    std::vector<double> core_usage;   // % busy (everything but idle + iowait)
+    std::vector<double> core_user;    // % user + nice
+    std::vector<double> core_system;  // % system + irq + softirq
+    std::vector<double> core_iowait;  // % iowait
+    int procs_running = 0;
+    int procs_blocked = 0;
+    uint64_t context_switches = 0;    // cumulative since boot
+    uint64_t interrupts = 0;          // cumulative since boot
+    double context_switches_per_sec = 0.0;
+    double interrupts_per_sec = 0.0;
+};
+
+// Run-queue latency from /proc/schedstat (CONFIG_SCHEDSTATS): how long
+// runnable tasks waited for a CPU. Rates are over the scheduler collector's
+// interval; per-CPU values are parallel arrays indexed by CPU id. Waiting
+// ms per second / 1000 is the average number of tasks kept waiting.
+struct SchedStats {
+    bool available = false;           // /proc/schedstat exists
+    uint64_t run_delay_ns = 0;        // all CPUs, cumulative since boot
+    uint64_t timeslices = 0;
+    double run_delay_ms_per_sec = 0.0;
+    double timeslices_per_sec = 0.0;
+    double avg_delay_us = 0.0;        // wait per timeslice over the interval
+    std::vector<uint64_t> cpu_run_delay_ns;
+    std::vector<uint64_t> cpu_timeslices;
+    std::vector<double> cpu_run_delay_ms_per_sec;
+    std::vector<double> cpu_timeslices_per_sec;
+    std::vector<double> cpu_avg_delay_us;
+};
+
+// perf_event counters for the host (every CPU) or one tracked process or
+// thread. Totals are cumulative since counting started; rates and ratios are
+// over the perf collector's last interval. Hardware counts are scaled up when
+// the PMU had to multiplex the group.
+struct PerfCounters {
+    bool available = false;        // software group counting
+    bool hardware = false;         // cycles and instructions counting
+    uint64_t context_switches = 0;
+    uint64_t cpu_migrations = 0;
+    uint64_t page_faults = 0;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cache_references = 0;
+    uint64_t cache_misses = 0;
+    uint64_t branches = 0;
+    uint64_t branch_misses = 0;
+    double context_switches_per_sec = 0.0;
+    double cpu_migrations_per_sec = 0.0;
+    double page_faults_per_sec = 0.0;
+    double cycles_per_sec = 0.0;
+    double ipc = 0.0;                  // instructions per cycle
+    double cache_miss_percent = 0.0;   // of cache references
+    double cache_mpki = 0.0;           // cache misses per 1000 instructions
+    double branch_miss_percent = 0.0;
+};
+
+struct ThreadStats {
+    int tid = 0;
+    std::string name;
+    char state = '?';
+    double cpu_percent = 0.0;
+    uint64_t voluntary_ctxt_switches = 0;
+    uint64_t nonvoluntary_ctxt_switches = 0;
+    double run_delay_ms_per_sec = 0.0;  // waiting for a CPU, /proc/.../schedstat
+    double avg_delay_us = 0.0;
+};
+
+// A tracked process (tid == 0) or a single tracked thread
+struct ProcessStats {
+    std::string name;              // label given when tracking started
+    int pid = 0;
+    int tid = 0;
+    bool alive = false;
+    char state = '?';
+    int num_threads = 0;
+    double cpu_percent = 0.0;      // 100 = one full core
+    size_t rss_kb = 0;
+    size_t virt_kb = 0;
+    uint64_t voluntary_ctxt_switches = 0;
+    uint64_t nonvoluntary_ctxt_switches = 0;
+    double voluntary_ctxt_switches_per_sec = 0.0;
+    double nonvoluntary_ctxt_switches_per_sec = 0.0;
+    uint64_t read_bytes = 0;       // storage I/O, cumulative
+    uint64_t write_bytes = 0;
+    double read_bytes_per_sec = 0.0;
+    double write_bytes_per_sec = 0.0;
+    // schedstat, summed over the threads when they're tracked (otherwise
+    // the main thread only); the totals never go back when threads exit
+    uint64_t run_delay_ns = 0;
+    uint64_t timeslices = 0;
+    double run_delay_ms_per_sec = 0.0;
+    double timeslices_per_sec = 0.0;
+    double avg_delay_us = 0.0;
+    PerfCounters perf;                 // summed over every thread of a process
+    std::vector<ThreadStats> threads;  // only when tracked with threads
+};
+
+// One complete sampling cycle. The sampler fills a private copy, then hands it
+// to SnapshotPublisher; readers only ever see fully written snapshots.
+struct MetricsSnapshot {
+    uint64_t generation = 0;
+    std::chrono::system_clock::time_point timestamp;
+    int64_t monotonic_ns = 0;  // steady clock at collection; use for intervals
+    bool burst = false;        // event mode: sampling fast after a PSI trigger
+    uint64_t psi_events = 0;   // PSI trigger firings since start
+    size_t alerts_active = 0;  // anomaly alerts firing after this sample
+    uint32_t collectors = 0;   // enabled collectors, bit i: HostCollectors source i
+
+    double cpu_usage = 0.0;
+    CpuStats cpu_stats;
+    PerfCounters perf;
+    size_t memory_usage = 0;  // in KB
+    size_t total_memory = 0;  // in KB
+    MemoryStats memory;
+    NetworkStats network_stats;
+    DiskStats disk_stats;
+    int process_count = 0;
+    double load_average_1min = 0.0;
+    double load_average_5min = 0.0;
+    double load_average_15min = 0.0;
+    SchedStats scheduler;
+    std::vector<ProcessStats> services;
+    SystemPressure pressure;
+    std::vector<CgroupStats> cgroups;
+    std::vector<CustomMetric> custom_metrics;
+
+    // Rendered once at publish time so /metrics is just a copy
+    std::string json;
+};
+
+// Single writer, many lock-free readers.
+//
+// Snapshots live in a small pool of slots that are never freed while the
+// publisher exists. A reader pins the current slot by bumping its reader count
+// and re-checking that it is still current; the writer only refills slots that
+// are neither current nor pinned. Readers never block and never see a slot
+// that is being written.
+class SnapshotPublisher {
+    struct Slot {
+        MetricsSnapshot snapshot;
+        std::atomic<int> readers{0};
+    };
+
+public:
+    // RAII pin on a published snapshot
+    class Handle {
+    public:
+        Handle() = default;
+        Handle(Handle&& other) noexcept : slot(other.slot) { other.slot = nullptr; }
+        Handle& operator=(Handle&& other) noexcept;
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        ~Handle() { release(); }
+
+        explicit operator bool() const { return slot != nullptr; }
+        const MetricsSnapshot& operator*() const { return slot->snapshot; }
+        const MetricsSnapshot* operator->() const { return &slot->snapshot; }
+
+    private:
+        friend class SnapshotPublisher;
+        explicit Handle(Slot* s) : slot(s) {}
+        void release();
+        Slot* slot = nullptr;
+    };
+
+    SnapshotPublisher();
+
+    // Writer side (sampler thread only). beginWrite returns a slot no reader
+    // can see; its previous contents are left in place so strings and vectors
+    // keep their capacity between cycles.
+    MetricsSnapshot& beginWrite();
+    void publish();
+
+    // Reader side, safe from any thread
+    Handle acquire() const;
+    uint64_t generation() const { return published_generation.load(std::memory_order_acquire); }
+
+private:
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::atomic<Slot*> current{nullptr};
+    Slot* pending = nullptr;
+    std::atomic<uint64_t> published_generation{0};
+};
@@ -0,0 +1,167 @@
+#include "timeseries.h"
+#include <charconv>
+#include <algorithm>
+
+namespace {
+
+// Passes renderRange makes before giving up on a writer that keeps lapping it
+const int kRenderAttempts = 4;
+
+void appendInt(std::string& out, int64_t value) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, result.ptr - buf);
+}
+
+void appendDouble(std::string& out, double value) {
+    char buf[48];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed, 2);
+    out.append(buf, result.ptr - buf);
+}
+
+// Folds samples of one bucket according to the requested aggregation
+struct Accumulator {
+    TimeSeriesStore::Aggregation aggregation;
+    double value = 0.0;
+    size_t count = 0;
+
+    void add(double v) {
+        switch (aggregation) {
+            case TimeSeriesStore::Aggregation::Mean: value += v; break;
+            case TimeSeriesStore::Aggregation::Min: value = count ? std::min(value, v) : v; break;
+            case TimeSeriesStore::Aggregation::Max: value = count ? std::max(value, v) : v; break;
+            case TimeSeriesStore::Aggregation::Last: value = v; break;
+        }
+        count++;
+    }
+    double result() const {
+        return aggregation == TimeSeriesStore::Aggregation::Mean ? value / count : value;
+    }
+};
+
+}
+
+TimeSeriesStore::TimeSeriesStore(std::vector<std::string> names, size_t capacity)
+    : names(std::move(names)), slots(capacity ? capacity : 1),
+      timestamps(new std::atomic<int64_t>[slots]),
+      values(new std::atomic<double>[slots * this->names.size()]) {
+}
+
+int TimeSeriesStore::metricIndex(std::string_view name) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) return (int)i;
+    }
+    return -1;
+}
+
+void TimeSeriesStore::append(int64_t timestamp_ms, const double* sample) {
+    uint64_t index = end_count.load(std::memory_order_relaxed);
+    size_t slot = index % slots;
+
+    begin_count.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    timestamps[slot].store(timestamp_ms, std::memory_order_relaxed);
+    for (size_t m = 0; m < names.size(); m++) {
+        values[m * slots + slot].store(sample[m], std::memory_order_relaxed);
+    }
+
+    end_count.store(index + 1, std::memory_order_release);
+}
+
+int64_t TimeSeriesStore::timestampAt(uint64_t index) const {
+    return timestamps[index % slots].load(std::memory_order_relaxed);
+}
+
+double TimeSeriesStore::valueAt(size_t metric, uint64_t index) const {
+    return values[metric * slots + index % slots].load(std::memory_order_relaxed);
+}
+
+// First index in [first, last) with timestamp >= timestamp_ms
+uint64_t TimeSeriesStore::lowerBound(uint64_t first, uint64_t last, int64_t timestamp_ms) const {
+    while (first < last) {
+        uint64_t mid = first + (last - first) / 2;
+        if (timestampAt(mid) < timestamp_ms) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+bool TimeSeriesStore::renderRange(const RangeQuery& query, std::string& out) const {
+    size_t mark = out.size();
+    uint64_t floor = 0;  // rows an earlier pass saw being overwritten
+    for (int attempt = 0; attempt < kRenderAttempts; attempt++) {
+        uint64_t end = end_count.load(std::memory_order_acquire);
+        uint64_t oldest = std::min(std::max(end > slots ? end - slots : 0, floor), end);
+        uint64_t first = lowerBound(oldest, end, query.from_ms - query.wall_offset_ms);
+        uint64_t last = lowerBound(first, end, query.to_ms - query.wall_offset_ms + 1);
+
+        renderColumns(query, first, last, out);
+
+        // If the writer started overwriting anything we read, try again
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t begin = begin_count.load(std::memory_order_relaxed);
+        if (begin <= slots || first >= begin - slots) {
+            return true;
+        }
+        out.resize(mark);
+        // Start the next pass past what the writer reached, with room for as
+        // many rows again as it wrote during this one
+        floor = begin - slots + (begin - end);
+    }
+    return false;
+}
+
+void TimeSeriesStore::renderColumns(const RangeQuery& query, uint64_t first, uint64_t last, std::string& out) const {
+    int64_t step = query.step_ms;
+    auto bucketOf = [&](uint64_t index) {
+        return step > 0 ? (wallAt(query, index) - query.from_ms) / step : (int64_t)index;
+    };
+
+    out += "{\"from_ms\": ";
+    appendInt(out, query.from_ms);
+    out += ", \"to_ms\": ";
+    appendInt(out, query.to_ms);
+    out += ", \"step_ms\": ";
+    appendInt(out, step);
+
+    // Bucket start times (or raw sample times when step is 0)
+    out += ", \"timestamps_ms\": [";
+    bool first_bucket = true;
+    for (uint64_t i = first; i < last; ) {
+        int64_t bucket = bucketOf(i);
+        int64_t ts = step > 0 ? query.from_ms + bucket * step : wallAt(query, i);
+        if (!first_bucket) out += ", ";
+        appendInt(out, ts);
+        first_bucket = false;
+        while (i < last && bucketOf(i) == bucket) i++;
+    }
+    out += "], \"series\": {";
+
+    // One walk per metric column - each is contiguous in memory
+    size_t metric_count = query.metrics.empty() ? names.size() : query.metrics.size();
+    for (size_t n = 0; n < metric_count; n++) {
+        size_t metric = query.metrics.empty() ? n : query.metrics[n];
+        if (n) out += ", ";
+        out += "\"";
+        out += names[metric];
+        out += "\": [";
+        first_bucket = true;
+        for (uint64_t i = first; i < last; ) {
+            int64_t bucket = bucketOf(i);
+            Accumulator acc{query.aggregation};
+            while (i < last && bucketOf(i) == bucket) {
+                acc.add(valueAt(metric, i));
+                i++;
+            }
+            if (!first_bucket) out += ", ";
+            appendDouble(out, acc.result());
+            first_bucket = false;
+        }
+        out += "]";
+    }
+    out += "}}";
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+// Fixed-capacity columnar history of every published sample.
+//
+// One timestamp column plus one value column per metric, each a contiguous
+// ring of `capacity` slots, so memory is fixed at construction
+// (capacity * (1 + metrics) * 8 bytes) and append is O(1).
+//
+// Slots are stamped with the steady clock, which never goes back, so the
+// ring stays sorted for the binary searches when the wall clock is stepped.
+// Queries are in wall time and are mapped through the current offset
+// between the two clocks, on the way in and on the way out.
+//
+// Single writer (the sampler), any number of lock-free readers. Readers
+// validate against a seqlock-style pair of counters and retry if the writer
+// lapped the range they were reading.
+class TimeSeriesStore {
+public:
+    enum class Aggregation { Mean, Min, Max, Last };
+
+    struct RangeQuery {
+        int64_t from_ms = 0;              // unix ms
+        int64_t to_ms = 0;
+        int64_t wall_offset_ms = 0;       // unix ms minus steady ms, now
+        int64_t step_ms = 0;              // 0 = raw samples
+        Aggregation aggregation = Aggregation::Mean;
+        std::vector<size_t> metrics;      // empty = all
+    };
+
+    TimeSeriesStore(std::vector<std::string> names, size_t capacity);
+
+    size_t capacity() const { return slots; }
+    size_t metricCount() const { return names.size(); }
+    const std::string& metricName(size_t index) const { return names[index]; }
+    // Index of a metric by name, or -1
+    int metricIndex(std::string_view name) const;
+
+    // Writer only; values holds metricCount() entries. steady_ms is
+    // steady_clock time, non-decreasing.
+    void append(int64_t steady_ms, const double* values);
+
+    // Appends {"from_ms":..,"timestamps_ms":[..],"series":{..}} to out. Only
+    // the requested range is walked; buckets are aggregated on the fly. The
+    // oldest rows are left out if the writer overwrites them meanwhile; false
+    // (out unchanged) if it keeps lapping the reader.
+    bool renderRange(const RangeQuery& query, std::string& out) const;
+
+private:
+    std::vector<std::string> names;
+    size_t slots;
+    std::unique_ptr<std::atomic<int64_t>[]> timestamps;
+    std::unique_ptr<std::atomic<double>[]> values;  // column-major: metric * slots + slot
+
+    // Total samples ever appended. begin_count moves before a slot is
+    // overwritten, end_count after it is complete.
+    std::atomic<uint64_t> begin_count{0};
+    std::atomic<uint64_t> end_count{0};
+
+    int64_t timestampAt(uint64_t index) const;
+    double valueAt(size_t metric, uint64_t index) const;
+    uint64_t lowerBound(uint64_t first, uint64_t last, int64_t timestamp_ms) const;
+    // Slot time in unix ms under the query's clock offset
+    int64_t wallAt(const RangeQuery& query, uint64_t index) const { return timestampAt(index) + query.wall_offset_ms; }
+    void renderColumns(const RangeQuery& query, uint64_t first, uint64_t last, std::string& out) const;
+};